@@ -0,0 +1,528 @@
+
+// DriAsterix.cpp : implementation file
+//
+
+#include "stdafx.h"
+#include "DriAsterix.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+
+// The number of the record items.
+#define DRI_ASTERIX_ITEMS		12
+// The FSPEC extension bit.
+#define DRI_ASTERIX_FX			0x01
+// The unknown speed and direction.
+#define DRI_ASTERIX_UNKNOWN		0xFFFF
+// The time of day units per second.
+#define DRI_ASTERIX_TOD_SCALE	128
+// The invalid altitude of the ASD messages.
+#define DRI_ASTERIX_NO_ALTITUDE	-1000
+// The longest FSPEC.
+#define DRI_ASTERIX_FSPEC_SIZE	((DRI_ASTERIX_ITEMS + 6) / 7)
+
+// The item sizes indexed by driAsterixItem.
+static const size_t DRI_ASTERIX_ITEM_SIZE[DRI_ASTERIX_ITEMS] = {
+	2, 2, 3, DRI_ASTERIX_NAME_SIZE, 2 + DRI_ASTERIX_ID_SIZE, 8, 7, 6, 5, 11, 11,
+	1 + DRI_ASTERIX_ID_SIZE };
+
+// The big-endian writers. They advance the pointer.
+
+static void PutByte(unsigned char*& p, const unsigned char Val)
+{
+	*p++ = Val;
+}
+
+static void PutWord(unsigned char*& p, const unsigned short Val)
+{
+	*p++ = (unsigned char)(Val >> 8);
+	*p++ = (unsigned char)Val;
+}
+
+static void PutDWord(unsigned char*& p, const unsigned long Val)
+{
+	*p++ = (unsigned char)(Val >> 24);
+	*p++ = (unsigned char)(Val >> 16);
+	*p++ = (unsigned char)(Val >> 8);
+	*p++ = (unsigned char)Val;
+}
+
+// Writes the text zero padded (or truncated) to Size bytes.
+static void PutText(unsigned char*& p, const char* const Text, const size_t Len,
+	const size_t Size)
+{
+	size_t Copy = min(Len, Size);
+	if (Copy > 0)
+		CopyMemory(p, Text, Copy);
+	if (Copy < Size)
+		ZeroMemory(p + Copy, Size - Copy);
+	p += Size;
+}
+
+static void PutId(unsigned char*& p, const wclDriAsdId& Id)
+{
+	if (Id.size() == 0)
+		PutText(p, "", 0, DRI_ASTERIX_ID_SIZE);
+	else
+		PutText(p, (const char*)&Id[0], Id.size(), DRI_ASTERIX_ID_SIZE);
+}
+
+// Degrees to 1E-7 degrees.
+static unsigned long LatLon(const double Val)
+{
+	return (unsigned long)(long)(Val * 10000000.0 + ((Val < 0) ? -0.5 : 0.5));
+}
+
+// Meters to 0.5 m, saturated to the signed 16 bit range.
+static unsigned short Altitude(const float Val)
+{
+	float Units = Val * 2;
+	if (Units > 32767)
+		return 32767;
+	if (Units < -32768)
+		return (unsigned short)-32768;
+	return (unsigned short)(short)(Units + ((Units < 0) ? -0.5f : 0.5f));
+}
+
+// Meters per second to 0.01 m/s, saturated to the signed 16 bit range.
+static unsigned short Speed(const float Val)
+{
+	float Units = Val * 100;
+	if (Units > 32767)
+		return 32767;
+	if (Units < -32768)
+		return (unsigned short)-32768;
+	return (unsigned short)(short)(Units + ((Units < 0) ? -0.5f : 0.5f));
+}
+
+// The big-endian readers. The caller checked the size; they advance the
+// pointer.
+
+static unsigned char GetByte(const unsigned char*& p)
+{
+	return *p++;
+}
+
+static unsigned short GetWord(const unsigned char*& p)
+{
+	unsigned short Val = (unsigned short)((p[0] << 8) | p[1]);
+	p += 2;
+	return Val;
+}
+
+static unsigned long GetDWord(const unsigned char*& p)
+{
+	unsigned long Val = ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16) |
+		((unsigned long)p[2] << 8) | p[3];
+	p += 4;
+	return Val;
+}
+
+// Reads Size bytes of zero padded text into the zero terminated buffer of
+// Size + 1 bytes.
+static void GetText(const unsigned char*& p, char* const Text, const size_t Size)
+{
+	CopyMemory(Text, p, Size);
+	Text[Size] = 0;
+	p += Size;
+}
+
+static double GetLatLon(const unsigned char*& p)
+{
+	return (double)(int)GetDWord(p) / 10000000.0;
+}
+
+static float GetAltitude(const unsigned char*& p)
+{
+	return (float)(short)GetWord(p) / 2;
+}
+
+static bool ValidAltitudes(const CwclDriAsdLocationMessage* const Location)
+{
+	return (Location->GeoAltitude != DRI_ASTERIX_NO_ALTITUDE ||
+		Location->BaroAltitude != DRI_ASTERIX_NO_ALTITUDE ||
+		Location->Height != DRI_ASTERIX_NO_ALTITUDE);
+}
+
+static const CwclDriAsdMessage* SlotMessage(const driDrone& Drone,
+	const wclDriAsdMessageType MessageType)
+{
+	return Drone.Slots[CDriDroneList::SlotOf(MessageType)].Message;
+}
+
+
+// CDriAsterixEncoder
+
+CDriAsterixEncoder::CDriAsterixEncoder(const size_t Size)
+{
+	// The block length must fit its 16 bit field.
+	FSize = min(max(Size, (size_t)(DRI_ASTERIX_HEADER_SIZE + DRI_ASTERIX_MAX_RECORD)),
+		(size_t)DRI_ASTERIX_MAX_BLOCK);
+	FBuffer = new unsigned char[FSize];
+	FSource = 0;
+	Reset();
+}
+
+CDriAsterixEncoder::~CDriAsterixEncoder()
+{
+	delete[] FBuffer;
+}
+
+void CDriAsterixEncoder::Reset()
+{
+	FBuffer[0] = DRI_ASTERIX_CATEGORY;
+	FLength = DRI_ASTERIX_HEADER_SIZE;
+	FCount = 0;
+	// The header always holds the current length.
+	unsigned char* p = FBuffer + 1;
+	PutWord(p, (unsigned short)FLength);
+}
+
+bool CDriAsterixEncoder::Add(const unsigned short Target, const driDrone& Drone,
+	const unsigned long TimeOfDay)
+{
+	const CwclDriAsdBasicIdMessage* Basic = (const CwclDriAsdBasicIdMessage*)SlotMessage(Drone, mtBasicId);
+	const CwclDriAsdLocationMessage* Location = (const CwclDriAsdLocationMessage*)SlotMessage(Drone, mtLocation);
+	const CwclDriAsdSystemMessage* System = (const CwclDriAsdSystemMessage*)SlotMessage(Drone, mtSystem);
+	const CwclDriAsdOperatorIdMessage* Operator = (const CwclDriAsdOperatorIdMessage*)SlotMessage(Drone, mtOperatorId);
+	if (Basic == NULL && Location == NULL && System == NULL && Operator == NULL)
+		return true;
+
+	// The items present: the bit number is the item. The invalid positions
+	// and altitudes are left out, not sent as values.
+	unsigned long Items = (1 << aiSource) | (1 << aiTarget) | (1 << aiTimeOfDay) | (1 << aiName);
+	if (Basic != NULL)
+		Items |= (1 << aiBasicId);
+	if (Location != NULL)
+	{
+		Items |= (1 << aiVelocity) | (1 << aiStatus);
+		if (Location->Latitude != 0 || Location->Longitude != 0)
+			Items |= (1 << aiPosition);
+		if (ValidAltitudes(Location))
+			Items |= (1 << aiAltitude);
+	}
+	if (System != NULL)
+	{
+		Items |= (1 << aiArea);
+		if (System->OperatorLatitude != 0 || System->OperatorLongitude != 0)
+			Items |= (1 << aiOperator);
+	}
+	if (Operator != NULL)
+		Items |= (1 << aiOperatorId);
+
+	// Build the FSPEC: 7 items per octet, the octets after the last present
+	// item are omitted.
+	unsigned char Fspec[DRI_ASTERIX_FSPEC_SIZE];
+	size_t FspecLen = 0;
+	size_t Size = 0;
+	for (size_t Item = 0; Item < DRI_ASTERIX_ITEMS; Item++)
+	{
+		if (Item % 7 == 0)
+			Fspec[Item / 7] = 0;
+		if ((Items & (1 << Item)) != 0)
+		{
+			Fspec[Item / 7] |= (unsigned char)(0x80 >> (Item % 7));
+			FspecLen = Item / 7 + 1;
+			Size += DRI_ASTERIX_ITEM_SIZE[Item];
+		}
+	}
+	for (size_t i = 0; i + 1 < FspecLen; i++)
+		Fspec[i] |= DRI_ASTERIX_FX;
+	Size += FspecLen;
+
+	if (FLength + Size > FSize)
+		return false;
+
+	unsigned char* p = FBuffer + FLength;
+	CopyMemory(p, Fspec, FspecLen);
+	p += FspecLen;
+
+	// I010, I015, I020.
+	PutWord(p, FSource);
+	PutWord(p, Target);
+	PutByte(p, (unsigned char)(TimeOfDay >> 16));
+	PutWord(p, (unsigned short)TimeOfDay);
+
+	// I030.
+#ifdef _UNICODE
+	char Name[DRI_ASTERIX_NAME_SIZE];
+	int Len = WideCharToMultiByte(CP_UTF8, 0, Drone.Ssid.c_str(), (int)Drone.Ssid.length(),
+		Name, DRI_ASTERIX_NAME_SIZE, NULL, NULL);
+	PutText(p, Name, (Len > 0) ? Len : 0, DRI_ASTERIX_NAME_SIZE);
+#else
+	PutText(p, Drone.Ssid.c_str(), Drone.Ssid.length(), DRI_ASTERIX_NAME_SIZE);
+#endif
+
+	if (Basic != NULL)
+	{
+		// I040.
+		PutByte(p, (unsigned char)Basic->IdType);
+		PutByte(p, (unsigned char)Basic->UavType);
+		PutId(p, Basic->Id);
+	}
+
+	if (Location != NULL)
+	{
+		if ((Items & (1 << aiPosition)) != 0)
+		{
+			// I050.
+			PutDWord(p, LatLon(Location->Latitude));
+			PutDWord(p, LatLon(Location->Longitude));
+		}
+		if ((Items & (1 << aiAltitude)) != 0)
+		{
+			// I060.
+			PutWord(p, Altitude(Location->GeoAltitude));
+			PutWord(p, Altitude(Location->BaroAltitude));
+			PutWord(p, Altitude(Location->Height));
+			PutByte(p, (unsigned char)Location->HeightReference);
+		}
+		// I070. Same as the formatter: out of range values mean unknown.
+		if (Location->HorizontalSpeed == 255)
+			PutWord(p, DRI_ASTERIX_UNKNOWN);
+		else
+			PutWord(p, (unsigned short)(Location->HorizontalSpeed * 100 + 0.5f));
+		PutWord(p, Speed(Location->VerticalSpeed));
+		if (Location->Direction > 360)
+			PutWord(p, DRI_ASTERIX_UNKNOWN);
+		else
+			PutWord(p, Location->Direction);
+		// I080.
+		PutByte(p, (unsigned char)Location->Status);
+		PutByte(p, (unsigned char)Location->HorizontalAccuracy);
+		PutByte(p, (unsigned char)Location->VerticalAccuracy);
+		PutByte(p, (unsigned char)Location->BaroAccuracy);
+		PutByte(p, (unsigned char)Location->SpeedAccuracy);
+	}
+
+	if (System != NULL)
+	{
+		if ((Items & (1 << aiOperator)) != 0)
+		{
+			// I090.
+			PutDWord(p, LatLon(System->OperatorLatitude));
+			PutDWord(p, LatLon(System->OperatorLongitude));
+			PutWord(p, Altitude(System->OperatorAltitude));
+			PutByte(p, (unsigned char)System->OperatorLocation);
+		}
+		// I100.
+		PutWord(p, System->AreaCount);
+		PutWord(p, System->AreaRadius);
+		PutWord(p, Altitude(System->AreaCeiling));
+		PutWord(p, Altitude(System->AreaFloor));
+		PutByte(p, (unsigned char)System->OperatorClassification);
+		PutByte(p, (unsigned char)System->UavEuCategory);
+		PutByte(p, (unsigned char)System->UavEuClass);
+	}
+
+	if (Operator != NULL)
+	{
+		// I110.
+		PutByte(p, Operator->IdType);
+		PutId(p, Operator->Id);
+	}
+
+	FLength += Size;
+	FCount++;
+
+	p = FBuffer + 1;
+	PutWord(p, (unsigned short)FLength);
+	return true;
+}
+
+unsigned long CDriAsterixEncoder::TimeOfDay()
+{
+	FILETIME Now;
+	GetSystemTimeAsFileTime(&Now);
+	unsigned __int64 Time = ((unsigned __int64)Now.dwHighDateTime << 32) | Now.dwLowDateTime;
+	// FILETIME is in 100 ns units; a day starts at a multiple of 24 hours.
+	Time %= 864000000000ULL;
+	return (unsigned long)(Time * DRI_ASTERIX_TOD_SCALE / 10000000);
+}
+
+const unsigned char* CDriAsterixEncoder::GetData() const
+{
+	return FBuffer;
+}
+
+size_t CDriAsterixEncoder::GetLength() const
+{
+	return FLength;
+}
+
+unsigned long CDriAsterixEncoder::GetCount() const
+{
+	return FCount;
+}
+
+unsigned short CDriAsterixEncoder::GetSource() const
+{
+	return FSource;
+}
+
+void CDriAsterixEncoder::SetSource(const unsigned short Value)
+{
+	FSource = Value;
+}
+
+
+// CDriAsterixDecoder
+
+CDriAsterixDecoder::CDriAsterixDecoder()
+{
+}
+
+CDriAsterixDecoder::~CDriAsterixDecoder()
+{
+}
+
+bool CDriAsterixDecoder::DecodeRecord(const unsigned char*& p,
+	const unsigned char* const End, driAsterixTarget& Target)
+{
+	ZeroMemory(&Target, sizeof(Target));
+	Target.HorizontalSpeed = 255;
+	Target.Direction = 361;
+
+	// The FSPEC: an item the decoder does not know has unknown size.
+	size_t Item = 0;
+	unsigned char Octet;
+	do
+	{
+		if (p >= End || Item >= DRI_ASTERIX_FSPEC_SIZE * 7)
+			return false;
+		Octet = GetByte(p);
+		for (unsigned long Bit = 0; Bit < 7; Bit++, Item++)
+		{
+			if ((Octet & (0x80 >> Bit)) != 0)
+			{
+				if (Item >= DRI_ASTERIX_ITEMS)
+					return false;
+				Target.Items |= (1 << Item);
+			}
+		}
+	} while ((Octet & DRI_ASTERIX_FX) != 0);
+	if (Target.Items == 0)
+		return false;
+
+	size_t Size = 0;
+	for (Item = 0; Item < DRI_ASTERIX_ITEMS; Item++)
+	{
+		if ((Target.Items & (1 << Item)) != 0)
+			Size += DRI_ASTERIX_ITEM_SIZE[Item];
+	}
+	if ((size_t)(End - p) < Size)
+		return false;
+
+	if ((Target.Items & (1 << aiSource)) != 0)
+		Target.Source = GetWord(p);
+	if ((Target.Items & (1 << aiTarget)) != 0)
+		Target.Target = GetWord(p);
+	if ((Target.Items & (1 << aiTimeOfDay)) != 0)
+	{
+		Target.TimeOfDay = (unsigned long)GetByte(p) << 16;
+		Target.TimeOfDay |= GetWord(p);
+	}
+	if ((Target.Items & (1 << aiName)) != 0)
+		GetText(p, Target.Name, DRI_ASTERIX_NAME_SIZE);
+	if ((Target.Items & (1 << aiBasicId)) != 0)
+	{
+		Target.IdType = GetByte(p);
+		Target.UavType = GetByte(p);
+		GetText(p, Target.Id, DRI_ASTERIX_ID_SIZE);
+	}
+	if ((Target.Items & (1 << aiPosition)) != 0)
+	{
+		Target.Latitude = GetLatLon(p);
+		Target.Longitude = GetLatLon(p);
+	}
+	if ((Target.Items & (1 << aiAltitude)) != 0)
+	{
+		Target.GeoAltitude = GetAltitude(p);
+		Target.BaroAltitude = GetAltitude(p);
+		Target.Height = GetAltitude(p);
+		Target.HeightReference = GetByte(p);
+	}
+	if ((Target.Items & (1 << aiVelocity)) != 0)
+	{
+		unsigned short Speed = GetWord(p);
+		if (Speed != DRI_ASTERIX_UNKNOWN)
+			Target.HorizontalSpeed = (float)Speed / 100;
+		Target.VerticalSpeed = (float)(short)GetWord(p) / 100;
+		unsigned short Direction = GetWord(p);
+		if (Direction != DRI_ASTERIX_UNKNOWN)
+			Target.Direction = Direction;
+	}
+	if ((Target.Items & (1 << aiStatus)) != 0)
+	{
+		Target.Status = GetByte(p);
+		Target.HorizontalAccuracy = GetByte(p);
+		Target.VerticalAccuracy = GetByte(p);
+		Target.BaroAccuracy = GetByte(p);
+		Target.SpeedAccuracy = GetByte(p);
+	}
+	if ((Target.Items & (1 << aiOperator)) != 0)
+	{
+		Target.OperatorLatitude = GetLatLon(p);
+		Target.OperatorLongitude = GetLatLon(p);
+		Target.OperatorAltitude = GetAltitude(p);
+		Target.OperatorLocation = GetByte(p);
+	}
+	if ((Target.Items & (1 << aiArea)) != 0)
+	{
+		Target.AreaCount = GetWord(p);
+		Target.AreaRadius = GetWord(p);
+		Target.AreaCeiling = GetAltitude(p);
+		Target.AreaFloor = GetAltitude(p);
+		Target.OperatorClassification = GetByte(p);
+		Target.UavEuCategory = GetByte(p);
+		Target.UavEuClass = GetByte(p);
+	}
+	if ((Target.Items & (1 << aiOperatorId)) != 0)
+	{
+		Target.OperatorIdType = GetByte(p);
+		GetText(p, Target.OperatorId, DRI_ASTERIX_ID_SIZE);
+	}
+	return true;
+}
+
+int CDriAsterixDecoder::Decode(const unsigned char* const Data, const size_t Length,
+	std::vector<driAsterixTarget>& Targets) const
+{
+	Targets.clear();
+	if (Data == NULL || Length == 0)
+		return WCL_E_INVALID_ARGUMENT;
+
+	const unsigned char* Block = Data;
+	const unsigned char* End = Data + Length;
+	while (Block < End)
+	{
+		if ((size_t)(End - Block) < DRI_ASTERIX_HEADER_SIZE || Block[0] != DRI_ASTERIX_CATEGORY)
+		{
+			Targets.clear();
+			return DRI_E_ASTERIX_INVALID_BLOCK;
+		}
+		const unsigned char* p = Block + 1;
+		size_t BlockLength = GetWord(p);
+		if (BlockLength < DRI_ASTERIX_HEADER_SIZE || BlockLength > (size_t)(End - Block))
+		{
+			Targets.clear();
+			return DRI_E_ASTERIX_INVALID_BLOCK;
+		}
+
+		const unsigned char* BlockEnd = Block + BlockLength;
+		while (p < BlockEnd)
+		{
+			driAsterixTarget Target;
+			if (!DecodeRecord(p, BlockEnd, Target))
+			{
+				Targets.clear();
+				return DRI_E_ASTERIX_INVALID_RECORD;
+			}
+			Targets.push_back(Target);
+		}
+		Block = BlockEnd;
+	}
+	return WCL_E_SUCCESS;
+}
@@ -0,0 +1,292 @@
+
+// DriAsterix.h : header file
+//
+
+#pragma once
+
+#include <vector>
+
+#include "wclHelpers.h"
+#include "wclDriAsd.h"
+
+#include "DriDroneList.h"
+#include "DriErrors.h"
+
+using namespace wclCommon;
+using namespace wclDri;
+
+/// <summary> The data category of the drone target blocks. A value from
+///   the range ASTERIX leaves for the non-standard categories. </summary>
+#define DRI_ASTERIX_CATEGORY		250
+/// <summary> The size of the block header: the category and the block
+///   length. </summary>
+#define DRI_ASTERIX_HEADER_SIZE		3
+/// <summary> The size of the target name item. </summary>
+#define DRI_ASTERIX_NAME_SIZE		32
+/// <summary> The size of the UAS and the operator ID fields. </summary>
+#define DRI_ASTERIX_ID_SIZE			20
+/// <summary> The largest target record: the field specification and all the
+///   items. </summary>
+#define DRI_ASTERIX_MAX_RECORD		132
+/// <summary> The largest block: the block length is 16 bits. </summary>
+#define DRI_ASTERIX_MAX_BLOCK		65535
+
+/// <summary> The target record items. The value is the item bit in the
+///   field specification. </summary>
+typedef enum
+{
+	/// <summary> I010: the sensor identification (SAC, SIC). 2
+	///   bytes. </summary>
+	aiSource = 0,
+	/// <summary> I015: the target number (the drone index). 2
+	///   bytes. </summary>
+	aiTarget = 1,
+	/// <summary> I020: the time of the report in 1/128 s since midnight
+	///   UTC. 3 bytes. </summary>
+	aiTimeOfDay = 2,
+	/// <summary> I030: the target name (SSID or Bluetooth address), UTF-8,
+	///   zero padded. 32 bytes. </summary>
+	aiName = 3,
+	/// <summary> I040: Basic ID: ID type, UA type, ID (ASCII, zero
+	///   padded). 22 bytes. </summary>
+	aiBasicId = 4,
+	/// <summary> I050: the position: latitude and longitude in 1E-7 degrees
+	///   (signed). 8 bytes. Left out when both are 0 (invalid in the
+	///   ASD message). </summary>
+	aiPosition = 5,
+	/// <summary> I060: the geodetic and the barometric altitudes and the
+	///   height in 0.5 m (signed), the height reference. 7 bytes. Left out
+	///   when all the three are -1000 m (invalid in the ASD message); one
+	///   invalid altitude stays -1000 m. </summary>
+	aiAltitude = 6,
+	/// <summary> I070: the horizontal speed in 0.01 m/s, the vertical
+	///   speed in 0.01 m/s (signed), the direction in degrees. 0xFFFF is
+	///   unknown. 6 bytes. </summary>
+	aiVelocity = 7,
+	/// <summary> I080: the status, the horizontal, vertical, barometric
+	///   and speed accuracies. 5 bytes. </summary>
+	aiStatus = 8,
+	/// <summary> I090: the operator position: latitude and longitude in
+	///   1E-7 degrees, altitude in 0.5 m (signed), the location type. 11
+	///   bytes. Left out when the latitude and the longitude are
+	///   0. </summary>
+	aiOperator = 9,
+	/// <summary> I100: the operating area: count, radius, ceiling and floor
+	///   in 0.5 m (signed), the classification, the EU category and
+	///   class. 11 bytes. </summary>
+	aiArea = 10,
+	/// <summary> I110: Operator ID: ID type, ID (ASCII, zero padded). 21
+	///   bytes. </summary>
+	aiOperatorId = 11
+} driAsterixItem;
+
+/// <summary> Encodes the drones into binary surveillance blocks in the
+///   ASTERIX layout. </summary>
+/// <remarks> <para> A block is the category (1 byte), the block length
+///   (2 bytes) and the target records. A record is the field specification
+///   (FSPEC) followed by the present items in the order of
+///   <see cref="driAsterixItem" />. The FSPEC is the presence bitmap: the
+///   first item is the most significant bit of the first octet, the least
+///   significant bit of an octet (FX) tells that one more octet follows. All
+///   the items have a fixed size and all the values are
+///   big-endian. </para>
+///   <para> A record holds the latest Basic ID, Location, System and
+///   Operator ID messages of a drone; the items of the missing messages are
+///   left out. </para>
+///   <para> The encoder writes into the buffer allocated by the constructor
+///   and does not allocate itself (only the ID properties of the messages
+///   return copies). A record that does not fit is not written so the owner
+///   sends the block and starts a new one. </para> </remarks>
+class CDriAsterixEncoder
+{
+	DISABLE_COPY(CDriAsterixEncoder);
+
+private:
+	unsigned char*	FBuffer;
+	size_t			FSize;
+	size_t			FLength;
+	unsigned long	FCount;
+	unsigned short	FSource;
+
+public:
+	/// <summary> Creates new encoder. </summary>
+	/// <param name="Size"> The maximum block size in bytes. Up to
+	///   <see cref="DRI_ASTERIX_MAX_BLOCK" />. </param>
+	CDriAsterixEncoder(const size_t Size);
+	/// <summary> Frees the encoder. </summary>
+	virtual ~CDriAsterixEncoder();
+
+	/// <summary> Starts new block. </summary>
+	void Reset();
+	/// <summary> Adds the target record of a drone to the block. </summary>
+	/// <param name="Target"> The target number. </param>
+	/// <param name="Drone"> The drone. </param>
+	/// <param name="TimeOfDay"> The report time in 1/128 s since midnight
+	///   UTC. </param>
+	/// <returns> <c>True</c> if the record was added or the drone has none
+	///   of the encoded messages (nothing to add). <c>False</c> if the block
+	///   is full. </returns>
+	bool Add(const unsigned short Target, const driDrone& Drone,
+		const unsigned long TimeOfDay);
+
+	/// <summary> Gets the current time of day. </summary>
+	/// <returns> The time in 1/128 s since midnight UTC. </returns>
+	static unsigned long TimeOfDay();
+
+	/// <summary> Gets the block data. </summary>
+	/// <returns> The pointer to the block. </returns>
+	const unsigned char* GetData() const;
+	/// <summary> Gets the block data. </summary>
+	/// <value> The pointer to the block. </value>
+	__declspec(property(get = GetData)) const unsigned char* Data;
+
+	/// <summary> Gets the block length. </summary>
+	/// <returns> The length in bytes including the header. </returns>
+	size_t GetLength() const;
+	/// <summary> Gets the block length. </summary>
+	/// <value> The length in bytes including the header. </value>
+	__declspec(property(get = GetLength)) size_t Length;
+
+	/// <summary> Gets the number of records in the block. </summary>
+	/// <returns> The records count. </returns>
+	unsigned long GetCount() const;
+	/// <summary> Gets the number of records in the block. </summary>
+	/// <value> The records count. </value>
+	__declspec(property(get = GetCount)) unsigned long Count;
+
+	/// <summary> Gets the sensor identification. </summary>
+	/// <returns> The SAC in the high byte and the SIC in the low
+	///   byte. </returns>
+	unsigned short GetSource() const;
+	/// <summary> Sets the sensor identification. </summary>
+	/// <param name="Value"> The SAC in the high byte and the SIC in the low
+	///   byte. </param>
+	void SetSource(const unsigned short Value);
+	/// <summary> Gets or sets the sensor identification. </summary>
+	/// <value> The SAC in the high byte and the SIC in the low
+	///   byte. </value>
+	__declspec(property(get = GetSource, put = SetSource))
+		unsigned short Source;
+};
+
+/// <summary> The decoded target record. </summary>
+/// <remarks> <c>Items</c> tells which fields are valid. The values are in
+///   the units of the ASD messages; the unknown speed is 255 and the unknown
+///   direction is 361 as there. </remarks>
+typedef struct
+{
+	/// <summary> The present items: bit N is the item N of
+	///   <see cref="driAsterixItem" />. </summary>
+	unsigned long	Items;
+
+	/// <summary> I010: the SAC in the high byte and the SIC in the low
+	///   byte. </summary>
+	unsigned short	Source;
+	/// <summary> I015: the target number. </summary>
+	unsigned short	Target;
+	/// <summary> I020: the report time in 1/128 s since midnight
+	///   UTC. </summary>
+	unsigned long	TimeOfDay;
+	/// <summary> I030: the target name, UTF-8, zero terminated. </summary>
+	char			Name[DRI_ASTERIX_NAME_SIZE + 1];
+
+	/// <summary> I040: the ID type (<c>wclDriAsdIdType</c>). </summary>
+	unsigned char	IdType;
+	/// <summary> I040: the UA type (<c>wclDriAsdUavType</c>). </summary>
+	unsigned char	UavType;
+	/// <summary> I040: the UAS ID, zero terminated. </summary>
+	char			Id[DRI_ASTERIX_ID_SIZE + 1];
+
+	/// <summary> I050: the latitude in degrees. </summary>
+	double			Latitude;
+	/// <summary> I050: the longitude in degrees. </summary>
+	double			Longitude;
+
+	/// <summary> I060: the geodetic altitude in meters. </summary>
+	float			GeoAltitude;
+	/// <summary> I060: the barometric altitude in meters. </summary>
+	float			BaroAltitude;
+	/// <summary> I060: the height in meters. </summary>
+	float			Height;
+	/// <summary> I060: the height reference
+	///   (<c>wclDriAsdUavHeightReference</c>). </summary>
+	unsigned char	HeightReference;
+
+	/// <summary> I070: the horizontal speed in m/s. </summary>
+	float			HorizontalSpeed;
+	/// <summary> I070: the vertical speed in m/s. </summary>
+	float			VerticalSpeed;
+	/// <summary> I070: the direction in degrees. </summary>
+	unsigned short	Direction;
+
+	/// <summary> I080: the status (<c>wclDriAsdUavStatus</c>). </summary>
+	unsigned char	Status;
+	/// <summary> I080: the horizontal accuracy. </summary>
+	unsigned char	HorizontalAccuracy;
+	/// <summary> I080: the vertical accuracy. </summary>
+	unsigned char	VerticalAccuracy;
+	/// <summary> I080: the barometric altitude accuracy. </summary>
+	unsigned char	BaroAccuracy;
+	/// <summary> I080: the speed accuracy. </summary>
+	unsigned char	SpeedAccuracy;
+
+	/// <summary> I090: the operator latitude in degrees. </summary>
+	double			OperatorLatitude;
+	/// <summary> I090: the operator longitude in degrees. </summary>
+	double			OperatorLongitude;
+	/// <summary> I090: the operator altitude in meters. </summary>
+	float			OperatorAltitude;
+	/// <summary> I090: the operator location type. </summary>
+	unsigned char	OperatorLocation;
+
+	/// <summary> I100: the number of the aircraft in the area. </summary>
+	unsigned short	AreaCount;
+	/// <summary> I100: the area radius in meters. </summary>
+	unsigned short	AreaRadius;
+	/// <summary> I100: the area ceiling in meters. </summary>
+	float			AreaCeiling;
+	/// <summary> I100: the area floor in meters. </summary>
+	float			AreaFloor;
+	/// <summary> I100: the operator classification. </summary>
+	unsigned char	OperatorClassification;
+	/// <summary> I100: the UA EU category. </summary>
+	unsigned char	UavEuCategory;
+	/// <summary> I100: the UA EU class. </summary>
+	unsigned char	UavEuClass;
+
+	/// <summary> I110: the operator ID type. </summary>
+	unsigned char	OperatorIdType;
+	/// <summary> I110: the operator ID, zero terminated. </summary>
+	char			OperatorId[DRI_ASTERIX_ID_SIZE + 1];
+} driAsterixTarget;
+
+/// <summary> Decodes the blocks written by
+///   <see cref="CDriAsterixEncoder" />. </summary>
+/// <remarks> The decoder checks every length against the data: a damaged
+///   datagram is rejected, it never reads past the end. The decoder has no
+///   state and is thread safe. </remarks>
+class CDriAsterixDecoder
+{
+	DISABLE_COPY(CDriAsterixDecoder);
+
+private:
+	static bool DecodeRecord(const unsigned char*& p, const unsigned char* const End,
+		driAsterixTarget& Target);
+
+public:
+	/// <summary> Creates new decoder. </summary>
+	CDriAsterixDecoder();
+	/// <summary> Frees the decoder. </summary>
+	virtual ~CDriAsterixDecoder();
+
+	/// <summary> Decodes the blocks of a datagram. </summary>
+	/// <param name="Data"> The datagram: one or more blocks. </param>
+	/// <param name="Length"> The datagram length in bytes. </param>
+	/// <param name="Targets"> On output contains the target records of all
+	///   the blocks. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes; the targets are cleared. </returns>
+	int Decode(const unsigned char* const Data, const size_t Length,
+		std::vector<driAsterixTarget>& Targets) const;
+};
@@ -0,0 +1,515 @@
+
+// DriCaptureLog.cpp : implementation file
+//
+
+#include "stdafx.h"
+#include "DriCaptureLog.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+
+// The size of the mapped window used by the reader. Records never exceed
+// 64 KB so the window always holds at least one complete record.
+#define DRI_CAPTURE_VIEW_SIZE	(16 * 1024 * 1024)
+
+// The zeros the records are padded with.
+static const unsigned char DRI_CAPTURE_PADDING[DRI_CAPTURE_ALIGN] = { 0 };
+
+static size_t AlignRecord(const size_t Size)
+{
+	return (Size + DRI_CAPTURE_ALIGN - 1) & ~((size_t)DRI_CAPTURE_ALIGN - 1);
+}
+
+static __int64 CurrentFileTime()
+{
+	FILETIME Now;
+	GetSystemTimeAsFileTime(&Now);
+	return ((__int64)Now.dwHighDateTime << 32) | Now.dwLowDateTime;
+}
+
+
+// CDriCaptureLogWriter
+
+CDriCaptureLogWriter::CDriCaptureLogWriter()
+{
+	FCS = new CwclCriticalSection();
+	FStream = NULL;
+	FBufferSize = 1024 * 1024;
+	FFrames = 0;
+	FLastSync = 0;
+	FOffset = 0;
+	FSyncInterval = 50000;
+	FUnsynced = 0;
+	FFailed = false;
+}
+
+CDriCaptureLogWriter::~CDriCaptureLogWriter()
+{
+	Close();
+
+	delete FCS;
+}
+
+void CDriCaptureLogWriter::Put(const void* const Data, const size_t Size)
+{
+	const unsigned char* Bytes = (const unsigned char*)Data;
+	FBuffer.insert(FBuffer.end(), Bytes, Bytes + Size);
+	FOffset += Size;
+}
+
+int CDriCaptureLogWriter::FlushBuffer()
+{
+	if (FFailed)
+		return DRI_E_LOG_WRITE_FAILED;
+
+	int Res = WCL_E_SUCCESS;
+	if (FBuffer.size() > 0)
+	{
+		unsigned long Size = (unsigned long)FBuffer.size();
+		unsigned long Written = FStream->Write(&FBuffer[0], Size);
+		if (Written != Size)
+		{
+			// The offsets must not point past the real end of the file.
+			FOffset -= Size - Written;
+			FFailed = true;
+			Res = DRI_E_LOG_WRITE_FAILED;
+		}
+		FBuffer.clear();
+	}
+	return Res;
+}
+
+int CDriCaptureLogWriter::WriteSyncPoint()
+{
+	// Everything before the sync record must be on the disk before the record
+	// itself is written.
+	int Res = FlushBuffer();
+	if (Res == WCL_E_SUCCESS)
+	{
+		if (!FlushFileBuffers(FStream->GetHandle()))
+		{
+			// The records before may not be on the disk: no sync point can
+			// follow them.
+			FFailed = true;
+			Res = DRI_E_LOG_WRITE_FAILED;
+		}
+		else
+		{
+			driCaptureRecordHeader Header;
+			ZeroMemory(&Header, sizeof(Header));
+			Header.Length = sizeof(driCaptureSyncPoint);
+			Header.Kind = rkSync;
+			Header.Timestamp = CurrentFileTime();
+
+			driCaptureSyncPoint SyncPoint;
+			ZeroMemory(&SyncPoint, sizeof(SyncPoint));
+			SyncPoint.Magic = DRI_CAPTURE_SYNC_MAGIC;
+			SyncPoint.Frames = FFrames;
+			SyncPoint.Previous = FLastSync;
+
+			FLastSync = FOffset;
+			Put(&Header, sizeof(Header));
+			Put(&SyncPoint, sizeof(SyncPoint));
+
+			FUnsynced = 0;
+		}
+	}
+	return Res;
+}
+
+int CDriCaptureLogWriter::Open(const tstring& FileName)
+{
+	if (FileName == _T(""))
+		return WCL_E_INVALID_ARGUMENT;
+
+	FCS->Enter();
+	int Res = WCL_E_SUCCESS;
+	if (FStream != NULL)
+		Res = DRI_E_LOG_OPENED;
+	else
+	{
+		try
+		{
+			FStream = new CwclFileStream(FileName, CREATE_ALWAYS, GENERIC_WRITE,
+				FILE_SHARE_READ);
+		}
+		catch (wclEFileOpenFailed&)
+		{
+			FStream = NULL;
+			Res = DRI_E_LOG_OPEN_FAILED;
+		}
+
+		if (Res == WCL_E_SUCCESS)
+		{
+			FBuffer.clear();
+			FBuffer.reserve(FBufferSize);
+			FFrames = 0;
+			FLastSync = 0;
+			FOffset = 0;
+			FUnsynced = 0;
+			FFailed = false;
+
+			driCaptureFileHeader Header;
+			ZeroMemory(&Header, sizeof(Header));
+			CopyMemory(Header.Magic, DRI_CAPTURE_MAGIC, sizeof(Header.Magic));
+			Header.Version = DRI_CAPTURE_VERSION;
+			// The records start aligned after the header.
+			Header.HeaderSize = (unsigned short)AlignRecord(sizeof(Header));
+			Header.Created = CurrentFileTime();
+			Put(&Header, sizeof(Header));
+			if (Header.HeaderSize > sizeof(Header))
+				Put(DRI_CAPTURE_PADDING, Header.HeaderSize - sizeof(Header));
+
+			Res = FlushBuffer();
+			if (Res != WCL_E_SUCCESS)
+			{
+				delete FStream;
+				FStream = NULL;
+			}
+		}
+	}
+	FCS->Leave();
+	return Res;
+}
+
+int CDriCaptureLogWriter::Close()
+{
+	FCS->Enter();
+	int Res = WCL_E_SUCCESS;
+	if (FStream == NULL)
+		Res = DRI_E_LOG_CLOSED;
+	else
+	{
+		Res = WriteSyncPoint();
+		if (Res == WCL_E_SUCCESS)
+			Res = FlushBuffer();
+		FBuffer.clear();
+
+		delete FStream;
+		FStream = NULL;
+	}
+	FCS->Leave();
+	return Res;
+}
+
+int CDriCaptureLogWriter::Append(const driCaptureTransport Transport,
+	const unsigned char Radio, const __int64 Source, const __int64 Timestamp,
+	const char Rssi, const unsigned char* const Data, const size_t Length,
+	unsigned __int64& Offset)
+{
+	// Zero length frames are used by the reader to detect a zero-filled torn
+	// tail so they are not allowed.
+	if (Data == NULL || Length == 0 || Length > 0xFFFF)
+		return WCL_E_INVALID_ARGUMENT;
+
+	FCS->Enter();
+	int Res = WCL_E_SUCCESS;
+	if (FStream == NULL)
+		Res = DRI_E_LOG_CLOSED;
+	else
+	{
+		if (FFailed)
+			Res = DRI_E_LOG_WRITE_FAILED;
+	}
+	if (Res == WCL_E_SUCCESS)
+	{
+		size_t Size = sizeof(driCaptureRecordHeader) + Length;
+		size_t Padded = AlignRecord(Size);
+		if (FBuffer.size() + Padded > FBufferSize)
+			Res = FlushBuffer();
+
+		if (Res == WCL_E_SUCCESS)
+		{
+			driCaptureRecordHeader Header;
+			Header.Length = (unsigned short)Length;
+			Header.Kind = rkFrame;
+			Header.Transport = (unsigned char)Transport;
+			Header.Rssi = Rssi;
+			Header.Radio = Radio;
+			Header.Reserved = 0;
+			Header.Timestamp = Timestamp;
+			Header.Source = Source;
+
+			Offset = FOffset;
+			Put(&Header, sizeof(Header));
+			Put(Data, Length);
+			if (Padded > Size)
+				Put(DRI_CAPTURE_PADDING, Padded - Size);
+			FFrames++;
+
+			if (FSyncInterval > 0)
+			{
+				FUnsynced++;
+				if (FUnsynced >= FSyncInterval)
+					Res = WriteSyncPoint();
+			}
+		}
+	}
+	FCS->Leave();
+	return Res;
+}
+
+int CDriCaptureLogWriter::Append(const driCaptureTransport Transport,
+	const __int64 Source, const __int64 Timestamp, const char Rssi,
+	const wclDriRawData& Raw)
+{
+	if (Raw.size() == 0)
+		return WCL_E_INVALID_ARGUMENT;
+
+	unsigned __int64 Offset;
+	return Append(Transport, 0, Source, Timestamp, Rssi, &Raw[0], Raw.size(), Offset);
+}
+
+int CDriCaptureLogWriter::Sync()
+{
+	FCS->Enter();
+	int Res = WCL_E_SUCCESS;
+	if (FStream == NULL)
+		Res = DRI_E_LOG_CLOSED;
+	else
+	{
+		Res = WriteSyncPoint();
+		if (Res == WCL_E_SUCCESS)
+			Res = FlushBuffer();
+	}
+	FCS->Leave();
+	return Res;
+}
+
+bool CDriCaptureLogWriter::GetActive() const
+{
+	return (FStream != NULL);
+}
+
+unsigned __int64 CDriCaptureLogWriter::GetFrames() const
+{
+	return FFrames;
+}
+
+size_t CDriCaptureLogWriter::GetBufferSize() const
+{
+	return FBufferSize;
+}
+
+void CDriCaptureLogWriter::SetBufferSize(const size_t Value)
+{
+	if (FStream == NULL && Value >= 4096)
+		FBufferSize = Value;
+}
+
+unsigned long CDriCaptureLogWriter::GetSyncInterval() const
+{
+	return FSyncInterval;
+}
+
+void CDriCaptureLogWriter::SetSyncInterval(const unsigned long Value)
+{
+	FCS->Enter();
+	FSyncInterval = Value;
+	FCS->Leave();
+}
+
+
+// CDriCaptureLogReader
+
+CDriCaptureLogReader::CDriCaptureLogReader()
+{
+	FFile = new CDriMappedFile(DRI_CAPTURE_VIEW_SIZE);
+	FFirst = 0;
+	FEnd = 0;
+	FFrames = 0;
+}
+
+CDriCaptureLogReader::~CDriCaptureLogReader()
+{
+	Close();
+
+	delete FFile;
+}
+
+void CDriCaptureLogReader::FindEnd()
+{
+	// Walk the record headers. A sync point is valid if it counts the frames
+	// before it and links to the previous valid one; the first damaged
+	// record ends the walk.
+	FEnd = FFirst;
+	FFrames = 0;
+	unsigned __int64 Frames = 0;
+	unsigned __int64 LastSync = 0;
+	unsigned __int64 Position = FFirst;
+	while (true)
+	{
+		const driCaptureRecordHeader* Header = (const driCaptureRecordHeader*)
+			FFile->Map(Position, sizeof(driCaptureRecordHeader));
+		if (Header == NULL)
+			break;
+		if (Position + sizeof(driCaptureRecordHeader) + Header->Length > FFile->GetSize())
+			break;
+		unsigned __int64 Next = Position + AlignRecord(sizeof(driCaptureRecordHeader) + Header->Length);
+
+		if (Header->Kind == rkFrame)
+		{
+			if (Header->Length == 0)
+				break;
+			Frames++;
+		}
+		else
+		{
+			if (Header->Kind != rkSync || Header->Length != sizeof(driCaptureSyncPoint))
+				break;
+			const driCaptureSyncPoint* SyncPoint = (const driCaptureSyncPoint*)
+				FFile->Map(Position + sizeof(driCaptureRecordHeader), sizeof(driCaptureSyncPoint));
+			if (SyncPoint == NULL || SyncPoint->Magic != DRI_CAPTURE_SYNC_MAGIC ||
+				SyncPoint->Frames != Frames || SyncPoint->Previous != LastSync)
+			{
+				break;
+			}
+			LastSync = Position;
+			FEnd = Next;
+			FFrames = Frames;
+		}
+		Position = Next;
+	}
+}
+
+int CDriCaptureLogReader::Open(const tstring& FileName, const bool Sequential)
+{
+	// The reader sees the log as it was at the moment it was opened.
+	int Res = FFile->Open(FileName, Sequential);
+	if (Res == WCL_E_SUCCESS)
+	{
+		if (FFile->GetSize() < sizeof(driCaptureFileHeader))
+			Res = DRI_E_LOG_INVALID_FORMAT;
+		else
+		{
+			const driCaptureFileHeader* Header = (const driCaptureFileHeader*)
+				FFile->Map(0, sizeof(driCaptureFileHeader));
+			if (Header == NULL)
+				Res = DRI_E_LOG_MAP_FAILED;
+			else
+			{
+				if (memcmp(Header->Magic, DRI_CAPTURE_MAGIC, sizeof(Header->Magic)) != 0 ||
+					Header->Version != DRI_CAPTURE_VERSION ||
+					Header->HeaderSize < sizeof(driCaptureFileHeader) ||
+					Header->HeaderSize % DRI_CAPTURE_ALIGN != 0 ||
+					Header->HeaderSize > FFile->GetSize())
+				{
+					Res = DRI_E_LOG_INVALID_FORMAT;
+				}
+				else
+					FFirst = Header->HeaderSize;
+			}
+		}
+
+		if (Res == WCL_E_SUCCESS)
+			FindEnd();
+		else
+			FFile->Close();
+	}
+	return Res;
+}
+
+int CDriCaptureLogReader::Close()
+{
+	if (!FFile->GetActive())
+		return DRI_E_LOG_CLOSED;
+
+	FFile->Close();
+	return WCL_E_SUCCESS;
+}
+
+int CDriCaptureLogReader::ReadAt(const unsigned __int64 Offset,
+	driCaptureFrame& Frame)
+{
+	if (!FFile->GetActive())
+		return DRI_E_LOG_CLOSED;
+	if (Offset < FFirst || Offset % DRI_CAPTURE_ALIGN != 0)
+		return WCL_E_INVALID_ARGUMENT;
+	// The records after the last sync point may be torn.
+	if (Offset >= FEnd)
+		return DRI_E_LOG_EOF;
+
+	const driCaptureRecordHeader* Header = (const driCaptureRecordHeader*)
+		FFile->Map(Offset, sizeof(driCaptureRecordHeader));
+	if (Header == NULL)
+		return DRI_E_LOG_EOF;
+	if (Header->Kind != rkFrame || Header->Length == 0)
+		return DRI_E_LOG_CORRUPTED;
+
+	// Mapping the whole record may move the view.
+	Header = (const driCaptureRecordHeader*)FFile->Map(Offset,
+		sizeof(driCaptureRecordHeader) + Header->Length);
+	if (Header == NULL)
+		return DRI_E_LOG_CORRUPTED;
+
+	Frame.Offset = Offset;
+	Frame.Transport = (driCaptureTransport)Header->Transport;
+	Frame.Radio = Header->Radio;
+	Frame.Rssi = Header->Rssi;
+	Frame.Timestamp = Header->Timestamp;
+	Frame.Source = Header->Source;
+	Frame.Data = (const unsigned char*)(Header + 1);
+	Frame.Length = Header->Length;
+
+	return WCL_E_SUCCESS;
+}
+
+int CDriCaptureLogReader::Next(unsigned __int64& Position, driCaptureFrame& Frame)
+{
+	if (!FFile->GetActive())
+		return DRI_E_LOG_CLOSED;
+
+	while (Position < FEnd)
+	{
+		const driCaptureRecordHeader* Header = (const driCaptureRecordHeader*)
+			FFile->Map(Position, sizeof(driCaptureRecordHeader));
+		if (Header == NULL)
+			return DRI_E_LOG_EOF;
+
+		unsigned __int64 Size = AlignRecord(sizeof(driCaptureRecordHeader) + Header->Length);
+		if (Position + sizeof(driCaptureRecordHeader) + Header->Length > FFile->GetSize())
+			return DRI_E_LOG_EOF;
+
+		if (Header->Kind == rkSync)
+		{
+			if (Header->Length != sizeof(driCaptureSyncPoint))
+				return DRI_E_LOG_EOF;
+			Position += Size;
+			continue;
+		}
+
+		// Anything else than a valid frame is a torn tail.
+		if (Header->Kind != rkFrame || Header->Length == 0)
+			return DRI_E_LOG_EOF;
+
+		int Res = ReadAt(Position, Frame);
+		if (Res != WCL_E_SUCCESS)
+			return DRI_E_LOG_EOF;
+
+		Position += Size;
+		return WCL_E_SUCCESS;
+	}
+	return DRI_E_LOG_EOF;
+}
+
+unsigned __int64 CDriCaptureLogReader::First() const
+{
+	return FFirst;
+}
+
+bool CDriCaptureLogReader::GetActive() const
+{
+	return FFile->GetActive();
+}
+
+unsigned __int64 CDriCaptureLogReader::GetSize() const
+{
+	return FFile->GetSize();
+}
+
+unsigned __int64 CDriCaptureLogReader::GetFrames() const
+{
+	return FFrames;
+}
@@ -0,0 +1,337 @@
+
+// DriCaptureLog.h : header file
+//
+
+#pragma once
+
+#include <vector>
+
+#include "wclHelpers.h"
+#include "wclSync.h"
+#include "wclDriCommon.h"
+
+#include "DriErrors.h"
+#include "DriMappedFile.h"
+
+using namespace wclCommon;
+using namespace wclSync;
+using namespace wclDri;
+
+// Capture log file layout (all values are little-endian):
+//
+//   driCaptureFileHeader
+//   record 0
+//   record 1
+//   ...
+//
+// Every record starts with driCaptureRecordHeader followed by Length bytes of
+// payload and is padded with zeros to DRI_CAPTURE_ALIGN bytes so the headers
+// of a memory-mapped log are always aligned. Frame records carry the raw DRI
+// data as payload. Sync records carry driCaptureSyncPoint and are written
+// after the data preceding them reached the disk, so the reader can trust
+// everything up to the last sync point even if the tail was torn by a crash.
+
+/// <summary> The capture log file signature. </summary>
+#define DRI_CAPTURE_MAGIC			"DRICAPLG"
+/// <summary> The capture log format version. </summary>
+#define DRI_CAPTURE_VERSION			1
+/// <summary> The records alignment in bytes. </summary>
+#define DRI_CAPTURE_ALIGN			8
+/// <summary> The sync point signature. </summary>
+#define DRI_CAPTURE_SYNC_MAGIC		0x434E5953 // "SYNC"
+
+/// <summary> The transport a DRI frame was received from. </summary>
+typedef enum
+{
+	/// <summary> Bluetooth LE advertisement (ASD service data). </summary>
+	ctBluetooth = 0,
+	/// <summary> WiFi beacon (DRI vendor specific IE). </summary>
+	ctWiFi = 1
+} driCaptureTransport;
+
+/// <summary> The capture log record kinds. </summary>
+typedef enum
+{
+	/// <summary> The record contains a raw DRI frame. </summary>
+	rkFrame = 0,
+	/// <summary> The record is a sync point. </summary>
+	rkSync = 1
+} driCaptureRecordKind;
+
+#pragma pack(push, 1)
+/// <summary> The capture log file header. </summary>
+typedef struct
+{
+	char			Magic[8];
+	unsigned short	Version;
+	unsigned short	HeaderSize;
+	unsigned long	Flags;
+	/// <summary> The log creation time (FILETIME). </summary>
+	__int64			Created;
+	__int64			Reserved;
+} driCaptureFileHeader;
+
+/// <summary> The capture log record header. </summary>
+typedef struct
+{
+	/// <summary> The payload length (without padding). </summary>
+	unsigned short	Length;
+	/// <summary> One of the <c>driCaptureRecordKind</c> values. </summary>
+	unsigned char	Kind;
+	/// <summary> One of the <c>driCaptureTransport</c> values. </summary>
+	unsigned char	Transport;
+	char			Rssi;
+	/// <summary> The receiving radio index (see the capture manager). </summary>
+	unsigned char	Radio;
+	unsigned short	Reserved;
+	/// <summary> The receive time (FILETIME, UTC). </summary>
+	__int64			Timestamp;
+	/// <summary> The source MAC address. </summary>
+	__int64			Source;
+} driCaptureRecordHeader;
+
+/// <summary> The sync record payload. </summary>
+typedef struct
+{
+	unsigned long		Magic;
+	unsigned long		Reserved;
+	/// <summary> The number of frame records written before the sync
+	///   point. </summary>
+	unsigned __int64	Frames;
+	/// <summary> The offset of the previous sync record or 0. </summary>
+	unsigned __int64	Previous;
+} driCaptureSyncPoint;
+#pragma pack(pop)
+
+/// <summary> A frame read from the capture log. </summary>
+/// <remarks> <c>Data</c> points directly into the mapped log view and stays
+///   valid until the next reader call. </remarks>
+typedef struct
+{
+	/// <summary> The record offset in the log file. </summary>
+	unsigned __int64		Offset;
+	driCaptureTransport		Transport;
+	unsigned char			Radio;
+	char					Rssi;
+	__int64					Timestamp;
+	__int64					Source;
+	const unsigned char*	Data;
+	unsigned short			Length;
+} driCaptureFrame;
+
+/// <summary> Writes raw DRI frames into an append-only binary capture
+///   log. </summary>
+/// <remarks> Records are collected in a memory buffer and written through
+///   <c>CwclFileStream</c> in large chunks. A sync point is written every
+///   <c>SyncInterval</c> frames (and on <c>Sync</c>/<c>Close</c>). After a
+///   failed write the writer refuses the new records with
+///   <see cref="DRI_E_LOG_WRITE_FAILED" /> until it is reopened: the
+///   reader recovers the file up to the last sync point. The methods
+///   are thread safe. </remarks>
+class CDriCaptureLogWriter
+{
+	DISABLE_COPY(CDriCaptureLogWriter);
+
+private:
+	CwclCriticalSection*		FCS;
+	CwclFileStream*				FStream;
+	std::vector<unsigned char>	FBuffer;
+	size_t						FBufferSize;
+	unsigned __int64			FFrames;
+	unsigned __int64			FLastSync;
+	unsigned __int64			FOffset;
+	unsigned long				FSyncInterval;
+	unsigned long				FUnsynced;
+	// A write failed: the file tail is not aligned any more.
+	bool						FFailed;
+
+	int FlushBuffer();
+	int WriteSyncPoint();
+	void Put(const void* const Data, const size_t Size);
+
+public:
+	/// <summary> Creates new capture log writer. </summary>
+	CDriCaptureLogWriter();
+	/// <summary> Closes the log and frees the writer. </summary>
+	virtual ~CDriCaptureLogWriter();
+
+	/// <summary> Creates new capture log file. </summary>
+	/// <param name="FileName"> The log file name. Existing file is
+	///   overwritten. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Open(const tstring& FileName);
+	/// <summary> Writes the final sync point and closes the log. </summary>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Close();
+
+	/// <summary> Appends a raw DRI frame to the log. </summary>
+	/// <param name="Transport"> The transport the frame was received
+	///   from. </param>
+	/// <param name="Radio"> The receiving radio index. </param>
+	/// <param name="Source"> The source MAC address. </param>
+	/// <param name="Timestamp"> The receive time (FILETIME, UTC). </param>
+	/// <param name="Rssi"> The frame RSSI. </param>
+	/// <param name="Data"> The raw frame bytes. </param>
+	/// <param name="Length"> The raw frame length. Must not exceed
+	///   65535 bytes. </param>
+	/// <param name="Offset"> If the method completed with success on output
+	///   contains the record offset in the log file. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Append(const driCaptureTransport Transport, const unsigned char Radio,
+		const __int64 Source, const __int64 Timestamp, const char Rssi,
+		const unsigned char* const Data, const size_t Length,
+		unsigned __int64& Offset);
+	/// <summary> Appends a raw DRI frame to the log. </summary>
+	/// <param name="Transport"> The transport the frame was received
+	///   from. </param>
+	/// <param name="Source"> The source MAC address. </param>
+	/// <param name="Timestamp"> The receive time (FILETIME, UTC). </param>
+	/// <param name="Rssi"> The frame RSSI. </param>
+	/// <param name="Raw"> The raw frame. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Append(const driCaptureTransport Transport, const __int64 Source,
+		const __int64 Timestamp, const char Rssi, const wclDriRawData& Raw);
+
+	/// <summary> Writes buffered records and a sync point and flushes the file
+	///   to the disk. </summary>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Sync();
+
+	/// <summary> Gets the writer state. </summary>
+	/// <returns> <c>True</c> if the log is opened. </returns>
+	bool GetActive() const;
+	/// <summary> Gets the writer state. </summary>
+	/// <value> <c>True</c> if the log is opened. </value>
+	__declspec(property(get = GetActive)) bool Active;
+
+	/// <summary> Gets the number of frames written. </summary>
+	/// <returns> The frames count. </returns>
+	unsigned __int64 GetFrames() const;
+	/// <summary> Gets the number of frames written. </summary>
+	/// <value> The frames count. </value>
+	__declspec(property(get = GetFrames)) unsigned __int64 Frames;
+
+	/// <summary> Gets the write buffer size. </summary>
+	/// <returns> The buffer size in bytes. </returns>
+	size_t GetBufferSize() const;
+	/// <summary> Sets the write buffer size. </summary>
+	/// <param name="Value"> The buffer size in bytes. Can be changed only
+	///   when the log is closed. </param>
+	void SetBufferSize(const size_t Value);
+	/// <summary> Gets and sets the write buffer size. </summary>
+	/// <value> The buffer size in bytes. </value>
+	__declspec(property(get = GetBufferSize, put = SetBufferSize)) size_t BufferSize;
+
+	/// <summary> Gets the sync interval. </summary>
+	/// <returns> The number of frames between sync points. </returns>
+	unsigned long GetSyncInterval() const;
+	/// <summary> Sets the sync interval. </summary>
+	/// <param name="Value"> The number of frames between sync points. 0
+	///   disables automatic sync points. </param>
+	void SetSyncInterval(const unsigned long Value);
+	/// <summary> Gets and sets the sync interval. </summary>
+	/// <value> The number of frames between sync points. </value>
+	__declspec(property(get = GetSyncInterval, put = SetSyncInterval))
+		unsigned long SyncInterval;
+};
+
+/// <summary> Reads a capture log through a sliding memory-mapped
+///   view. </summary>
+/// <remarks> <para> <c>Open</c> walks the record headers and finds the last
+///   valid sync point: its frame count matches the frames before it and it
+///   links to the previous sync point. Only the records before it are read;
+///   the tail after it may be torn. </para>
+///   <para> Frames are returned without copying: the <c>Data</c> member of
+///   <see cref="driCaptureFrame" /> points into the mapped view. The reader is
+///   not thread safe. </para> </remarks>
+class CDriCaptureLogReader
+{
+	DISABLE_COPY(CDriCaptureLogReader);
+
+private:
+	CDriMappedFile*		FFile;
+	unsigned __int64	FFirst;
+	// The end of the last valid sync record.
+	unsigned __int64	FEnd;
+	unsigned __int64	FFrames;
+
+	void FindEnd();
+
+public:
+	/// <summary> Creates new capture log reader. </summary>
+	CDriCaptureLogReader();
+	/// <summary> Closes the log and frees the reader. </summary>
+	virtual ~CDriCaptureLogReader();
+
+	/// <summary> Opens the capture log file for reading. </summary>
+	/// <param name="FileName"> The log file name. </param>
+	/// <param name="Sequential"> <c>True</c> if the log is mostly read with
+	///   <c>Next</c>, <c>False</c> if it is mostly read with
+	///   <c>ReadAt</c>. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Open(const tstring& FileName, const bool Sequential = true);
+	/// <summary> Closes the capture log. </summary>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Close();
+
+	/// <summary> Reads the frame record at the given offset. </summary>
+	/// <param name="Offset"> The record offset. </param>
+	/// <param name="Frame"> If the method completed with success on output
+	///   contains the frame. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int ReadAt(const unsigned __int64 Offset, driCaptureFrame& Frame);
+	/// <summary> Reads the next frame skipping sync records. </summary>
+	/// <param name="Position"> The read position. Use <c>First</c> to get the
+	///   position of the first record. On output contains the position of the
+	///   next record. </param>
+	/// <param name="Frame"> If the method completed with success on output
+	///   contains the frame. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. When the last valid sync point is
+	///   reached the method returns <see cref="DRI_E_LOG_EOF" />. </returns>
+	int Next(unsigned __int64& Position, driCaptureFrame& Frame);
+
+	/// <summary> Gets the offset of the first record. </summary>
+	/// <returns> The first record offset: after the <c>HeaderSize</c> of
+	///   the file header. </returns>
+	unsigned __int64 First() const;
+
+	/// <summary> Gets the reader state. </summary>
+	/// <returns> <c>True</c> if the log is opened. </returns>
+	bool GetActive() const;
+	/// <summary> Gets the reader state. </summary>
+	/// <value> <c>True</c> if the log is opened. </value>
+	__declspec(property(get = GetActive)) bool Active;
+
+	/// <summary> Gets the log file size. </summary>
+	/// <returns> The file size in bytes. </returns>
+	unsigned __int64 GetSize() const;
+	/// <summary> Gets the log file size. </summary>
+	/// <value> The file size in bytes. </value>
+	__declspec(property(get = GetSize)) unsigned __int64 Size;
+
+	/// <summary> Gets the number of the frames before the last valid sync
+	///   point. </summary>
+	/// <returns> The readable frames count. </returns>
+	unsigned __int64 GetFrames() const;
+	/// <summary> Gets the number of the frames before the last valid sync
+	///   point. </summary>
+	/// <value> The readable frames count. </value>
+	__declspec(property(get = GetFrames)) unsigned __int64 Frames;
+};
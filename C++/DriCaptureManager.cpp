@@ -0,0 +1,797 @@
+
+// DriCaptureManager.cpp : implementation file
+//
+
+#include "stdafx.h"
+#include "DriCaptureManager.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+
+// The scan interval difference between the Bluetooth LE radios
+// (0.625 ms units).
+#define DRI_CAPTURE_INTERVAL_STEP	16
+// The WiFi scan retry delay after a failure (ms).
+#define DRI_CAPTURE_SCAN_RETRY		1000
+// The radio index is stored in a byte.
+#define DRI_CAPTURE_MAX_RADIOS		256
+
+static __int64 MacToInt64(const tstring& Mac)
+{
+	__int64 Result = 0;
+	for (tstring::const_iterator c = Mac.begin(); c != Mac.end(); c++)
+	{
+		if (_istxdigit(*c))
+		{
+			TCHAR Digit[2] = { *c, 0 };
+			Result = (Result << 4) | _tcstol(Digit, NULL, 16);
+		}
+	}
+	return Result;
+}
+
+static tstring Int64ToMac(const __int64 Address)
+{
+	static const TCHAR Digits[] = _T("0123456789ABCDEF");
+
+	tstring Result;
+	for (int i = 5; i >= 0; i--)
+	{
+		unsigned char b = (unsigned char)(Address >> (i * 8));
+		Result += Digits[b >> 4];
+		Result += Digits[b & 0x0F];
+		if (i > 0)
+			Result += _T(':');
+	}
+	return Result;
+}
+
+// Checks that the beacon carries the ASD-STAN vendor specific element.
+static bool IsDriBeacon(const wclWiFiIeRawData& Raw)
+{
+	driIeView Element;
+	return CDriIeIterator::FindVendor(Raw.data(), Raw.size(), DRI_IE_ASD_OUI,
+		DRI_IE_ASD_TYPE, Element);
+}
+
+
+// CDriCaptureManager
+
+CDriCaptureManager::CDriCaptureManager()
+{
+	FLock = new CDriSpinMutex();
+	FEventCS = new CwclCriticalSection();
+	FMessageProcessing = mpSync;
+	FActive = false;
+	FDedupWindow = 2000;
+	FScanStagger = 1000;
+	FDriOnly = false;
+	FLastTick = 0;
+	FBatchSize = 0;
+	FBatchLatency = 100;
+	FBatchStart = 0;
+
+	__hook(&CwclWiFiEvents::OnAcmInterfaceArrival, &FWiFiEvents, &CDriCaptureManager::WiFiEventsAcmInterfaceArrival);
+	__hook(&CwclWiFiEvents::OnAcmInterfaceRemoval, &FWiFiEvents, &CDriCaptureManager::WiFiEventsAcmInterfaceRemoval);
+	__hook(&CwclWiFiEvents::OnAcmScanComplete, &FWiFiEvents, &CDriCaptureManager::WiFiEventsAcmScanComplete);
+	__hook(&CwclWiFiEvents::OnAcmScanFail, &FWiFiEvents, &CDriCaptureManager::WiFiEventsAcmScanFail);
+	__hook(&CwclWiFiEvents::OnMsmRadioStateChange, &FWiFiEvents, &CDriCaptureManager::WiFiEventsMsmRadioStateChange);
+}
+
+CDriCaptureManager::~CDriCaptureManager()
+{
+	Stop();
+
+	__unhook(&FWiFiEvents);
+
+	for (std::vector<driRadio*>::iterator Radio = FRadios.begin(); Radio != FRadios.end(); Radio++)
+		delete (*Radio);
+
+	delete FEventCS;
+	delete FLock;
+}
+
+CDriCaptureManager::driRadio* CDriCaptureManager::AddRadio(
+	const driCaptureTransport Transport, const tstring& Name)
+{
+	if (FRadios.size() >= DRI_CAPTURE_MAX_RADIOS)
+		return NULL;
+
+	driRadio* Radio = new driRadio;
+	Radio->Index = (unsigned char)FRadios.size();
+	Radio->Statistics.Transport = Transport;
+	Radio->Statistics.Name = Name;
+	Radio->Statistics.Active = false;
+	Radio->Statistics.Frames = 0;
+	Radio->Statistics.Unique = 0;
+	Radio->Statistics.Rate = 0;
+	Radio->Statistics.UniqueRate = 0;
+	Radio->LastFrames = 0;
+	Radio->LastUnique = 0;
+	Radio->Watcher = NULL;
+	Radio->Controller = NULL;
+	Radio->IfaceId = wclWiFi::GUID_NULL;
+	Radio->NextScan = 0;
+	Radio->Scanning = false;
+
+	FLock->Enter();
+	FRadios.push_back(Radio);
+	FLock->Leave();
+
+	return Radio;
+}
+
+CDriCaptureManager::driRadio* CDriCaptureManager::FindWiFi(const GUID& IfaceId)
+{
+	for (std::vector<driRadio*>::iterator Radio = FRadios.begin(); Radio != FRadios.end(); Radio++)
+	{
+		if ((*Radio)->Statistics.Transport == ctWiFi && (*Radio)->IfaceId == IfaceId)
+			return (*Radio);
+	}
+	return NULL;
+}
+
+bool CDriCaptureManager::IsDuplicate(const __int64 Source, const wclDriRawData& Raw)
+{
+	// FNV-1a over the source address and the frame content.
+	unsigned __int64 Key = 0xCBF29CE484222325ULL;
+	for (int i = 0; i < 8; i++)
+	{
+		Key ^= (unsigned char)(Source >> (i * 8));
+		Key *= 0x00000100000001B3ULL;
+	}
+	for (wclDriRawData::const_iterator b = Raw.begin(); b != Raw.end(); b++)
+	{
+		Key ^= (*b);
+		Key *= 0x00000100000001B3ULL;
+	}
+
+	DWORD Now = GetTickCount();
+	std::map<unsigned __int64, DWORD>::iterator Seen = FSeen.find(Key);
+	if (Seen == FSeen.end())
+	{
+		FSeen.insert(std::make_pair(Key, Now));
+		return false;
+	}
+
+	bool Result = (Now - Seen->second <= FDedupWindow);
+	// A frame repeated without a pause (the WiFi BSS cache) stays a
+	// duplicate.
+	Seen->second = Now;
+	return Result;
+}
+
+void CDriCaptureManager::Deliver(driRadio* const Radio, driFrame& Frame)
+{
+	Frame.Radio = Radio->Index;
+
+	FLock->Enter();
+	Radio->Statistics.Frames++;
+	bool Duplicate = IsDuplicate(Frame.Source, *Frame.Raw);
+	if (!Duplicate)
+		Radio->Statistics.Unique++;
+	FLock->Leave();
+
+	if (!Duplicate)
+	{
+		if (FBatchSize == 0)
+			DoDriFrame(Frame);
+		else
+		{
+			AddToBatch(Frame);
+			FlushBatch(FBatch.size() >= FBatchSize);
+		}
+	}
+}
+
+void CDriCaptureManager::AddToBatch(const driFrame& Frame)
+{
+	if (FBatch.size() == 0)
+		FBatchStart = GetTickCount();
+
+	driFrameRecord Record;
+	Record.Transport = Frame.Transport;
+	Record.Radio = Frame.Radio;
+	Record.Rssi = Frame.Rssi;
+	Record.Source = Frame.Source;
+	Record.Timestamp = Frame.Timestamp;
+	Record.Offset = (unsigned long)FBatchData.size();
+	Record.Length = (unsigned long)Frame.Raw->size();
+	FBatchData.insert(FBatchData.end(), Frame.Raw->begin(), Frame.Raw->end());
+
+	Record.SsidOffset = 0;
+	Record.SsidLength = (unsigned long)Frame.Ssid.length();
+	if (Record.SsidLength > 0)
+	{
+		// Align the name so it can be read in place.
+		size_t Size = FBatchData.size();
+		Size = (Size + sizeof(TCHAR) - 1) / sizeof(TCHAR) * sizeof(TCHAR);
+		Record.SsidOffset = (unsigned long)Size;
+
+		const unsigned char* Ssid = (const unsigned char*)Frame.Ssid.c_str();
+		FBatchData.resize(Size);
+		FBatchData.insert(FBatchData.end(), Ssid, Ssid + Record.SsidLength * sizeof(TCHAR));
+	}
+
+	FBatch.push_back(Record);
+}
+
+void CDriCaptureManager::FlushBatch(const bool Force)
+{
+	if (FBatch.size() == 0)
+		return;
+	if (!Force && GetTickCount() - FBatchStart < FBatchLatency)
+		return;
+
+	const unsigned char* Data = NULL;
+	if (FBatchData.size() > 0)
+		Data = &FBatchData[0];
+	DoDriFrames(&FBatch[0], FBatch.size(), Data);
+
+	// Keep the memory for the next batch.
+	FBatch.clear();
+	FBatchData.clear();
+}
+
+void CDriCaptureManager::PruneSeen()
+{
+	DWORD Now = GetTickCount();
+
+	FLock->Enter();
+	std::map<unsigned __int64, DWORD>::iterator Seen = FSeen.begin();
+	while (Seen != FSeen.end())
+	{
+		if (Now - Seen->second > FDedupWindow)
+			Seen = FSeen.erase(Seen);
+		else
+			Seen++;
+	}
+	FLock->Leave();
+}
+
+int CDriCaptureManager::StartBluetooth()
+{
+	wclBluetoothApis Apis;
+	Apis.insert(baMicrosoft);
+	Apis.insert(baBled112);
+	Apis.insert(baBlueSoleil);
+	Apis.insert(baToshiba);
+
+	FBluetoothManager.MessageProcessing = FMessageProcessing;
+	int Res = FBluetoothManager.Open(Apis);
+	if (Res != WCL_E_SUCCESS)
+		return Res;
+
+	unsigned short Offset = 0;
+	size_t Started = 0;
+	for (size_t i = 0; i < FBluetoothManager.GetCount(); i++)
+	{
+		CwclBluetoothRadio* Radio = FBluetoothManager.GetRadios(i);
+		if (Radio == NULL || !Radio->GetAvailable() || !Radio->GetLeSupported())
+			continue;
+
+		tstring Name = Radio->GetApiName();
+		__int64 Address;
+		if (Radio->GetAddress(Address) == WCL_E_SUCCESS)
+			Name += _T(" ") + Int64ToMac(Address);
+
+		driRadio* Capture = AddRadio(ctBluetooth, Name);
+		if (Capture == NULL)
+			break;
+
+		Capture->Watcher = new CwclBluetoothLeBeaconWatcher();
+		Capture->Controller = new CDriScanController(Capture->Watcher);
+		Capture->Controller->SetIntervalOffset(Offset);
+		Capture->Controller->SetDriOnly(FDriOnly);
+
+		__hook(&CwclBluetoothLeBeaconWatcher::OnDriAsdMessage, Capture->Watcher, &CDriCaptureManager::WatcherDriAsdMessage);
+		__hook(&CDriScanController::OnProfileChanged, Capture->Controller, &CDriCaptureManager::ControllerProfileChanged);
+
+		if (Capture->Controller->Start(Radio) == WCL_E_SUCCESS)
+		{
+			Capture->Statistics.Active = true;
+			Offset += DRI_CAPTURE_INTERVAL_STEP;
+			Started++;
+
+			DoRadioStateChanged(Capture->Index, true);
+		}
+	}
+
+	if (Started == 0)
+	{
+		StopBluetooth();
+		return DRI_E_CAP_NO_RADIOS;
+	}
+	return WCL_E_SUCCESS;
+}
+
+void CDriCaptureManager::StopBluetooth()
+{
+	for (std::vector<driRadio*>::iterator Radio = FRadios.begin(); Radio != FRadios.end(); Radio++)
+	{
+		if ((*Radio)->Controller != NULL)
+		{
+			(*Radio)->Controller->Stop();
+
+			__unhook((*Radio)->Controller);
+			__unhook((*Radio)->Watcher);
+
+			delete (*Radio)->Controller;
+			delete (*Radio)->Watcher;
+			(*Radio)->Controller = NULL;
+			(*Radio)->Watcher = NULL;
+
+			if ((*Radio)->Statistics.Active)
+			{
+				(*Radio)->Statistics.Active = false;
+				DoRadioStateChanged((*Radio)->Index, false);
+			}
+		}
+	}
+
+	FBluetoothManager.Close();
+}
+
+int CDriCaptureManager::StartWiFi()
+{
+	int Res = FWiFiClient.Open();
+	if (Res != WCL_E_SUCCESS)
+		return Res;
+
+	FWiFiEvents.MessageProcessing = FMessageProcessing;
+	Res = FWiFiEvents.Open();
+	if (Res != WCL_E_SUCCESS)
+	{
+		FWiFiClient.Close();
+		return Res;
+	}
+
+	EnumInterfaces();
+
+	for (std::vector<driRadio*>::iterator Radio = FRadios.begin(); Radio != FRadios.end(); Radio++)
+	{
+		if ((*Radio)->Statistics.Transport == ctWiFi && (*Radio)->Statistics.Active)
+			return WCL_E_SUCCESS;
+	}
+
+	StopWiFi();
+	return DRI_E_CAP_NO_RADIOS;
+}
+
+void CDriCaptureManager::StopWiFi()
+{
+	FWiFiEvents.Close();
+	FWiFiClient.Close();
+
+	for (std::vector<driRadio*>::iterator Radio = FRadios.begin(); Radio != FRadios.end(); Radio++)
+	{
+		if ((*Radio)->Statistics.Transport == ctWiFi && (*Radio)->Statistics.Active)
+		{
+			(*Radio)->Statistics.Active = false;
+			(*Radio)->Scanning = false;
+			DoRadioStateChanged((*Radio)->Index, false);
+		}
+	}
+}
+
+void CDriCaptureManager::EnumInterfaces()
+{
+	wclWiFiInterfaces Ifaces;
+	if (FWiFiClient.EnumInterfaces(Ifaces) != WCL_E_SUCCESS)
+		return;
+
+	size_t Scanning = 0;
+	for (std::vector<driRadio*>::iterator Radio = FRadios.begin(); Radio != FRadios.end(); Radio++)
+	{
+		if ((*Radio)->Statistics.Transport == ctWiFi && (*Radio)->Statistics.Active)
+			Scanning++;
+	}
+
+	DWORD Now = GetTickCount();
+	for (wclWiFiInterfaces::iterator Iface = Ifaces.begin(); Iface != Ifaces.end(); Iface++)
+	{
+		driRadio* Radio = FindWiFi(Iface->Id);
+		if (Radio != NULL && Radio->Statistics.Active)
+			continue;
+		if (!InterfaceEnabled(Iface->Id))
+			continue;
+
+		if (Radio == NULL)
+		{
+			Radio = AddRadio(ctWiFi, Iface->Description);
+			if (Radio == NULL)
+				break;
+			Radio->IfaceId = Iface->Id;
+		}
+
+		// The interfaces start one after another so their channel sweeps do
+		// not run in lock step.
+		Radio->Statistics.Active = true;
+		Radio->Scanning = false;
+		Radio->NextScan = Now + (DWORD)(FScanStagger * Scanning);
+		Scanning++;
+
+		DoRadioStateChanged(Radio->Index, true);
+	}
+}
+
+bool CDriCaptureManager::InterfaceEnabled(const GUID& IfaceId)
+{
+	bool Result = false;
+
+	CwclWiFiInterface* Iface = new CwclWiFiInterface(IfaceId);
+	if (Iface->Open() == WCL_E_SUCCESS)
+	{
+		wclWiFiPhyRadioStates States;
+		if (Iface->GetRadioState(States) == WCL_E_SUCCESS)
+		{
+			for (wclWiFiPhyRadioStates::iterator State = States.begin(); State != States.end(); State++)
+			{
+				Result = (State->SoftwareState == rsOn && State->HardwareState == rsOn);
+				if (!Result)
+					break;
+			}
+		}
+		Iface->Close();
+	}
+	delete Iface;
+
+	return Result;
+}
+
+void CDriCaptureManager::ReadBss(driRadio* const Radio)
+{
+	// clear() keeps the capacity of the radio's list.
+	wclWiFiBssArray& BssList = Radio->BssList;
+	BssList.clear();
+	if (FWiFiClient.EnumBss(Radio->IfaceId, _T(""), bssAny, true, BssList) != WCL_E_SUCCESS)
+		return;
+
+	// One frame for the whole list so the name string memory is reused.
+	driFrame Frame;
+	Frame.Transport = ctWiFi;
+	for (wclWiFiBssArray::iterator Bss = BssList.begin(); Bss != BssList.end(); Bss++)
+	{
+		if (IsDriBeacon(Bss->IeRaw))
+		{
+			Frame.Source = MacToInt64(Bss->Mac);
+			Frame.Timestamp = (__int64)Bss->HostTimestamp;
+			Frame.Rssi = (char)max(-128, min(127, Bss->Rssi));
+			Frame.Ssid.assign(Bss->Ssid);
+			Frame.Raw = &Bss->IeRaw;
+			Deliver(Radio, Frame);
+		}
+	}
+}
+
+void CDriCaptureManager::WatcherDriAsdMessage(void* Sender, const __int64 Address,
+	const __int64 Timestamp, const char Rssi, const wclDriRawData& Raw)
+{
+	FEventCS->Enter();
+	for (std::vector<driRadio*>::iterator Radio = FRadios.begin(); Radio != FRadios.end(); Radio++)
+	{
+		if ((*Radio)->Watcher == Sender)
+		{
+			driFrame Frame;
+			Frame.Transport = ctBluetooth;
+			Frame.Source = Address;
+			Frame.Timestamp = Timestamp;
+			Frame.Rssi = Rssi;
+			Frame.Raw = &Raw;
+			Deliver(*Radio, Frame);
+			break;
+		}
+	}
+	FEventCS->Leave();
+}
+
+void CDriCaptureManager::ControllerProfileChanged(void* Sender,
+	const driScanMetrics& Metrics)
+{
+	FEventCS->Enter();
+	for (std::vector<driRadio*>::iterator Radio = FRadios.begin(); Radio != FRadios.end(); Radio++)
+	{
+		if ((*Radio)->Controller == Sender)
+		{
+			DoScanProfileChanged((*Radio)->Index, Metrics);
+			break;
+		}
+	}
+	FEventCS->Leave();
+}
+
+void CDriCaptureManager::WiFiEventsAcmInterfaceArrival(void* Sender,
+	const GUID& IfaceId)
+{
+	UNREFERENCED_PARAMETER(Sender);
+	UNREFERENCED_PARAMETER(IfaceId);
+
+	FEventCS->Enter();
+	if (FActive)
+		EnumInterfaces();
+	FEventCS->Leave();
+}
+
+void CDriCaptureManager::WiFiEventsAcmInterfaceRemoval(void* Sender,
+	const GUID& IfaceId)
+{
+	UNREFERENCED_PARAMETER(Sender);
+
+	FEventCS->Enter();
+	driRadio* Radio = FindWiFi(IfaceId);
+	if (Radio != NULL && Radio->Statistics.Active)
+	{
+		Radio->Statistics.Active = false;
+		Radio->Scanning = false;
+		DoRadioStateChanged(Radio->Index, false);
+	}
+	FEventCS->Leave();
+}
+
+void CDriCaptureManager::WiFiEventsAcmScanComplete(void* Sender,
+	const GUID& IfaceId)
+{
+	UNREFERENCED_PARAMETER(Sender);
+
+	FEventCS->Enter();
+	driRadio* Radio = FindWiFi(IfaceId);
+	if (Radio != NULL && Radio->Statistics.Active)
+	{
+		Radio->Scanning = false;
+		ReadBss(Radio);
+
+		// Rescan at once to keep the interface listening.
+		if (FWiFiClient.Scan(IfaceId) == WCL_E_SUCCESS)
+			Radio->Scanning = true;
+		else
+			Radio->NextScan = GetTickCount() + DRI_CAPTURE_SCAN_RETRY;
+	}
+	FEventCS->Leave();
+}
+
+void CDriCaptureManager::WiFiEventsAcmScanFail(void* Sender, const GUID& IfaceId,
+	const int Reason)
+{
+	UNREFERENCED_PARAMETER(Sender);
+	UNREFERENCED_PARAMETER(Reason);
+
+	FEventCS->Enter();
+	driRadio* Radio = FindWiFi(IfaceId);
+	if (Radio != NULL && Radio->Statistics.Active)
+	{
+		Radio->Scanning = false;
+		Radio->NextScan = GetTickCount() + DRI_CAPTURE_SCAN_RETRY;
+	}
+	FEventCS->Leave();
+}
+
+void CDriCaptureManager::WiFiEventsMsmRadioStateChange(void* Sender,
+	const GUID& IfaceId, const wclWiFiPhyRadioState& State)
+{
+	UNREFERENCED_PARAMETER(Sender);
+
+	if (!FActive)
+		return;
+
+	FEventCS->Enter();
+	if (State.SoftwareState == rsOff || State.HardwareState == rsOff)
+	{
+		driRadio* Radio = FindWiFi(IfaceId);
+		if (Radio != NULL && Radio->Statistics.Active)
+		{
+			Radio->Statistics.Active = false;
+			Radio->Scanning = false;
+			DoRadioStateChanged(Radio->Index, false);
+		}
+	}
+	else
+		EnumInterfaces();
+	FEventCS->Leave();
+}
+
+void CDriCaptureManager::DoDriFrame(const driFrame& Frame)
+{
+	OnDriFrame(this, Frame);
+}
+
+void CDriCaptureManager::DoDriFrames(const driFrameRecord* const Records,
+	const size_t Count, const unsigned char* const Data)
+{
+	OnDriFrames(this, Records, Count, Data);
+}
+
+void CDriCaptureManager::DoRadioStateChanged(const unsigned char Radio,
+	const bool Active)
+{
+	OnRadioStateChanged(this, Radio, Active);
+}
+
+void CDriCaptureManager::DoScanProfileChanged(const unsigned char Radio,
+	const driScanMetrics& Metrics)
+{
+	OnScanProfileChanged(this, Radio, Metrics);
+}
+
+int CDriCaptureManager::Start()
+{
+	if (FActive)
+		return DRI_E_CAP_ACTIVE;
+
+	FLock->Enter();
+	for (std::vector<driRadio*>::iterator Radio = FRadios.begin(); Radio != FRadios.end(); Radio++)
+		delete (*Radio);
+	FRadios.clear();
+	FSeen.clear();
+	FLock->Leave();
+
+	FActive = true;
+
+	int BluetoothRes = StartBluetooth();
+	int WiFiRes = StartWiFi();
+	if (BluetoothRes != WCL_E_SUCCESS && WiFiRes != WCL_E_SUCCESS)
+	{
+		FActive = false;
+		return DRI_E_CAP_NO_RADIOS;
+	}
+
+	FLastTick = GetTickCount();
+	return WCL_E_SUCCESS;
+}
+
+int CDriCaptureManager::Stop()
+{
+	if (!FActive)
+		return DRI_E_CAP_NOT_ACTIVE;
+
+	StopWiFi();
+	StopBluetooth();
+
+	FEventCS->Enter();
+	FlushBatch(true);
+	FActive = false;
+	FEventCS->Leave();
+
+	FLock->Enter();
+	FSeen.clear();
+	for (std::vector<driRadio*>::iterator Radio = FRadios.begin(); Radio != FRadios.end(); Radio++)
+	{
+		(*Radio)->Statistics.Rate = 0;
+		(*Radio)->Statistics.UniqueRate = 0;
+	}
+	FLock->Leave();
+
+	return WCL_E_SUCCESS;
+}
+
+void CDriCaptureManager::Tick()
+{
+	if (!FActive)
+		return;
+
+	// A scan controller can restart its watcher and wait for the watcher
+	// thread, so the controllers are ticked without the event lock.
+	std::vector<CDriScanController*> Controllers;
+
+	DWORD Now = GetTickCount();
+	FEventCS->Enter();
+	for (std::vector<driRadio*>::iterator Radio = FRadios.begin(); Radio != FRadios.end(); Radio++)
+	{
+		if ((*Radio)->Controller != NULL)
+			Controllers.push_back((*Radio)->Controller);
+		else
+		{
+			if ((*Radio)->Statistics.Transport == ctWiFi && (*Radio)->Statistics.Active &&
+				!(*Radio)->Scanning && (LONG)(Now - (*Radio)->NextScan) >= 0)
+			{
+				if (FWiFiClient.Scan((*Radio)->IfaceId) == WCL_E_SUCCESS)
+					(*Radio)->Scanning = true;
+				else
+					(*Radio)->NextScan = Now + DRI_CAPTURE_SCAN_RETRY;
+			}
+		}
+	}
+	FEventCS->Leave();
+
+	for (std::vector<CDriScanController*>::iterator Controller = Controllers.begin(); Controller != Controllers.end(); Controller++)
+		(*Controller)->Tick();
+
+	DWORD Elapsed = Now - FLastTick;
+	if (Elapsed > 0)
+	{
+		FLock->Enter();
+		for (std::vector<driRadio*>::iterator Radio = FRadios.begin(); Radio != FRadios.end(); Radio++)
+		{
+			driRadioStatistics& Statistics = (*Radio)->Statistics;
+			Statistics.Rate = (double)(Statistics.Frames - (*Radio)->LastFrames) * 1000 / Elapsed;
+			Statistics.UniqueRate = (double)(Statistics.Unique - (*Radio)->LastUnique) * 1000 / Elapsed;
+			(*Radio)->LastFrames = Statistics.Frames;
+			(*Radio)->LastUnique = Statistics.Unique;
+		}
+		FLock->Leave();
+		FLastTick = Now;
+	}
+
+	PruneSeen();
+}
+
+void CDriCaptureManager::Flush()
+{
+	FEventCS->Enter();
+	FlushBatch(false);
+	FEventCS->Leave();
+}
+
+void CDriCaptureManager::GetStatistics(
+	std::vector<driRadioStatistics>& Statistics) const
+{
+	FLock->Enter();
+	Statistics.clear();
+	for (std::vector<driRadio*>::const_iterator Radio = FRadios.begin(); Radio != FRadios.end(); Radio++)
+		Statistics.push_back((*Radio)->Statistics);
+	FLock->Leave();
+}
+
+bool CDriCaptureManager::GetActive() const
+{
+	return FActive;
+}
+
+unsigned long CDriCaptureManager::GetDedupWindow() const
+{
+	return FDedupWindow;
+}
+
+void CDriCaptureManager::SetDedupWindow(const unsigned long Value)
+{
+	FLock->Enter();
+	FDedupWindow = Value;
+	FLock->Leave();
+}
+
+bool CDriCaptureManager::GetDriOnly() const
+{
+	return FDriOnly;
+}
+
+void CDriCaptureManager::SetDriOnly(const bool Value)
+{
+	FDriOnly = Value;
+}
+
+unsigned long CDriCaptureManager::GetBatchSize() const
+{
+	return FBatchSize;
+}
+
+void CDriCaptureManager::SetBatchSize(const unsigned long Value)
+{
+	if (Value != FBatchSize)
+	{
+		FEventCS->Enter();
+		FlushBatch(true);
+		FBatchSize = Value;
+		FEventCS->Leave();
+	}
+}
+
+unsigned long CDriCaptureManager::GetBatchLatency() const
+{
+	return FBatchLatency;
+}
+
+void CDriCaptureManager::SetBatchLatency(const unsigned long Value)
+{
+	FBatchLatency = Value;
+}
+
+wclMessageProcessingMethod CDriCaptureManager::GetMessageProcessing() const
+{
+	return FMessageProcessing;
+}
+
+void CDriCaptureManager::SetMessageProcessing(const wclMessageProcessingMethod Value)
+{
+	FMessageProcessing = Value;
+}
@@ -0,0 +1,363 @@
+
+// DriCaptureManager.h : header file
+//
+
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include "wclHelpers.h"
+#include "wclSync.h"
+#include "wclWiFi.h"
+#include "wclBluetooth.h"
+#include "wclDriCommon.h"
+
+#include "DriErrors.h"
+#include "DriSync.h"
+#include "DriCaptureLog.h"
+#include "DriIe.h"
+#include "DriScanController.h"
+
+using namespace wclCommon;
+using namespace wclSync;
+using namespace wclWiFi;
+using namespace wclBluetooth;
+using namespace wclDri;
+
+/// <summary> A DRI frame delivered by the capture manager. </summary>
+typedef struct
+{
+	driCaptureTransport		Transport;
+	/// <summary> The receiving radio index (see
+	///   <c>GetStatistics</c>). </summary>
+	unsigned char			Radio;
+	/// <summary> The source MAC address. </summary>
+	__int64					Source;
+	/// <summary> The receive time (FILETIME, UTC). </summary>
+	__int64					Timestamp;
+	char					Rssi;
+	/// <summary> The network name for WiFi frames. Empty for
+	///   Bluetooth. </summary>
+	tstring					Ssid;
+	/// <summary> The raw frame: the ASD service data for Bluetooth or the
+	///   beacon information elements for WiFi. Valid only within the event
+	///   handler. </summary>
+	const wclDriRawData*	Raw;
+} driFrame;
+
+/// <summary> A DRI frame record of a frames batch. </summary>
+/// <seealso cref="CDriCaptureManager::OnDriFrames" />
+typedef struct
+{
+	driCaptureTransport		Transport;
+	/// <summary> The receiving radio index. </summary>
+	unsigned char			Radio;
+	char					Rssi;
+	/// <summary> The source MAC address. </summary>
+	__int64					Source;
+	/// <summary> The receive time (FILETIME, UTC). </summary>
+	__int64					Timestamp;
+	/// <summary> The raw frame offset in the batch buffer. </summary>
+	unsigned long			Offset;
+	/// <summary> The raw frame length in bytes. </summary>
+	unsigned long			Length;
+	/// <summary> The network name offset in the batch buffer (aligned to
+	///   <c>TCHAR</c>). </summary>
+	unsigned long			SsidOffset;
+	/// <summary> The network name length in characters (not null
+	///   terminated). 0 for Bluetooth. </summary>
+	unsigned long			SsidLength;
+} driFrameRecord;
+
+/// <summary> The per-radio capture statistics. </summary>
+typedef struct
+{
+	driCaptureTransport		Transport;
+	/// <summary> The radio (API and address) or WiFi interface
+	///   description. </summary>
+	tstring					Name;
+	/// <summary> <c>True</c> if the radio is capturing. </summary>
+	bool					Active;
+	/// <summary> The DRI frames received by the radio. </summary>
+	unsigned __int64		Frames;
+	/// <summary> The frames the radio received first (not
+	///   duplicates). </summary>
+	unsigned __int64		Unique;
+	/// <summary> The frames per second during the last
+	///   <c>Tick</c> period. </summary>
+	double					Rate;
+	/// <summary> The unique frames per second during the last
+	///   <c>Tick</c> period. </summary>
+	double					UniqueRate;
+} driRadioStatistics;
+
+/// <summary> Captures DRI frames from all the Bluetooth LE radios and WiFi
+///   interfaces in parallel. </summary>
+/// <remarks> <para> Every Bluetooth LE radio (including BLED112 dongles) runs
+///   its own beacon watcher tuned by a <see cref="CDriScanController" />.
+///   The radios use different scan intervals so their advertising channel
+///   rotation drifts apart and at most moments they listen on different
+///   channels. Every enabled WiFi interface scans continuously; the scans of
+///   different interfaces are started with a delay so their channel sweeps do
+///   not run in lock step. </para>
+///   <para> Frames received by several radios (and the WiFi BSS entries
+///   reported again by the next scans) are merged: a frame with the same
+///   source and content seen within <c>DedupWindow</c> milliseconds is
+///   delivered once through <c>OnDriFrame</c>. </para>
+///   <para> When <c>BatchSize</c> is not 0 the frames are collected and
+///   delivered by <c>OnDriFrames</c> as an array of records referencing one
+///   shared buffer instead. The batch is delivered when it has
+///   <c>BatchSize</c> frames or when its first frame is older than
+///   <c>BatchLatency</c> milliseconds (checked on every frame and by
+///   <c>Flush</c>). The record and buffer memory is reused by the next
+///   batches. </para>
+///   <para> The manager must be created and used from the application's main
+///   thread. <c>Tick</c> must be called periodically (once a
+///   second). </para>
+///   <para> With <c>MessageProcessing</c> set to <c>mpAsync</c> the radio
+///   events come from the library threads and no message loop is needed
+///   (services and console applications). The event handlers, <c>Tick</c> and
+///   <c>Flush</c> are serialized by an internal lock so the
+///   <c>OnDriFrame</c>, <c>OnDriFrames</c>, <c>OnRadioStateChanged</c> and
+///   <c>OnScanProfileChanged</c> handlers never run at the same time but can
+///   run in any thread. </para> </remarks>
+class CDriCaptureManager
+{
+	DISABLE_COPY(CDriCaptureManager);
+
+private:
+	typedef struct
+	{
+		unsigned char					Index;
+		driRadioStatistics				Statistics;
+		unsigned __int64				LastFrames;
+		unsigned __int64				LastUnique;
+
+		CwclBluetoothLeBeaconWatcher*	Watcher;
+		CDriScanController*				Controller;
+
+		GUID							IfaceId;
+		DWORD							NextScan;
+		bool							Scanning;
+		// The BSS list of the last scan. Kept so the array memory is reused
+		// by the next scans.
+		wclWiFiBssArray					BssList;
+	} driRadio;
+
+	CDriSpinMutex*						FLock;
+	// Serializes the radio events with Tick and Flush.
+	CwclCriticalSection*				FEventCS;
+	wclMessageProcessingMethod			FMessageProcessing;
+	CwclBluetoothManager				FBluetoothManager;
+	CwclWiFiClient						FWiFiClient;
+	CwclWiFiEvents						FWiFiEvents;
+
+	bool								FActive;
+	std::vector<driRadio*>				FRadios;
+	std::map<unsigned __int64, DWORD>	FSeen;
+	unsigned long						FDedupWindow;
+	unsigned long						FScanStagger;
+	bool								FDriOnly;
+	DWORD								FLastTick;
+
+	std::vector<driFrameRecord>			FBatch;
+	std::vector<unsigned char>			FBatchData;
+	unsigned long						FBatchSize;
+	unsigned long						FBatchLatency;
+	DWORD								FBatchStart;
+
+	driRadio* AddRadio(const driCaptureTransport Transport, const tstring& Name);
+	driRadio* FindWiFi(const GUID& IfaceId);
+	bool IsDuplicate(const __int64 Source, const wclDriRawData& Raw);
+	void Deliver(driRadio* const Radio, driFrame& Frame);
+	void AddToBatch(const driFrame& Frame);
+	void FlushBatch(const bool Force);
+	void PruneSeen();
+
+	int StartBluetooth();
+	void StopBluetooth();
+	int StartWiFi();
+	void StopWiFi();
+	void EnumInterfaces();
+	bool InterfaceEnabled(const GUID& IfaceId);
+	void ReadBss(driRadio* const Radio);
+
+	void WatcherDriAsdMessage(void* Sender, const __int64 Address,
+		const __int64 Timestamp, const char Rssi, const wclDriRawData& Raw);
+	void ControllerProfileChanged(void* Sender, const driScanMetrics& Metrics);
+
+	void WiFiEventsAcmInterfaceArrival(void* Sender, const GUID& IfaceId);
+	void WiFiEventsAcmInterfaceRemoval(void* Sender, const GUID& IfaceId);
+	void WiFiEventsAcmScanComplete(void* Sender, const GUID& IfaceId);
+	void WiFiEventsAcmScanFail(void* Sender, const GUID& IfaceId, const int Reason);
+	void WiFiEventsMsmRadioStateChange(void* Sender, const GUID& IfaceId,
+		const wclWiFiPhyRadioState& State);
+
+protected:
+	/// <summary> Fires the <c>OnDriFrame</c> event. </summary>
+	/// <param name="Frame"> The DRI frame. </param>
+	virtual void DoDriFrame(const driFrame& Frame);
+	/// <summary> Fires the <c>OnDriFrames</c> event. </summary>
+	/// <param name="Records"> The frame records. </param>
+	/// <param name="Count"> The number of records. </param>
+	/// <param name="Data"> The batch buffer. </param>
+	virtual void DoDriFrames(const driFrameRecord* const Records,
+		const size_t Count, const unsigned char* const Data);
+	/// <summary> Fires the <c>OnRadioStateChanged</c> event. </summary>
+	/// <param name="Radio"> The radio index. </param>
+	/// <param name="Active"> <c>True</c> if the radio started
+	///   capturing. </param>
+	virtual void DoRadioStateChanged(const unsigned char Radio, const bool Active);
+	/// <summary> Fires the <c>OnScanProfileChanged</c> event. </summary>
+	/// <param name="Radio"> The radio index. </param>
+	/// <param name="Metrics"> The scan controller metrics. </param>
+	virtual void DoScanProfileChanged(const unsigned char Radio,
+		const driScanMetrics& Metrics);
+
+public:
+	/// <summary> Creates new capture manager. </summary>
+	CDriCaptureManager();
+	/// <summary> Stops capturing and frees the object. </summary>
+	virtual ~CDriCaptureManager();
+
+	/// <summary> Starts capturing on all the available radios and
+	///   interfaces. </summary>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	/// <remarks> The method succeeds if at least one radio or interface
+	///   started. </remarks>
+	int Start();
+	/// <summary> Stops capturing. </summary>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Stop();
+
+	/// <summary> Runs the periodic tasks: scan tuning, delayed WiFi scans,
+	///   rates calculation and the duplicates table cleanup. </summary>
+	void Tick();
+
+	/// <summary> Delivers the collected frames if the batch latency
+	///   expired. </summary>
+	/// <remarks> Call the method more often than <c>BatchLatency</c> so a
+	///   batch is not delayed when no more frames come. </remarks>
+	void Flush();
+
+	/// <summary> Gets the per-radio statistics. </summary>
+	/// <param name="Statistics"> On output contains the statistics. The index
+	///   in the array is the radio index. </param>
+	void GetStatistics(std::vector<driRadioStatistics>& Statistics) const;
+
+	/// <summary> Gets the capture state. </summary>
+	/// <returns> <c>True</c> if capturing. </returns>
+	bool GetActive() const;
+	/// <summary> Gets the capture state. </summary>
+	/// <value> <c>True</c> if capturing. </value>
+	__declspec(property(get = GetActive)) bool Active;
+
+	/// <summary> Gets the duplicates window. </summary>
+	/// <returns> The window in milliseconds. </returns>
+	unsigned long GetDedupWindow() const;
+	/// <summary> Sets the duplicates window. </summary>
+	/// <param name="Value"> The window in milliseconds. </param>
+	void SetDedupWindow(const unsigned long Value);
+	/// <summary> Gets and sets the duplicates window. </summary>
+	/// <value> The window in milliseconds. </value>
+	__declspec(property(get = GetDedupWindow, put = SetDedupWindow))
+		unsigned long DedupWindow;
+
+	/// <summary> Gets the DRI only mode of the Bluetooth LE radios. </summary>
+	/// <returns> <c>True</c> if the radios handle only the DRI
+	///   advertisements. </returns>
+	bool GetDriOnly() const;
+	/// <summary> Sets the DRI only mode of the Bluetooth LE radios. </summary>
+	/// <param name="Value"> <c>True</c> to skip all the other
+	///   advertisements. <c>False</c> (the default) to count them for the scan
+	///   controller congestion metrics and the <c>MaxAdvertRate</c> budget.
+	///   Applied on the next <c>Start</c>. </param>
+	/// <seealso cref="CDriScanController::DriOnly" />
+	void SetDriOnly(const bool Value);
+	/// <summary> Gets and sets the DRI only mode of the Bluetooth LE
+	///   radios. </summary>
+	/// <value> <c>True</c> if the radios handle only the DRI
+	///   advertisements. </value>
+	__declspec(property(get = GetDriOnly, put = SetDriOnly)) bool DriOnly;
+
+	/// <summary> Gets the batch size. </summary>
+	/// <returns> The maximum number of frames in a batch. 0 if the batching
+	///   is off. </returns>
+	unsigned long GetBatchSize() const;
+	/// <summary> Sets the batch size. </summary>
+	/// <param name="Value"> The maximum number of frames in a batch. 0 (the
+	///   default) to deliver every frame through <c>OnDriFrame</c>. The
+	///   collected frames are delivered at once. </param>
+	void SetBatchSize(const unsigned long Value);
+	/// <summary> Gets and sets the batch size. </summary>
+	/// <value> The maximum number of frames in a batch. 0 if the batching is
+	///   off. </value>
+	__declspec(property(get = GetBatchSize, put = SetBatchSize))
+		unsigned long BatchSize;
+
+	/// <summary> Gets the batch latency. </summary>
+	/// <returns> The maximum age of the collected frames in
+	///   milliseconds. </returns>
+	unsigned long GetBatchLatency() const;
+	/// <summary> Sets the batch latency. </summary>
+	/// <param name="Value"> The maximum age of the collected frames in
+	///   milliseconds. </param>
+	void SetBatchLatency(const unsigned long Value);
+	/// <summary> Gets and sets the batch latency. </summary>
+	/// <value> The maximum age of the collected frames in
+	///   milliseconds. </value>
+	__declspec(property(get = GetBatchLatency, put = SetBatchLatency))
+		unsigned long BatchLatency;
+
+	/// <summary> Gets the message processing method. </summary>
+	/// <returns> The message processing method of the radio
+	///   events. </returns>
+	wclMessageProcessingMethod GetMessageProcessing() const;
+	/// <summary> Sets the message processing method. </summary>
+	/// <param name="Value"> <c>mpSync</c> (the default) to get the events in
+	///   the thread that called <c>Start</c> (it must run a message loop).
+	///   <c>mpAsync</c> to get them in the library threads. Applied on the
+	///   next <c>Start</c>. </param>
+	void SetMessageProcessing(const wclMessageProcessingMethod Value);
+	/// <summary> Gets and sets the message processing method. </summary>
+	/// <value> The message processing method of the radio events. </value>
+	__declspec(property(get = GetMessageProcessing, put = SetMessageProcessing))
+		wclMessageProcessingMethod MessageProcessing;
+
+	/// <summary> The event fires when a new (not duplicated) DRI frame
+	///   received. </summary>
+	/// <param name="Sender"> The object initiates the event. </param>
+	/// <param name="Frame"> The DRI frame. </param>
+	__event void OnDriFrame(void* Sender, const driFrame& Frame);
+	/// <summary> The event fires when a batch of new (not duplicated) DRI
+	///   frames is ready. </summary>
+	/// <param name="Sender"> The object initiates the event. </param>
+	/// <param name="Records"> The frame records. </param>
+	/// <param name="Count"> The number of records. </param>
+	/// <param name="Data"> The batch buffer with the raw frames and the
+	///   network names. Valid only within the event handler. </param>
+	/// <remarks> The handler must not call <c>Stop</c> or change
+	///   <c>BatchSize</c>. </remarks>
+	__event void OnDriFrames(void* Sender, const driFrameRecord* const Records,
+		const size_t Count, const unsigned char* const Data);
+	/// <summary> The event fires when a radio or interface started or stopped
+	///   capturing. </summary>
+	/// <param name="Sender"> The object initiates the event. </param>
+	/// <param name="Radio"> The radio index. </param>
+	/// <param name="Active"> <c>True</c> if the radio started
+	///   capturing. </param>
+	__event void OnRadioStateChanged(void* Sender, const unsigned char Radio,
+		const bool Active);
+	/// <summary> The event fires when the scan controller of a Bluetooth LE
+	///   radio changed the scan profile. </summary>
+	/// <param name="Sender"> The object initiates the event. </param>
+	/// <param name="Radio"> The radio index. </param>
+	/// <param name="Metrics"> The scan controller metrics. </param>
+	__event void OnScanProfileChanged(void* Sender, const unsigned char Radio,
+		const driScanMetrics& Metrics);
+};
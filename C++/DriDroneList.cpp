@@ -0,0 +1,120 @@
+
+// DriDroneList.cpp : implementation file
+//
+
+#include "stdafx.h"
+#include "DriDroneList.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+
+// CDriDroneList
+
+CDriDroneList::CDriDroneList()
+{
+}
+
+CDriDroneList::~CDriDroneList()
+{
+	Clear();
+}
+
+void CDriDroneList::Clear()
+{
+	for (std::vector<driDrone*>::iterator Drone = FDrones.begin(); Drone != FDrones.end(); Drone++)
+	{
+		for (size_t i = 0; i < DRI_MESSAGE_SLOTS; i++)
+			delete (*Drone)->Slots[i].Message;
+		delete (*Drone);
+	}
+	FDrones.clear();
+	FIndex.clear();
+}
+
+size_t CDriDroneList::Find(const tstring& Ssid) const
+{
+	std::map<tstring, size_t>::const_iterator Index = FIndex.find(Ssid);
+	if (Index == FIndex.end())
+		return DRI_NO_DRONE;
+	return Index->second;
+}
+
+size_t CDriDroneList::Add(const tstring& Ssid, bool& Added)
+{
+	size_t Result = Find(Ssid);
+	Added = (Result == DRI_NO_DRONE);
+	if (Added)
+	{
+		driDrone* Drone = new driDrone;
+		Drone->Ssid = Ssid;
+		for (size_t i = 0; i < DRI_MESSAGE_SLOTS; i++)
+		{
+			Drone->Slots[i].Message = NULL;
+			Drone->Slots[i].Formatted = false;
+		}
+
+		Result = FDrones.size();
+		FDrones.push_back(Drone);
+		FIndex[Ssid] = Result;
+	}
+	return Result;
+}
+
+size_t CDriDroneList::Update(const size_t Drone, CwclDriAsdMessage* const Message,
+	bool& Added)
+{
+	size_t Slot = SlotOf(Message->MessageType);
+	driMessageSlot& Data = FDrones[Drone]->Slots[Slot];
+
+	Added = (Data.Message == NULL);
+	delete Data.Message;
+	Data.Message = Message;
+	// Keep the rows: the new message is formatted into the same strings.
+	Data.Formatted = false;
+	return Slot;
+}
+
+const driDrone* CDriDroneList::GetDrone(const size_t Drone) const
+{
+	if (Drone >= FDrones.size())
+		return NULL;
+	return FDrones[Drone];
+}
+
+const driDetailRows* CDriDroneList::GetDetails(const size_t Drone, const size_t Slot)
+{
+	if (Drone >= FDrones.size() || Slot >= DRI_MESSAGE_SLOTS)
+		return NULL;
+
+	driMessageSlot& Data = FDrones[Drone]->Slots[Slot];
+	if (Data.Message == NULL)
+		return NULL;
+
+	if (!Data.Formatted)
+	{
+		CDriFormatter::Format(FDrones[Drone]->Ssid, Data.Message, Data.Rows);
+		Data.Formatted = true;
+	}
+	return &Data.Rows;
+}
+
+size_t CDriDroneList::SlotOf(const wclDriAsdMessageType MessageType)
+{
+	if ((size_t)MessageType < DRI_MESSAGE_SLOTS - 1)
+		return (size_t)MessageType;
+	return DRI_MESSAGE_SLOTS - 1;
+}
+
+const TCHAR* CDriDroneList::SlotText(const size_t Slot)
+{
+	if (Slot < DRI_MESSAGE_SLOTS - 1)
+		return CDriFormatter::MessageTypeText((wclDriAsdMessageType)Slot);
+	return CDriFormatter::MessageTypeText((wclDriAsdMessageType)0xFF);
+}
+
+size_t CDriDroneList::GetCount() const
+{
+	return FDrones.size();
+}
@@ -0,0 +1,126 @@
+
+// DriDroneList.h : header file
+//
+
+#pragma once
+
+#include <vector>
+#include <map>
+
+#include "wclHelpers.h"
+#include "wclDriCommon.h"
+#include "wclDriAsd.h"
+
+#include "DriFormat.h"
+
+using namespace wclCommon;
+using namespace wclDri;
+
+/// <summary> The number of the message slots of a drone: one per ASD message
+///   type and one for all the unknown types. </summary>
+#define DRI_MESSAGE_SLOTS	7
+/// <summary> The invalid drone index. </summary>
+#define DRI_NO_DRONE		((size_t)-1)
+/// <summary> The invalid message slot. </summary>
+#define DRI_NO_SLOT			((size_t)-1)
+
+/// <summary> The last received message of one type. </summary>
+typedef struct
+{
+	/// <summary> The message. <c>NULL</c> if no message of this type was
+	///   received. </summary>
+	CwclDriAsdMessage*	Message;
+	/// <summary> <c>True</c> if <c>Rows</c> contains the details of the
+	///   current message. </summary>
+	bool				Formatted;
+	/// <summary> The formatted details. </summary>
+	driDetailRows		Rows;
+} driMessageSlot;
+
+/// <summary> The drone data. </summary>
+typedef struct
+{
+	/// <summary> The drone SSID (or the Bluetooth address). </summary>
+	tstring				Ssid;
+	/// <summary> The last messages indexed by the slot. </summary>
+	driMessageSlot		Slots[DRI_MESSAGE_SLOTS];
+} driDrone;
+
+/// <summary> The drones data model of the user interface. </summary>
+/// <remarks> <para> The list keeps the last message of every type for each
+///   drone. Drones are never removed (until <c>Clear</c>) so a drone index
+///   can be stored in the user interface controls instead of a
+///   pointer. </para>
+///   <para> The message details are formatted only when requested and kept
+///   until the message is replaced. </para>
+///   <para> The list is not thread safe; it is used by the UI thread
+///   only. </para> </remarks>
+class CDriDroneList
+{
+	DISABLE_COPY(CDriDroneList);
+
+private:
+	std::vector<driDrone*>		FDrones;
+	std::map<tstring, size_t>	FIndex;
+
+public:
+	/// <summary> Creates new empty drone list. </summary>
+	CDriDroneList();
+	/// <summary> Frees the list and all the messages. </summary>
+	virtual ~CDriDroneList();
+
+	/// <summary> Removes all the drones and frees the messages. </summary>
+	void Clear();
+
+	/// <summary> Finds the drone. </summary>
+	/// <param name="Ssid"> The drone SSID. </param>
+	/// <returns> The drone index or <see cref="DRI_NO_DRONE" /> if the drone
+	///   is not in the list. </returns>
+	size_t Find(const tstring& Ssid) const;
+	/// <summary> Finds the drone and adds it if it is not in the
+	///   list. </summary>
+	/// <param name="Ssid"> The drone SSID. </param>
+	/// <param name="Added"> On output is <c>true</c> if the drone was
+	///   added. </param>
+	/// <returns> The drone index. </returns>
+	size_t Add(const tstring& Ssid, bool& Added);
+
+	/// <summary> Stores the drone message. </summary>
+	/// <param name="Drone"> The drone index. </param>
+	/// <param name="Message"> The message. The list takes the ownership and
+	///   frees the previous message of the same type. </param>
+	/// <param name="Added"> On output is <c>true</c> if it is the first
+	///   message of this type. </param>
+	/// <returns> The message slot. </returns>
+	size_t Update(const size_t Drone, CwclDriAsdMessage* const Message,
+		bool& Added);
+
+	/// <summary> Gets the drone. </summary>
+	/// <param name="Drone"> The drone index. </param>
+	/// <returns> The drone or <c>NULL</c> if the index is invalid. </returns>
+	const driDrone* GetDrone(const size_t Drone) const;
+	/// <summary> Gets the formatted message details. </summary>
+	/// <param name="Drone"> The drone index. </param>
+	/// <param name="Slot"> The message slot. </param>
+	/// <returns> The details or <c>NULL</c> if there is no such message. The
+	///   pointer is valid until the message is replaced. </returns>
+	/// <remarks> The message is formatted on the first call after it was
+	///   received. </remarks>
+	const driDetailRows* GetDetails(const size_t Drone, const size_t Slot);
+
+	/// <summary> Gets the message slot of the ASD message type. </summary>
+	/// <param name="MessageType"> The message type. </param>
+	/// <returns> The slot index. </returns>
+	static size_t SlotOf(const wclDriAsdMessageType MessageType);
+	/// <summary> Gets the message slot name. </summary>
+	/// <param name="Slot"> The slot index. </param>
+	/// <returns> The static slot name. </returns>
+	static const TCHAR* SlotText(const size_t Slot);
+
+	/// <summary> Gets the number of drones. </summary>
+	/// <returns> The drones count. </returns>
+	size_t GetCount() const;
+	/// <summary> Gets the number of drones. </summary>
+	/// <value> The drones count. </value>
+	__declspec(property(get = GetCount)) size_t Count;
+};
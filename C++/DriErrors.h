@@ -0,0 +1,218 @@
+
+// DriErrors.h : error codes of the DRI helper classes
+//
+
+#pragma once
+
+#include "wclErrors.h"
+
+using namespace wclCommon;
+
+// The helper classes return the WCL error codes (WCL_E_SUCCESS,
+// WCL_E_INVALID_ARGUMENT, WCL_E_OUT_OF_MEMORY, ...) where they apply and the
+// codes below for their own failures.
+
+/// <summary> The base error code for the DRI helper classes. </summary>
+const int DRI_E_BASE = 0x00100000;
+
+/* Capture log error codes. */
+
+/// <summary> The base error code for the capture log. </summary>
+const int DRI_E_LOG_BASE = DRI_E_BASE + 0x1000;
+/// <summary> The capture log is already opened. </summary>
+const int DRI_E_LOG_OPENED = DRI_E_LOG_BASE + 0x0000;
+/// <summary> The capture log is not opened. </summary>
+const int DRI_E_LOG_CLOSED = DRI_E_LOG_BASE + 0x0001;
+/// <summary> Unable to create or open the capture log file. </summary>
+const int DRI_E_LOG_OPEN_FAILED = DRI_E_LOG_BASE + 0x0002;
+/// <summary> Writing to the capture log file failed. </summary>
+const int DRI_E_LOG_WRITE_FAILED = DRI_E_LOG_BASE + 0x0003;
+/// <summary> The file is not a capture log or has unsupported
+///   version. </summary>
+const int DRI_E_LOG_INVALID_FORMAT = DRI_E_LOG_BASE + 0x0004;
+/// <summary> Unable to map the capture log file into memory. </summary>
+const int DRI_E_LOG_MAP_FAILED = DRI_E_LOG_BASE + 0x0005;
+/// <summary> No more records in the capture log. </summary>
+const int DRI_E_LOG_EOF = DRI_E_LOG_BASE + 0x0006;
+/// <summary> The record at the given offset is damaged or
+///   truncated. </summary>
+const int DRI_E_LOG_CORRUPTED = DRI_E_LOG_BASE + 0x0007;
+
+/* Indexed recording error codes. */
+
+/// <summary> The base error code for the indexed recordings. </summary>
+const int DRI_E_REC_BASE = DRI_E_BASE + 0x2000;
+/// <summary> Unable to create or open the recording index file. </summary>
+const int DRI_E_REC_INDEX_OPEN_FAILED = DRI_E_REC_BASE + 0x0000;
+/// <summary> Writing to the recording index file failed. </summary>
+const int DRI_E_REC_INDEX_WRITE_FAILED = DRI_E_REC_BASE + 0x0001;
+/// <summary> The file is not a recording index or has unsupported
+///   version. </summary>
+const int DRI_E_REC_INDEX_INVALID_FORMAT = DRI_E_REC_BASE + 0x0002;
+/// <summary> No query is active. Call <c>Seek</c> first. </summary>
+const int DRI_E_REC_NO_QUERY = DRI_E_REC_BASE + 0x0003;
+/// <summary> The recorder queue is full. The frame was dropped. </summary>
+const int DRI_E_REC_QUEUE_FULL = DRI_E_REC_BASE + 0x0004;
+/// <summary> Unable to start the recorder thread. </summary>
+const int DRI_E_REC_THREAD_FAILED = DRI_E_REC_BASE + 0x0005;
+/// <summary> The recording is already opened. </summary>
+const int DRI_E_REC_OPENED = DRI_E_REC_BASE + 0x0006;
+/// <summary> The recording is not opened. </summary>
+const int DRI_E_REC_CLOSED = DRI_E_REC_BASE + 0x0007;
+/// <summary> Unable to map the recording index file into memory. </summary>
+const int DRI_E_REC_INDEX_MAP_FAILED = DRI_E_REC_BASE + 0x0008;
+
+/* Scan controller error codes. */
+
+/// <summary> The base error code for the scan controller. </summary>
+const int DRI_E_SCAN_BASE = DRI_E_BASE + 0x3000;
+/// <summary> The scan controller is already running. </summary>
+const int DRI_E_SCAN_ACTIVE = DRI_E_SCAN_BASE + 0x0000;
+/// <summary> The scan controller is not running. </summary>
+const int DRI_E_SCAN_NOT_ACTIVE = DRI_E_SCAN_BASE + 0x0001;
+/// <summary> The watcher rejected the scan parameters. </summary>
+const int DRI_E_SCAN_INVALID_PROFILE = DRI_E_SCAN_BASE + 0x0002;
+
+/* Capture manager error codes. */
+
+/// <summary> The base error code for the capture manager. </summary>
+const int DRI_E_CAP_BASE = DRI_E_BASE + 0x4000;
+/// <summary> The capture manager is already running. </summary>
+const int DRI_E_CAP_ACTIVE = DRI_E_CAP_BASE + 0x0000;
+/// <summary> The capture manager is not running. </summary>
+const int DRI_E_CAP_NOT_ACTIVE = DRI_E_CAP_BASE + 0x0001;
+/// <summary> No one Bluetooth LE radio or WiFi interface could be
+///   started. </summary>
+const int DRI_E_CAP_NO_RADIOS = DRI_E_CAP_BASE + 0x0002;
+
+/* Thread pool error codes. */
+
+/// <summary> The base error code for the thread pool. </summary>
+const int DRI_E_POOL_BASE = DRI_E_BASE + 0x5000;
+/// <summary> The thread pool is already running. </summary>
+const int DRI_E_POOL_ACTIVE = DRI_E_POOL_BASE + 0x0000;
+/// <summary> The thread pool is not running. </summary>
+const int DRI_E_POOL_NOT_ACTIVE = DRI_E_POOL_BASE + 0x0001;
+/// <summary> Unable to start a worker thread. </summary>
+const int DRI_E_POOL_THREAD_FAILED = DRI_E_POOL_BASE + 0x0002;
+
+/* Sensor error codes. */
+
+/// <summary> The base error code for the sensor. </summary>
+const int DRI_E_SENSOR_BASE = DRI_E_BASE + 0x6000;
+/// <summary> The sensor is already opened. </summary>
+const int DRI_E_SENSOR_OPENED = DRI_E_SENSOR_BASE + 0x0000;
+/// <summary> The sensor is not opened. </summary>
+const int DRI_E_SENSOR_CLOSED = DRI_E_SENSOR_BASE + 0x0001;
+/// <summary> The sensor is capturing. </summary>
+const int DRI_E_SENSOR_ACTIVE = DRI_E_SENSOR_BASE + 0x0002;
+/// <summary> The sensor is not capturing. </summary>
+const int DRI_E_SENSOR_NOT_ACTIVE = DRI_E_SENSOR_BASE + 0x0003;
+/// <summary> The configuration file does not exist. </summary>
+const int DRI_E_SENSOR_NO_CONFIG = DRI_E_SENSOR_BASE + 0x0004;
+
+/* Exporter error codes. */
+
+/// <summary> The base error code for the exporter. </summary>
+const int DRI_E_EXP_BASE = DRI_E_BASE + 0x7000;
+/// <summary> The exporter is already opened. </summary>
+const int DRI_E_EXP_OPENED = DRI_E_EXP_BASE + 0x0000;
+/// <summary> The exporter is not opened. </summary>
+const int DRI_E_EXP_CLOSED = DRI_E_EXP_BASE + 0x0001;
+/// <summary> Unable to initialize Windows Sockets. </summary>
+const int DRI_E_EXP_WINSOCK_FAILED = DRI_E_EXP_BASE + 0x0002;
+/// <summary> Unable to resolve the destination address. </summary>
+const int DRI_E_EXP_RESOLVE_FAILED = DRI_E_EXP_BASE + 0x0003;
+/// <summary> Unable to create or connect the socket. </summary>
+const int DRI_E_EXP_SOCKET_FAILED = DRI_E_EXP_BASE + 0x0004;
+/// <summary> Unable to start the sender thread. </summary>
+const int DRI_E_EXP_THREAD_FAILED = DRI_E_EXP_BASE + 0x0005;
+
+/* Shared table error codes. */
+
+/// <summary> The base error code for the shared drone table. </summary>
+const int DRI_E_TABLE_BASE = DRI_E_BASE + 0x8000;
+/// <summary> The table is already opened. </summary>
+const int DRI_E_TABLE_OPENED = DRI_E_TABLE_BASE + 0x0000;
+/// <summary> The table is not opened. </summary>
+const int DRI_E_TABLE_CLOSED = DRI_E_TABLE_BASE + 0x0001;
+/// <summary> Unable to create or open the shared memory section. </summary>
+const int DRI_E_TABLE_MAP_FAILED = DRI_E_TABLE_BASE + 0x0002;
+/// <summary> The section already exists (other process publishes a table
+///   with the same name). </summary>
+const int DRI_E_TABLE_EXISTS = DRI_E_TABLE_BASE + 0x0003;
+/// <summary> The section is not a drone table or has other
+///   version. </summary>
+const int DRI_E_TABLE_INVALID_FORMAT = DRI_E_TABLE_BASE + 0x0004;
+
+/* Track archive error codes. */
+
+/// <summary> The base error code for the track archive. </summary>
+const int DRI_E_TRACK_BASE = DRI_E_BASE + 0x9000;
+/// <summary> Writing to the archive file failed. </summary>
+const int DRI_E_TRACK_WRITE_FAILED = DRI_E_TRACK_BASE + 0x0000;
+/// <summary> The file is not a track archive or has unsupported
+///   version. </summary>
+const int DRI_E_TRACK_INVALID_FORMAT = DRI_E_TRACK_BASE + 0x0001;
+/// <summary> The chunk column data is damaged or truncated. </summary>
+const int DRI_E_TRACK_CORRUPTED = DRI_E_TRACK_BASE + 0x0002;
+/// <summary> The archive is already opened. </summary>
+const int DRI_E_TRACK_OPENED = DRI_E_TRACK_BASE + 0x0003;
+/// <summary> The archive is not opened. </summary>
+const int DRI_E_TRACK_CLOSED = DRI_E_TRACK_BASE + 0x0004;
+/// <summary> Unable to create or open the archive file. </summary>
+const int DRI_E_TRACK_OPEN_FAILED = DRI_E_TRACK_BASE + 0x0005;
+
+/* Query server error codes. */
+
+/// <summary> The base error code for the query server. </summary>
+const int DRI_E_QUERY_BASE = DRI_E_BASE + 0xA000;
+/// <summary> The server is already opened. </summary>
+const int DRI_E_QUERY_OPENED = DRI_E_QUERY_BASE + 0x0000;
+/// <summary> The server is not opened. </summary>
+const int DRI_E_QUERY_CLOSED = DRI_E_QUERY_BASE + 0x0001;
+/// <summary> Unable to initialize Windows Sockets. </summary>
+const int DRI_E_QUERY_WINSOCK_FAILED = DRI_E_QUERY_BASE + 0x0002;
+/// <summary> Unable to create the listening socket or to bind it to the
+///   port. </summary>
+const int DRI_E_QUERY_SOCKET_FAILED = DRI_E_QUERY_BASE + 0x0003;
+/// <summary> Unable to start the server thread. </summary>
+const int DRI_E_QUERY_THREAD_FAILED = DRI_E_QUERY_BASE + 0x0004;
+
+/* Fusion node error codes. */
+
+/// <summary> The base error code for the fusion node. </summary>
+const int DRI_E_FUSION_BASE = DRI_E_BASE + 0xB000;
+/// <summary> The fusion node is already opened. </summary>
+const int DRI_E_FUSION_OPENED = DRI_E_FUSION_BASE + 0x0000;
+/// <summary> The fusion node is not opened. </summary>
+const int DRI_E_FUSION_CLOSED = DRI_E_FUSION_BASE + 0x0001;
+/// <summary> Unable to initialize Windows Sockets. </summary>
+const int DRI_E_FUSION_WINSOCK_FAILED = DRI_E_FUSION_BASE + 0x0002;
+/// <summary> Unable to create the receive socket or to bind it to the
+///   port. </summary>
+const int DRI_E_FUSION_SOCKET_FAILED = DRI_E_FUSION_BASE + 0x0003;
+/// <summary> Unable to start the receive thread. </summary>
+const int DRI_E_FUSION_THREAD_FAILED = DRI_E_FUSION_BASE + 0x0004;
+
+/* ASTERIX decoder error codes. */
+
+/// <summary> The base error code for the ASTERIX decoder. </summary>
+const int DRI_E_ASTERIX_BASE = DRI_E_BASE + 0xC000;
+/// <summary> The block has other category or its length does not match
+///   the data. </summary>
+const int DRI_E_ASTERIX_INVALID_BLOCK = DRI_E_ASTERIX_BASE + 0x0000;
+/// <summary> The record has an unknown item or does not fit in the
+///   block. </summary>
+const int DRI_E_ASTERIX_INVALID_RECORD = DRI_E_ASTERIX_BASE + 0x0001;
+
+/* Memory-mapped file error codes. */
+
+/// <summary> The base error code for the memory-mapped files. </summary>
+const int DRI_E_MAPPED_BASE = DRI_E_BASE + 0xD000;
+/// <summary> The mapped file is already opened. </summary>
+const int DRI_E_MAPPED_OPENED = DRI_E_MAPPED_BASE + 0x0000;
+/// <summary> Unable to open the file or to get its size. </summary>
+const int DRI_E_MAPPED_OPEN_FAILED = DRI_E_MAPPED_BASE + 0x0001;
+/// <summary> Unable to create the file mapping. </summary>
+const int DRI_E_MAPPED_MAP_FAILED = DRI_E_MAPPED_BASE + 0x0002;
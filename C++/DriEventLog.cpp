@@ -0,0 +1,299 @@
+
+// DriEventLog.cpp : implementation file
+//
+
+#include "stdafx.h"
+#include "DriEventLog.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+
+static const TCHAR* const DRI_SEVERITY_TEXT[] = {
+	_T("Debug"), _T("Info"), _T("Warning"), _T("Error") };
+// The severity names in the log file.
+static const char* const DRI_SEVERITY_FILE_TEXT[] = {
+	"DEBUG", "INFO", "WARNING", "ERROR" };
+
+#define DRI_SEVERITY_COUNT	(sizeof(DRI_SEVERITY_TEXT) / sizeof(DRI_SEVERITY_TEXT[0]))
+
+// Reads a sequence number changed by other threads. A plain 64-bit read is
+// two reads on x86 and may return a torn value.
+static __int64 ReadSequence(const volatile __int64& Value)
+{
+	return InterlockedCompareExchange64((volatile __int64*)&Value, 0, 0);
+}
+
+
+// CDriEventLog
+
+CDriEventLog::CDriEventLog(CDriThreadPool* const ThreadPool,
+	const unsigned long Capacity)
+{
+	unsigned long Size = 2;
+	while (Size < Capacity && Size < 0x40000000)
+		Size <<= 1;
+
+	FCells = new driEventCell[Size];
+	for (unsigned long i = 0; i < Size; i++)
+		FCells[i].Sequence = -1;
+	FMask = Size - 1;
+	FNext = 0;
+	FFirst = 0;
+
+	FCS = new CwclCriticalSection();
+	FStream = NULL;
+	FThreadPool = ThreadPool;
+	FState = new CDriFutex();
+	FFlushed = 0;
+	FLastFlush = 0;
+	FFlushInterval = DRI_EVENT_FLUSH_INTERVAL;
+	FLost = 0;
+}
+
+CDriEventLog::~CDriEventLog()
+{
+	Close();
+
+	delete FState;
+	delete FCS;
+	delete[] FCells;
+}
+
+void __stdcall CDriEventLog::FlushProc(void* Param)
+{
+	CDriEventLog* Log = (CDriEventLog*)Param;
+	Log->WriteEvents();
+	// The state change is the last access to the log: Close may go on right
+	// after.
+	Log->FState->Exchange(0);
+}
+
+void CDriEventLog::WriteEvents()
+{
+	FBuffer.clear();
+
+	__int64 Next = ReadSequence(FNext);
+	while (FFlushed < Next)
+	{
+		driEvent Event;
+		if (Get(FFlushed, Event))
+			FormatEvent(Event);
+		else
+		{
+			// The event is still being written: take it next time.
+			__int64 Oldest = ReadSequence(FNext) - (__int64)FMask - 1;
+			if (FFlushed >= Oldest)
+				break;
+
+			// Overwritten: skip all the lost events at once.
+			FLost += (unsigned __int64)(Oldest - FFlushed);
+
+			char Lost[64];
+			sprintf_s(Lost, sizeof(Lost), "*** %I64d events lost\r\n", Oldest - FFlushed);
+			FBuffer.append(Lost);
+
+			FFlushed = Oldest;
+			continue;
+		}
+		FFlushed++;
+	}
+
+	if (FBuffer.size() > 0)
+		FStream->Write(FBuffer.data(), (unsigned long)FBuffer.size());
+}
+
+void CDriEventLog::FormatEvent(const driEvent& Event)
+{
+	FILETIME Utc;
+	Utc.dwLowDateTime = (DWORD)Event.Timestamp;
+	Utc.dwHighDateTime = (DWORD)(Event.Timestamp >> 32);
+	FILETIME Local;
+	SYSTEMTIME Time;
+	if (!FileTimeToLocalFileTime(&Utc, &Local) || !FileTimeToSystemTime(&Local, &Time))
+		ZeroMemory(&Time, sizeof(SYSTEMTIME));
+
+	char Header[64];
+	sprintf_s(Header, sizeof(Header), "%.4u-%.2u-%.2u %.2u:%.2u:%.2u.%.3u %-7s ",
+		Time.wYear, Time.wMonth, Time.wDay, Time.wHour, Time.wMinute, Time.wSecond,
+		Time.wMilliseconds, ((size_t)Event.Severity < DRI_SEVERITY_COUNT) ?
+		DRI_SEVERITY_FILE_TEXT[Event.Severity] : "");
+	FBuffer.append(Header);
+
+#ifdef _UNICODE
+	char Text[DRI_EVENT_TEXT_SIZE * 3];
+	int Len = WideCharToMultiByte(CP_UTF8, 0, Event.Text, -1, Text, sizeof(Text), NULL, NULL);
+	// The length includes the terminating zero.
+	if (Len > 1)
+		FBuffer.append(Text, Len - 1);
+#else
+	FBuffer.append(Event.Text);
+#endif
+	FBuffer.append("\r\n");
+}
+
+void CDriEventLog::Add(const driEventSeverity Severity, const TCHAR* const Text)
+{
+	__int64 Sequence = InterlockedIncrement64(&FNext) - 1;
+	driEventCell* Cell = &FCells[(unsigned long)Sequence & FMask];
+
+	InterlockedExchange64(&Cell->Sequence, -1);
+
+	FILETIME Now;
+	GetSystemTimeAsFileTime(&Now);
+	Cell->Event.Timestamp = ((__int64)Now.dwHighDateTime << 32) | Now.dwLowDateTime;
+	Cell->Event.Severity = Severity;
+	if (Text == NULL)
+		Cell->Event.Text[0] = 0;
+	else
+		_tcsncpy_s(Cell->Event.Text, DRI_EVENT_TEXT_SIZE, Text, _TRUNCATE);
+
+	// Publish the event.
+	InterlockedExchange64(&Cell->Sequence, Sequence);
+}
+
+bool CDriEventLog::Get(const __int64 Sequence, driEvent& Event) const
+{
+	if (Sequence < 0 || Sequence >= ReadSequence(FNext))
+		return false;
+
+	const driEventCell* Cell = &FCells[(unsigned long)Sequence & FMask];
+	if (ReadSequence(Cell->Sequence) != Sequence)
+		return false;
+
+	Event = Cell->Event;
+	// The copy must be complete before the number is checked again.
+	MemoryBarrier();
+	if (ReadSequence(Cell->Sequence) != Sequence)
+		return false;
+
+	Event.Text[DRI_EVENT_TEXT_SIZE - 1] = 0;
+	return true;
+}
+
+void CDriEventLog::Clear()
+{
+	InterlockedExchange64(&FFirst, ReadSequence(FNext));
+}
+
+int CDriEventLog::Open(const tstring& FileName)
+{
+	if (FileName == _T(""))
+		return WCL_E_INVALID_ARGUMENT;
+
+	FCS->Enter();
+	int Res = WCL_E_SUCCESS;
+	if (FStream != NULL)
+		Res = DRI_E_LOG_OPENED;
+	else
+	{
+		try
+		{
+			FStream = new CwclFileStream(FileName, OPEN_ALWAYS, GENERIC_WRITE,
+				FILE_SHARE_READ);
+			FStream->Seek(0, soEnd);
+		}
+		catch (wclEFileOpenFailed&)
+		{
+			FStream = NULL;
+			Res = DRI_E_LOG_OPEN_FAILED;
+		}
+
+		if (Res == WCL_E_SUCCESS)
+		{
+			FFlushed = ReadSequence(FNext);
+			FLastFlush = GetTickCount();
+			FLost = 0;
+		}
+	}
+	FCS->Leave();
+	return Res;
+}
+
+int CDriEventLog::Close()
+{
+	FCS->Enter();
+	int Res = WCL_E_SUCCESS;
+	if (FStream == NULL)
+		Res = DRI_E_LOG_CLOSED;
+	else
+	{
+		// Take the flush state so no flush task runs, then write the rest
+		// here.
+		LONG State;
+		while ((State = FState->CompareExchange(1, 0)) != 0)
+			FState->Wait(State, INFINITE);
+
+		WriteEvents();
+		FBuffer.clear();
+
+		delete FStream;
+		FStream = NULL;
+
+		FState->Exchange(0);
+	}
+	FCS->Leave();
+	return Res;
+}
+
+void CDriEventLog::Flush(const bool Force)
+{
+	if (FStream == NULL || FFlushed == ReadSequence(FNext))
+		return;
+	if (!Force && GetTickCount() - FLastFlush < FFlushInterval)
+		return;
+
+	if (FState->CompareExchange(1, 0) == 0)
+	{
+		FLastFlush = GetTickCount();
+
+		int Res = DRI_E_POOL_NOT_ACTIVE;
+		if (FThreadPool != NULL)
+			Res = FThreadPool->Submit(FlushProc, this);
+		// No pool: write the events here.
+		if (Res != WCL_E_SUCCESS)
+			FlushProc(this);
+	}
+}
+
+__int64 CDriEventLog::GetFirst() const
+{
+	__int64 Oldest = ReadSequence(FNext) - (__int64)FMask - 1;
+	__int64 First = ReadSequence(FFirst);
+	if (Oldest < First)
+		return First;
+	return Oldest;
+}
+
+__int64 CDriEventLog::GetNext() const
+{
+	return ReadSequence(FNext);
+}
+
+unsigned long CDriEventLog::GetCapacity() const
+{
+	return FMask + 1;
+}
+
+unsigned __int64 CDriEventLog::GetLost() const
+{
+	return FLost;
+}
+
+unsigned long CDriEventLog::GetFlushInterval() const
+{
+	return FFlushInterval;
+}
+
+void CDriEventLog::SetFlushInterval(const unsigned long Value)
+{
+	FFlushInterval = Value;
+}
+
+const TCHAR* CDriEventLog::SeverityText(const driEventSeverity Severity)
+{
+	if ((size_t)Severity < DRI_SEVERITY_COUNT)
+		return DRI_SEVERITY_TEXT[Severity];
+	return _T("");
+}
@@ -0,0 +1,197 @@
+
+// DriEventLog.h : header file
+//
+
+#pragma once
+
+#include <string>
+
+#include "wclHelpers.h"
+#include "wclSync.h"
+
+#include "DriErrors.h"
+#include "DriSync.h"
+#include "DriThreadPool.h"
+
+using namespace wclCommon;
+using namespace wclSync;
+
+/// <summary> The default event log capacity (events). </summary>
+#define DRI_EVENT_LOG_SIZE			4096
+/// <summary> The maximum event text length (including the terminating
+///   zero). Longer texts are truncated. </summary>
+#define DRI_EVENT_TEXT_SIZE			128
+/// <summary> The default file sink flush interval in
+///   milliseconds. </summary>
+#define DRI_EVENT_FLUSH_INTERVAL	1000
+
+/// <summary> The event severity. </summary>
+typedef enum
+{
+	esDebug = 0,
+	esInfo = 1,
+	esWarning = 2,
+	esError = 3
+} driEventSeverity;
+
+/// <summary> The logged event. </summary>
+typedef struct
+{
+	/// <summary> The event time (FILETIME, UTC). </summary>
+	__int64				Timestamp;
+	driEventSeverity	Severity;
+	/// <summary> The zero terminated event text. </summary>
+	TCHAR				Text[DRI_EVENT_TEXT_SIZE];
+} driEvent;
+
+/// <summary> A fixed-size in-memory event log. </summary>
+/// <remarks> <para> The events are kept in a ring of preallocated cells.
+///   A writer takes the next sequence number with one interlocked increment
+///   and fills the cell at that position, so <c>Add</c> never blocks and
+///   never allocates. When the ring is full the oldest events are
+///   overwritten. </para>
+///   <para> Each cell carries the sequence number of the event it holds.
+///   <c>Get</c> checks the number before and after copying the event and
+///   fails if the event was overwritten or is still being written. A writer
+///   stalled for the time it takes to log <c>Capacity</c> newer events can
+///   leave the text of one event mixed; the text is always zero
+///   terminated. </para>
+///   <para> The optional file sink appends the events to a text file (UTF-8)
+///   from a thread pool task. <c>Flush</c> schedules the task at most once
+///   per <c>FlushInterval</c>; the task writes all the events logged since
+///   the previous flush at once. Events overwritten before they were
+///   flushed are counted and reported in the file. </para>
+///   <para> <c>Add</c> and <c>Get</c> can be called from any thread.
+///   </para> </remarks>
+class CDriEventLog
+{
+	DISABLE_COPY(CDriEventLog);
+
+private:
+	typedef struct
+	{
+		// The event sequence number; -1 while the cell is written.
+		volatile __int64	Sequence;
+		driEvent			Event;
+	} driEventCell;
+
+	driEventCell*			FCells;
+	unsigned long			FMask;
+	// The next event sequence number.
+	volatile __int64		FNext;
+	// The first event to show (changed by Clear).
+	volatile __int64		FFirst;
+
+	CwclCriticalSection*	FCS;
+	CwclFileStream*			FStream;
+	CDriThreadPool*			FThreadPool;
+	// 0 - idle, 1 - the flush task is scheduled or running.
+	CDriFutex*				FState;
+	__int64					FFlushed;
+	DWORD					FLastFlush;
+	unsigned long			FFlushInterval;
+	unsigned __int64		FLost;
+	std::string				FBuffer;
+
+	static void __stdcall FlushProc(void* Param);
+	void WriteEvents();
+	void FormatEvent(const driEvent& Event);
+
+public:
+	/// <summary> Creates new event log. </summary>
+	/// <param name="ThreadPool"> The thread pool that runs the file sink
+	///   task. When the pool is not active the events are written by the
+	///   thread that calls <c>Flush</c>. </param>
+	/// <param name="Capacity"> The maximum number of events. Rounded up to
+	///   the power of 2. </param>
+	CDriEventLog(CDriThreadPool* const ThreadPool,
+		const unsigned long Capacity = DRI_EVENT_LOG_SIZE);
+	/// <summary> Closes the file sink and frees the log. </summary>
+	virtual ~CDriEventLog();
+
+	/// <summary> Adds an event. </summary>
+	/// <param name="Severity"> The event severity. </param>
+	/// <param name="Text"> The event text. </param>
+	void Add(const driEventSeverity Severity, const TCHAR* const Text);
+	/// <summary> Gets an event. </summary>
+	/// <param name="Sequence"> The event sequence number. </param>
+	/// <param name="Event"> On output contains the event. </param>
+	/// <returns> <c>True</c> if the event was copied. <c>False</c> if there
+	///   is no such event (not logged yet or already overwritten). </returns>
+	bool Get(const __int64 Sequence, driEvent& Event) const;
+	/// <summary> Hides all the logged events. </summary>
+	/// <remarks> Only <c>First</c> changes. The events not flushed yet are
+	///   still written to the file. </remarks>
+	void Clear();
+
+	/// <summary> Opens the file sink. </summary>
+	/// <param name="FileName"> The log file name. The events are appended to
+	///   an existing file. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	/// <remarks> Only the events logged after the sink is opened are
+	///   written. </remarks>
+	int Open(const tstring& FileName);
+	/// <summary> Writes the pending events and closes the file
+	///   sink. </summary>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Close();
+	/// <summary> Schedules writing the pending events to the file
+	///   sink. </summary>
+	/// <param name="Force"> <c>True</c> to schedule the write even if the
+	///   flush interval did not expire. </param>
+	/// <remarks> Call it periodically. Does nothing if the sink is not
+	///   opened or there are no new events. </remarks>
+	void Flush(const bool Force = false);
+
+	/// <summary> Gets the first event to show. </summary>
+	/// <returns> The sequence number of the oldest event still in the log
+	///   and not cleared. </returns>
+	__int64 GetFirst() const;
+	/// <summary> Gets the first event to show. </summary>
+	/// <value> The sequence number of the oldest event still in the log and
+	///   not cleared. </value>
+	__declspec(property(get = GetFirst)) __int64 First;
+
+	/// <summary> Gets the next event sequence number. </summary>
+	/// <returns> The total number of the logged events. </returns>
+	__int64 GetNext() const;
+	/// <summary> Gets the next event sequence number. </summary>
+	/// <value> The total number of the logged events. </value>
+	__declspec(property(get = GetNext)) __int64 Next;
+
+	/// <summary> Gets the log capacity. </summary>
+	/// <returns> The maximum number of events. </returns>
+	unsigned long GetCapacity() const;
+	/// <summary> Gets the log capacity. </summary>
+	/// <value> The maximum number of events. </value>
+	__declspec(property(get = GetCapacity)) unsigned long Capacity;
+
+	/// <summary> Gets the number of events overwritten before they were
+	///   written to the file. </summary>
+	/// <returns> The lost events count. </returns>
+	unsigned __int64 GetLost() const;
+	/// <summary> Gets the number of events overwritten before they were
+	///   written to the file. </summary>
+	/// <value> The lost events count. </value>
+	__declspec(property(get = GetLost)) unsigned __int64 Lost;
+
+	/// <summary> Gets the file sink flush interval. </summary>
+	/// <returns> The interval in milliseconds. </returns>
+	unsigned long GetFlushInterval() const;
+	/// <summary> Sets the file sink flush interval. </summary>
+	/// <param name="Value"> The interval in milliseconds. </param>
+	void SetFlushInterval(const unsigned long Value);
+	/// <summary> Gets and sets the file sink flush interval. </summary>
+	/// <value> The interval in milliseconds. </value>
+	__declspec(property(get = GetFlushInterval, put = SetFlushInterval))
+		unsigned long FlushInterval;
+
+	/// <summary> Gets the event severity name. </summary>
+	/// <param name="Severity"> The severity. </param>
+	/// <returns> The static severity name. </returns>
+	static const TCHAR* SeverityText(const driEventSeverity Severity);
+};
@@ -0,0 +1,652 @@
+
+// DriExport.cpp : implementation file
+//
+
+#include "stdafx.h"
+#include "DriExport.h"
+
+#include <stdarg.h>
+#include <ws2tcpip.h>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+
+// The maximum JSON line length. A longer line is dropped.
+#define DRI_EXPORT_LINE_SIZE	1024
+// The number of the records the sender thread takes from the queue at once.
+#define DRI_EXPORT_BATCH		256
+// The socket send buffer size: keeps the bursts in the kernel.
+#define DRI_EXPORT_SEND_BUFFER	(1024 * 1024)
+// The minimum time between the TCP connect attempts in milliseconds.
+#define DRI_EXPORT_RECONNECT	1000
+// The largest binary record.
+#define DRI_EXPORT_RECORD_SIZE	(sizeof(driExportRecordHeader) + DRI_EXPORT_NAME_SIZE + 255)
+// The difference between the FILETIME and the Unix epochs in 100 ns units.
+#define DRI_UNIX_EPOCH			116444736000000000LL
+
+static const char* const DRI_EXPORT_TYPE_TEXT[] = {
+	"basic_id", "location", "auth", "self_id", "system", "operator_id" };
+
+#define DRI_EXPORT_TYPE_COUNT	(sizeof(DRI_EXPORT_TYPE_TEXT) / sizeof(DRI_EXPORT_TYPE_TEXT[0]))
+
+// A JSON line being built.
+typedef struct
+{
+	char	Data[DRI_EXPORT_LINE_SIZE];
+	size_t	Length;
+	bool	Overflow;
+} driJsonLine;
+
+static void JsonAppend(driJsonLine& Line, const char* const Format, ...)
+{
+	if (Line.Overflow)
+		return;
+
+	va_list Args;
+	va_start(Args, Format);
+	int Len = _vsnprintf_s(Line.Data + Line.Length, DRI_EXPORT_LINE_SIZE - Line.Length,
+		_TRUNCATE, Format, Args);
+	va_end(Args);
+
+	if (Len < 0)
+		Line.Overflow = true;
+	else
+		Line.Length += Len;
+}
+
+// Appends the "Name":"Text" pair. The text is UTF-8; the ID and the
+// description fields are ASCII so other bytes are replaced.
+static void JsonString(driJsonLine& Line, const char* const Name,
+	const char* const Text, const size_t Size, const bool Ascii)
+{
+	JsonAppend(Line, ",\"%s\":\"", Name);
+	for (size_t i = 0; i < Size && Text[i] != 0 && !Line.Overflow; i++)
+	{
+		unsigned char c = (unsigned char)Text[i];
+		if (c == '"' || c == '\\')
+			JsonAppend(Line, "\\%c", c);
+		else
+		{
+			if (c < 0x20)
+				JsonAppend(Line, "\\u%.4x", c);
+			else
+			{
+				if (Ascii && c > 0x7E)
+					c = '?';
+				if (Line.Length + 1 < DRI_EXPORT_LINE_SIZE)
+					Line.Data[Line.Length++] = (char)c;
+				else
+					Line.Overflow = true;
+			}
+		}
+	}
+	JsonAppend(Line, "\"");
+}
+
+static void JsonId(driJsonLine& Line, const char* const Name,
+	const wclDriAsdId& Id)
+{
+	if (Id.size() == 0)
+		JsonString(Line, Name, "", 0, true);
+	else
+		JsonString(Line, Name, (const char*)&Id[0], Id.size(), true);
+}
+
+// Reads a counter of the sender thread; a plain 64-bit read may tear on
+// x86.
+static unsigned __int64 ReadCounter(const volatile __int64& Counter)
+{
+	return (unsigned __int64)InterlockedCompareExchange64((volatile __int64*)&Counter, 0, 0);
+}
+
+static void JsonMessage(driJsonLine& Line, const CwclDriAsdMessage* const Message)
+{
+	switch (Message->MessageType)
+	{
+	case mtBasicId:
+		{
+			const CwclDriAsdBasicIdMessage* Basic = (const CwclDriAsdBasicIdMessage*)Message;
+			JsonId(Line, "id", Basic->Id);
+			JsonAppend(Line, ",\"id_type\":%u,\"uav_type\":%u", (unsigned int)Basic->IdType,
+				(unsigned int)Basic->UavType);
+			break;
+		}
+
+	case mtLocation:
+		{
+			const CwclDriAsdLocationMessage* Location = (const CwclDriAsdLocationMessage*)Message;
+			JsonAppend(Line, ",\"lat\":%.7f,\"lon\":%.7f,\"geo_alt\":%.1f,\"baro_alt\":%.1f,\"height\":%.1f,\"height_ref\":%u",
+				Location->Latitude, Location->Longitude, Location->GeoAltitude,
+				Location->BaroAltitude, Location->Height, (unsigned int)Location->HeightReference);
+			// Same as the formatter: out of range values mean unknown.
+			if (Location->Direction <= 360)
+				JsonAppend(Line, ",\"dir\":%u", (unsigned int)Location->Direction);
+			if (Location->HorizontalSpeed != 255)
+				JsonAppend(Line, ",\"speed\":%.2f", Location->HorizontalSpeed);
+			JsonAppend(Line, ",\"vspeed\":%.2f,\"status\":%u,\"time\":%.1f,\"h_acc\":%u,\"v_acc\":%u,\"baro_acc\":%u,\"speed_acc\":%u",
+				Location->VerticalSpeed, (unsigned int)Location->Status, Location->Timestamp,
+				(unsigned int)Location->HorizontalAccuracy, (unsigned int)Location->VerticalAccuracy,
+				(unsigned int)Location->BaroAccuracy, (unsigned int)Location->SpeedAccuracy);
+			break;
+		}
+
+	case mtSelfId:
+		{
+			const CwclDriAsdSelfIdMessage* SelfId = (const CwclDriAsdSelfIdMessage*)Message;
+			std::string Text = SelfId->Description;
+			JsonString(Line, "desc", Text.c_str(), Text.length(), true);
+			JsonAppend(Line, ",\"desc_type\":%u", (unsigned int)SelfId->DescriptionType);
+			break;
+		}
+
+	case mtSystem:
+		{
+			const CwclDriAsdSystemMessage* System = (const CwclDriAsdSystemMessage*)Message;
+			JsonAppend(Line, ",\"op_lat\":%.7f,\"op_lon\":%.7f,\"op_alt\":%.1f,\"op_location\":%u,\"op_class\":%u",
+				System->OperatorLatitude, System->OperatorLongitude, System->OperatorAltitude,
+				(unsigned int)System->OperatorLocation, (unsigned int)System->OperatorClassification);
+			JsonAppend(Line, ",\"area_count\":%u,\"area_radius\":%u,\"area_ceiling\":%.1f,\"area_floor\":%.1f,\"eu_category\":%u,\"eu_class\":%u,\"time\":%I64d",
+				(unsigned int)System->AreaCount, (unsigned int)System->AreaRadius,
+				System->AreaCeiling, System->AreaFloor, (unsigned int)System->UavEuCategory,
+				(unsigned int)System->UavEuClass, (__int64)System->Timestamp);
+			break;
+		}
+
+	case mtOperatorId:
+		{
+			const CwclDriAsdOperatorIdMessage* Operator = (const CwclDriAsdOperatorIdMessage*)Message;
+			JsonId(Line, "id", Operator->Id);
+			JsonAppend(Line, ",\"id_type\":%u", (unsigned int)Operator->IdType);
+			break;
+		}
+
+	default:
+		// The authentication and the unknown messages: the type is enough.
+		break;
+	}
+}
+
+
+// CDriExporter
+
+CDriExporter::CDriExporter(const unsigned long Capacity)
+{
+	FQueue = new CDriMpscQueue<driExportRecord>(Capacity);
+	FPool = new CDriBufferPool();
+	FSocket = INVALID_SOCKET;
+	FThread = NULL;
+	FTerminated = 0;
+	FActive = false;
+
+	FLatency = DRI_EXPORT_LATENCY;
+	FDatagramSize = DRI_EXPORT_DATAGRAM_SIZE;
+	FSource = 0;
+	FFormat = efJson;
+	FProtocol = epUdp;
+	ZeroMemory(&FAddress, sizeof(SOCKADDR_STORAGE));
+	FAddressLength = 0;
+
+	FFirst = 0;
+	FConnected = 0;
+
+	FRecords = 0;
+	FDatagrams = 0;
+	FErrors = 0;
+	FDropped = 0;
+	FMaxLatency = 0;
+}
+
+CDriExporter::~CDriExporter()
+{
+	Close();
+
+	delete FPool;
+	delete FQueue;
+}
+
+UINT __stdcall CDriExporter::ThreadProc(void* Param)
+{
+	((CDriExporter*)Param)->Execute();
+	return 0;
+}
+
+void CDriExporter::Execute()
+{
+	driExportRecord Records[DRI_EXPORT_BATCH];
+
+	while (true)
+	{
+		unsigned long Count = FQueue->PopBatch(Records, DRI_EXPORT_BATCH);
+		for (unsigned long i = 0; i < Count; i++)
+		{
+			if (Records[i].Datagram)
+			{
+				// Keep the order: the records queued before go first.
+				if (FDatagram.size() > 0)
+					Send();
+				SendData((const char*)Records[i].Data, Records[i].Length, Records[i].Posted);
+			}
+			else
+			{
+				// A record never spans datagrams.
+				if (FDatagram.size() > 0 && FDatagram.size() + Records[i].Length > FDatagramSize)
+					Send();
+				// The latency counts from the post: the time in the queue too.
+				if (FDatagram.size() == 0)
+					FFirst = Records[i].Posted;
+				FDatagram.append((const char*)Records[i].Data, Records[i].Length);
+			}
+			InterlockedIncrement64(&FRecords);
+			FPool->Free(Records[i].Data);
+		}
+
+		DWORD Elapsed = GetTickCount() - FFirst;
+		if (FDatagram.size() > 0 && Elapsed >= FLatency)
+		{
+			Send();
+			Elapsed = 0;
+		}
+
+		if (Count == 0)
+		{
+			if (FTerminated != 0)
+				break;
+
+			// Wait for new records, but no longer than the oldest record may
+			// wait.
+			if (FDatagram.size() == 0)
+				FQueue->Wait(INFINITE);
+			else
+				FQueue->Wait(FLatency - Elapsed);
+		}
+	}
+
+	if (FDatagram.size() > 0)
+		Send();
+	// The buffers were freed by this thread: give them back to the posters.
+	FPool->FlushThread();
+}
+
+bool CDriExporter::Connect()
+{
+	FConnected = GetTickCount();
+	if (FProtocol == epTcp)
+		FSocket = socket(FAddress.ss_family, SOCK_STREAM, IPPROTO_TCP);
+	else
+		FSocket = socket(FAddress.ss_family, SOCK_DGRAM, IPPROTO_UDP);
+	if (FSocket == INVALID_SOCKET)
+		return false;
+
+	// A connected UDP socket does not resolve the address on every send.
+	if (connect(FSocket, (const sockaddr*)&FAddress, FAddressLength) == SOCKET_ERROR)
+	{
+		closesocket(FSocket);
+		FSocket = INVALID_SOCKET;
+		return false;
+	}
+
+	int Size = DRI_EXPORT_SEND_BUFFER;
+	setsockopt(FSocket, SOL_SOCKET, SO_SNDBUF, (const char*)&Size, sizeof(Size));
+	if (FProtocol == epTcp)
+	{
+		// The records are batched already.
+		BOOL NoDelay = TRUE;
+		setsockopt(FSocket, IPPROTO_TCP, TCP_NODELAY, (const char*)&NoDelay, sizeof(NoDelay));
+	}
+	return true;
+}
+
+void CDriExporter::Send()
+{
+	SendData(FDatagram.data(), FDatagram.size(), FFirst);
+	FDatagram.clear();
+}
+
+void CDriExporter::SendData(const char* const Data, const size_t Length,
+	const DWORD Posted)
+{
+	// The TCP connection was lost: try again, but not on every send.
+	bool Sent = (FSocket != INVALID_SOCKET ||
+		(GetTickCount() - FConnected >= DRI_EXPORT_RECONNECT && Connect()));
+
+	size_t Done = 0;
+	while (Sent && Done < Length)
+	{
+		int Len = send(FSocket, Data + Done, (int)(Length - Done), 0);
+		if (Len == SOCKET_ERROR)
+			Sent = false;
+		else
+			Done += Len;
+	}
+
+	if (!Sent)
+	{
+		InterlockedIncrement64(&FErrors);
+		if (FProtocol == epTcp && FSocket != INVALID_SOCKET)
+		{
+			closesocket(FSocket);
+			FSocket = INVALID_SOCKET;
+		}
+	}
+	else
+	{
+		InterlockedIncrement64(&FDatagrams);
+		LONG Latency = (LONG)(GetTickCount() - Posted);
+		if (Latency > FMaxLatency)
+			InterlockedExchange(&FMaxLatency, Latency);
+	}
+}
+
+bool CDriExporter::Push(const unsigned char* const Data, const size_t Length,
+	const bool Datagram)
+{
+	driExportRecord Record;
+	Record.Data = FPool->Alloc(Length);
+	Record.Length = (unsigned long)Length;
+	Record.Datagram = Datagram;
+	Record.Posted = GetTickCount();
+	CopyMemory(Record.Data, Data, Length);
+	if (FQueue->Push(Record))
+		return true;
+
+	FPool->Free(Record.Data);
+	InterlockedIncrement64(&FDropped);
+	return false;
+}
+
+void CDriExporter::Discard()
+{
+	driExportRecord Record;
+	while (FQueue->Pop(Record))
+		FPool->Free(Record.Data);
+}
+
+int CDriExporter::Open(const tstring& Host, const unsigned short Port)
+{
+	if (FActive)
+		return DRI_E_EXP_OPENED;
+	if (Host == _T("") || Port == 0)
+		return WCL_E_INVALID_ARGUMENT;
+
+	WSADATA Data;
+	if (WSAStartup(MAKEWORD(2, 2), &Data) != 0)
+		return DRI_E_EXP_WINSOCK_FAILED;
+
+	ADDRINFOT Hints;
+	ZeroMemory(&Hints, sizeof(ADDRINFOT));
+	Hints.ai_family = AF_UNSPEC;
+	if (FProtocol == epTcp)
+	{
+		Hints.ai_socktype = SOCK_STREAM;
+		Hints.ai_protocol = IPPROTO_TCP;
+	}
+	else
+	{
+		Hints.ai_socktype = SOCK_DGRAM;
+		Hints.ai_protocol = IPPROTO_UDP;
+	}
+
+	TCHAR Service[8];
+	_stprintf_s(Service, 8, _T("%u"), (unsigned int)Port);
+
+	int Res = WCL_E_SUCCESS;
+	ADDRINFOT* Address = NULL;
+	if (GetAddrInfo(Host.c_str(), Service, &Hints, &Address) != 0)
+		Res = DRI_E_EXP_RESOLVE_FAILED;
+	else
+	{
+		// Kept to connect again over TCP.
+		FAddressLength = (int)min(Address->ai_addrlen, sizeof(SOCKADDR_STORAGE));
+		CopyMemory(&FAddress, Address->ai_addr, FAddressLength);
+		FreeAddrInfo(Address);
+
+		if (!Connect())
+			Res = DRI_E_EXP_SOCKET_FAILED;
+	}
+
+	if (Res == WCL_E_SUCCESS)
+	{
+		FRecords = 0;
+		FDatagrams = 0;
+		FErrors = 0;
+		FDropped = 0;
+		FMaxLatency = 0;
+		FDatagram.clear();
+		FDatagram.reserve(FDatagramSize + DRI_EXPORT_LINE_SIZE);
+		FTerminated = 0;
+
+		FThread = wclCreateThread(ThreadProc, this);
+		if (FThread == NULL)
+			Res = DRI_E_EXP_THREAD_FAILED;
+		else
+			FActive = true;
+	}
+
+	if (Res != WCL_E_SUCCESS)
+	{
+		if (FSocket != INVALID_SOCKET)
+		{
+			closesocket(FSocket);
+			FSocket = INVALID_SOCKET;
+		}
+		WSACleanup();
+	}
+	return Res;
+}
+
+int CDriExporter::Close()
+{
+	if (!FActive)
+		return DRI_E_EXP_CLOSED;
+
+	FActive = false;
+	// The thread sends the queued records before it exits.
+	InterlockedExchange(&FTerminated, 1);
+	FQueue->Wake();
+	wclWaitAndCloseThread(FThread);
+	FThread = NULL;
+	// The records posted while the thread was exiting.
+	Discard();
+
+	// A lost TCP connection has no socket.
+	if (FSocket != INVALID_SOCKET)
+	{
+		closesocket(FSocket);
+		FSocket = INVALID_SOCKET;
+	}
+	WSACleanup();
+	return WCL_E_SUCCESS;
+}
+
+void CDriExporter::Post(const driFrame& Frame, const tstring& Drone,
+	const CwclDriAsdMessage* const Message)
+{
+	if (!FActive || Message == NULL)
+		return;
+
+	if (FFormat == efBinary)
+	{
+		PostRecord(Frame, Drone, Message);
+		return;
+	}
+
+	driJsonLine Line;
+	Line.Length = 0;
+	Line.Overflow = false;
+
+	JsonAppend(Line, "{\"ts\":%I64d,\"sensor\":%u", (Frame.Timestamp - DRI_UNIX_EPOCH) / 10000,
+		(unsigned int)FSource);
+
+#ifdef _UNICODE
+	char Name[DRI_EXPORT_LINE_SIZE / 2];
+	int Len = WideCharToMultiByte(CP_UTF8, 0, Drone.c_str(), (int)Drone.length(), Name,
+		sizeof(Name), NULL, NULL);
+	JsonString(Line, "drone", Name, (Len > 0) ? Len : 0, false);
+#else
+	JsonString(Line, "drone", Drone.c_str(), Drone.length(), false);
+#endif
+
+	size_t Type = (size_t)Message->MessageType;
+	JsonAppend(Line, ",\"transport\":\"%s\",\"radio\":%u,\"rssi\":%d,\"type\":\"%s\",\"counter\":%u",
+		(Frame.Transport == ctWiFi) ? "wifi" : "bt", (unsigned int)Frame.Radio,
+		(int)Frame.Rssi, (Type < DRI_EXPORT_TYPE_COUNT) ? DRI_EXPORT_TYPE_TEXT[Type] : "unknown",
+		(unsigned int)Message->Counter);
+	JsonMessage(Line, Message);
+	JsonAppend(Line, "}\n");
+
+	if (Line.Overflow)
+	{
+		InterlockedIncrement64(&FDropped);
+		return;
+	}
+
+	Push((const unsigned char*)Line.Data, Line.Length, false);
+}
+
+void CDriExporter::PostRecord(const driFrame& Frame, const tstring& Drone,
+	const CwclDriAsdMessage* const Message)
+{
+	unsigned char Record[DRI_EXPORT_RECORD_SIZE];
+	driExportRecordHeader* Header = (driExportRecordHeader*)Record;
+	unsigned char* Name = Record + sizeof(driExportRecordHeader);
+
+#ifdef _UNICODE
+	int Len = WideCharToMultiByte(CP_UTF8, 0, Drone.c_str(), (int)Drone.length(), (char*)Name,
+		DRI_EXPORT_NAME_SIZE, NULL, NULL);
+	size_t NameLength = (Len > 0) ? Len : 0;
+#else
+	size_t NameLength = min(Drone.length(), (size_t)DRI_EXPORT_NAME_SIZE);
+	CopyMemory(Name, Drone.c_str(), NameLength);
+#endif
+
+	wclDriRawData Data = Message->Data;
+	if (Data.size() > 255)
+	{
+		InterlockedIncrement64(&FDropped);
+		return;
+	}
+	if (Data.size() > 0)
+		CopyMemory(Name + NameLength, &Data[0], Data.size());
+
+	size_t Length = sizeof(driExportRecordHeader) + NameLength + Data.size();
+	Header->Length = (unsigned short)Length;
+	Header->MessageType = (unsigned char)Message->MessageType;
+	Header->Version = Message->Version;
+	Header->Counter = Message->Counter;
+	Header->Transport = (unsigned char)Frame.Transport;
+	Header->Radio = Frame.Radio;
+	Header->Rssi = Frame.Rssi;
+	Header->Source = FSource;
+	Header->NameLength = (unsigned char)NameLength;
+	Header->DataLength = (unsigned char)Data.size();
+	Header->Timestamp = Frame.Timestamp;
+	Push(Record, Length, false);
+}
+
+void CDriExporter::PostDatagram(const unsigned char* const Data,
+	const size_t Length)
+{
+	if (!FActive || Data == NULL || Length == 0)
+		return;
+
+	Push(Data, Length, true);
+}
+
+void CDriExporter::PostLine(const char* const Line, const size_t Length)
+{
+	if (!FActive || Line == NULL || Length == 0)
+		return;
+	// A line never spans datagrams.
+	if (Length > FDatagramSize)
+	{
+		InterlockedIncrement64(&FDropped);
+		return;
+	}
+
+	Push((const unsigned char*)Line, Length, false);
+}
+
+bool CDriExporter::GetActive() const
+{
+	return FActive;
+}
+
+unsigned long CDriExporter::GetLatency() const
+{
+	return FLatency;
+}
+
+void CDriExporter::SetLatency(const unsigned long Value)
+{
+	FLatency = Value;
+}
+
+unsigned long CDriExporter::GetDatagramSize() const
+{
+	return FDatagramSize;
+}
+
+void CDriExporter::SetDatagramSize(const unsigned long Value)
+{
+	if (!FActive && Value > 0)
+		FDatagramSize = Value;
+}
+
+driExportFormat CDriExporter::GetFormat() const
+{
+	return FFormat;
+}
+
+void CDriExporter::SetFormat(const driExportFormat Value)
+{
+	if (!FActive)
+		FFormat = Value;
+}
+
+driExportProtocol CDriExporter::GetProtocol() const
+{
+	return FProtocol;
+}
+
+void CDriExporter::SetProtocol(const driExportProtocol Value)
+{
+	if (!FActive)
+		FProtocol = Value;
+}
+
+unsigned short CDriExporter::GetSource() const
+{
+	return FSource;
+}
+
+void CDriExporter::SetSource(const unsigned short Value)
+{
+	FSource = Value;
+}
+
+unsigned __int64 CDriExporter::GetRecords() const
+{
+	return ReadCounter(FRecords);
+}
+
+unsigned __int64 CDriExporter::GetDatagrams() const
+{
+	return ReadCounter(FDatagrams);
+}
+
+unsigned __int64 CDriExporter::GetDropped() const
+{
+	return ReadCounter(FDropped);
+}
+
+unsigned __int64 CDriExporter::GetErrors() const
+{
+	return ReadCounter(FErrors);
+}
+
+unsigned long CDriExporter::GetMaxLatency() const
+{
+	return (unsigned long)FMaxLatency;
+}
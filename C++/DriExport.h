@@ -0,0 +1,328 @@
+
+// DriExport.h : header file
+//
+
+#pragma once
+
+#include <winsock2.h>
+#include <string>
+
+#include "wclHelpers.h"
+#include "wclSync.h"
+#include "wclDriAsd.h"
+
+#include "DriErrors.h"
+#include "DriCaptureManager.h"
+#include "DriPool.h"
+#include "DriQueue.h"
+
+using namespace wclCommon;
+using namespace wclSync;
+using namespace wclDri;
+
+/// <summary> The default number of the queued records. </summary>
+#define DRI_EXPORT_QUEUE_SIZE		65536
+/// <summary> The default maximum datagram size in bytes. Fits the Ethernet
+///   MTU. </summary>
+#define DRI_EXPORT_DATAGRAM_SIZE	1400
+/// <summary> The default maximum time in milliseconds a record waits before
+///   its datagram is sent. </summary>
+#define DRI_EXPORT_LATENCY			100
+/// <summary> The default destination port. </summary>
+#define DRI_EXPORT_PORT				30000
+/// <summary> The longest drone name of a binary record in bytes. </summary>
+#define DRI_EXPORT_NAME_SIZE		64
+
+/// <summary> The export record formats. </summary>
+typedef enum
+{
+	/// <summary> One JSON line per message. </summary>
+	efJson = 0,
+	/// <summary> One <see cref="driExportRecordHeader" /> record per
+	///   message. </summary>
+	efBinary = 1
+} driExportFormat;
+
+/// <summary> The export transport protocols. </summary>
+typedef enum
+{
+	/// <summary> UDP datagrams. </summary>
+	epUdp = 0,
+	/// <summary> A TCP stream. </summary>
+	epTcp = 1
+} driExportProtocol;
+
+#pragma pack(push, 1)
+/// <summary> The binary export record header. </summary>
+/// <remarks> The header (little-endian) is followed by the drone name
+///   (UTF-8, <c>NameLength</c> bytes) and by the ASD message data as received
+///   (<c>DataLength</c> bytes, see ASTM F3411). </remarks>
+typedef struct
+{
+	/// <summary> The record length in bytes including the header. </summary>
+	unsigned short	Length;
+	/// <summary> The ASD message type. </summary>
+	unsigned char	MessageType;
+	/// <summary> The ASD protocol version. </summary>
+	unsigned char	Version;
+	/// <summary> The ASD message counter. </summary>
+	unsigned char	Counter;
+	/// <summary> One of the <c>driCaptureTransport</c> values. </summary>
+	unsigned char	Transport;
+	/// <summary> The receiving radio index. </summary>
+	unsigned char	Radio;
+	char			Rssi;
+	/// <summary> The sensor identification (SAC and SIC). </summary>
+	unsigned short	Source;
+	/// <summary> The drone name length in bytes. </summary>
+	unsigned char	NameLength;
+	/// <summary> The message data length in bytes. </summary>
+	unsigned char	DataLength;
+	/// <summary> The receive time (FILETIME, UTC). </summary>
+	__int64			Timestamp;
+} driExportRecordHeader;
+#pragma pack(pop)
+
+static_assert(sizeof(driExportRecordHeader) == 20, "driExportRecordHeader layout changed");
+
+/// <summary> Exports the decoded drone messages as newline-delimited JSON
+///   or binary records over UDP or TCP. </summary>
+/// <remarks> <para> Each message is serialized to one JSON line or one
+///   binary record (see <see cref="driExportRecordHeader" />) by <c>Post</c>
+///   in the calling (ingestion) thread into a pooled buffer and queued with
+///   its post time; <c>Post</c> never blocks and never waits for the
+///   network. A full queue drops the record and counts it in
+///   <c>Dropped</c>. </para>
+///   <para> A dedicated sender thread packs the records into datagrams (or
+///   stream writes) of up to <c>DatagramSize</c> bytes. A datagram is sent
+///   when the next record does not fit or when its oldest record waited
+///   <c>Latency</c> milliseconds since it was posted. A record never spans
+///   datagrams so every datagram is a complete set of records. Over TCP a
+///   lost connection is made again at most once a second; the records sent
+///   meanwhile are counted in <c>Errors</c>. </para>
+///   <para> A line has the fields <c>ts</c> (the receive time, Unix
+///   milliseconds), <c>sensor</c> (the <c>Source</c>), <c>drone</c>,
+///   <c>transport</c> (<c>wifi</c> or <c>bt</c>), <c>radio</c>, <c>rssi</c>,
+///   <c>type</c> (the ASD message type), <c>counter</c> (the ASD message
+///   counter) and the message fields. Enumerations are written as
+///   numbers. </para>
+///   <para> Complete datagrams (the binary target blocks) are queued with
+///   <c>PostDatagram</c> and sent as they are, in order with the
+///   lines. </para>
+///   <para> Any number of threads may call <c>Post</c>. <c>Open</c> and
+///   <c>Close</c> must not be called while other thread posts. </para>
+///   </remarks>
+class CDriExporter
+{
+	DISABLE_COPY(CDriExporter);
+
+private:
+	typedef struct
+	{
+		unsigned char*	Data;
+		unsigned long	Length;
+		// True for a complete datagram, false for a line or a binary record.
+		bool			Datagram;
+		// The post tick count.
+		DWORD			Posted;
+	} driExportRecord;
+
+	CDriMpscQueue<driExportRecord>*	FQueue;
+	CDriBufferPool*					FPool;
+	SOCKET							FSocket;
+	HANDLE							FThread;
+	volatile LONG					FTerminated;
+	bool							FActive;
+
+	unsigned long					FLatency;
+	unsigned long					FDatagramSize;
+	unsigned short					FSource;
+	driExportFormat					FFormat;
+	driExportProtocol				FProtocol;
+	SOCKADDR_STORAGE				FAddress;
+	int								FAddressLength;
+
+	// Used by the sender thread only.
+	// The datagram being collected and the post time of its oldest record.
+	std::string						FDatagram;
+	DWORD							FFirst;
+	// The last connect attempt tick count.
+	DWORD							FConnected;
+
+	// The counters are read by other threads.
+	volatile __int64				FRecords;
+	volatile __int64				FDatagrams;
+	volatile __int64				FErrors;
+	volatile __int64				FDropped;
+	volatile LONG					FMaxLatency;
+
+	static UINT __stdcall ThreadProc(void* Param);
+	void Execute();
+	bool Connect();
+	void Send();
+	void SendData(const char* const Data, const size_t Length, const DWORD Posted);
+	void Discard();
+	bool Push(const unsigned char* const Data, const size_t Length,
+		const bool Datagram);
+	void PostRecord(const driFrame& Frame, const tstring& Drone,
+		const CwclDriAsdMessage* const Message);
+
+public:
+	/// <summary> Creates new exporter. </summary>
+	/// <param name="Capacity"> The maximum number of the queued
+	///   records. </param>
+	CDriExporter(const unsigned long Capacity = DRI_EXPORT_QUEUE_SIZE);
+	/// <summary> Closes the exporter and frees the object. </summary>
+	virtual ~CDriExporter();
+
+	/// <summary> Starts exporting. </summary>
+	/// <param name="Host"> The destination host name or address. </param>
+	/// <param name="Port"> The destination UDP or TCP port. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Open(const tstring& Host, const unsigned short Port);
+	/// <summary> Sends the queued records and stops exporting. </summary>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Close();
+
+	/// <summary> Queues a decoded message in the <c>Format</c>. </summary>
+	/// <param name="Frame"> The frame the message was received in. </param>
+	/// <param name="Drone"> The drone name. </param>
+	/// <param name="Message"> The message. The exporter does not keep the
+	///   pointer. </param>
+	/// <remarks> Does nothing if the exporter is not opened. </remarks>
+	void Post(const driFrame& Frame, const tstring& Drone,
+		const CwclDriAsdMessage* const Message);
+	/// <summary> Queues a complete datagram (for example an encoded
+	///   binary block). </summary>
+	/// <param name="Data"> The datagram data. The data is copied. </param>
+	/// <param name="Length"> The datagram length in bytes. </param>
+	/// <remarks> The JSON lines queued before are sent first. Does nothing if
+	///   the exporter is not opened. </remarks>
+	void PostDatagram(const unsigned char* const Data, const size_t Length);
+	/// <summary> Queues a ready JSON line. </summary>
+	/// <param name="Line"> The line data ending with the line feed. The data
+	///   is copied. </param>
+	/// <param name="Length"> The line length in bytes. </param>
+	/// <remarks> Used to forward the lines built by other component (the
+	///   fusion node). The line is queued as it is in any <c>Format</c>. A
+	///   line longer than <c>DatagramSize</c> is dropped. Does nothing if the
+	///   exporter is not opened. </remarks>
+	void PostLine(const char* const Line, const size_t Length);
+
+	/// <summary> Gets the exporter state. </summary>
+	/// <returns> <c>True</c> if the exporter is opened. </returns>
+	bool GetActive() const;
+	/// <summary> Gets the exporter state. </summary>
+	/// <value> <c>True</c> if the exporter is opened. </value>
+	__declspec(property(get = GetActive)) bool Active;
+
+	/// <summary> Gets the maximum record latency. </summary>
+	/// <returns> The latency in milliseconds. </returns>
+	unsigned long GetLatency() const;
+	/// <summary> Sets the maximum record latency. </summary>
+	/// <param name="Value"> The latency in milliseconds. 0 sends every
+	///   batch of the queued records at once. </param>
+	void SetLatency(const unsigned long Value);
+	/// <summary> Gets or sets the maximum record latency. </summary>
+	/// <value> The latency in milliseconds. </value>
+	__declspec(property(get = GetLatency, put = SetLatency))
+		unsigned long Latency;
+
+	/// <summary> Gets the maximum datagram size. </summary>
+	/// <returns> The size in bytes. </returns>
+	unsigned long GetDatagramSize() const;
+	/// <summary> Sets the maximum datagram size. </summary>
+	/// <param name="Value"> The size in bytes. Over TCP the maximum size of
+	///   one write. </param>
+	/// <remarks> Must be set before the exporter is opened. </remarks>
+	void SetDatagramSize(const unsigned long Value);
+	/// <summary> Gets or sets the maximum datagram size. </summary>
+	/// <value> The size in bytes. </value>
+	__declspec(property(get = GetDatagramSize, put = SetDatagramSize))
+		unsigned long DatagramSize;
+
+	/// <summary> Gets the record format. </summary>
+	/// <returns> The format of the posted messages. </returns>
+	driExportFormat GetFormat() const;
+	/// <summary> Sets the record format. </summary>
+	/// <param name="Value"> The format of the posted messages. </param>
+	/// <remarks> Must be set before the exporter is opened. </remarks>
+	void SetFormat(const driExportFormat Value);
+	/// <summary> Gets or sets the record format. </summary>
+	/// <value> The format of the posted messages. The default is
+	///   <c>efJson</c>. </value>
+	__declspec(property(get = GetFormat, put = SetFormat))
+		driExportFormat Format;
+
+	/// <summary> Gets the transport protocol. </summary>
+	/// <returns> The protocol. </returns>
+	driExportProtocol GetProtocol() const;
+	/// <summary> Sets the transport protocol. </summary>
+	/// <param name="Value"> The protocol. </param>
+	/// <remarks> Must be set before the exporter is opened. </remarks>
+	void SetProtocol(const driExportProtocol Value);
+	/// <summary> Gets or sets the transport protocol. </summary>
+	/// <value> The protocol. The default is <c>epUdp</c>. </value>
+	__declspec(property(get = GetProtocol, put = SetProtocol))
+		driExportProtocol Protocol;
+
+	/// <summary> Gets the sensor identification. </summary>
+	/// <returns> The SAC in the high byte and the SIC in the low
+	///   byte. </returns>
+	unsigned short GetSource() const;
+	/// <summary> Sets the sensor identification. </summary>
+	/// <param name="Value"> The SAC in the high byte and the SIC in the low
+	///   byte. </param>
+	void SetSource(const unsigned short Value);
+	/// <summary> Gets or sets the sensor identification written to every
+	///   line. </summary>
+	/// <value> The SAC in the high byte and the SIC in the low
+	///   byte. </value>
+	__declspec(property(get = GetSource, put = SetSource))
+		unsigned short Source;
+
+	/// <summary> Gets the number of the sent records (JSON lines, binary
+	///   records and posted datagrams). </summary>
+	/// <returns> The records count. </returns>
+	unsigned __int64 GetRecords() const;
+	/// <summary> Gets the number of the sent records (JSON lines, binary
+	///   records and posted datagrams). </summary>
+	/// <value> The records count. </value>
+	__declspec(property(get = GetRecords)) unsigned __int64 Records;
+
+	/// <summary> Gets the number of the sent datagrams. </summary>
+	/// <returns> The datagrams count. </returns>
+	unsigned __int64 GetDatagrams() const;
+	/// <summary> Gets the number of the sent datagrams. </summary>
+	/// <value> The datagrams count. </value>
+	__declspec(property(get = GetDatagrams)) unsigned __int64 Datagrams;
+
+	/// <summary> Gets the number of the records dropped because the queue
+	///   was full. </summary>
+	/// <returns> The dropped records count. </returns>
+	unsigned __int64 GetDropped() const;
+	/// <summary> Gets the number of the records dropped because the queue
+	///   was full. </summary>
+	/// <value> The dropped records count. </value>
+	__declspec(property(get = GetDropped)) unsigned __int64 Dropped;
+
+	/// <summary> Gets the number of the failed sends. </summary>
+	/// <returns> The failed datagrams count. </returns>
+	unsigned __int64 GetErrors() const;
+	/// <summary> Gets the number of the failed sends. </summary>
+	/// <value> The failed datagrams count. </value>
+	__declspec(property(get = GetErrors)) unsigned __int64 Errors;
+
+	/// <summary> Gets the longest time a record waited from its post to its
+	///   send. </summary>
+	/// <returns> The latency in milliseconds. </returns>
+	unsigned long GetMaxLatency() const;
+	/// <summary> Gets the longest time a record waited from its post to its
+	///   send. </summary>
+	/// <value> The latency in milliseconds. </value>
+	__declspec(property(get = GetMaxLatency)) unsigned long MaxLatency;
+};
@@ -0,0 +1,384 @@
+
+// DriFormat.cpp : implementation file
+//
+
+#include "stdafx.h"
+#include "DriFormat.h"
+
+#include <math.h>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+
+// The enumeration texts. The tables are indexed by the enumeration value.
+
+static const TCHAR* const DRI_MESSAGE_TYPE_TEXT[] = {
+	_T("BASIC ID"), _T("LOCATION"), _T("AUTH"), _T("SELF ID"), _T("SYSTEM"),
+	_T("OPERATOR ID") };
+
+static const TCHAR* const DRI_ID_TYPE_TEXT[] = {
+	_T("None"), _T("Serial number"), _T("CAA registration ID"),
+	_T("UTM assigned UUID"), _T("Specific session ID") };
+
+static const TCHAR* const DRI_UAV_TYPE_TEXT[] = {
+	_T("None"), _T("Aeroplane"), _T("Copter"), _T("Gyroplane"), _T("Hybrid"),
+	_T("Ornithopter"), _T("Glider"), _T("Kite"), _T("Free balloon"),
+	_T("Captive balloon"), _T("Airship"), _T("Free fall parachute"),
+	_T("Rocket"), _T("Tethered powered aircraft"), _T("Ground obstacle"),
+	_T("Other") };
+
+static const TCHAR* const DRI_DESCRIPTION_TYPE_TEXT[] = {
+	_T("Text"), _T("Emergency"), _T("Extended") };
+
+static const TCHAR* const DRI_LOCATION_TYPE_TEXT[] = {
+	_T("Take off"), _T("Live GNSS"), _T("Fixed") };
+
+static const TCHAR* const DRI_CLASSIFICATION_TEXT[] = {
+	_T("Undeclared"), _T("EU") };
+
+static const TCHAR* const DRI_EU_CATEGORY_TEXT[] = {
+	_T("Undeclared"), _T("Open"), _T("Specific"), _T("Certified") };
+
+static const TCHAR* const DRI_EU_CLASS_TEXT[] = {
+	_T("Unspecified"), _T("Class 0"), _T("Class 1"), _T("Class 2"),
+	_T("Class 3"), _T("Class 4"), _T("Class 5"), _T("Class 6") };
+
+static const TCHAR* const DRI_STATUS_TEXT[] = {
+	_T("Undeclared"), _T("Ground"), _T("Airborne"), _T("Emergency"),
+	_T("Failure") };
+
+static const TCHAR* const DRI_HEIGHT_REFERENCE_TEXT[] = {
+	_T("Take off"), _T("Ground") };
+
+static const TCHAR* const DRI_HORIZONTAL_ACCURACY_TEXT[] = {
+	_T("Unknown"), _T("10 miles"), _T("4 miles"), _T("2 miles"), _T("1 mile"),
+	_T("0.5 mile"), _T("0.3 mile"), _T("0.1 mile"), _T("0.05 mile"),
+	_T("30 meters"), _T("10 meters"), _T("3 meters"), _T("1 meter") };
+
+static const TCHAR* const DRI_VERTICAL_ACCURACY_TEXT[] = {
+	_T("Unknow"), _T("150 m"), _T("45 m"), _T("25 m"), _T("10 m"), _T("3 m"),
+	_T("1 m") };
+
+static const TCHAR* const DRI_SPEED_ACCURACY_TEXT[] = {
+	_T("Unknown"), _T("10 m/s"), _T("3 m/s"), _T("1 m/s"), _T("0.3 m/s") };
+
+static const TCHAR* const DRI_TIMESTAMP_ACCURACY_TEXT[] = {
+	_T("Unknown"), _T("0.1 second"), _T("0.2 second"), _T("0.3 second"),
+	_T("0.4 second"), _T("0.5 second"), _T("0.6 second"), _T("0.7 second"),
+	_T("0.8 second"), _T("0.9 second"), _T("1 second"), _T("1.1 second"),
+	_T("1.2 second"), _T("1.3 second"), _T("1.4 second"), _T("1.5 second") };
+
+#define DRI_TABLE_SIZE(Table)	(sizeof(Table) / sizeof(Table[0]))
+
+static const TCHAR DRI_HEX_DIGITS[] = _T("0123456789ABCDEF");
+
+// AppendFloat formats the values under the limit itself. The scaled value
+// stays under 2^50 so its rounding error is at most 1/16.
+#define DRI_FLOAT_LIMIT		1e9
+
+
+// CDriFormatter
+
+void CDriFormatter::AddRow(driDetailRows& Rows, size_t& Count,
+	const TCHAR* const Name, const TCHAR* const Value)
+{
+	AddRow(Rows, Count, Name).append(Value);
+}
+
+tstring& CDriFormatter::AddRow(driDetailRows& Rows, size_t& Count,
+	const TCHAR* const Name)
+{
+	if (Count == Rows.size())
+		Rows.push_back(driDetailRow());
+
+	driDetailRow& Row = Rows[Count];
+	Count++;
+
+	Row.Name = Name;
+	// clear() keeps the capacity so the row is formatted without allocation
+	// when the same message is formatted again.
+	Row.Value.clear();
+	return Row.Value;
+}
+
+void CDriFormatter::AppendHex(tstring& Str, const unsigned char Val)
+{
+	Str += DRI_HEX_DIGITS[Val >> 4];
+	Str += DRI_HEX_DIGITS[Val & 0x0F];
+}
+
+void CDriFormatter::AppendUInt(tstring& Str, const unsigned long Val)
+{
+	TCHAR Buffer[16];
+	size_t Pos = DRI_TABLE_SIZE(Buffer);
+	unsigned long v = Val;
+	do
+	{
+		Pos--;
+		Buffer[Pos] = (TCHAR)(_T('0') + v % 10);
+		v /= 10;
+	} while (v != 0);
+	Str.append(Buffer + Pos, DRI_TABLE_SIZE(Buffer) - Pos);
+}
+
+void CDriFormatter::AppendFloat(tstring& Str, const double Val)
+{
+	// Same output as "%f" (6 decimal digits). Huge and not finite values go
+	// to the CRT.
+	if (!(Val > -DRI_FLOAT_LIMIT && Val < DRI_FLOAT_LIMIT))
+	{
+		TCHAR Buffer[64];
+		_stprintf_s(Buffer, DRI_TABLE_SIZE(Buffer), _T("%f"), Val);
+		Str.append(Buffer);
+		return;
+	}
+
+	double Abs = Val;
+	if (Val < 0)
+	{
+		Str += _T('-');
+		Abs = -Val;
+	}
+
+	// The CRT rounds the exact binary value half to even. The product is
+	// rounded, so its rounding error is taken from fma(): the exact value is
+	// Scaled + 0.5 + Rest + Error. Near a tie both Rest and Error are exact
+	// so the tie is detected exactly.
+	double Product = Abs * 1000000.0;
+	double Error = fma(Abs, 1000000.0, -Product);
+	unsigned __int64 Scaled = (unsigned __int64)Product;
+	double Rest = Product - (double)Scaled - 0.5;
+	if (Rest > -Error || (Rest == -Error && (Scaled & 1) != 0))
+		Scaled++;
+	unsigned __int64 Int = Scaled / 1000000;
+	unsigned long Frac = (unsigned long)(Scaled % 1000000);
+
+	TCHAR Buffer[32];
+	size_t Pos = DRI_TABLE_SIZE(Buffer);
+	for (int i = 0; i < 6; i++)
+	{
+		Pos--;
+		Buffer[Pos] = (TCHAR)(_T('0') + Frac % 10);
+		Frac /= 10;
+	}
+	Pos--;
+	Buffer[Pos] = _T('.');
+	do
+	{
+		Pos--;
+		Buffer[Pos] = (TCHAR)(_T('0') + (unsigned long)(Int % 10));
+		Int /= 10;
+	} while (Int != 0);
+	Str.append(Buffer + Pos, DRI_TABLE_SIZE(Buffer) - Pos);
+}
+
+void CDriFormatter::AppendEnum(tstring& Str, const TCHAR* const* const Table,
+	const size_t Count, const unsigned char Val)
+{
+	if (Val < Count)
+		Str.append(Table[Val]);
+	else
+	{
+		Str.append(_T("Raw value: 0x"));
+		AppendHex(Str, Val);
+	}
+}
+
+void CDriFormatter::AppendAltitude(tstring& Str, const float Altitude)
+{
+	if (Altitude == -1000)
+		Str.append(_T("Invalid"));
+	else
+		AppendFloat(Str, Altitude);
+}
+
+void CDriFormatter::AppendLatLon(tstring& Str, const double LatLon)
+{
+	if (LatLon == 0)
+		Str.append(_T("Invalid"));
+	else
+		AppendFloat(Str, LatLon);
+}
+
+void CDriFormatter::AppendDateTime(tstring& Str, const time_t Time)
+{
+	tm* ptm = localtime(&Time);
+	if (ptm != NULL)
+	{
+		TCHAR Buffer[32];
+		// Format: Mo, 15.06.2009 20:20:00
+		if (_tcsftime(Buffer, DRI_TABLE_SIZE(Buffer), _T("%a, %d.%m.%Y %H:%M:%S"), ptm) > 0)
+			Str.append(Buffer);
+	}
+}
+
+void CDriFormatter::AppendId(tstring& Str, const wclDriAsdId& Id)
+{
+	// The ID is a zero padded ASCII string.
+	for (wclDriAsdId::const_iterator c = Id.begin(); c != Id.end() && *c != 0; c++)
+		Str += (TCHAR)*c;
+}
+
+void CDriFormatter::FormatLocation(const CwclDriAsdLocationMessage* const Message,
+	driDetailRows& Rows, size_t& Count)
+{
+	AppendAltitude(AddRow(Rows, Count, _T("Baro Altitude")), Message->BaroAltitude);
+	AppendEnum(AddRow(Rows, Count, _T("Baro Accuracy")), DRI_VERTICAL_ACCURACY_TEXT,
+		DRI_TABLE_SIZE(DRI_VERTICAL_ACCURACY_TEXT), (unsigned char)Message->BaroAccuracy);
+
+	tstring& Direction = AddRow(Rows, Count, _T("Direction"));
+	if (Message->Direction > 360)
+		Direction.append(_T("Invalid"));
+	else
+		AppendUInt(Direction, Message->Direction);
+
+	AppendAltitude(AddRow(Rows, Count, _T("Geo Altitude")), Message->GeoAltitude);
+	AppendAltitude(AddRow(Rows, Count, _T("Height")), Message->Height);
+	AppendEnum(AddRow(Rows, Count, _T("Height Reference")), DRI_HEIGHT_REFERENCE_TEXT,
+		DRI_TABLE_SIZE(DRI_HEIGHT_REFERENCE_TEXT), (unsigned char)Message->HeightReference);
+	AppendEnum(AddRow(Rows, Count, _T("Horizontal Accuracy")), DRI_HORIZONTAL_ACCURACY_TEXT,
+		DRI_TABLE_SIZE(DRI_HORIZONTAL_ACCURACY_TEXT), (unsigned char)Message->HorizontalAccuracy);
+
+	tstring& Speed = AddRow(Rows, Count, _T("Horizontal Speed"));
+	if (Message->HorizontalSpeed == 255)
+		Speed.append(_T("Invalid"));
+	else
+		AppendFloat(Speed, Message->HorizontalSpeed);
+
+	AppendLatLon(AddRow(Rows, Count, _T("Latitude")), Message->Latitude);
+	AppendLatLon(AddRow(Rows, Count, _T("Longitude")), Message->Longitude);
+	AppendEnum(AddRow(Rows, Count, _T("Speed Accuracy")), DRI_SPEED_ACCURACY_TEXT,
+		DRI_TABLE_SIZE(DRI_SPEED_ACCURACY_TEXT), (unsigned char)Message->SpeedAccuracy);
+	AppendEnum(AddRow(Rows, Count, _T("Status")), DRI_STATUS_TEXT,
+		DRI_TABLE_SIZE(DRI_STATUS_TEXT), (unsigned char)Message->Status);
+	AppendFloat(AddRow(Rows, Count, _T("Timestamp")), Message->Timestamp);
+	AppendEnum(AddRow(Rows, Count, _T("Timestamp Accuracy")), DRI_TIMESTAMP_ACCURACY_TEXT,
+		DRI_TABLE_SIZE(DRI_TIMESTAMP_ACCURACY_TEXT), (unsigned char)Message->TimestampAccuracy);
+	AppendEnum(AddRow(Rows, Count, _T("Vertical Accuracy")), DRI_VERTICAL_ACCURACY_TEXT,
+		DRI_TABLE_SIZE(DRI_VERTICAL_ACCURACY_TEXT), (unsigned char)Message->VerticalAccuracy);
+	AppendFloat(AddRow(Rows, Count, _T("Vertical Speed")), Message->VerticalSpeed);
+}
+
+void CDriFormatter::FormatSelfId(const CwclDriAsdSelfIdMessage* const Message,
+	driDetailRows& Rows, size_t& Count)
+{
+	tstring& Description = AddRow(Rows, Count, _T("Description"));
+	std::string Text = Message->Description;
+	for (std::string::const_iterator c = Text.begin(); c != Text.end() && *c != 0; c++)
+		Description += (TCHAR)(unsigned char)*c;
+
+	AppendEnum(AddRow(Rows, Count, _T("Description Type")), DRI_DESCRIPTION_TYPE_TEXT,
+		DRI_TABLE_SIZE(DRI_DESCRIPTION_TYPE_TEXT), (unsigned char)Message->DescriptionType);
+}
+
+void CDriFormatter::FormatOperatorId(const CwclDriAsdOperatorIdMessage* const Message,
+	driDetailRows& Rows, size_t& Count)
+{
+	AppendId(AddRow(Rows, Count, _T("ID")), Message->Id);
+
+	tstring& IdType = AddRow(Rows, Count, _T("ID Type"));
+	IdType.append(_T("0x"));
+	AppendHex(IdType, Message->IdType);
+}
+
+void CDriFormatter::FormatSystem(const CwclDriAsdSystemMessage* const Message,
+	driDetailRows& Rows, size_t& Count)
+{
+	AppendAltitude(AddRow(Rows, Count, _T("Area ceiling")), Message->AreaCeiling);
+	AppendUInt(AddRow(Rows, Count, _T("Area count")), Message->AreaCount);
+	AppendAltitude(AddRow(Rows, Count, _T("Area floor")), Message->AreaFloor);
+	AppendUInt(AddRow(Rows, Count, _T("Area radius")), Message->AreaRadius);
+	AppendFloat(AddRow(Rows, Count, _T("Operator altitude")), Message->OperatorAltitude);
+	AppendEnum(AddRow(Rows, Count, _T("Operator classification")), DRI_CLASSIFICATION_TEXT,
+		DRI_TABLE_SIZE(DRI_CLASSIFICATION_TEXT), (unsigned char)Message->OperatorClassification);
+	AppendLatLon(AddRow(Rows, Count, _T("Operator latitude")), Message->OperatorLatitude);
+	AppendLatLon(AddRow(Rows, Count, _T("Operator longitude")), Message->OperatorLongitude);
+	AppendEnum(AddRow(Rows, Count, _T("Location type")), DRI_LOCATION_TYPE_TEXT,
+		DRI_TABLE_SIZE(DRI_LOCATION_TYPE_TEXT), (unsigned char)Message->OperatorLocation);
+	AppendDateTime(AddRow(Rows, Count, _T("Timestamp")), Message->Timestamp);
+	AppendEnum(AddRow(Rows, Count, _T("UAV EU category")), DRI_EU_CATEGORY_TEXT,
+		DRI_TABLE_SIZE(DRI_EU_CATEGORY_TEXT), (unsigned char)Message->UavEuCategory);
+	AppendEnum(AddRow(Rows, Count, _T("UAV EU class")), DRI_EU_CLASS_TEXT,
+		DRI_TABLE_SIZE(DRI_EU_CLASS_TEXT), (unsigned char)Message->UavEuClass);
+}
+
+void CDriFormatter::FormatBasicId(const CwclDriAsdBasicIdMessage* const Message,
+	driDetailRows& Rows, size_t& Count)
+{
+	AppendId(AddRow(Rows, Count, _T("ID")), Message->Id);
+	AppendEnum(AddRow(Rows, Count, _T("ID type")), DRI_ID_TYPE_TEXT,
+		DRI_TABLE_SIZE(DRI_ID_TYPE_TEXT), (unsigned char)Message->IdType);
+	AppendEnum(AddRow(Rows, Count, _T("UAV type")), DRI_UAV_TYPE_TEXT,
+		DRI_TABLE_SIZE(DRI_UAV_TYPE_TEXT), (unsigned char)Message->UavType);
+}
+
+void CDriFormatter::FormatUnknown(const CwclDriAsdMessage* const Message,
+	driDetailRows& Rows, size_t& Count)
+{
+	AppendHex(AddRow(Rows, Count, _T("Message type")), (unsigned char)Message->MessageType);
+
+	tstring& Raw = AddRow(Rows, Count, _T("Raw date"));
+	wclDriRawData Data = Message->Data;
+	Raw.reserve(Data.size() * 2);
+	for (wclDriRawData::const_iterator b = Data.begin(); b != Data.end(); b++)
+		AppendHex(Raw, *b);
+}
+
+const TCHAR* CDriFormatter::MessageTypeText(const wclDriAsdMessageType MessageType)
+{
+	if ((size_t)MessageType < DRI_TABLE_SIZE(DRI_MESSAGE_TYPE_TEXT))
+		return DRI_MESSAGE_TYPE_TEXT[MessageType];
+	return _T("UNKNOWN");
+}
+
+const TCHAR* CDriFormatter::VendorText(const wclDriVendor Vendor)
+{
+	switch (Vendor)
+	{
+		case driAsd:
+			return _T("ASD");
+		default:
+			return _T("UKNOWN");
+	}
+}
+
+void CDriFormatter::Format(const tstring& Ssid, const CwclDriMessage* const Message,
+	driDetailRows& Rows)
+{
+	size_t Count = 0;
+
+	if (Message != NULL && Message->Vendor == driAsd)
+	{
+		AddRow(Rows, Count, _T("SSID")).append(Ssid);
+		AddRow(Rows, Count, _T("Vendor"), VendorText(Message->Vendor));
+		AddRow(Rows, Count, _T(""));
+
+		const CwclDriAsdMessage* AsdMessage = (const CwclDriAsdMessage*)Message;
+		switch (AsdMessage->MessageType)
+		{
+			case mtBasicId:
+				FormatBasicId((const CwclDriAsdBasicIdMessage*)AsdMessage, Rows, Count);
+				break;
+			case mtLocation:
+				FormatLocation((const CwclDriAsdLocationMessage*)AsdMessage, Rows, Count);
+				break;
+			case mtSelfId:
+				FormatSelfId((const CwclDriAsdSelfIdMessage*)AsdMessage, Rows, Count);
+				break;
+			case mtSystem:
+				FormatSystem((const CwclDriAsdSystemMessage*)AsdMessage, Rows, Count);
+				break;
+			case mtOperatorId:
+				FormatOperatorId((const CwclDriAsdOperatorIdMessage*)AsdMessage, Rows, Count);
+				break;
+			default:
+				// mtAuth and the unknown messages.
+				FormatUnknown(AsdMessage, Rows, Count);
+				break;
+		}
+	}
+
+	Rows.resize(Count);
+}
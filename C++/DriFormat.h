@@ -0,0 +1,87 @@
+
+// DriFormat.h : header file
+//
+
+#pragma once
+
+#include <vector>
+
+#include "wclHelpers.h"
+#include "wclDriCommon.h"
+#include "wclDriAsd.h"
+
+using namespace wclCommon;
+using namespace wclDri;
+
+/// <summary> The formatted DRI message detail row. </summary>
+typedef struct
+{
+	/// <summary> The row name. Points to a static string. </summary>
+	const TCHAR*	Name;
+	/// <summary> The formatted value. </summary>
+	tstring			Value;
+} driDetailRow;
+
+/// <summary> The formatted DRI message details. </summary>
+typedef std::vector<driDetailRow> driDetailRows;
+
+/// <summary> Converts the DRI messages to the display strings. </summary>
+/// <remarks> <para> All the enumeration texts come from static tables
+///   indexed by the value so no string is built for them. Numbers are
+///   formatted without the CRT locale look-up. </para>
+///   <para> <c>Format</c> reuses the rows (and the value strings capacity)
+///   passed in, so a message formatted once can be shown any number of times
+///   by copying the string pointers. </para> </remarks>
+class CDriFormatter
+{
+	DISABLE_COPY(CDriFormatter);
+
+private:
+	static void AddRow(driDetailRows& Rows, size_t& Count, const TCHAR* const Name,
+		const TCHAR* const Value);
+	static tstring& AddRow(driDetailRows& Rows, size_t& Count,
+		const TCHAR* const Name);
+
+	static void AppendHex(tstring& Str, const unsigned char Val);
+	static void AppendUInt(tstring& Str, const unsigned long Val);
+	static void AppendFloat(tstring& Str, const double Val);
+	static void AppendEnum(tstring& Str, const TCHAR* const* const Table,
+		const size_t Count, const unsigned char Val);
+	static void AppendAltitude(tstring& Str, const float Altitude);
+	static void AppendLatLon(tstring& Str, const double LatLon);
+	static void AppendDateTime(tstring& Str, const time_t Time);
+	static void AppendId(tstring& Str, const wclDriAsdId& Id);
+
+	static void FormatLocation(const CwclDriAsdLocationMessage* const Message,
+		driDetailRows& Rows, size_t& Count);
+	static void FormatSelfId(const CwclDriAsdSelfIdMessage* const Message,
+		driDetailRows& Rows, size_t& Count);
+	static void FormatOperatorId(const CwclDriAsdOperatorIdMessage* const Message,
+		driDetailRows& Rows, size_t& Count);
+	static void FormatSystem(const CwclDriAsdSystemMessage* const Message,
+		driDetailRows& Rows, size_t& Count);
+	static void FormatBasicId(const CwclDriAsdBasicIdMessage* const Message,
+		driDetailRows& Rows, size_t& Count);
+	static void FormatUnknown(const CwclDriAsdMessage* const Message,
+		driDetailRows& Rows, size_t& Count);
+
+public:
+	/// <summary> Gets the ASD message type name. </summary>
+	/// <param name="MessageType"> The message type. </param>
+	/// <returns> The static message type name. </returns>
+	static const TCHAR* MessageTypeText(const wclDriAsdMessageType MessageType);
+	/// <summary> Gets the DRI vendor name. </summary>
+	/// <param name="Vendor"> The vendor. </param>
+	/// <returns> The static vendor name. </returns>
+	static const TCHAR* VendorText(const wclDriVendor Vendor);
+
+	/// <summary> Formats the DRI message details. </summary>
+	/// <param name="Ssid"> The drone SSID. </param>
+	/// <param name="Message"> The DRI message. </param>
+	/// <param name="Rows"> On output contains the detail rows. The existing
+	///   rows are reused. </param>
+	/// <remarks> Only the ASD messages have details. For other vendors the
+	///   rows are cleared. </remarks>
+	static void Format(const tstring& Ssid, const CwclDriMessage* const Message,
+		driDetailRows& Rows);
+};
@@ -0,0 +1,916 @@
+
+// DriFusion.cpp : implementation file
+//
+
+#include "stdafx.h"
+#include "DriFusion.h"
+
+#include <stdlib.h>
+
+#include "wclDriAsd.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+
+// The receive buffer: the largest UDP datagram.
+#define DRI_FUSION_DATAGRAM_SIZE	65536
+// The socket receive buffer size: keeps the bursts of all the sensors in
+// the kernel.
+#define DRI_FUSION_RECEIVE_BUFFER	(8 * 1024 * 1024)
+// The number of the datagrams received before the due messages are
+// forwarded.
+#define DRI_FUSION_BATCH			256
+// The wait interval in milliseconds: the forward time granularity.
+#define DRI_FUSION_POLL_INTERVAL	10
+// The prune interval in milliseconds.
+#define DRI_FUSION_PRUNE_INTERVAL	1000
+// The time in milliseconds a copy of the forwarded message is still
+// recognized. The counter wraps much later.
+#define DRI_FUSION_MATCH			2000
+// One hour in milliseconds.
+#define DRI_FUSION_HOUR				3600000LL
+// The time in milliseconds the estimate of a drone is a warm start for
+// its next message.
+#define DRI_FUSION_WARM_TIME		5000
+
+// Same order as the exporter (the ASD message types).
+static const char* const DRI_FUSION_TYPE_TEXT[DRI_FUSION_TYPES] = {
+	"basic_id", "location", "auth", "self_id", "system", "operator_id" };
+
+// The fields of a line the node uses. The strings point into the datagram
+// and stay escaped.
+typedef struct
+{
+	__int64			Timestamp;
+	unsigned short	Source;
+	const char*		Drone;
+	size_t			DroneLength;
+	const char*		Transport;
+	size_t			TransportLength;
+	int				Rssi;
+	int				Type;
+	int				Counter;
+	// The location time in seconds after the hour. Negative if none.
+	double			Time;
+	// The reported position. The altitude is DRI_LOCATE_NO_ALTITUDE if
+	// none.
+	bool			Reported;
+	double			Latitude;
+	double			Longitude;
+	double			Altitude;
+	const char*		Id;
+	size_t			IdLength;
+	// The closing brace.
+	const char*		Close;
+} driFusionLine;
+
+static bool KeyIs(const char* const Key, const size_t Length, const char* const Name)
+{
+	return (strlen(Name) == Length && memcmp(Key, Name, Length) == 0);
+}
+
+// Parses a flat JSON object written by the exporter. Only the used fields
+// are read.
+static bool ParseLine(const char* const Line, const char* const End,
+	driFusionLine& Result)
+{
+	Result.Timestamp = -1;
+	Result.Source = 0;
+	Result.Drone = NULL;
+	Result.DroneLength = 0;
+	Result.Transport = "";
+	Result.TransportLength = 0;
+	Result.Rssi = -128;
+	Result.Type = -1;
+	Result.Counter = -1;
+	Result.Time = -1;
+	Result.Latitude = 0;
+	Result.Longitude = 0;
+	Result.Altitude = DRI_LOCATE_NO_ALTITUDE;
+	Result.Id = NULL;
+	Result.IdLength = 0;
+	Result.Close = NULL;
+
+	const char* p = Line;
+	if (p == End || *p != '{')
+		return false;
+	p++;
+
+	while (p < End)
+	{
+		if (*p != '"')
+			return false;
+		const char* Key = ++p;
+		while (p < End && *p != '"')
+			p++;
+		if (p + 1 >= End || p[1] != ':')
+			return false;
+		size_t KeyLength = p - Key;
+		p += 2;
+		if (p >= End)
+			return false;
+
+		if (*p == '"')
+		{
+			const char* Value = ++p;
+			while (p < End && *p != '"')
+			{
+				if (*p == '\\')
+					p++;
+				p++;
+			}
+			if (p >= End)
+				return false;
+			size_t Length = p - Value;
+			p++;
+
+			if (KeyIs(Key, KeyLength, "drone"))
+			{
+				Result.Drone = Value;
+				Result.DroneLength = Length;
+			}
+			else
+			{
+				if (KeyIs(Key, KeyLength, "transport"))
+				{
+					Result.Transport = Value;
+					Result.TransportLength = Length;
+				}
+				else
+				{
+					if (KeyIs(Key, KeyLength, "type"))
+					{
+						for (int i = 0; i < DRI_FUSION_TYPES; i++)
+						{
+							if (KeyIs(Value, Length, DRI_FUSION_TYPE_TEXT[i]))
+								Result.Type = i;
+						}
+					}
+					else
+					{
+						if (KeyIs(Key, KeyLength, "id"))
+						{
+							Result.Id = Value;
+							Result.IdLength = Length;
+						}
+					}
+				}
+			}
+		}
+		else
+		{
+			// The line is terminated by the closing brace so the number
+			// conversion stops inside the line.
+			if (KeyIs(Key, KeyLength, "ts"))
+				Result.Timestamp = _strtoi64(p, NULL, 10);
+			else
+			{
+				if (KeyIs(Key, KeyLength, "sensor"))
+					Result.Source = (unsigned short)strtoul(p, NULL, 10);
+				else
+				{
+					if (KeyIs(Key, KeyLength, "rssi"))
+						Result.Rssi = (int)strtol(p, NULL, 10);
+					else
+					{
+						if (KeyIs(Key, KeyLength, "counter"))
+							Result.Counter = (int)strtol(p, NULL, 10);
+						else
+						{
+							if (KeyIs(Key, KeyLength, "time"))
+								Result.Time = strtod(p, NULL);
+							else
+							{
+								if (KeyIs(Key, KeyLength, "lat"))
+									Result.Latitude = strtod(p, NULL);
+								else
+								{
+									if (KeyIs(Key, KeyLength, "lon"))
+										Result.Longitude = strtod(p, NULL);
+									else
+									{
+										if (KeyIs(Key, KeyLength, "geo_alt"))
+											Result.Altitude = strtod(p, NULL);
+									}
+								}
+							}
+						}
+					}
+				}
+			}
+			while (p < End && *p != ',' && *p != '}')
+				p++;
+		}
+
+		if (p >= End)
+			return false;
+		if (*p == '}')
+		{
+			Result.Close = p;
+			break;
+		}
+		p++;
+	}
+
+	// A drone without the fix reports zeros.
+	Result.Reported = (Result.Type == mtLocation && Result.Latitude >= -90 &&
+		Result.Latitude <= 90 && Result.Longitude >= -180 && Result.Longitude <= 180 &&
+		(Result.Latitude != 0 || Result.Longitude != 0));
+
+	return (Result.Close != NULL && Result.Timestamp >= 0 && Result.Drone != NULL &&
+		Result.DroneLength > 0 && Result.Counter >= 0 && Result.Counter <= 0xFF);
+}
+
+
+// CDriFusion
+
+CDriFusion::CDriFusion(CDriExporter* const Output)
+{
+	FOutput = Output;
+	FCS = new CwclCriticalSection();
+	FSocket = INVALID_SOCKET;
+	FThread = NULL;
+	FTerminated = 0;
+	FActive = false;
+	FWindow = DRI_FUSION_WINDOW;
+
+	FSequence = 0;
+
+	FLines = 0;
+	FFused = 0;
+	FDuplicates = 0;
+	FLate = 0;
+	FErrors = 0;
+	FLocated = 0;
+	FSpoofed = 0;
+}
+
+CDriFusion::~CDriFusion()
+{
+	Close();
+
+	delete FCS;
+}
+
+UINT __stdcall CDriFusion::ThreadProc(void* Param)
+{
+	((CDriFusion*)Param)->Execute();
+	return 0;
+}
+
+void CDriFusion::Execute()
+{
+	DWORD LastPrune = GetTickCount();
+	while (FTerminated == 0)
+	{
+		fd_set ReadSet;
+		FD_ZERO(&ReadSet);
+		FD_SET(FSocket, &ReadSet);
+
+		timeval Timeout;
+		Timeout.tv_sec = 0;
+		Timeout.tv_usec = DRI_FUSION_POLL_INTERVAL * 1000;
+		int Ready = select(0, &ReadSet, NULL, NULL, &Timeout);
+		if (Ready == SOCKET_ERROR)
+			Sleep(DRI_FUSION_POLL_INTERVAL);
+		else
+		{
+			if (Ready > 0)
+				Receive();
+		}
+
+		ForwardDue(false);
+		if (GetTickCount() - LastPrune >= DRI_FUSION_PRUNE_INTERVAL)
+		{
+			Prune();
+			LastPrune = GetTickCount();
+		}
+	}
+
+	ForwardDue(true);
+}
+
+void CDriFusion::Receive()
+{
+	for (int i = 0; i < DRI_FUSION_BATCH; i++)
+	{
+		sockaddr_in From;
+		int FromLength = sizeof(From);
+		int Len = recvfrom(FSocket, &FBuffer[0], DRI_FUSION_DATAGRAM_SIZE, 0,
+			(sockaddr*)&From, &FromLength);
+		// Nothing more (the socket is non-blocking).
+		if (Len == SOCKET_ERROR)
+			break;
+		if (Len == 0)
+			continue;
+		// Stops the number conversion of a truncated line.
+		FBuffer[Len] = 0;
+
+		unsigned __int64 Key = ((unsigned __int64)From.sin_addr.s_addr << 16) | From.sin_port;
+		DWORD Now = GetTickCount();
+
+		FCS->Enter();
+		std::map<unsigned __int64, driFusionSensorEntry>::iterator Sensor = FSensors.find(Key);
+		if (Sensor == FSensors.end())
+		{
+			driFusionSensorEntry Entry;
+			Entry.Info.Address = From.sin_addr.s_addr;
+			Entry.Info.Port = ntohs(From.sin_port);
+			Entry.Info.Source = 0;
+			Entry.Info.Lines = 0;
+			Entry.Info.Synchronized = false;
+			Entry.Info.Offset = 0;
+			Sensor = FSensors.insert(std::make_pair(Key, Entry)).first;
+		}
+		Sensor->second.Seen = Now;
+
+		// A datagram holds complete lines.
+		const char* Line = &FBuffer[0];
+		const char* End = Line + Len;
+		while (Line < End)
+		{
+			const char* Next = (const char*)memchr(Line, '\n', End - Line);
+			if (Next == NULL)
+				Next = End;
+			if (Next > Line)
+				Ingest(Sensor->second, Line, Next);
+			Line = Next + 1;
+		}
+		FCS->Leave();
+	}
+}
+
+void CDriFusion::Ingest(driFusionSensorEntry& Sensor, const char* const Line,
+	const char* const End)
+{
+	FLines++;
+	Sensor.Info.Lines++;
+
+	driFusionLine Data;
+	if (!ParseLine(Line, End, Data))
+	{
+		FErrors++;
+		return;
+	}
+	// The authentication and the unknown messages are not fused.
+	if (Data.Type < 0 || Data.Type == mtAuth)
+		return;
+	Sensor.Info.Source = Data.Source;
+
+	__int64 Aligned;
+	bool Synchronized = true;
+	if (Data.Type == mtLocation && Data.Time >= 0 && Data.Time < 3600)
+	{
+		// The drone time is the time after the hour: take the hour of the
+		// receive time on the drone clock.
+		__int64 Local = Data.Timestamp;
+		if (Sensor.Info.Synchronized)
+			Local -= Sensor.Info.Offset;
+		Aligned = (Local / DRI_FUSION_HOUR) * DRI_FUSION_HOUR + (__int64)(Data.Time * 1000 + 0.5);
+		if (Aligned - Local > DRI_FUSION_HOUR / 2)
+			Aligned -= DRI_FUSION_HOUR;
+		else
+		{
+			if (Local - Aligned > DRI_FUSION_HOUR / 2)
+				Aligned += DRI_FUSION_HOUR;
+		}
+
+		// Follow the shortest delivery: a queued frame must not move the
+		// clock.
+		__int64 Offset = Data.Timestamp - Aligned;
+		if (!Sensor.Info.Synchronized)
+		{
+			Sensor.Info.Offset = Offset;
+			Sensor.Info.Synchronized = true;
+		}
+		else
+		{
+			if (Offset < Sensor.Info.Offset)
+				Sensor.Info.Offset += (Offset - Sensor.Info.Offset) / 4;
+			else
+				Sensor.Info.Offset += (Offset - Sensor.Info.Offset) / 64;
+		}
+	}
+	else
+	{
+		Aligned = Data.Timestamp;
+		if (Sensor.Info.Synchronized)
+			Aligned -= Sensor.Info.Offset;
+		else
+			Synchronized = false;
+	}
+
+	std::string Name(Data.Drone, Data.DroneLength);
+	std::string Id;
+	if (Data.Type == mtBasicId && Data.Id != NULL)
+		Id.assign(Data.Id, Data.IdLength);
+	driFusionDrone* Drone = FindDrone(Name, Id, std::string(Data.Transport, Data.TransportLength));
+	// The copies are matched by the node clock: the sensor clocks
+	// differ.
+	DWORD Now = GetTickCount();
+	Drone->Seen = Now;
+	if (Data.Reported && Data.Altitude > DRI_LOCATE_NO_ALTITUDE)
+		Drone->Altitude = Data.Altitude;
+
+	driFusionSlot& Slot = Drone->Slots[Data.Type];
+	unsigned char Counter = (unsigned char)Data.Counter;
+
+	// Other copy of the waiting message: keep the strongest one.
+	if (Slot.Pending && Slot.Counter == Counter)
+	{
+		FDuplicates++;
+		if (Data.Rssi > Slot.Rssi)
+		{
+			Slot.Rssi = Data.Rssi;
+			Slot.Line.assign(Line, Data.Close);
+		}
+		if (!Slot.Synchronized && Synchronized)
+		{
+			Slot.Aligned = Aligned;
+			Slot.Synchronized = true;
+		}
+		// A sensor hears a frame once but may resend it.
+		std::vector<driFusionCopy>::iterator Copy = Slot.Copies.begin();
+		while (Copy != Slot.Copies.end() &&
+			(Copy->Address != Sensor.Info.Address || Copy->Port != Sensor.Info.Port))
+		{
+			Copy++;
+		}
+		if (Copy == Slot.Copies.end())
+		{
+			driFusionCopy New;
+			New.Address = Sensor.Info.Address;
+			New.Port = Sensor.Info.Port;
+			New.Source = Data.Source;
+			New.Rssi = Data.Rssi;
+			Slot.Copies.push_back(New);
+		}
+		else
+		{
+			if (Data.Rssi > Copy->Rssi)
+				Copy->Rssi = Data.Rssi;
+		}
+		return;
+	}
+	// A copy that came after the message was forwarded.
+	if (Slot.Forwarded && Slot.LastCounter == Counter && Now - Slot.LastArrived <= DRI_FUSION_MATCH)
+	{
+		FDuplicates++;
+		return;
+	}
+	// The track must not go back. A big step back is a new drone clock.
+	if (Data.Type == mtLocation && (Slot.Pending || Slot.Forwarded))
+	{
+		__int64 Last = Slot.Pending ? Slot.Aligned : Slot.LastAligned;
+		if (Aligned < Last && Last - Aligned < DRI_FUSION_TIMEOUT)
+		{
+			FLate++;
+			return;
+		}
+	}
+
+	if (Slot.Pending)
+	{
+		driFusionDue Pending;
+		Pending.Drone = Drone;
+		Pending.Type = (unsigned char)Data.Type;
+		Pending.Sequence = Slot.Sequence;
+		Pending.Arrived = Slot.Arrived;
+		Forward(&Pending, 1);
+	}
+
+	Slot.Pending = true;
+	Slot.Counter = Counter;
+	Slot.Arrived = Now;
+	Slot.Aligned = Aligned;
+	Slot.Synchronized = Synchronized;
+	Slot.Rssi = Data.Rssi;
+	Slot.Line.assign(Line, Data.Close);
+	Slot.Sequence = ++FSequence;
+	Slot.Copies.clear();
+	driFusionCopy Copy;
+	Copy.Address = Sensor.Info.Address;
+	Copy.Port = Sensor.Info.Port;
+	Copy.Source = Data.Source;
+	Copy.Rssi = Data.Rssi;
+	Slot.Copies.push_back(Copy);
+	Slot.Reported = Data.Reported;
+	Slot.Latitude = Data.Latitude;
+	Slot.Longitude = Data.Longitude;
+
+	driFusionDue Due;
+	Due.Drone = Drone;
+	Due.Type = (unsigned char)Data.Type;
+	Due.Sequence = Slot.Sequence;
+	Due.Arrived = Now;
+	FDue.push_back(Due);
+}
+
+CDriFusion::driFusionDrone* CDriFusion::FindDrone(const std::string& Name,
+	const std::string& Id, const std::string& Transport)
+{
+	driFusionDrone* Drone = NULL;
+	std::map<std::string, driFusionDrone*>::iterator Named = FNames.find(Name);
+	if (Named != FNames.end())
+		Drone = Named->second;
+
+	if (Id.length() > 0 && (Drone == NULL || Drone->Id != Id))
+	{
+		// The counters of the transports are independent.
+		std::string Key = Id + "/" + Transport;
+		std::map<std::string, driFusionDrone*>::iterator Track = FTracks.find(Key);
+		if (Track != FTracks.end())
+		{
+			// Other name of an identified drone. The unidentified entry
+			// forwards its pending messages and expires.
+			Drone = Track->second;
+		}
+		else
+		{
+			if (Drone != NULL && Drone->Id.length() == 0)
+			{
+				Drone->Id = Id;
+				FTracks.insert(std::make_pair(Key, Drone));
+			}
+			else
+			{
+				// A name reused by other drone gets new entry.
+				Drone = NULL;
+			}
+		}
+		if (Drone != NULL)
+		{
+			FNames[Name] = Drone;
+			return Drone;
+		}
+	}
+
+	if (Drone == NULL)
+	{
+		Drone = new driFusionDrone;
+		Drone->Id = Id;
+		Drone->Name = Name;
+		Drone->Seen = GetTickCount();
+		for (int i = 0; i < DRI_FUSION_TYPES; i++)
+		{
+			Drone->Slots[i].Pending = false;
+			Drone->Slots[i].Counter = 0;
+			Drone->Slots[i].Arrived = 0;
+			Drone->Slots[i].Aligned = 0;
+			Drone->Slots[i].Synchronized = false;
+			Drone->Slots[i].Rssi = 0;
+			Drone->Slots[i].Sequence = 0;
+			Drone->Slots[i].Reported = false;
+			Drone->Slots[i].Latitude = 0;
+			Drone->Slots[i].Longitude = 0;
+			Drone->Slots[i].Forwarded = false;
+			Drone->Slots[i].LastCounter = 0;
+			Drone->Slots[i].LastArrived = 0;
+			Drone->Slots[i].LastAligned = 0;
+		}
+		Drone->Altitude = DRI_LOCATE_NO_ALTITUDE;
+		ZeroMemory(&Drone->Estimate, sizeof(Drone->Estimate));
+		Drone->Located = 0;
+		FDrones.push_back(Drone);
+
+		FNames[Name] = Drone;
+		if (Id.length() > 0)
+			FTracks[Id + "/" + Transport] = Drone;
+	}
+	return Drone;
+}
+
+void CDriFusion::Forward(const driFusionDue* const Due, const size_t Count)
+{
+	// Locate the transmitters of all the messages at once: the solver
+	// iterates the whole batch together.
+	FFrames.assign(Count, (size_t)-1);
+	if (FLocator.Count > 0)
+	{
+		DWORD Now = GetTickCount();
+		FLocator.Clear();
+		for (size_t i = 0; i < Count; i++)
+		{
+			driFusionDrone* Drone = Due[i].Drone;
+			const driFusionSlot& Slot = Drone->Slots[Due[i].Type];
+			if (Slot.Copies.size() < DRI_LOCATE_MIN_SENSORS)
+				continue;
+
+			const driLocateResult* Start = NULL;
+			if (Drone->Estimate.Valid && Now - Drone->Located <= DRI_FUSION_WARM_TIME)
+				Start = &Drone->Estimate;
+			FFrames[i] = FLocator.AddFrame(Drone->Altitude, Start);
+			// The receive times are in milliseconds: no use for the TDOA.
+			for (std::vector<driFusionCopy>::const_iterator Copy = Slot.Copies.begin();
+				Copy != Slot.Copies.end(); Copy++)
+			{
+				FLocator.AddObservation(Copy->Source, Copy->Rssi, 0);
+			}
+		}
+		if (FLocator.Frames > 0)
+			FLocator.Solve();
+	}
+
+	for (size_t i = 0; i < Count; i++)
+	{
+		driLocateResult Estimate;
+		Estimate.Valid = false;
+		if (FFrames[i] != (size_t)-1)
+			FLocator.GetResult(FFrames[i], Estimate);
+		Emit(Due[i].Drone, Due[i].Type, Estimate.Valid ? &Estimate : NULL);
+	}
+}
+
+void CDriFusion::Emit(driFusionDrone* const Drone, const unsigned char Type,
+	const driLocateResult* const Estimate)
+{
+	driFusionSlot& Slot = Drone->Slots[Type];
+
+	char Tail[64];
+	_snprintf_s(Tail, sizeof(Tail), _TRUNCATE, "\",\"aligned\":%I64d,\"sensors\":%u",
+		Slot.Aligned, (unsigned int)Slot.Copies.size());
+
+	FLine.assign(Slot.Line);
+	FLine.append(",\"track\":\"");
+	if (Drone->Id.length() > 0)
+		FLine.append(Drone->Id);
+	else
+		FLine.append(Drone->Name);
+	FLine.append(Tail);
+
+	if (Estimate != NULL)
+	{
+		char Fields[128];
+		_snprintf_s(Fields, sizeof(Fields), _TRUNCATE, ",\"est_lat\":%.7f,\"est_lon\":%.7f,\"est_err\":%.0f",
+			Estimate->Latitude, Estimate->Longitude, Estimate->Error);
+		FLine.append(Fields);
+		if (Slot.Reported)
+		{
+			double Distance = FLocator.Distance(Slot.Latitude, Slot.Longitude,
+				Estimate->Latitude, Estimate->Longitude);
+			_snprintf_s(Fields, sizeof(Fields), _TRUNCATE, ",\"est_dist\":%.0f", Distance);
+			FLine.append(Fields);
+			if (Distance > 3 * Estimate->Error && Distance > DRI_FUSION_SPOOF_DISTANCE)
+			{
+				FLine.append(",\"spoofed\":true");
+				FSpoofed++;
+			}
+		}
+
+		Drone->Estimate = *Estimate;
+		Drone->Located = GetTickCount();
+		FLocated++;
+	}
+
+	FLine.append("}\n");
+	if (FOutput != NULL)
+		FOutput->PostLine(FLine.data(), FLine.length());
+
+	Slot.Pending = false;
+	Slot.Forwarded = true;
+	Slot.LastCounter = Slot.Counter;
+	Slot.LastArrived = Slot.Arrived;
+	Slot.LastAligned = Slot.Aligned;
+	FFused++;
+}
+
+void CDriFusion::ForwardDue(const bool All)
+{
+	DWORD Now = GetTickCount();
+
+	FCS->Enter();
+	FReady.clear();
+	while (FDue.size() > 0)
+	{
+		const driFusionDue& Due = FDue.front();
+		if (!All && Now - Due.Arrived < FWindow)
+			break;
+
+		// The message may have been forwarded by a newer one.
+		driFusionSlot& Slot = Due.Drone->Slots[Due.Type];
+		if (Slot.Pending && Slot.Sequence == Due.Sequence)
+			FReady.push_back(Due);
+		FDue.pop_front();
+	}
+	if (FReady.size() > 0)
+		Forward(&FReady[0], FReady.size());
+	FCS->Leave();
+}
+
+void CDriFusion::Prune()
+{
+	DWORD Now = GetTickCount();
+
+	// A drone is silent much longer than the window so none of its messages
+	// is due.
+	FCS->Enter();
+	std::map<std::string, driFusionDrone*>::iterator Name = FNames.begin();
+	while (Name != FNames.end())
+	{
+		if (Now - Name->second->Seen > DRI_FUSION_TIMEOUT)
+			Name = FNames.erase(Name);
+		else
+			Name++;
+	}
+	std::map<std::string, driFusionDrone*>::iterator Track = FTracks.begin();
+	while (Track != FTracks.end())
+	{
+		if (Now - Track->second->Seen > DRI_FUSION_TIMEOUT)
+			Track = FTracks.erase(Track);
+		else
+			Track++;
+	}
+	size_t Kept = 0;
+	for (size_t i = 0; i < FDrones.size(); i++)
+	{
+		if (Now - FDrones[i]->Seen > DRI_FUSION_TIMEOUT)
+			delete FDrones[i];
+		else
+			FDrones[Kept++] = FDrones[i];
+	}
+	FDrones.resize(Kept);
+
+	std::map<unsigned __int64, driFusionSensorEntry>::iterator Sensor = FSensors.begin();
+	while (Sensor != FSensors.end())
+	{
+		if (Now - Sensor->second.Seen > DRI_FUSION_TIMEOUT)
+			Sensor = FSensors.erase(Sensor);
+		else
+			Sensor++;
+	}
+	FCS->Leave();
+}
+
+void CDriFusion::Clear()
+{
+	for (size_t i = 0; i < FDrones.size(); i++)
+		delete FDrones[i];
+	FDrones.clear();
+	FNames.clear();
+	FTracks.clear();
+	FDue.clear();
+	FSensors.clear();
+}
+
+int CDriFusion::Open(const unsigned short Port)
+{
+	if (FActive)
+		return DRI_E_FUSION_OPENED;
+	if (Port == 0)
+		return WCL_E_INVALID_ARGUMENT;
+
+	WSADATA Data;
+	if (WSAStartup(MAKEWORD(2, 2), &Data) != 0)
+		return DRI_E_FUSION_WINSOCK_FAILED;
+
+	int Res = WCL_E_SUCCESS;
+	FSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (FSocket == INVALID_SOCKET)
+		Res = DRI_E_FUSION_SOCKET_FAILED;
+	else
+	{
+		BOOL Exclusive = TRUE;
+		setsockopt(FSocket, SOL_SOCKET, SO_EXCLUSIVEADDRUSE, (const char*)&Exclusive,
+			sizeof(Exclusive));
+		int Size = DRI_FUSION_RECEIVE_BUFFER;
+		setsockopt(FSocket, SOL_SOCKET, SO_RCVBUF, (const char*)&Size, sizeof(Size));
+
+		// The sensors are other hosts of the site.
+		sockaddr_in Address;
+		ZeroMemory(&Address, sizeof(Address));
+		Address.sin_family = AF_INET;
+		Address.sin_port = htons(Port);
+		Address.sin_addr.s_addr = htonl(INADDR_ANY);
+
+		unsigned long NonBlocking = 1;
+		if (bind(FSocket, (const sockaddr*)&Address, sizeof(Address)) == SOCKET_ERROR ||
+			ioctlsocket(FSocket, FIONBIO, &NonBlocking) == SOCKET_ERROR)
+		{
+			Res = DRI_E_FUSION_SOCKET_FAILED;
+		}
+	}
+
+	if (Res == WCL_E_SUCCESS)
+	{
+		Clear();
+		FBuffer.resize(DRI_FUSION_DATAGRAM_SIZE + 1);
+		FSequence = 0;
+		FLines = 0;
+		FFused = 0;
+		FDuplicates = 0;
+		FLate = 0;
+		FErrors = 0;
+		FLocated = 0;
+		FSpoofed = 0;
+		FTerminated = 0;
+
+		FThread = wclCreateThread(ThreadProc, this);
+		if (FThread == NULL)
+			Res = DRI_E_FUSION_THREAD_FAILED;
+		else
+			FActive = true;
+	}
+
+	if (Res != WCL_E_SUCCESS)
+	{
+		if (FSocket != INVALID_SOCKET)
+		{
+			closesocket(FSocket);
+			FSocket = INVALID_SOCKET;
+		}
+		WSACleanup();
+	}
+	return Res;
+}
+
+int CDriFusion::Close()
+{
+	if (!FActive)
+		return DRI_E_FUSION_CLOSED;
+
+	FActive = false;
+	// The thread forwards the pending messages before it exits.
+	InterlockedExchange(&FTerminated, 1);
+	wclWaitAndCloseThread(FThread);
+	FThread = NULL;
+
+	closesocket(FSocket);
+	FSocket = INVALID_SOCKET;
+	Clear();
+	WSACleanup();
+	return WCL_E_SUCCESS;
+}
+
+int CDriFusion::AddSensor(const unsigned short Source, const double Latitude,
+	const double Longitude, const double Altitude)
+{
+	if (FActive)
+		return DRI_E_FUSION_OPENED;
+	return FLocator.AddSensor(Source, Latitude, Longitude, Altitude);
+}
+
+void CDriFusion::GetSensors(std::vector<driFusionSensor>& Sensors) const
+{
+	Sensors.clear();
+
+	FCS->Enter();
+	for (std::map<unsigned __int64, driFusionSensorEntry>::const_iterator Sensor = FSensors.begin();
+		Sensor != FSensors.end(); Sensor++)
+	{
+		Sensors.push_back(Sensor->second.Info);
+	}
+	FCS->Leave();
+}
+
+bool CDriFusion::GetActive() const
+{
+	return FActive;
+}
+
+unsigned long CDriFusion::GetWindow() const
+{
+	return FWindow;
+}
+
+void CDriFusion::SetWindow(const unsigned long Value)
+{
+	if (!FActive && Value > 0 && Value <= DRI_FUSION_MAX_WINDOW)
+		FWindow = Value;
+}
+
+unsigned __int64 CDriFusion::GetLines() const
+{
+	return FLines;
+}
+
+unsigned __int64 CDriFusion::GetFused() const
+{
+	return FFused;
+}
+
+unsigned __int64 CDriFusion::GetDuplicates() const
+{
+	return FDuplicates;
+}
+
+unsigned __int64 CDriFusion::GetLate() const
+{
+	return FLate;
+}
+
+unsigned __int64 CDriFusion::GetErrors() const
+{
+	return FErrors;
+}
+
+unsigned __int64 CDriFusion::GetLocated() const
+{
+	return FLocated;
+}
+
+unsigned __int64 CDriFusion::GetSpoofed() const
+{
+	return FSpoofed;
+}
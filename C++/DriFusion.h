@@ -0,0 +1,330 @@
+
+// DriFusion.h : header file
+//
+
+#pragma once
+
+#include <winsock2.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "wclHelpers.h"
+#include "wclSync.h"
+
+#include "DriErrors.h"
+#include "DriExport.h"
+#include "DriLocate.h"
+
+using namespace wclCommon;
+using namespace wclSync;
+
+/// <summary> The default time in milliseconds the fusion node waits for
+///   the copies of a message from the other sensors. Longer than the default
+///   export latency of the sensors. </summary>
+#define DRI_FUSION_WINDOW			200
+/// <summary> The maximum fusion window in milliseconds. </summary>
+#define DRI_FUSION_MAX_WINDOW		10000
+/// <summary> The time in milliseconds a silent drone or sensor is
+///   kept. </summary>
+#define DRI_FUSION_TIMEOUT			60000
+/// <summary> The number of the ASD message types the node tracks. </summary>
+#define DRI_FUSION_TYPES			6
+/// <summary> The minimum distance in meters between the reported and the
+///   estimated positions of a spoofed location. </summary>
+#define DRI_FUSION_SPOOF_DISTANCE	300.0
+
+/// <summary> A sensor known to the fusion node. </summary>
+typedef struct
+{
+	/// <summary> The sender IPv4 address (network order). </summary>
+	unsigned long		Address;
+	/// <summary> The sender UDP port. </summary>
+	unsigned short		Port;
+	/// <summary> The sensor identification from the lines (the
+	///   <c>ExportSource</c> of the sensor). </summary>
+	unsigned short		Source;
+	/// <summary> The number of the received lines. </summary>
+	unsigned __int64	Lines;
+	/// <summary> <c>True</c> if the clock offset is known. </summary>
+	bool				Synchronized;
+	/// <summary> The sensor clock offset against the drone (GNSS) time plus
+	///   the shortest delivery delay in milliseconds. </summary>
+	__int64				Offset;
+} driFusionSensor;
+
+/// <summary> Fuses the JSON line streams of many sensors into one track
+///   per drone. </summary>
+/// <remarks> <para> The sensors export their decoded messages
+///   (<see cref="CDriExporter" />) to the UDP port of the node. The node
+///   identifies a sensor by the sender address. </para>
+///   <para> Time alignment: a Location message carries the drone time (the
+///   tenths of seconds after the hour); the hour is taken from the receive
+///   time. The difference between the receive time and the drone time is
+///   the sensor offset; the node follows its minimum (a late delivery only
+///   raises it slowly). The other messages are aligned by the receive time
+///   minus the sensor offset. </para>
+///   <para> Deduplication: a drone is identified by the UAS ID and the
+///   transport once its Basic ID is received (until then by the radio
+///   name). The copies of one message (the same drone, type and counter)
+///   received by the sensors within <c>Window</c> milliseconds of the first
+///   one are merged: the copy with the best RSSI is
+///   forwarded to the <c>Output</c> exporter with the fields
+///   <c>track</c> (the UAS ID or the name), <c>aligned</c> (the aligned
+///   time, Unix milliseconds) and <c>sensors</c> (the number of the
+///   sensors that heard it). Later copies and the locations older than the forwarded one
+///   are dropped, so a message is forwarded not later than <c>Window</c>
+///   after its first copy and the track time never goes back. </para>
+///   <para> Transmitter location: if the positions of the sensors are
+///   added (<see cref="AddSensor" />) a message heard by
+///   <see cref="DRI_LOCATE_MIN_SENSORS" /> or more of them is located by the
+///   RSSI of its copies (<see cref="CDriLocator" />). All the messages due
+///   at once are solved in one batch, each started at the previous estimate
+///   of its drone. The forwarded line gets the fields <c>est_lat</c>,
+///   <c>est_lon</c> and <c>est_err</c> (one sigma, meters); a Location also
+///   gets <c>est_dist</c> (meters from the reported position) and
+///   <c>spoofed</c> if the distance is larger than both three
+///   <c>est_err</c> and <see cref="DRI_FUSION_SPOOF_DISTANCE" />. The
+///   receive times are not used: the sensors stamp the lines in
+///   milliseconds. </para>
+///   <para> One thread receives and fuses. The statistics are read without
+///   the lock and may be a bit stale. </para> </remarks>
+class CDriFusion
+{
+	DISABLE_COPY(CDriFusion);
+
+private:
+	typedef struct
+	{
+		// The sensor endpoint: the sensors may all send the same source.
+		unsigned long		Address;
+		unsigned short		Port;
+		unsigned short		Source;
+		int					Rssi;
+	} driFusionCopy;
+
+	typedef struct
+	{
+		// The message waits for the other copies.
+		bool				Pending;
+		unsigned char		Counter;
+		// The tick count the first copy arrived at.
+		DWORD				Arrived;
+		__int64				Aligned;
+		// The aligned time is on the drone clock (not the receive time of a
+		// sensor with unknown offset).
+		bool				Synchronized;
+		int					Rssi;
+		// The best copy without the closing brace.
+		std::string			Line;
+		// Tells the due entry of the pending message from the older ones.
+		unsigned __int64	Sequence;
+		// The copies, one per sensor: a sensor may resend a frame.
+		std::vector<driFusionCopy>	Copies;
+		// The position a Location message reports.
+		bool				Reported;
+		double				Latitude;
+		double				Longitude;
+
+		// The last forwarded message.
+		bool				Forwarded;
+		unsigned char		LastCounter;
+		DWORD				LastArrived;
+		__int64				LastAligned;
+	} driFusionSlot;
+
+	typedef struct
+	{
+		// The UAS ID (escaped as in the lines). Empty until the Basic ID
+		// is received.
+		std::string			Id;
+		// The first radio name (escaped as in the lines).
+		std::string			Name;
+		DWORD				Seen;
+		driFusionSlot		Slots[DRI_FUSION_TYPES];
+		// The last reported geodetic altitude or DRI_LOCATE_NO_ALTITUDE.
+		double				Altitude;
+		// The last transmitter estimate and the tick count it was made at.
+		driLocateResult		Estimate;
+		DWORD				Located;
+	} driFusionDrone;
+
+	typedef struct
+	{
+		driFusionDrone*		Drone;
+		unsigned char		Type;
+		unsigned __int64	Sequence;
+		DWORD				Arrived;
+	} driFusionDue;
+
+	typedef struct
+	{
+		driFusionSensor		Info;
+		DWORD				Seen;
+	} driFusionSensorEntry;
+
+	CDriExporter*						FOutput;
+	CwclCriticalSection*				FCS;
+	SOCKET								FSocket;
+	HANDLE								FThread;
+	volatile LONG						FTerminated;
+	bool								FActive;
+	unsigned long						FWindow;
+
+	// Used by the receive thread only (the sensors under the lock).
+	std::map<unsigned __int64, driFusionSensorEntry>	FSensors;
+	std::vector<driFusionDrone*>		FDrones;
+	// The drones by the radio name.
+	std::map<std::string, driFusionDrone*>	FNames;
+	// The identified drones by the UAS ID and the transport.
+	std::map<std::string, driFusionDrone*>	FTracks;
+	// The pending messages in the arrival order.
+	std::deque<driFusionDue>			FDue;
+	unsigned __int64					FSequence;
+	std::vector<char>					FBuffer;
+	std::string							FLine;
+	CDriLocator							FLocator;
+	// The due messages forwarded in one batch and their locator frames.
+	std::vector<driFusionDue>			FReady;
+	std::vector<size_t>					FFrames;
+
+	// The receive thread counters.
+	unsigned __int64					FLines;
+	unsigned __int64					FFused;
+	unsigned __int64					FDuplicates;
+	unsigned __int64					FLate;
+	unsigned __int64					FErrors;
+	unsigned __int64					FLocated;
+	unsigned __int64					FSpoofed;
+
+	static UINT __stdcall ThreadProc(void* Param);
+	void Execute();
+
+	void Receive();
+	void Ingest(driFusionSensorEntry& Sensor, const char* const Line,
+		const char* const End);
+	driFusionDrone* FindDrone(const std::string& Name, const std::string& Id,
+		const std::string& Transport);
+	void Forward(const driFusionDue* const Due, const size_t Count);
+	void Emit(driFusionDrone* const Drone, const unsigned char Type,
+		const driLocateResult* const Estimate);
+	void ForwardDue(const bool All);
+	void Prune();
+	void Clear();
+
+public:
+	/// <summary> Creates new fusion node. </summary>
+	/// <param name="Output"> The exporter the fused lines are sent to. The
+	///   owner opens and closes it. </param>
+	CDriFusion(CDriExporter* const Output);
+	/// <summary> Closes the node and frees the object. </summary>
+	virtual ~CDriFusion();
+
+	/// <summary> Starts receiving the sensor streams. </summary>
+	/// <param name="Port"> The UDP port. The node listens on all the
+	///   IPv4 interfaces. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Open(const unsigned short Port);
+	/// <summary> Forwards the pending messages and stops receiving. </summary>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Close();
+
+	/// <summary> Adds the position of a sensor for the transmitter
+	///   location. </summary>
+	/// <param name="Source"> The sensor identification (the
+	///   <c>ExportSource</c> of the sensor). </param>
+	/// <param name="Latitude"> The antenna latitude in degrees. </param>
+	/// <param name="Longitude"> The antenna longitude in degrees. </param>
+	/// <param name="Altitude"> The antenna geodetic altitude in
+	///   meters. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	/// <remarks> Must be called before the node is opened. </remarks>
+	int AddSensor(const unsigned short Source, const double Latitude,
+		const double Longitude, const double Altitude);
+
+	/// <summary> Gets the known sensors. </summary>
+	/// <param name="Sensors"> On output contains the sensors. </param>
+	void GetSensors(std::vector<driFusionSensor>& Sensors) const;
+
+	/// <summary> Gets the node state. </summary>
+	/// <returns> <c>True</c> if the node is opened. </returns>
+	bool GetActive() const;
+	/// <summary> Gets the node state. </summary>
+	/// <value> <c>True</c> if the node is opened. </value>
+	__declspec(property(get = GetActive)) bool Active;
+
+	/// <summary> Gets the fusion window. </summary>
+	/// <returns> The window in milliseconds. </returns>
+	unsigned long GetWindow() const;
+	/// <summary> Sets the fusion window. </summary>
+	/// <param name="Value"> The window in milliseconds, up to
+	///   <see cref="DRI_FUSION_MAX_WINDOW" />. </param>
+	/// <remarks> Must be set before the node is opened. </remarks>
+	void SetWindow(const unsigned long Value);
+	/// <summary> Gets or sets the fusion window. </summary>
+	/// <value> The window in milliseconds. </value>
+	__declspec(property(get = GetWindow, put = SetWindow))
+		unsigned long Window;
+
+	/// <summary> Gets the number of the received lines. </summary>
+	/// <returns> The lines count. </returns>
+	unsigned __int64 GetLines() const;
+	/// <summary> Gets the number of the received lines. </summary>
+	/// <value> The lines count. </value>
+	__declspec(property(get = GetLines)) unsigned __int64 Lines;
+
+	/// <summary> Gets the number of the forwarded messages. </summary>
+	/// <returns> The fused messages count. </returns>
+	unsigned __int64 GetFused() const;
+	/// <summary> Gets the number of the forwarded messages. </summary>
+	/// <value> The fused messages count. </value>
+	__declspec(property(get = GetFused)) unsigned __int64 Fused;
+
+	/// <summary> Gets the number of the merged copies. </summary>
+	/// <returns> The duplicates count. </returns>
+	unsigned __int64 GetDuplicates() const;
+	/// <summary> Gets the number of the merged copies. </summary>
+	/// <value> The duplicates count. </value>
+	__declspec(property(get = GetDuplicates)) unsigned __int64 Duplicates;
+
+	/// <summary> Gets the number of the locations dropped because they were
+	///   older than the forwarded one. </summary>
+	/// <returns> The late locations count. </returns>
+	unsigned __int64 GetLate() const;
+	/// <summary> Gets the number of the locations dropped because they were
+	///   older than the forwarded one. </summary>
+	/// <value> The late locations count. </value>
+	__declspec(property(get = GetLate)) unsigned __int64 Late;
+
+	/// <summary> Gets the number of the malformed lines. </summary>
+	/// <returns> The malformed lines count. </returns>
+	unsigned __int64 GetErrors() const;
+	/// <summary> Gets the number of the malformed lines. </summary>
+	/// <value> The malformed lines count. </value>
+	__declspec(property(get = GetErrors)) unsigned __int64 Errors;
+
+	/// <summary> Gets the number of the forwarded messages with the
+	///   transmitter estimate. </summary>
+	/// <returns> The located messages count. </returns>
+	unsigned __int64 GetLocated() const;
+	/// <summary> Gets the number of the forwarded messages with the
+	///   transmitter estimate. </summary>
+	/// <value> The located messages count. </value>
+	__declspec(property(get = GetLocated)) unsigned __int64 Located;
+
+	/// <summary> Gets the number of the locations marked as
+	///   spoofed. </summary>
+	/// <returns> The spoofed locations count. </returns>
+	unsigned __int64 GetSpoofed() const;
+	/// <summary> Gets the number of the locations marked as
+	///   spoofed. </summary>
+	/// <value> The spoofed locations count. </value>
+	__declspec(property(get = GetSpoofed)) unsigned __int64 Spoofed;
+};
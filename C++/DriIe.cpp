@@ -0,0 +1,84 @@
+
+// DriIe.cpp : implementation file
+//
+
+#include "stdafx.h"
+#include "DriIe.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+
+// CDriIeIterator
+
+CDriIeIterator::CDriIeIterator(const unsigned char* const Data, const size_t Size)
+{
+	FData = Data;
+	FSize = (Data == NULL) ? 0 : Size;
+	FPos = 0;
+	FMalformed = false;
+}
+
+bool CDriIeIterator::Next(driIeView& Element)
+{
+	if (FPos + 2 > FSize)
+	{
+		// Trailing byte that can not be an element header.
+		if (FPos < FSize)
+			FMalformed = true;
+		return false;
+	}
+
+	const unsigned char* Header = FData + FPos;
+	size_t Length = Header[1];
+	if (FPos + 2 + Length > FSize)
+	{
+		FMalformed = true;
+		return false;
+	}
+
+	Element.Id = Header[0];
+	Element.ExtId = 0;
+	Element.Element = Header;
+	Element.Data = Header + 2;
+	Element.Length = (unsigned long)Length;
+	if (Element.Id == DRI_IE_EXTENSION && Length > 0)
+	{
+		Element.ExtId = Header[2];
+		Element.Data++;
+		Element.Length--;
+	}
+
+	FPos += 2 + Length;
+	return true;
+}
+
+void CDriIeIterator::Reset()
+{
+	FPos = 0;
+	FMalformed = false;
+}
+
+bool CDriIeIterator::FindVendor(const unsigned char* const Data,
+	const size_t Size, const unsigned long Oui, const unsigned char Type,
+	driIeView& Element)
+{
+	CDriIeIterator Iterator(Data, Size);
+	while (Iterator.Next(Element))
+	{
+		if (Element.Id == DRI_IE_VENDOR && Element.Length >= 4 &&
+			Element.Data[0] == (unsigned char)(Oui >> 16) &&
+			Element.Data[1] == (unsigned char)(Oui >> 8) &&
+			Element.Data[2] == (unsigned char)Oui && Element.Data[3] == Type)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool CDriIeIterator::GetMalformed() const
+{
+	return FMalformed;
+}
@@ -0,0 +1,88 @@
+
+// DriIe.h : header file
+//
+
+#pragma once
+
+#include "wclHelpers.h"
+
+using namespace wclCommon;
+
+/// <summary> The vendor specific information element ID. </summary>
+#define DRI_IE_VENDOR			0xDD
+/// <summary> The extension information element ID. </summary>
+#define DRI_IE_EXTENSION		0xFF
+/// <summary> The ASD-STAN OUI of the DRI vendor specific element. </summary>
+#define DRI_IE_ASD_OUI			0xFA0BBC
+/// <summary> The DRI vendor specific element type. </summary>
+#define DRI_IE_ASD_TYPE			0x0D
+
+/// <summary> A view of one information element in a raw IE
+///   buffer. </summary>
+/// <remarks> The pointers reference the iterated buffer; nothing is
+///   copied. </remarks>
+typedef struct
+{
+	/// <summary> The element ID. </summary>
+	unsigned char			Id;
+	/// <summary> The extension element ID if <c>Id</c> is
+	///   <c>DRI_IE_EXTENSION</c>. Otherwise 0. </summary>
+	unsigned char			ExtId;
+	/// <summary> The element start (the ID byte). </summary>
+	const unsigned char*	Element;
+	/// <summary> The element body (after the extension ID for the extension
+	///   elements). </summary>
+	const unsigned char*	Data;
+	/// <summary> The body length in bytes. </summary>
+	unsigned long			Length;
+} driIeView;
+
+/// <summary> Iterates the information elements of a raw IE buffer (a beacon
+///   or probe response body) without copying. </summary>
+/// <remarks> Every element is checked against the buffer bounds. The
+///   iteration stops at the first element that does not fit; the
+///   <c>Malformed</c> property then is <c>True</c>. </remarks>
+class CDriIeIterator
+{
+	DISABLE_COPY(CDriIeIterator);
+
+private:
+	const unsigned char*	FData;
+	size_t					FSize;
+	size_t					FPos;
+	bool					FMalformed;
+
+public:
+	/// <summary> Creates new iterator. </summary>
+	/// <param name="Data"> The raw IE buffer. </param>
+	/// <param name="Size"> The buffer size in bytes. </param>
+	CDriIeIterator(const unsigned char* const Data, const size_t Size);
+
+	/// <summary> Gets the next element. </summary>
+	/// <param name="Element"> On output contains the element view. </param>
+	/// <returns> <c>True</c> if the element was read. <c>False</c> at the end
+	///   of the buffer or if the element is malformed. </returns>
+	bool Next(driIeView& Element);
+	/// <summary> Restarts the iteration from the first element. </summary>
+	void Reset();
+
+	/// <summary> Finds a vendor specific element. </summary>
+	/// <param name="Data"> The raw IE buffer. </param>
+	/// <param name="Size"> The buffer size in bytes. </param>
+	/// <param name="Oui"> The vendor OUI. </param>
+	/// <param name="Type"> The vendor element type. </param>
+	/// <param name="Element"> On output contains the element view. The body
+	///   starts with the OUI and the type. </param>
+	/// <returns> <c>True</c> if the element was found. </returns>
+	static bool FindVendor(const unsigned char* const Data, const size_t Size,
+		const unsigned long Oui, const unsigned char Type, driIeView& Element);
+
+	/// <summary> Gets the buffer state. </summary>
+	/// <returns> <c>True</c> if an element did not fit into the
+	///   buffer. </returns>
+	bool GetMalformed() const;
+	/// <summary> Gets the buffer state. </summary>
+	/// <value> <c>True</c> if an element did not fit into the
+	///   buffer. </value>
+	__declspec(property(get = GetMalformed)) bool Malformed;
+};
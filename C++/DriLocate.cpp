@@ -0,0 +1,648 @@
+
+// DriLocate.cpp : implementation file
+//
+
+#include "stdafx.h"
+#include "DriLocate.h"
+
+#include <float.h>
+#include <math.h>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+
+// The mean Earth radius in meters.
+#define DRI_LOCATE_EARTH_RADIUS		6371008.8
+// The speed of light in meters per second.
+#define DRI_LOCATE_LIGHT			299792458.0
+#define DRI_LOCATE_PI				3.14159265358979323846
+// The solution is converged when the horizontal step in meters or the
+// relative cost decrease is smaller.
+#define DRI_LOCATE_CONVERGED		0.5
+#define DRI_LOCATE_TOLERANCE		1e-4
+// The initial and the maximum damping.
+#define DRI_LOCATE_LAMBDA			0.001
+#define DRI_LOCATE_MAX_LAMBDA		1e8
+
+// The indexes of the packed upper triangle of the 4 x 4 normal matrix.
+static const int DRI_LOCATE_INDEX[4][4] = {
+	{ 0, 1, 2, 3 },
+	{ 1, 4, 5, 6 },
+	{ 2, 5, 7, 8 },
+	{ 3, 6, 8, 9 } };
+
+// Solves the symmetric positive definite system (the packed normal matrix)
+// by the Cholesky decomposition.
+static bool SolveNormal(const double* const Normal, const double* const B,
+	double* const X)
+{
+	double L[4][4];
+	for (int i = 0; i < 4; i++)
+	{
+		for (int j = 0; j <= i; j++)
+		{
+			double Sum = Normal[DRI_LOCATE_INDEX[i][j]];
+			for (int k = 0; k < j; k++)
+				Sum -= L[i][k] * L[j][k];
+			if (i == j)
+			{
+				if (!(Sum > DBL_EPSILON * fabs(Normal[DRI_LOCATE_INDEX[i][i]])))
+					return false;
+				L[i][i] = sqrt(Sum);
+			}
+			else
+				L[i][j] = Sum / L[j][j];
+		}
+	}
+
+	double Y[4];
+	for (int i = 0; i < 4; i++)
+	{
+		double Sum = B[i];
+		for (int k = 0; k < i; k++)
+			Sum -= L[i][k] * Y[k];
+		Y[i] = Sum / L[i][i];
+	}
+	for (int i = 3; i >= 0; i--)
+	{
+		double Sum = Y[i];
+		for (int k = i + 1; k < 4; k++)
+			Sum -= L[k][i] * X[k];
+		X[i] = Sum / L[i][i];
+	}
+	return true;
+}
+
+
+// CDriLocator
+
+CDriLocator::CDriLocator()
+{
+	FOrigin = false;
+	FLatitude = 0;
+	FLongitude = 0;
+	FAltitude = 0;
+	FNorth = 0;
+	FEast = 0;
+
+	FPathLoss = DRI_LOCATE_PATH_LOSS;
+	FRssiSigma = DRI_LOCATE_RSSI_SIGMA;
+	FTimeSigma = 0;
+}
+
+CDriLocator::~CDriLocator()
+{
+}
+
+void CDriLocator::ToLocal(const double Latitude, const double Longitude,
+	double& X, double& Y) const
+{
+	double Delta = Longitude - FLongitude;
+	if (Delta > 180)
+		Delta -= 360;
+	else
+	{
+		if (Delta < -180)
+			Delta += 360;
+	}
+	X = Delta * FEast;
+	Y = (Latitude - FLatitude) * FNorth;
+}
+
+void CDriLocator::ToGlobal(const double X, const double Y, double& Latitude,
+	double& Longitude) const
+{
+	Latitude = FLatitude + Y / FNorth;
+	Longitude = FLongitude + X / FEast;
+	if (Longitude > 180)
+		Longitude -= 360;
+	else
+	{
+		if (Longitude < -180)
+			Longitude += 360;
+	}
+}
+
+double CDriLocator::Power(const driLocateFrame& Frame, const double X,
+	const double Y) const
+{
+	// The mean of RSSI + K ln(d) fits the power best.
+	double K = 10 * FPathLoss / log(10.0);
+	double Sum = 0;
+	size_t Last = Frame.First + Frame.Count;
+	for (size_t i = Frame.First; i < Last; i++)
+	{
+		double Dx = X - FSensorX[i];
+		double Dy = Y - FSensorY[i];
+		double Dz = Frame.Z - FSensorZ[i];
+		Sum += FRssi[i] + 0.5 * K * log(Dx * Dx + Dy * Dy + Dz * Dz + 1);
+	}
+	return Sum / Frame.Count;
+}
+
+double CDriLocator::Fit(const driLocateFrame& Frame, const double X,
+	const double Y) const
+{
+	double K = 10 * FPathLoss / log(10.0);
+	double P = Power(Frame, X, Y);
+	double Sum = 0;
+	size_t Last = Frame.First + Frame.Count;
+	for (size_t i = Frame.First; i < Last; i++)
+	{
+		double Dx = X - FSensorX[i];
+		double Dy = Y - FSensorY[i];
+		double Dz = Frame.Z - FSensorZ[i];
+		double Residual = FRssi[i] - P + 0.5 * K * log(Dx * Dx + Dy * Dy + Dz * Dz + 1);
+		Sum += Residual * Residual;
+	}
+	return Sum;
+}
+
+void CDriLocator::Prepare(driLocateFrame& Frame)
+{
+	Frame.Active = false;
+	Frame.Valid = false;
+	Frame.Iterations = 0;
+	// A frame without enough sensors (an empty one too) is not solved and
+	// stays invalid: the means below divide by the count.
+	if (Frame.Count < DRI_LOCATE_MIN_SENSORS)
+		return;
+
+	size_t Last = Frame.First + Frame.Count;
+	if (Frame.Z <= DRI_LOCATE_NO_ALTITUDE)
+	{
+		double Z = 0;
+		for (size_t i = Frame.First; i < Last; i++)
+			Z += FSensorZ[i];
+		Frame.Z = Z / Frame.Count + DRI_LOCATE_HEIGHT;
+	}
+	else
+		Frame.Z -= FAltitude;
+
+	// The times become the pseudoranges from the first reception.
+	double Time = FRange[Frame.First];
+	for (size_t i = Frame.First; i < Last; i++)
+		FRange[i] = (FRange[i] - Time) * DRI_LOCATE_LIGHT;
+
+	// The centroid of the sensors weighted by the square of the inverse
+	// distance the RSSI gives.
+	double K = 10 * FPathLoss / log(10.0);
+	double Max = FRssi[Frame.First];
+	for (size_t i = Frame.First + 1; i < Last; i++)
+	{
+		if (FRssi[i] > Max)
+			Max = FRssi[i];
+	}
+	double X = 0;
+	double Y = 0;
+	double Sum = 0;
+	for (size_t i = Frame.First; i < Last; i++)
+	{
+		double Weight = exp(2 * (FRssi[i] - Max) / K);
+		X += FSensorX[i] * Weight;
+		Y += FSensorY[i] * Weight;
+		Sum += Weight;
+	}
+	X /= Sum;
+	Y /= Sum;
+
+	// The previous solution is kept only if it fits the frame better: the
+	// position of a fast or a noisy transmitter jumps.
+	if (!Frame.Warm || Fit(Frame, X, Y) < Fit(Frame, Frame.Params[0], Frame.Params[1]))
+	{
+		Frame.Params[0] = X;
+		Frame.Params[1] = Y;
+	}
+	Frame.Params[2] = Power(Frame, Frame.Params[0], Frame.Params[1]);
+
+	double Bias = 0;
+	for (size_t i = Frame.First; i < Last; i++)
+	{
+		double Dx = Frame.Params[0] - FSensorX[i];
+		double Dy = Frame.Params[1] - FSensorY[i];
+		double Dz = Frame.Z - FSensorZ[i];
+		Bias += FRange[i] - sqrt(Dx * Dx + Dy * Dy + Dz * Dz + 1);
+	}
+	Frame.Params[3] = Bias / Frame.Count;
+
+	for (int i = 0; i < 4; i++)
+		Frame.Trial[i] = Frame.Params[i];
+	Frame.Cost = DBL_MAX;
+	Frame.Lambda = DRI_LOCATE_LAMBDA;
+	Frame.Step = DBL_MAX;
+	Frame.Active = true;
+}
+
+void CDriLocator::Evaluate()
+{
+	// Spread the trial solutions over the observations.
+	for (std::vector<driLocateFrame>::const_iterator Frame = FFrames.begin();
+		Frame != FFrames.end(); Frame++)
+	{
+		size_t Last = Frame->First + Frame->Count;
+		for (size_t i = Frame->First; i < Last; i++)
+		{
+			FX[i] = Frame->Trial[0];
+			FY[i] = Frame->Trial[1];
+			FZ[i] = Frame->Z;
+			FPower[i] = Frame->Trial[2];
+			FBias[i] = Frame->Trial[3];
+		}
+	}
+
+	// One flat pass without branches. The distance is kept above one meter
+	// so the logarithm is defined.
+	double K = 10 * FPathLoss / log(10.0);
+	double RssiWeight = 1 / FRssiSigma;
+	double RangeWeight = (FTimeSigma > 0) ? 1 / (FTimeSigma * DRI_LOCATE_LIGHT) : 0;
+	size_t Count = FRssi.size();
+	const double* SensorX = (Count > 0) ? &FSensorX[0] : NULL;
+	const double* SensorY = (Count > 0) ? &FSensorY[0] : NULL;
+	const double* SensorZ = (Count > 0) ? &FSensorZ[0] : NULL;
+	const double* Rssi = (Count > 0) ? &FRssi[0] : NULL;
+	const double* Range = (Count > 0) ? &FRange[0] : NULL;
+	const double* X = (Count > 0) ? &FX[0] : NULL;
+	const double* Y = (Count > 0) ? &FY[0] : NULL;
+	const double* Z = (Count > 0) ? &FZ[0] : NULL;
+	const double* Power = (Count > 0) ? &FPower[0] : NULL;
+	const double* Bias = (Count > 0) ? &FBias[0] : NULL;
+	double* RssiResidual = (Count > 0) ? &FRssiResidual[0] : NULL;
+	double* RssiDx = (Count > 0) ? &FRssiDx[0] : NULL;
+	double* RssiDy = (Count > 0) ? &FRssiDy[0] : NULL;
+	double* RangeResidual = (Count > 0) ? &FRangeResidual[0] : NULL;
+	double* RangeDx = (Count > 0) ? &FRangeDx[0] : NULL;
+	double* RangeDy = (Count > 0) ? &FRangeDy[0] : NULL;
+	for (size_t i = 0; i < Count; i++)
+	{
+		double Dx = X[i] - SensorX[i];
+		double Dy = Y[i] - SensorY[i];
+		double Dz = Z[i] - SensorZ[i];
+		double Square = Dx * Dx + Dy * Dy + Dz * Dz + 1;
+		double Distance = sqrt(Square);
+
+		// RSSI = P - K ln(d): the model derivative by x is -K dx / d^2.
+		RssiResidual[i] = (Rssi[i] - Power[i] + 0.5 * K * log(Square)) * RssiWeight;
+		double Slope = -K * RssiWeight / Square;
+		RssiDx[i] = Slope * Dx;
+		RssiDy[i] = Slope * Dy;
+
+		// c t = d + b: the model derivative by x is dx / d.
+		RangeResidual[i] = (Range[i] - Distance - Bias[i]) * RangeWeight;
+		RangeDx[i] = Dx / Distance * RangeWeight;
+		RangeDy[i] = Dy / Distance * RangeWeight;
+	}
+}
+
+void CDriLocator::Reduce(const driLocateFrame& Frame, double* const Normal,
+	double* const Gradient, double& Cost) const
+{
+	double RssiWeight = 1 / FRssiSigma;
+	double RangeWeight = (FTimeSigma > 0) ? 1 / (FTimeSigma * DRI_LOCATE_LIGHT) : 0;
+
+	for (int i = 0; i < 10; i++)
+		Normal[i] = 0;
+	for (int i = 0; i < 4; i++)
+		Gradient[i] = 0;
+	Cost = 0;
+
+	size_t Last = Frame.First + Frame.Count;
+	for (size_t i = Frame.First; i < Last; i++)
+	{
+		// The RSSI row is (dx, dy, w, 0), the range row is (dx, dy, 0, w).
+		double Rx = FRssiDx[i];
+		double Ry = FRssiDy[i];
+		double Rr = FRssiResidual[i];
+		double Tx = FRangeDx[i];
+		double Ty = FRangeDy[i];
+		double Tr = FRangeResidual[i];
+
+		Normal[0] += Rx * Rx + Tx * Tx;
+		Normal[1] += Rx * Ry + Tx * Ty;
+		Normal[2] += Rx * RssiWeight;
+		Normal[3] += Tx * RangeWeight;
+		Normal[4] += Ry * Ry + Ty * Ty;
+		Normal[5] += Ry * RssiWeight;
+		Normal[6] += Ty * RangeWeight;
+		Gradient[0] += Rx * Rr + Tx * Tr;
+		Gradient[1] += Ry * Rr + Ty * Tr;
+		Gradient[2] += RssiWeight * Rr;
+		Gradient[3] += RangeWeight * Tr;
+		Cost += Rr * Rr + Tr * Tr;
+	}
+	Normal[7] += Frame.Count * RssiWeight * RssiWeight;
+	Normal[9] += Frame.Count * RangeWeight * RangeWeight;
+
+	// The power prior.
+	double Prior = (DRI_LOCATE_POWER - Frame.Trial[2]) / DRI_LOCATE_POWER_SIGMA;
+	Normal[7] += 1 / (DRI_LOCATE_POWER_SIGMA * DRI_LOCATE_POWER_SIGMA);
+	Gradient[2] += Prior / DRI_LOCATE_POWER_SIGMA;
+	Cost += Prior * Prior;
+
+	// Without the times the range bias stays where it is.
+	if (RangeWeight == 0)
+		Normal[9] = 1;
+}
+
+int CDriLocator::AddSensor(const unsigned short Source, const double Latitude,
+	const double Longitude, const double Altitude)
+{
+	// Also rejects NaN.
+	if (!(Latitude >= -89 && Latitude <= 89) || !(Longitude >= -180 && Longitude <= 180) ||
+		!(Altitude > DRI_LOCATE_NO_ALTITUDE && Altitude < 100000))
+	{
+		return WCL_E_INVALID_ARGUMENT;
+	}
+
+	if (!FOrigin)
+	{
+		FLatitude = Latitude;
+		FLongitude = Longitude;
+		FAltitude = Altitude;
+		FNorth = DRI_LOCATE_EARTH_RADIUS * DRI_LOCATE_PI / 180;
+		FEast = FNorth * cos(Latitude * DRI_LOCATE_PI / 180);
+		FOrigin = true;
+	}
+
+	driLocateSensor Sensor;
+	ToLocal(Latitude, Longitude, Sensor.X, Sensor.Y);
+	Sensor.Z = Altitude - FAltitude;
+	FSensors[Source] = Sensor;
+	return WCL_E_SUCCESS;
+}
+
+void CDriLocator::Clear()
+{
+	FFrames.clear();
+	FSensorX.clear();
+	FSensorY.clear();
+	FSensorZ.clear();
+	FRssi.clear();
+	FRange.clear();
+}
+
+size_t CDriLocator::AddFrame(const double Altitude, const driLocateResult* const Start)
+{
+	driLocateFrame Frame;
+	ZeroMemory(&Frame, sizeof(Frame));
+	Frame.First = FRssi.size();
+	Frame.Count = 0;
+	Frame.Z = Altitude;
+	Frame.Warm = (Start != NULL && Start->Valid && FOrigin);
+	if (Frame.Warm)
+	{
+		ToLocal(Start->Latitude, Start->Longitude, Frame.Params[0], Frame.Params[1]);
+	}
+	FFrames.push_back(Frame);
+	return FFrames.size() - 1;
+}
+
+bool CDriLocator::AddObservation(const unsigned short Source, const double Rssi,
+	const double Time)
+{
+	if (FFrames.size() == 0)
+		return false;
+	std::map<unsigned short, driLocateSensor>::const_iterator Sensor = FSensors.find(Source);
+	if (Sensor == FSensors.end())
+		return false;
+
+	FSensorX.push_back(Sensor->second.X);
+	FSensorY.push_back(Sensor->second.Y);
+	FSensorZ.push_back(Sensor->second.Z);
+	FRssi.push_back(Rssi);
+	// Made the pseudorange when the frame is solved.
+	FRange.push_back(Time);
+	FFrames.back().Count++;
+	return true;
+}
+
+void CDriLocator::Solve()
+{
+	size_t Count = FRssi.size();
+	FX.resize(Count);
+	FY.resize(Count);
+	FZ.resize(Count);
+	FPower.resize(Count);
+	FBias.resize(Count);
+	FRssiResidual.resize(Count);
+	FRssiDx.resize(Count);
+	FRssiDy.resize(Count);
+	FRangeResidual.resize(Count);
+	FRangeDx.resize(Count);
+	FRangeDy.resize(Count);
+
+	for (std::vector<driLocateFrame>::iterator Frame = FFrames.begin(); Frame != FFrames.end(); Frame++)
+		Prepare(*Frame);
+
+	for (int Iteration = 0; Iteration < DRI_LOCATE_ITERATIONS; Iteration++)
+	{
+		bool Active = false;
+		for (std::vector<driLocateFrame>::const_iterator Frame = FFrames.begin();
+			Frame != FFrames.end() && !Active; Frame++)
+		{
+			Active = Frame->Active;
+		}
+		if (!Active)
+			break;
+
+		Evaluate();
+
+		for (std::vector<driLocateFrame>::iterator Frame = FFrames.begin(); Frame != FFrames.end(); Frame++)
+		{
+			if (!Frame->Active)
+				continue;
+
+			double Normal[10];
+			double Gradient[4];
+			double Cost;
+			Reduce(*Frame, Normal, Gradient, Cost);
+			Frame->Iterations++;
+
+			if (Cost < Frame->Cost)
+			{
+				bool Converged = (Frame->Step < DRI_LOCATE_CONVERGED ||
+					Frame->Cost - Cost < DRI_LOCATE_TOLERANCE * Frame->Cost);
+				for (int i = 0; i < 4; i++)
+				{
+					Frame->Params[i] = Frame->Trial[i];
+					Frame->Gradient[i] = Gradient[i];
+				}
+				for (int i = 0; i < 10; i++)
+					Frame->Normal[i] = Normal[i];
+				Frame->Cost = Cost;
+				Frame->Lambda *= 0.2;
+				if (Converged)
+				{
+					Frame->Active = false;
+					Frame->Valid = true;
+					continue;
+				}
+			}
+			else
+			{
+				// Closer to the gradient descent. The accepted solution is a
+				// minimum if no step helps.
+				Frame->Lambda *= 10;
+				if (Frame->Step < DRI_LOCATE_CONVERGED || Frame->Lambda > DRI_LOCATE_MAX_LAMBDA)
+				{
+					Frame->Active = false;
+					Frame->Valid = true;
+					continue;
+				}
+			}
+
+			double Damped[10];
+			for (int i = 0; i < 10; i++)
+				Damped[i] = Frame->Normal[i];
+			Damped[0] *= 1 + Frame->Lambda;
+			Damped[4] *= 1 + Frame->Lambda;
+			Damped[7] *= 1 + Frame->Lambda;
+			Damped[9] *= 1 + Frame->Lambda;
+
+			double Delta[4];
+			if (!SolveNormal(Damped, Frame->Gradient, Delta))
+			{
+				Frame->Active = false;
+				continue;
+			}
+			for (int i = 0; i < 4; i++)
+				Frame->Trial[i] = Frame->Params[i] + Delta[i];
+			Frame->Step = sqrt(Delta[0] * Delta[0] + Delta[1] * Delta[1]);
+		}
+	}
+
+	// Out of the iterations: the last accepted solution.
+	for (std::vector<driLocateFrame>::iterator Frame = FFrames.begin(); Frame != FFrames.end(); Frame++)
+	{
+		if (Frame->Active)
+		{
+			Frame->Active = false;
+			Frame->Valid = true;
+		}
+		for (int i = 0; i < 4; i++)
+			Frame->Trial[i] = Frame->Params[i];
+	}
+
+	// The residuals at the solutions.
+	Evaluate();
+
+	for (std::vector<driLocateFrame>::iterator Frame = FFrames.begin(); Frame != FFrames.end(); Frame++)
+	{
+		if (!Frame->Valid || Frame->Count < DRI_LOCATE_MIN_SENSORS)
+		{
+			Frame->Valid = false;
+			continue;
+		}
+
+		// The position covariance is the inverse of the normal matrix.
+		double Unit[4] = { 1, 0, 0, 0 };
+		double Column[4];
+		double Variance = 0;
+		if (SolveNormal(Frame->Normal, Unit, Column))
+		{
+			Variance = Column[0];
+			Unit[0] = 0;
+			Unit[1] = 1;
+			if (SolveNormal(Frame->Normal, Unit, Column))
+				Variance += Column[1];
+			else
+				Variance = -1;
+		}
+		else
+			Variance = -1;
+
+		double Residual = 0;
+		double Nearest = DBL_MAX;
+		size_t Last = Frame->First + Frame->Count;
+		for (size_t i = Frame->First; i < Last; i++)
+		{
+			Residual += FRssiResidual[i] * FRssiResidual[i];
+			double Dx = Frame->Params[0] - FSensorX[i];
+			double Dy = Frame->Params[1] - FSensorY[i];
+			double Distance = sqrt(Dx * Dx + Dy * Dy);
+			if (Distance < Nearest)
+				Nearest = Distance;
+		}
+		Frame->Residual = sqrt(Residual / Frame->Count) * FRssiSigma;
+		Frame->Error = (Variance > 0) ? sqrt(Variance) : 0;
+		Frame->Valid = (Variance > 0 && Nearest <= DRI_LOCATE_RANGE);
+	}
+}
+
+void CDriLocator::GetResult(const size_t Frame, driLocateResult& Result) const
+{
+	ZeroMemory(&Result, sizeof(Result));
+	if (Frame >= FFrames.size())
+		return;
+
+	const driLocateFrame& Solved = FFrames[Frame];
+	Result.Valid = Solved.Valid;
+	Result.Sensors = (unsigned long)Solved.Count;
+	Result.Iterations = Solved.Iterations;
+	if (Solved.Valid)
+	{
+		ToGlobal(Solved.Params[0], Solved.Params[1], Result.Latitude, Result.Longitude);
+		Result.Error = Solved.Error;
+		Result.Power = Solved.Params[2];
+		Result.Residual = Solved.Residual;
+	}
+}
+
+double CDriLocator::Distance(const double Latitude1, const double Longitude1,
+	const double Latitude2, const double Longitude2) const
+{
+	if (!FOrigin)
+		return 0;
+
+	double X1;
+	double Y1;
+	double X2;
+	double Y2;
+	ToLocal(Latitude1, Longitude1, X1, Y1);
+	ToLocal(Latitude2, Longitude2, X2, Y2);
+	return sqrt((X1 - X2) * (X1 - X2) + (Y1 - Y2) * (Y1 - Y2));
+}
+
+size_t CDriLocator::GetCount() const
+{
+	return FSensors.size();
+}
+
+size_t CDriLocator::GetFrames() const
+{
+	return FFrames.size();
+}
+
+double CDriLocator::GetPathLoss() const
+{
+	return FPathLoss;
+}
+
+void CDriLocator::SetPathLoss(const double Value)
+{
+	if (Value >= 1 && Value <= 6)
+		FPathLoss = Value;
+}
+
+double CDriLocator::GetRssiSigma() const
+{
+	return FRssiSigma;
+}
+
+void CDriLocator::SetRssiSigma(const double Value)
+{
+	if (Value > 0)
+		FRssiSigma = Value;
+}
+
+double CDriLocator::GetTimeSigma() const
+{
+	return FTimeSigma;
+}
+
+void CDriLocator::SetTimeSigma(const double Value)
+{
+	if (Value >= 0)
+		FTimeSigma = Value;
+}
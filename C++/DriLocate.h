@@ -0,0 +1,272 @@
+
+// DriLocate.h : header file
+//
+
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include "wclHelpers.h"
+
+#include "DriErrors.h"
+
+using namespace wclCommon;
+
+/// <summary> The default path loss exponent (2 is the free space). </summary>
+#define DRI_LOCATE_PATH_LOSS		2.2
+/// <summary> The default RSSI error in dB (the fading of one frame). </summary>
+#define DRI_LOCATE_RSSI_SIGMA		6.0
+/// <summary> The expected RSSI of a transmitter at 1 meter in dBm. The
+///   estimated power is pulled to it with <see cref="DRI_LOCATE_POWER_SIGMA" />
+///   so a transmitter outside of the sensors does not run away. </summary>
+#define DRI_LOCATE_POWER			-35.0
+/// <summary> The spread of the transmitter power in dB. </summary>
+#define DRI_LOCATE_POWER_SIGMA		15.0
+/// <summary> The assumed transmitter height over the mean sensor altitude in
+///   meters if the drone does not report its altitude. </summary>
+#define DRI_LOCATE_HEIGHT			50.0
+/// <summary> The altitude value that means "unknown" (the ASTM invalid
+///   geodetic altitude). </summary>
+#define DRI_LOCATE_NO_ALTITUDE		-1000.0
+/// <summary> The minimum number of the sensors heard a frame. </summary>
+#define DRI_LOCATE_MIN_SENSORS		3
+/// <summary> The maximum number of the solver iterations. </summary>
+#define DRI_LOCATE_ITERATIONS		15
+/// <summary> The maximum distance in meters between the estimate and the
+///   nearest sensor. A farther solution is a diverged one. </summary>
+#define DRI_LOCATE_RANGE			10000.0
+
+/// <summary> The transmitter position estimate. </summary>
+typedef struct
+{
+	/// <summary> <c>True</c> if the solver converged. The other fields are
+	///   valid only if the flag is set. </summary>
+	bool			Valid;
+	/// <summary> The latitude in degrees. </summary>
+	double			Latitude;
+	/// <summary> The longitude in degrees. </summary>
+	double			Longitude;
+	/// <summary> The horizontal error (one sigma) in meters. </summary>
+	double			Error;
+	/// <summary> The estimated RSSI at 1 meter in dBm. </summary>
+	double			Power;
+	/// <summary> The RMS RSSI residual in dB. </summary>
+	double			Residual;
+	/// <summary> The number of the used sensors. </summary>
+	unsigned long	Sensors;
+	/// <summary> The number of the solver iterations. </summary>
+	unsigned long	Iterations;
+} driLocateResult;
+
+/// <summary> Estimates the transmitter positions from the RSSI (and
+///   optionally the receive times) of one frame at several sensors. </summary>
+/// <remarks> <para> The model of a sensor <c>i</c> at the distance
+///   <c>d</c> is <c>RSSI = P - 10 n log10(d)</c> with unknown transmitter
+///   power <c>P</c>. With <c>TimeSigma</c> set the receive times are added
+///   as pseudoranges <c>c t = d + b</c> with unknown emission time
+///   <c>b</c> (TDOA). The times must be on a common clock and much finer
+///   than a millisecond to help: one microsecond is 300 meters. </para>
+///   <para> The positions are solved in the local east-north-up frame of
+///   the first sensor (the site is small) for the horizontal position; the
+///   altitude is taken from the drone. </para>
+///   <para> The frames are solved in batches by the damped Gauss-Newton
+///   (Levenberg-Marquardt) method. One iteration evaluates the models and
+///   the derivatives of all the observations of the batch in one flat,
+///   branch-free pass over the observation arrays (so the compiler can
+///   vectorize it) and then solves the small normal equations of every
+///   frame. A frame may start at the previous solution of its drone (the
+///   warm start); it is used if it fits the frame better than the RSSI
+///   weighted centroid of the sensors. </para>
+///   <para> The object is not thread safe. </para> </remarks>
+class CDriLocator
+{
+	DISABLE_COPY(CDriLocator);
+
+private:
+	typedef struct
+	{
+		double			X;
+		double			Y;
+		double			Z;
+	} driLocateSensor;
+
+	typedef struct
+	{
+		size_t			First;
+		size_t			Count;
+		// The transmitter altitude (the local one once started).
+		double			Z;
+		// Started at the previous solution.
+		bool			Warm;
+		// The accepted solution (east, north, power, range bias).
+		double			Params[4];
+		// The evaluated (trial) solution.
+		double			Trial[4];
+		// The normal equations at the accepted solution (the upper
+		// triangle by rows) and the gradient.
+		double			Normal[10];
+		double			Gradient[4];
+		double			Cost;
+		double			Lambda;
+		double			Step;
+		double			Error;
+		double			Residual;
+		unsigned long	Iterations;
+		bool			Active;
+		bool			Valid;
+	} driLocateFrame;
+
+	// The local frame origin.
+	bool							FOrigin;
+	double							FLatitude;
+	double							FLongitude;
+	double							FAltitude;
+	double							FNorth;
+	double							FEast;
+
+	std::map<unsigned short, driLocateSensor>	FSensors;
+	double							FPathLoss;
+	double							FRssiSigma;
+	double							FTimeSigma;
+
+	std::vector<driLocateFrame>		FFrames;
+
+	// The observations of the batch (a structure of arrays).
+	std::vector<double>				FSensorX;
+	std::vector<double>				FSensorY;
+	std::vector<double>				FSensorZ;
+	std::vector<double>				FRssi;
+	std::vector<double>				FRange;
+	// The solution of the owning frame, copied for the flat pass.
+	std::vector<double>				FX;
+	std::vector<double>				FY;
+	std::vector<double>				FZ;
+	std::vector<double>				FPower;
+	std::vector<double>				FBias;
+	// The weighted residuals and derivatives of the flat pass.
+	std::vector<double>				FRssiResidual;
+	std::vector<double>				FRssiDx;
+	std::vector<double>				FRssiDy;
+	std::vector<double>				FRangeResidual;
+	std::vector<double>				FRangeDx;
+	std::vector<double>				FRangeDy;
+
+	void ToLocal(const double Latitude, const double Longitude, double& X,
+		double& Y) const;
+	void ToGlobal(const double X, const double Y, double& Latitude,
+		double& Longitude) const;
+
+	double Power(const driLocateFrame& Frame, const double X,
+		const double Y) const;
+	double Fit(const driLocateFrame& Frame, const double X,
+		const double Y) const;
+	void Prepare(driLocateFrame& Frame);
+	void Evaluate();
+	void Reduce(const driLocateFrame& Frame, double* const Normal,
+		double* const Gradient, double& Cost) const;
+
+public:
+	/// <summary> Creates new locator. </summary>
+	CDriLocator();
+	/// <summary> Frees the object. </summary>
+	virtual ~CDriLocator();
+
+	/// <summary> Adds or moves a sensor. </summary>
+	/// <param name="Source"> The sensor identification (the
+	///   <c>ExportSource</c> of the sensor). </param>
+	/// <param name="Latitude"> The antenna latitude in degrees. </param>
+	/// <param name="Longitude"> The antenna longitude in degrees. </param>
+	/// <param name="Altitude"> The antenna altitude in meters, on the same
+	///   reference as the drone geodetic altitude. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	/// <remarks> The first sensor is the origin of the local frame. A sensor
+	///   must not be moved far from it. </remarks>
+	int AddSensor(const unsigned short Source, const double Latitude,
+		const double Longitude, const double Altitude);
+
+	/// <summary> Removes the frames of the previous batch. </summary>
+	void Clear();
+	/// <summary> Adds a frame to the batch. </summary>
+	/// <param name="Altitude"> The transmitter altitude in meters or
+	///   <see cref="DRI_LOCATE_NO_ALTITUDE" />. </param>
+	/// <param name="Start"> The previous solution of the transmitter (the
+	///   warm start) or <c>NULL</c>. </param>
+	/// <returns> The frame index. </returns>
+	size_t AddFrame(const double Altitude, const driLocateResult* const Start);
+	/// <summary> Adds the reception of the last added frame. </summary>
+	/// <param name="Source"> The sensor identification. </param>
+	/// <param name="Rssi"> The RSSI in dBm. </param>
+	/// <param name="Time"> The receive time in seconds (any epoch common to
+	///   the frame). Used only if <c>TimeSigma</c> is set. </param>
+	/// <returns> <c>False</c> if the sensor position is unknown. </returns>
+	bool AddObservation(const unsigned short Source, const double Rssi,
+		const double Time);
+	/// <summary> Solves all the frames of the batch. </summary>
+	void Solve();
+	/// <summary> Gets the solution of a frame. </summary>
+	/// <param name="Frame"> The frame index. </param>
+	/// <param name="Result"> On output contains the solution. </param>
+	void GetResult(const size_t Frame, driLocateResult& Result) const;
+
+	/// <summary> Gets the ground distance between two points of the
+	///   site. </summary>
+	/// <param name="Latitude1"> The first point latitude. </param>
+	/// <param name="Longitude1"> The first point longitude. </param>
+	/// <param name="Latitude2"> The second point latitude. </param>
+	/// <param name="Longitude2"> The second point longitude. </param>
+	/// <returns> The distance in meters. </returns>
+	double Distance(const double Latitude1, const double Longitude1,
+		const double Latitude2, const double Longitude2) const;
+
+	/// <summary> Gets the number of the sensors with known
+	///   positions. </summary>
+	/// <returns> The sensors count. </returns>
+	size_t GetCount() const;
+	/// <summary> Gets the number of the sensors with known
+	///   positions. </summary>
+	/// <value> The sensors count. </value>
+	__declspec(property(get = GetCount)) size_t Count;
+
+	/// <summary> Gets the number of the frames in the batch. </summary>
+	/// <returns> The frames count. </returns>
+	size_t GetFrames() const;
+	/// <summary> Gets the number of the frames in the batch. </summary>
+	/// <value> The frames count. </value>
+	__declspec(property(get = GetFrames)) size_t Frames;
+
+	/// <summary> Gets the path loss exponent. </summary>
+	/// <returns> The exponent. </returns>
+	double GetPathLoss() const;
+	/// <summary> Sets the path loss exponent. </summary>
+	/// <param name="Value"> The exponent from 1 to 6. </param>
+	void SetPathLoss(const double Value);
+	/// <summary> Gets or sets the path loss exponent. </summary>
+	/// <value> The exponent. </value>
+	__declspec(property(get = GetPathLoss, put = SetPathLoss)) double PathLoss;
+
+	/// <summary> Gets the RSSI error. </summary>
+	/// <returns> The error in dB. </returns>
+	double GetRssiSigma() const;
+	/// <summary> Sets the RSSI error. </summary>
+	/// <param name="Value"> The error in dB. </param>
+	void SetRssiSigma(const double Value);
+	/// <summary> Gets or sets the RSSI error. </summary>
+	/// <value> The error in dB. </value>
+	__declspec(property(get = GetRssiSigma, put = SetRssiSigma)) double RssiSigma;
+
+	/// <summary> Gets the receive time error. </summary>
+	/// <returns> The error in seconds. Zero if the times are not
+	///   used. </returns>
+	double GetTimeSigma() const;
+	/// <summary> Sets the receive time error. </summary>
+	/// <param name="Value"> The error in seconds. Zero (the default) does
+	///   not use the times. </param>
+	void SetTimeSigma(const double Value);
+	/// <summary> Gets or sets the receive time error. </summary>
+	/// <value> The error in seconds. Zero if the times are not
+	///   used. </value>
+	__declspec(property(get = GetTimeSigma, put = SetTimeSigma)) double TimeSigma;
+};
@@ -0,0 +1,140 @@
+
+// DriMappedFile.cpp : implementation file
+//
+
+#include "stdafx.h"
+#include "DriMappedFile.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+
+// CDriMappedFile
+
+CDriMappedFile::CDriMappedFile(const unsigned long Window)
+{
+	FFile = INVALID_HANDLE_VALUE;
+	FMapping = NULL;
+	FSize = 0;
+
+	SYSTEM_INFO Info;
+	GetSystemInfo(&Info);
+	FGranularity = Info.dwAllocationGranularity;
+	FWindow = Window;
+	if (FWindow < FGranularity)
+		FWindow = FGranularity;
+
+	FView = NULL;
+	FViewOffset = 0;
+	FViewSize = 0;
+}
+
+CDriMappedFile::~CDriMappedFile()
+{
+	Close();
+}
+
+void CDriMappedFile::Unmap()
+{
+	if (FView != NULL)
+	{
+		UnmapViewOfFile(FView);
+		FView = NULL;
+		FViewOffset = 0;
+		FViewSize = 0;
+	}
+}
+
+int CDriMappedFile::Open(const tstring& FileName, const bool Sequential)
+{
+	if (FileName == _T(""))
+		return WCL_E_INVALID_ARGUMENT;
+	if (FFile != INVALID_HANDLE_VALUE)
+		return DRI_E_MAPPED_OPENED;
+
+	// The writer may still be writing to the file so allow write sharing.
+	DWORD Flags = FILE_ATTRIBUTE_NORMAL;
+	if (Sequential)
+		Flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+	else
+		Flags |= FILE_FLAG_RANDOM_ACCESS;
+	FFile = CreateFile(FileName.c_str(), GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, Flags, NULL);
+	if (FFile == INVALID_HANDLE_VALUE)
+		return DRI_E_MAPPED_OPEN_FAILED;
+
+	int Res = WCL_E_SUCCESS;
+	LARGE_INTEGER Size;
+	if (!GetFileSizeEx(FFile, &Size))
+		Res = DRI_E_MAPPED_OPEN_FAILED;
+	else
+	{
+		FSize = (unsigned __int64)Size.QuadPart;
+		// An empty file can not be mapped. Map always fails for it.
+		if (FSize > 0)
+		{
+			FMapping = CreateFileMapping(FFile, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (FMapping == NULL)
+				Res = DRI_E_MAPPED_MAP_FAILED;
+		}
+	}
+
+	if (Res != WCL_E_SUCCESS)
+		Close();
+	return Res;
+}
+
+void CDriMappedFile::Close()
+{
+	Unmap();
+	if (FMapping != NULL)
+	{
+		CloseHandle(FMapping);
+		FMapping = NULL;
+	}
+	if (FFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(FFile);
+		FFile = INVALID_HANDLE_VALUE;
+	}
+	FSize = 0;
+}
+
+const unsigned char* CDriMappedFile::Map(const unsigned __int64 Offset,
+	const unsigned long Size)
+{
+	if (FMapping == NULL || Offset + Size > FSize)
+		return NULL;
+
+	if (FView != NULL && Offset >= FViewOffset && Offset + Size <= FViewOffset + FViewSize)
+		return FView + (Offset - FViewOffset);
+
+	Unmap();
+
+	unsigned __int64 Start = Offset - (Offset % FGranularity);
+	unsigned __int64 Length = FWindow;
+	if (Length < Offset + Size - Start)
+		Length = Offset + Size - Start;
+	if (Start + Length > FSize)
+		Length = FSize - Start;
+
+	FView = (const unsigned char*)MapViewOfFile(FMapping, FILE_MAP_READ,
+		(DWORD)(Start >> 32), (DWORD)(Start & 0xFFFFFFFF), (SIZE_T)Length);
+	if (FView == NULL)
+		return NULL;
+
+	FViewOffset = Start;
+	FViewSize = (unsigned long)Length;
+	return FView + (Offset - FViewOffset);
+}
+
+bool CDriMappedFile::GetActive() const
+{
+	return (FFile != INVALID_HANDLE_VALUE);
+}
+
+unsigned __int64 CDriMappedFile::GetSize() const
+{
+	return FSize;
+}
@@ -0,0 +1,77 @@
+
+// DriMappedFile.h : header file
+//
+
+#pragma once
+
+#include "wclHelpers.h"
+
+#include "DriErrors.h"
+
+using namespace wclCommon;
+
+/// <summary> Read-only access to a file through a sliding memory-mapped
+///   view. </summary>
+/// <remarks> Only one view is mapped at a time so files larger than the
+///   process address space can be read. A pointer returned by <c>Map</c>
+///   stays valid until the next <c>Map</c> call. The class is not thread
+///   safe. </remarks>
+class CDriMappedFile
+{
+	DISABLE_COPY(CDriMappedFile);
+
+private:
+	HANDLE					FFile;
+	HANDLE					FMapping;
+	unsigned __int64		FSize;
+	unsigned long			FGranularity;
+	unsigned long			FWindow;
+
+	const unsigned char*	FView;
+	unsigned __int64		FViewOffset;
+	unsigned long			FViewSize;
+
+	void Unmap();
+
+public:
+	/// <summary> Creates new mapped file object. </summary>
+	/// <param name="Window"> The preferred view size in bytes. </param>
+	CDriMappedFile(const unsigned long Window);
+	/// <summary> Closes the file and frees the object. </summary>
+	virtual ~CDriMappedFile();
+
+	/// <summary> Opens the file. </summary>
+	/// <param name="FileName"> The file name. </param>
+	/// <param name="Sequential"> <c>True</c> if the file is mostly read from
+	///   the beginning to the end. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	/// <remarks> The file may still be written by other process. Only the data
+	///   written before the file was opened is available. </remarks>
+	int Open(const tstring& FileName, const bool Sequential);
+	/// <summary> Closes the file. </summary>
+	void Close();
+
+	/// <summary> Maps the given file range. </summary>
+	/// <param name="Offset"> The range offset. </param>
+	/// <param name="Size"> The range size. Must not exceed the
+	///   window size. </param>
+	/// <returns> The pointer to the range or <c>NULL</c> if the range is out of
+	///   the file bounds or mapping failed. </returns>
+	const unsigned char* Map(const unsigned __int64 Offset, const unsigned long Size);
+
+	/// <summary> Gets the file state. </summary>
+	/// <returns> <c>True</c> if the file is opened. </returns>
+	bool GetActive() const;
+	/// <summary> Gets the file state. </summary>
+	/// <value> <c>True</c> if the file is opened. </value>
+	__declspec(property(get = GetActive)) bool Active;
+
+	/// <summary> Gets the file size. </summary>
+	/// <returns> The file size in bytes. </returns>
+	unsigned __int64 GetSize() const;
+	/// <summary> Gets the file size. </summary>
+	/// <value> The file size in bytes. </value>
+	__declspec(property(get = GetSize)) unsigned __int64 Size;
+};
@@ -0,0 +1,326 @@
+
+// DriPicture.cpp : implementation file
+//
+
+#include "stdafx.h"
+#include "DriPicture.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+
+// The number of FILETIME units in one second.
+#define DRI_FILETIME_SECOND		10000000
+
+static std::string IdText(const wclDriAsdId& Id)
+{
+	// The ID is a zero padded string.
+	size_t Length = Id.size();
+	while (Length > 0 && Id[Length - 1] == 0)
+		Length--;
+	if (Length == 0)
+		return std::string();
+	return std::string((const char*)&Id[0], Length);
+}
+
+// The structure has strings so it is initialized field by field.
+static void InitDrone(driPictureDrone& Drone, const std::string& Name)
+{
+	Drone.Name = Name;
+	Drone.Id.clear();
+	Drone.Version = 0;
+	Drone.Removed = false;
+	Drone.Updated = 0;
+	Drone.Transport = ctBluetooth;
+	Drone.Rssi = 0;
+	Drone.Messages = 0;
+	Drone.Located = false;
+	Drone.Latitude = 0;
+	Drone.Longitude = 0;
+	Drone.GeoAltitude = 0;
+	Drone.Height = 0;
+	Drone.HorizontalSpeed = 255;
+	Drone.VerticalSpeed = 0;
+	Drone.Direction = 361;
+	Drone.Status = 0;
+	Drone.Operated = false;
+	Drone.OperatorLatitude = 0;
+	Drone.OperatorLongitude = 0;
+}
+
+
+// CDriPicture
+
+CDriPicture::CDriPicture()
+{
+	FCS = new CwclCriticalSection();
+	FDropped = 0;
+	FVersion = 0;
+	FTimeout = DRI_PICTURE_TIMEOUT * (__int64)DRI_FILETIME_SECOND;
+	FTrackSpan = DRI_PICTURE_TRACK_SPAN * 60 * (__int64)DRI_FILETIME_SECOND;
+}
+
+CDriPicture::~CDriPicture()
+{
+	delete FCS;
+}
+
+std::string CDriPicture::Utf8(const tstring& Text)
+{
+#ifdef _UNICODE
+	if (Text.length() == 0)
+		return std::string();
+
+	int Len = WideCharToMultiByte(CP_UTF8, 0, Text.c_str(), (int)Text.length(), NULL, 0,
+		NULL, NULL);
+	if (Len <= 0)
+		return std::string();
+
+	std::string Res(Len, 0);
+	WideCharToMultiByte(CP_UTF8, 0, Text.c_str(), (int)Text.length(), &Res[0], Len,
+		NULL, NULL);
+	return Res;
+#else
+	return Text;
+#endif
+}
+
+bool CDriPicture::InArea(const driPictureDrone& Drone, const driPictureArea* const Area)
+{
+	if (Area == NULL)
+		return true;
+	return (Drone.Located &&
+		Drone.Latitude >= Area->MinLatitude && Drone.Latitude <= Area->MaxLatitude &&
+		Drone.Longitude >= Area->MinLongitude && Drone.Longitude <= Area->MaxLongitude);
+}
+
+void CDriPicture::Remove(const std::string& Name)
+{
+	driPictureDrone Removed;
+	InitDrone(Removed, Name);
+	Removed.Version = ++FVersion;
+	Removed.Removed = true;
+	if (FRemovals.size() >= DRI_PICTURE_REMOVALS)
+	{
+		// The readers older than the dropped removal get the whole picture.
+		FDropped = FRemovals.front().Version;
+		FRemovals.pop_front();
+	}
+	FRemovals.push_back(Removed);
+}
+
+void CDriPicture::Update(const driFrame& Frame, const tstring& Name,
+	const CwclDriAsdMessage* const Message)
+{
+	if (Message == NULL)
+		return;
+
+	std::string Key = Utf8(Name);
+
+	FCS->Enter();
+	driPictureEntries::iterator Entry = FDrones.find(Key);
+	if (Entry == FDrones.end())
+	{
+		driPictureEntry New;
+		InitDrone(New.State, Key);
+		Entry = FDrones.insert(std::make_pair(Key, New)).first;
+	}
+
+	driPictureDrone& State = Entry->second.State;
+	State.Version = ++FVersion;
+	State.Updated = Frame.Timestamp;
+	State.Transport = Frame.Transport;
+	State.Rssi = Frame.Rssi;
+	State.Messages++;
+
+	switch (Message->MessageType)
+	{
+	case mtBasicId:
+		State.Id = IdText(((const CwclDriAsdBasicIdMessage*)Message)->Id);
+		break;
+
+	case mtLocation:
+		{
+			const CwclDriAsdLocationMessage* Location = (const CwclDriAsdLocationMessage*)Message;
+			State.Located = true;
+			State.Latitude = Location->Latitude;
+			State.Longitude = Location->Longitude;
+			State.GeoAltitude = Location->GeoAltitude;
+			State.Height = Location->Height;
+			State.HorizontalSpeed = Location->HorizontalSpeed;
+			State.VerticalSpeed = Location->VerticalSpeed;
+			State.Direction = Location->Direction;
+			State.Status = (unsigned char)Location->Status;
+
+			std::deque<driPicturePoint>& Track = Entry->second.Track;
+			if (Track.size() >= DRI_PICTURE_TRACK_POINTS)
+				Track.pop_front();
+			driPicturePoint Point;
+			Point.Timestamp = Frame.Timestamp;
+			Point.Latitude = Location->Latitude;
+			Point.Longitude = Location->Longitude;
+			Point.GeoAltitude = Location->GeoAltitude;
+			Track.push_back(Point);
+			break;
+		}
+
+	case mtSystem:
+		{
+			const CwclDriAsdSystemMessage* System = (const CwclDriAsdSystemMessage*)Message;
+			State.Operated = true;
+			State.OperatorLatitude = System->OperatorLatitude;
+			State.OperatorLongitude = System->OperatorLongitude;
+			break;
+		}
+
+	default:
+		// The other messages only refresh the drone.
+		break;
+	}
+	FCS->Leave();
+}
+
+void CDriPicture::Expire(const __int64 Now)
+{
+	FCS->Enter();
+	driPictureEntries::iterator Entry = FDrones.begin();
+	while (Entry != FDrones.end())
+	{
+		if (Entry->second.State.Updated + FTimeout < Now)
+		{
+			Remove(Entry->first);
+			Entry = FDrones.erase(Entry);
+		}
+		else
+		{
+			// The track points are in the receive order.
+			std::deque<driPicturePoint>& Track = Entry->second.Track;
+			while (Track.size() > 0 && Track.front().Timestamp + FTrackSpan < Now)
+				Track.pop_front();
+			Entry++;
+		}
+	}
+	FCS->Leave();
+}
+
+void CDriPicture::Clear()
+{
+	FCS->Enter();
+	for (driPictureEntries::const_iterator Entry = FDrones.begin(); Entry != FDrones.end(); Entry++)
+		Remove(Entry->first);
+	FDrones.clear();
+	FCS->Leave();
+}
+
+unsigned __int64 CDriPicture::GetDrones(const driPictureArea* const Area,
+	std::vector<driPictureDrone>& Drones) const
+{
+	Drones.clear();
+
+	FCS->Enter();
+	Drones.reserve(FDrones.size());
+	for (driPictureEntries::const_iterator Entry = FDrones.begin(); Entry != FDrones.end(); Entry++)
+	{
+		if (InArea(Entry->second.State, Area))
+			Drones.push_back(Entry->second.State);
+	}
+	unsigned __int64 Version = FVersion;
+	FCS->Leave();
+	return Version;
+}
+
+unsigned __int64 CDriPicture::GetChanges(const unsigned __int64 Since,
+	std::vector<driPictureDrone>& Drones, bool& Reset) const
+{
+	Drones.clear();
+
+	FCS->Enter();
+	unsigned __int64 Version = FVersion;
+	// Some of the removals the reader did not see are forgotten.
+	Reset = (Since < FDropped);
+	if (Reset)
+	{
+		Drones.reserve(FDrones.size());
+		for (driPictureEntries::const_iterator Entry = FDrones.begin(); Entry != FDrones.end(); Entry++)
+			Drones.push_back(Entry->second.State);
+	}
+	else
+	{
+		if (Version > Since)
+		{
+			for (std::deque<driPictureDrone>::const_iterator Removed = FRemovals.begin();
+				Removed != FRemovals.end(); Removed++)
+			{
+				if (Removed->Version > Since)
+					Drones.push_back(*Removed);
+			}
+			for (driPictureEntries::const_iterator Entry = FDrones.begin(); Entry != FDrones.end(); Entry++)
+			{
+				if (Entry->second.State.Version > Since)
+					Drones.push_back(Entry->second.State);
+			}
+		}
+	}
+	FCS->Leave();
+	return Version;
+}
+
+bool CDriPicture::GetTrack(const std::string& Name, const __int64 From,
+	std::vector<driPicturePoint>& Points) const
+{
+	Points.clear();
+
+	FCS->Enter();
+	driPictureEntries::const_iterator Entry = FDrones.find(Name);
+	bool Found = (Entry != FDrones.end());
+	if (Found)
+	{
+		const std::deque<driPicturePoint>& Track = Entry->second.Track;
+		for (std::deque<driPicturePoint>::const_iterator Point = Track.begin(); Point != Track.end(); Point++)
+		{
+			if (Point->Timestamp >= From)
+				Points.push_back(*Point);
+		}
+	}
+	FCS->Leave();
+	return Found;
+}
+
+unsigned __int64 CDriPicture::GetVersion() const
+{
+	FCS->Enter();
+	unsigned __int64 Version = FVersion;
+	FCS->Leave();
+	return Version;
+}
+
+size_t CDriPicture::GetCount() const
+{
+	FCS->Enter();
+	size_t Count = FDrones.size();
+	FCS->Leave();
+	return Count;
+}
+
+unsigned long CDriPicture::GetTimeout() const
+{
+	return (unsigned long)(FTimeout / DRI_FILETIME_SECOND);
+}
+
+void CDriPicture::SetTimeout(const unsigned long Value)
+{
+	if (Value > 0)
+		FTimeout = Value * (__int64)DRI_FILETIME_SECOND;
+}
+
+unsigned long CDriPicture::GetTrackSpan() const
+{
+	return (unsigned long)(FTrackSpan / (60 * (__int64)DRI_FILETIME_SECOND));
+}
+
+void CDriPicture::SetTrackSpan(const unsigned long Value)
+{
+	if (Value > 0)
+		FTrackSpan = Value * 60 * (__int64)DRI_FILETIME_SECOND;
+}
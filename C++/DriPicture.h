@@ -0,0 +1,215 @@
+
+// DriPicture.h : header file
+//
+
+#pragma once
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "wclHelpers.h"
+#include "wclSync.h"
+#include "wclDriAsd.h"
+
+#include "DriCaptureManager.h"
+
+using namespace wclCommon;
+using namespace wclSync;
+using namespace wclDri;
+
+/// <summary> The default time a silent drone stays in the picture in
+///   seconds. </summary>
+#define DRI_PICTURE_TIMEOUT			60
+/// <summary> The default track history length in minutes. </summary>
+#define DRI_PICTURE_TRACK_SPAN		10
+/// <summary> The maximum number of the track points of one drone. </summary>
+#define DRI_PICTURE_TRACK_POINTS	3600
+/// <summary> The number of the remembered drone removals for the change
+///   feed. </summary>
+#define DRI_PICTURE_REMOVALS		256
+
+/// <summary> A track point. </summary>
+typedef struct
+{
+	/// <summary> The receive time (FILETIME, UTC). </summary>
+	__int64		Timestamp;
+	/// <summary> The latitude in degrees. </summary>
+	double		Latitude;
+	/// <summary> The longitude in degrees. </summary>
+	double		Longitude;
+	/// <summary> The geodetic altitude in meters. </summary>
+	float		GeoAltitude;
+} driPicturePoint;
+
+/// <summary> The current state of a drone. </summary>
+typedef struct
+{
+	/// <summary> The drone name (the SSID or the Bluetooth address,
+	///   UTF-8). </summary>
+	std::string			Name;
+	/// <summary> The UAS ID. Empty until the Basic ID is
+	///   received. </summary>
+	std::string			Id;
+	/// <summary> The picture version of the last change. </summary>
+	unsigned __int64	Version;
+	/// <summary> <c>True</c> if the drone was removed (the change feed
+	///   only). </summary>
+	bool				Removed;
+	/// <summary> The last receive time (FILETIME, UTC). </summary>
+	__int64				Updated;
+	driCaptureTransport	Transport;
+	char				Rssi;
+	/// <summary> The number of the received messages. </summary>
+	unsigned long		Messages;
+	/// <summary> <c>True</c> if the location fields are valid. </summary>
+	bool				Located;
+	double				Latitude;
+	double				Longitude;
+	float				GeoAltitude;
+	float				Height;
+	/// <summary> The horizontal speed in m/s. 255 if unknown. </summary>
+	float				HorizontalSpeed;
+	float				VerticalSpeed;
+	/// <summary> The direction in degrees. Above 360 if unknown. </summary>
+	unsigned short		Direction;
+	unsigned char		Status;
+	/// <summary> <c>True</c> if the operator fields are valid. </summary>
+	bool				Operated;
+	double				OperatorLatitude;
+	double				OperatorLongitude;
+} driPictureDrone;
+
+/// <summary> An area in degrees. </summary>
+typedef struct
+{
+	double	MinLatitude;
+	double	MinLongitude;
+	double	MaxLatitude;
+	double	MaxLongitude;
+} driPictureArea;
+
+/// <summary> The in-memory drone picture: the current state and the short
+///   track history of every drone. </summary>
+/// <remarks> <para> The picture is fed with the decoded messages by the
+///   sensor and read by the consumers in other threads (the query server).
+///   It does not share anything with the user interface or the
+///   <see cref="CDriDroneList" />, so a slow reader never holds the sensor
+///   lock. </para>
+///   <para> Every change increments the picture version and stamps the
+///   changed drone with it, so a reader asks for the changes since the
+///   version it saw last. The methods are thread safe. </para> </remarks>
+class CDriPicture
+{
+	DISABLE_COPY(CDriPicture);
+
+private:
+	typedef struct
+	{
+		driPictureDrone				State;
+		std::deque<driPicturePoint>	Track;
+	} driPictureEntry;
+
+	typedef std::map<std::string, driPictureEntry> driPictureEntries;
+
+	CwclCriticalSection*			FCS;
+	driPictureEntries				FDrones;
+	// The removed drones (the name and the version) for the change feed.
+	std::deque<driPictureDrone>		FRemovals;
+	// The version of the last removal dropped from FRemovals.
+	unsigned __int64				FDropped;
+	unsigned __int64				FVersion;
+	__int64							FTimeout;
+	__int64							FTrackSpan;
+
+	static std::string Utf8(const tstring& Text);
+	static bool InArea(const driPictureDrone& Drone, const driPictureArea* const Area);
+
+	void Remove(const std::string& Name);
+
+public:
+	/// <summary> Creates new empty picture. </summary>
+	CDriPicture();
+	/// <summary> Frees the picture. </summary>
+	virtual ~CDriPicture();
+
+	/// <summary> Updates the drone state with a decoded message. </summary>
+	/// <param name="Frame"> The frame the message was received in. </param>
+	/// <param name="Name"> The drone name. </param>
+	/// <param name="Message"> The ASD message. </param>
+	void Update(const driFrame& Frame, const tstring& Name,
+		const CwclDriAsdMessage* const Message);
+	/// <summary> Removes the silent drones and the old track
+	///   points. </summary>
+	/// <param name="Now"> The current time (FILETIME, UTC). </param>
+	void Expire(const __int64 Now);
+	/// <summary> Removes all the drones. </summary>
+	void Clear();
+
+	/// <summary> Gets the current drones. </summary>
+	/// <param name="Area"> The area or <c>NULL</c> for all the drones. A
+	///   drone without location is never in an area. </param>
+	/// <param name="Drones"> On output contains the drones. </param>
+	/// <returns> The picture version of the copy. </returns>
+	unsigned __int64 GetDrones(const driPictureArea* const Area,
+		std::vector<driPictureDrone>& Drones) const;
+	/// <summary> Gets the drones changed or removed after the
+	///   version. </summary>
+	/// <param name="Since"> The version the reader saw last. </param>
+	/// <param name="Drones"> On output contains the changed drones. The
+	///   removed drones have <c>Removed</c> set; only their name and version
+	///   are valid. </param>
+	/// <param name="Reset"> On output is <c>true</c> if the changes can not
+	///   be told: <c>Drones</c> contains all the current drones and the
+	///   reader must drop the drones it has. </param>
+	/// <returns> The picture version of the copy. </returns>
+	/// <remarks> Only the last <see cref="DRI_PICTURE_REMOVALS" /> removals
+	///   are remembered. A reader that fell behind further gets the whole
+	///   picture with <c>Reset</c> set. </remarks>
+	unsigned __int64 GetChanges(const unsigned __int64 Since,
+		std::vector<driPictureDrone>& Drones, bool& Reset) const;
+	/// <summary> Gets the drone track. </summary>
+	/// <param name="Name"> The drone name (UTF-8). </param>
+	/// <param name="From"> The earliest point time (FILETIME, UTC). </param>
+	/// <param name="Points"> On output contains the track points. </param>
+	/// <returns> <c>True</c> if the drone is in the picture. </returns>
+	bool GetTrack(const std::string& Name, const __int64 From,
+		std::vector<driPicturePoint>& Points) const;
+
+	/// <summary> Gets the picture version. </summary>
+	/// <returns> The version. Changes when any drone changes. </returns>
+	unsigned __int64 GetVersion() const;
+	/// <summary> Gets the picture version. </summary>
+	/// <value> The version. </value>
+	__declspec(property(get = GetVersion)) unsigned __int64 Version;
+
+	/// <summary> Gets the number of the drones. </summary>
+	/// <returns> The drones count. </returns>
+	size_t GetCount() const;
+	/// <summary> Gets the number of the drones. </summary>
+	/// <value> The drones count. </value>
+	__declspec(property(get = GetCount)) size_t Count;
+
+	/// <summary> Gets the silent drone timeout. </summary>
+	/// <returns> The timeout in seconds. </returns>
+	unsigned long GetTimeout() const;
+	/// <summary> Sets the silent drone timeout. </summary>
+	/// <param name="Value"> The timeout in seconds. </param>
+	void SetTimeout(const unsigned long Value);
+	/// <summary> Gets and sets the silent drone timeout. </summary>
+	/// <value> The timeout in seconds. </value>
+	__declspec(property(get = GetTimeout, put = SetTimeout))
+		unsigned long Timeout;
+
+	/// <summary> Gets the track history length. </summary>
+	/// <returns> The length in minutes. </returns>
+	unsigned long GetTrackSpan() const;
+	/// <summary> Sets the track history length. </summary>
+	/// <param name="Value"> The length in minutes. </param>
+	void SetTrackSpan(const unsigned long Value);
+	/// <summary> Gets and sets the track history length. </summary>
+	/// <value> The length in minutes. </value>
+	__declspec(property(get = GetTrackSpan, put = SetTrackSpan))
+		unsigned long TrackSpan;
+};
@@ -0,0 +1,263 @@
+
+// DriPool.cpp : implementation file
+//
+
+#include "stdafx.h"
+#include "DriPool.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+
+// Every block starts with the header: the list link while the block is free
+// and the size class index while it is allocated.
+#define DRI_POOL_HEADER		sizeof(SLIST_ENTRY)
+
+
+static size_t ClassSize(const size_t Class)
+{
+	return ((size_t)DRI_POOL_MIN_BLOCK << Class);
+}
+
+static size_t SizeClass(const size_t Size)
+{
+	size_t Class = 0;
+	while (Class < DRI_POOL_CLASSES && ClassSize(Class) < Size)
+		Class++;
+	return Class;
+}
+
+static void AddStatistics(driPoolStatistics& Dst, const driPoolStatistics& Src)
+{
+	Dst.Allocations += Src.Allocations;
+	Dst.CacheHits += Src.CacheHits;
+	Dst.ListHits += Src.ListHits;
+	Dst.Misses += Src.Misses;
+}
+
+
+// CDriBufferPool
+
+CDriBufferPool::CDriBufferPool()
+{
+	FCS = new CwclCriticalSection();
+	FTls = TlsAlloc();
+
+	FLists = (PSLIST_HEADER)_aligned_malloc(sizeof(SLIST_HEADER) * DRI_POOL_CLASSES,
+		MEMORY_ALLOCATION_ALIGNMENT);
+	for (size_t i = 0; i < DRI_POOL_CLASSES; i++)
+		InitializeSListHead(&FLists[i]);
+
+	ZeroMemory(FRetired, sizeof(FRetired));
+	for (size_t i = 0; i < DRI_POOL_CLASSES; i++)
+		FRetired[i].Size = ClassSize(i);
+}
+
+CDriBufferPool::~CDriBufferPool()
+{
+	// Caches of the threads that did not flush.
+	while (FCaches.size() > 0)
+	{
+		driPoolCache* Cache = FCaches.back();
+		FCaches.pop_back();
+		for (size_t i = 0; i < DRI_POOL_CLASSES; i++)
+		{
+			PSLIST_ENTRY Block = (PSLIST_ENTRY)Cache->Head[i];
+			while (Block != NULL)
+			{
+				PSLIST_ENTRY Next = Block->Next;
+				_aligned_free(Block);
+				Block = Next;
+			}
+		}
+		delete Cache;
+	}
+
+	for (size_t i = 0; i < DRI_POOL_CLASSES; i++)
+	{
+		PSLIST_ENTRY Block = InterlockedFlushSList(&FLists[i]);
+		while (Block != NULL)
+		{
+			PSLIST_ENTRY Next = Block->Next;
+			_aligned_free(Block);
+			Block = Next;
+		}
+	}
+	_aligned_free(FLists);
+
+	if (FTls != TLS_OUT_OF_INDEXES)
+		TlsFree(FTls);
+	delete FCS;
+}
+
+CDriBufferPool::driPoolCache* CDriBufferPool::GetCache()
+{
+	if (FTls == TLS_OUT_OF_INDEXES)
+		return NULL;
+
+	driPoolCache* Cache = (driPoolCache*)TlsGetValue(FTls);
+	if (Cache == NULL)
+	{
+		Cache = new driPoolCache;
+		ZeroMemory(Cache, sizeof(driPoolCache));
+		for (size_t i = 0; i < DRI_POOL_CLASSES; i++)
+			Cache->Statistics[i].Size = ClassSize(i);
+
+		FCS->Enter();
+		FCaches.push_back(Cache);
+		FCS->Leave();
+
+		TlsSetValue(FTls, Cache);
+	}
+	return Cache;
+}
+
+void CDriBufferPool::ReleaseCache(driPoolCache* const Cache)
+{
+	for (size_t i = 0; i < DRI_POOL_CLASSES; i++)
+	{
+		PSLIST_ENTRY Block = (PSLIST_ENTRY)Cache->Head[i];
+		while (Block != NULL)
+		{
+			PSLIST_ENTRY Next = Block->Next;
+			InterlockedPushEntrySList(&FLists[i], Block);
+			Block = Next;
+		}
+	}
+
+	FCS->Enter();
+	for (std::vector<driPoolCache*>::iterator Item = FCaches.begin();
+		Item != FCaches.end(); Item++)
+	{
+		if (*Item == Cache)
+		{
+			FCaches.erase(Item);
+			break;
+		}
+	}
+	for (size_t i = 0; i <= DRI_POOL_CLASSES; i++)
+		AddStatistics(FRetired[i], Cache->Statistics[i]);
+	FCS->Leave();
+
+	delete Cache;
+}
+
+unsigned char* CDriBufferPool::Alloc(const size_t Size)
+{
+	size_t Class = SizeClass(Size);
+	driPoolCache* Cache = GetCache();
+
+	PSLIST_ENTRY Block = NULL;
+	if (Class == DRI_POOL_CLASSES)
+	{
+		Block = (PSLIST_ENTRY)_aligned_malloc(DRI_POOL_HEADER + Size,
+			MEMORY_ALLOCATION_ALIGNMENT);
+		if (Cache != NULL)
+		{
+			Cache->Statistics[Class].Allocations++;
+			Cache->Statistics[Class].Misses++;
+		}
+	}
+	else
+	{
+		if (Cache != NULL)
+		{
+			Cache->Statistics[Class].Allocations++;
+			Block = (PSLIST_ENTRY)Cache->Head[Class];
+			if (Block != NULL)
+			{
+				Cache->Head[Class] = Block->Next;
+				Cache->Count[Class]--;
+				Cache->Statistics[Class].CacheHits++;
+			}
+		}
+
+		if (Block == NULL)
+		{
+			Block = InterlockedPopEntrySList(&FLists[Class]);
+			if (Block != NULL)
+			{
+				if (Cache != NULL)
+					Cache->Statistics[Class].ListHits++;
+			}
+			else
+			{
+				Block = (PSLIST_ENTRY)_aligned_malloc(DRI_POOL_HEADER +
+					ClassSize(Class), MEMORY_ALLOCATION_ALIGNMENT);
+				if (Cache != NULL)
+					Cache->Statistics[Class].Misses++;
+			}
+		}
+	}
+
+	if (Block == NULL)
+		return NULL;
+
+	*(size_t*)Block = Class;
+	return (unsigned char*)Block + DRI_POOL_HEADER;
+}
+
+void CDriBufferPool::Free(const unsigned char* const Buffer)
+{
+	if (Buffer == NULL)
+		return;
+
+	PSLIST_ENTRY Block = (PSLIST_ENTRY)(Buffer - DRI_POOL_HEADER);
+	size_t Class = *(size_t*)Block;
+	if (Class >= DRI_POOL_CLASSES)
+	{
+		_aligned_free(Block);
+		return;
+	}
+
+	driPoolCache* Cache = GetCache();
+	if (Cache == NULL)
+	{
+		InterlockedPushEntrySList(&FLists[Class], Block);
+		return;
+	}
+
+	if (Cache->Count[Class] >= DRI_POOL_CACHE_SIZE)
+	{
+		// Give half of the cache to the other threads (usually to the thread
+		// that allocates the buffers this thread frees).
+		while (Cache->Count[Class] > DRI_POOL_CACHE_SIZE / 2)
+		{
+			PSLIST_ENTRY Spare = (PSLIST_ENTRY)Cache->Head[Class];
+			Cache->Head[Class] = Spare->Next;
+			Cache->Count[Class]--;
+			InterlockedPushEntrySList(&FLists[Class], Spare);
+		}
+	}
+
+	Block->Next = (PSLIST_ENTRY)Cache->Head[Class];
+	Cache->Head[Class] = Block;
+	Cache->Count[Class]++;
+}
+
+void CDriBufferPool::FlushThread()
+{
+	if (FTls == TLS_OUT_OF_INDEXES)
+		return;
+
+	driPoolCache* Cache = (driPoolCache*)TlsGetValue(FTls);
+	if (Cache != NULL)
+	{
+		TlsSetValue(FTls, NULL);
+		ReleaseCache(Cache);
+	}
+}
+
+void CDriBufferPool::GetStatistics(std::vector<driPoolStatistics>& Statistics) const
+{
+	FCS->Enter();
+	Statistics.assign(FRetired, FRetired + DRI_POOL_CLASSES + 1);
+	for (std::vector<driPoolCache*>::const_iterator Cache = FCaches.begin();
+		Cache != FCaches.end(); Cache++)
+	{
+		for (size_t i = 0; i <= DRI_POOL_CLASSES; i++)
+			AddStatistics(Statistics[i], (*Cache)->Statistics[i]);
+	}
+	FCS->Leave();
+}
@@ -0,0 +1,100 @@
+
+// DriPool.h : header file
+//
+
+#pragma once
+
+#include <vector>
+
+#include "wclHelpers.h"
+#include "wclSync.h"
+
+using namespace wclCommon;
+using namespace wclSync;
+
+/// <summary> The number of the pool size classes. </summary>
+#define DRI_POOL_CLASSES			6
+/// <summary> The smallest pool block size. Each next class doubles
+///   it. </summary>
+#define DRI_POOL_MIN_BLOCK			64
+/// <summary> The maximum number of free blocks of one class cached by a
+///   thread. </summary>
+#define DRI_POOL_CACHE_SIZE			64
+
+/// <summary> The buffer pool statistics of one size class. </summary>
+typedef struct
+{
+	/// <summary> The block size. 0 for the oversized buffers allocated from
+	///   the heap directly. </summary>
+	size_t				Size;
+	/// <summary> The number of allocations. </summary>
+	unsigned __int64	Allocations;
+	/// <summary> The allocations served from the thread cache. </summary>
+	unsigned __int64	CacheHits;
+	/// <summary> The allocations served from the shared free list. </summary>
+	unsigned __int64	ListHits;
+	/// <summary> The allocations that went to the heap. </summary>
+	unsigned __int64	Misses;
+} driPoolStatistics;
+
+/// <summary> A pool of byte buffers with per-thread caches. </summary>
+/// <remarks> <para> Buffers are grouped in size classes (64 to 2048 bytes).
+///   A freed buffer goes to the cache of the calling thread; when the cache is
+///   full half of it is moved to the shared lock-free list of the class
+///   (SLIST). An allocation takes a buffer from the thread cache, then from the
+///   shared list, and only then from the heap. So buffers allocated by a
+///   producer thread and freed by a consumer thread flow back to the producer
+///   without locks and without the heap. </para>
+///   <para> Buffers larger than the largest class are allocated from the heap
+///   directly. </para>
+///   <para> A thread that stops using the pool should call
+///   <c>FlushThread</c> to return its cache. Outstanding buffers must be
+///   freed before the pool is destroyed. </para> </remarks>
+class CDriBufferPool
+{
+	DISABLE_COPY(CDriBufferPool);
+
+private:
+	typedef struct
+	{
+		void*				Head[DRI_POOL_CLASSES];
+		unsigned long		Count[DRI_POOL_CLASSES];
+		driPoolStatistics	Statistics[DRI_POOL_CLASSES + 1];
+	} driPoolCache;
+
+	CwclCriticalSection*			FCS;
+	DWORD							FTls;
+	PSLIST_HEADER					FLists;
+	std::vector<driPoolCache*>		FCaches;
+	// The counters of the threads that already flushed their caches.
+	driPoolStatistics				FRetired[DRI_POOL_CLASSES + 1];
+
+	driPoolCache* GetCache();
+	void ReleaseCache(driPoolCache* const Cache);
+
+public:
+	/// <summary> Creates new buffer pool. </summary>
+	CDriBufferPool();
+	/// <summary> Frees the pool and all the cached buffers. </summary>
+	virtual ~CDriBufferPool();
+
+	/// <summary> Allocates a buffer. </summary>
+	/// <param name="Size"> The required size in bytes. </param>
+	/// <returns> The buffer. The buffer may be larger than requested. </returns>
+	unsigned char* Alloc(const size_t Size);
+	/// <summary> Returns the buffer to the pool. </summary>
+	/// <param name="Buffer"> The buffer allocated by <c>Alloc</c>.
+	///   <c>NULL</c> is ignored. </param>
+	void Free(const unsigned char* const Buffer);
+
+	/// <summary> Returns the cache of the calling thread to the shared
+	///   lists. </summary>
+	void FlushThread();
+
+	/// <summary> Gets the pool statistics. </summary>
+	/// <param name="Statistics"> On output contains the statistics of each
+	///   size class followed by the oversized buffers statistics. </param>
+	/// <remarks> The counters of running threads are read without locks so
+	///   the numbers are approximate. </remarks>
+	void GetStatistics(std::vector<driPoolStatistics>& Statistics) const;
+};
@@ -0,0 +1,756 @@
+
+// DriQueryServer.cpp : implementation file
+//
+
+#include "stdafx.h"
+#include "DriQueryServer.h"
+
+#include <stdarg.h>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+
+// The event loop period in milliseconds: the event streams are updated and
+// the termination is checked at least so often.
+#define DRI_QUERY_POLL_INTERVAL		100
+// The maximum request header size. A longer request is refused.
+#define DRI_QUERY_REQUEST_SIZE		8192
+// The receive buffer size.
+#define DRI_QUERY_RECEIVE_SIZE		4096
+// The maximum received and not processed data size (the pipelined
+// requests). A client sending more is disconnected.
+#define DRI_QUERY_INPUT_SIZE		(2 * DRI_QUERY_REQUEST_SIZE)
+// An event stream is not fed while it has more unsent data.
+#define DRI_QUERY_STREAM_BACKLOG	(256 * 1024)
+// An idle connection is closed after this time in milliseconds.
+#define DRI_QUERY_IDLE_TIMEOUT		30000
+// An idle event stream gets a comment after this time in milliseconds so
+// the proxies and the client keep it open.
+#define DRI_QUERY_KEEP_ALIVE		15000
+// The formatted value buffer size.
+#define DRI_QUERY_VALUE_SIZE		256
+// The number of FILETIME units in one minute.
+#define DRI_FILETIME_MINUTE			600000000LL
+// The difference between the FILETIME and the Unix epochs in 100 ns units.
+#define DRI_UNIX_EPOCH				116444736000000000LL
+
+static void JsonAppend(std::string& Json, const char* const Format, ...)
+{
+	char Value[DRI_QUERY_VALUE_SIZE];
+
+	va_list Args;
+	va_start(Args, Format);
+	int Len = _vsnprintf_s(Value, DRI_QUERY_VALUE_SIZE, _TRUNCATE, Format, Args);
+	va_end(Args);
+
+	if (Len > 0)
+		Json.append(Value, Len);
+}
+
+// Appends the "Name":"Text" pair. The text is UTF-8.
+static void JsonString(std::string& Json, const char* const Name,
+	const std::string& Text)
+{
+	JsonAppend(Json, "\"%s\":\"", Name);
+	for (size_t i = 0; i < Text.length(); i++)
+	{
+		unsigned char c = (unsigned char)Text[i];
+		if (c == '"' || c == '\\')
+		{
+			Json += '\\';
+			Json += (char)c;
+		}
+		else
+		{
+			if (c < 0x20)
+				JsonAppend(Json, "\\u%.4x", c);
+			else
+				Json += (char)c;
+		}
+	}
+	Json += '"';
+}
+
+static void JsonDrone(std::string& Json, const driPictureDrone& Drone)
+{
+	Json += '{';
+	JsonString(Json, "name", Drone.Name);
+	if (Drone.Removed)
+	{
+		Json += ",\"removed\":true}";
+		return;
+	}
+
+	Json += ',';
+	JsonString(Json, "id", Drone.Id);
+	JsonAppend(Json, ",\"ts\":%I64d,\"transport\":\"%s\",\"rssi\":%d,\"messages\":%u",
+		(Drone.Updated - DRI_UNIX_EPOCH) / 10000,
+		(Drone.Transport == ctWiFi) ? "wifi" : "bt", (int)Drone.Rssi,
+		(unsigned int)Drone.Messages);
+	if (Drone.Located)
+	{
+		JsonAppend(Json, ",\"lat\":%.7f,\"lon\":%.7f,\"geo_alt\":%.1f,\"height\":%.1f,\"vspeed\":%.2f,\"status\":%u",
+			Drone.Latitude, Drone.Longitude, Drone.GeoAltitude, Drone.Height,
+			Drone.VerticalSpeed, (unsigned int)Drone.Status);
+		// Same as the exporter: out of range values mean unknown.
+		if (Drone.Direction <= 360)
+			JsonAppend(Json, ",\"dir\":%u", (unsigned int)Drone.Direction);
+		if (Drone.HorizontalSpeed != 255)
+			JsonAppend(Json, ",\"speed\":%.2f", Drone.HorizontalSpeed);
+	}
+	if (Drone.Operated)
+	{
+		JsonAppend(Json, ",\"op_lat\":%.7f,\"op_lon\":%.7f", Drone.OperatorLatitude,
+			Drone.OperatorLongitude);
+	}
+	Json += '}';
+}
+
+static const char* StatusText(const int Status)
+{
+	switch (Status)
+	{
+	case 200:
+		return "OK";
+	case 400:
+		return "Bad Request";
+	case 404:
+		return "Not Found";
+	case 405:
+		return "Method Not Allowed";
+	case 431:
+		return "Request Header Fields Too Large";
+	}
+	return "Internal Server Error";
+}
+
+static int HexValue(const char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+// Decodes the percent encoded URL part.
+static std::string UrlDecode(const std::string& Text)
+{
+	std::string Res;
+	Res.reserve(Text.length());
+	for (size_t i = 0; i < Text.length(); i++)
+	{
+		char c = Text[i];
+		if (c == '+')
+			Res += ' ';
+		else
+		{
+			if (c == '%' && i + 2 < Text.length() && HexValue(Text[i + 1]) >= 0 &&
+				HexValue(Text[i + 2]) >= 0)
+			{
+				Res += (char)(HexValue(Text[i + 1]) * 16 + HexValue(Text[i + 2]));
+				i += 2;
+			}
+			else
+				Res += c;
+		}
+	}
+	return Res;
+}
+
+// Splits the query string into the decoded name and value pairs.
+static void ParseQuery(const std::string& Query, std::map<std::string, std::string>& Params)
+{
+	size_t Start = 0;
+	while (Start < Query.length())
+	{
+		size_t End = Query.find('&', Start);
+		if (End == std::string::npos)
+			End = Query.length();
+
+		std::string Pair = Query.substr(Start, End - Start);
+		size_t Equal = Pair.find('=');
+		if (Equal == std::string::npos)
+			Params[UrlDecode(Pair)] = "";
+		else
+			Params[UrlDecode(Pair.substr(0, Equal))] = UrlDecode(Pair.substr(Equal + 1));
+
+		Start = End + 1;
+	}
+}
+
+static std::string Trim(const std::string& Text)
+{
+	size_t First = Text.find_first_not_of(" \t");
+	if (First == std::string::npos)
+		return std::string();
+	size_t Last = Text.find_last_not_of(" \t");
+	return Text.substr(First, Last - First + 1);
+}
+
+static std::string LowerCase(const std::string& Text)
+{
+	std::string Res = Text;
+	for (size_t i = 0; i < Res.length(); i++)
+		Res[i] = (char)tolower((unsigned char)Res[i]);
+	return Res;
+}
+
+// Checks if a comma separated header field (all the fields with the name)
+// lists the token. The name and the token are lower case.
+static bool HasToken(const std::string& Header, const char* const Name,
+	const char* const Token)
+{
+	// The first line is the request line.
+	size_t Start = Header.find("\r\n");
+	while (Start != std::string::npos)
+	{
+		Start += 2;
+		size_t End = Header.find("\r\n", Start);
+		std::string Field = Header.substr(Start, (End == std::string::npos) ?
+			std::string::npos : End - Start);
+
+		// The name is followed by the colon at once; the value may have
+		// white space around.
+		size_t Colon = Field.find(':');
+		if (Colon != std::string::npos && LowerCase(Field.substr(0, Colon)) == Name)
+		{
+			std::string Value = Field.substr(Colon + 1);
+			size_t First = 0;
+			while (First <= Value.length())
+			{
+				size_t Comma = Value.find(',', First);
+				if (Comma == std::string::npos)
+					Comma = Value.length();
+				if (LowerCase(Trim(Value.substr(First, Comma - First))) == Token)
+					return true;
+				First = Comma + 1;
+			}
+		}
+		Start = End;
+	}
+	return false;
+}
+
+static __int64 FileTimeNow()
+{
+	FILETIME Now;
+	GetSystemTimeAsFileTime(&Now);
+	return (__int64)(((unsigned __int64)Now.dwHighDateTime << 32) | Now.dwLowDateTime);
+}
+
+
+// CDriQueryServer
+
+CDriQueryServer::CDriQueryServer(CDriPicture* const Picture)
+{
+	FPicture = Picture;
+	FSocket = INVALID_SOCKET;
+	FThread = NULL;
+	FTerminated = 0;
+	FActive = false;
+
+	FCacheVersion = 0;
+	FCacheValid = false;
+
+	FRequests = 0;
+	FCacheHits = 0;
+}
+
+CDriQueryServer::~CDriQueryServer()
+{
+	Close();
+}
+
+UINT __stdcall CDriQueryServer::ThreadProc(void* Param)
+{
+	((CDriQueryServer*)Param)->Execute();
+	return 0;
+}
+
+void CDriQueryServer::Execute()
+{
+	DWORD LastPush = GetTickCount();
+	while (FTerminated == 0)
+	{
+		fd_set ReadSet;
+		fd_set WriteSet;
+		FD_ZERO(&ReadSet);
+		FD_ZERO(&WriteSet);
+
+		if (FClients.size() < DRI_QUERY_MAX_CLIENTS)
+			FD_SET(FSocket, &ReadSet);
+		for (std::vector<driQueryClient*>::iterator Client = FClients.begin(); Client != FClients.end(); Client++)
+		{
+			// A client with a pending answer is not read: the pipelined
+			// requests wait in the kernel.
+			if ((*Client)->Output.size() > (*Client)->Sent)
+				FD_SET((*Client)->Socket, &WriteSet);
+			else
+			{
+				if (!(*Client)->Closing)
+					FD_SET((*Client)->Socket, &ReadSet);
+			}
+		}
+
+		timeval Timeout;
+		Timeout.tv_sec = 0;
+		Timeout.tv_usec = DRI_QUERY_POLL_INTERVAL * 1000;
+		int Ready = select(0, &ReadSet, &WriteSet, NULL, &Timeout);
+		if (Ready == SOCKET_ERROR)
+		{
+			Sleep(DRI_QUERY_POLL_INTERVAL);
+			continue;
+		}
+
+		if (Ready > 0 && FD_ISSET(FSocket, &ReadSet))
+			Accept();
+
+		DWORD Now = GetTickCount();
+		bool Feed = (Now - LastPush >= DRI_QUERY_POLL_INTERVAL);
+		if (Feed)
+			LastPush = Now;
+
+		std::vector<driQueryClient*>::iterator Client = FClients.begin();
+		while (Client != FClients.end())
+		{
+			driQueryClient* Data = *Client;
+			bool Alive = true;
+			if (Ready > 0 && FD_ISSET(Data->Socket, &ReadSet))
+				Alive = Receive(Data);
+			if (Alive && Data->Stream && Feed)
+				Push(Data);
+			// Send at once: the socket is almost always writable.
+			if (Alive && Data->Output.size() > Data->Sent)
+				Alive = Transmit(Data);
+
+			if (Alive)
+			{
+				if (Data->Closing && Data->Output.size() == Data->Sent)
+					Alive = false;
+				else
+				{
+					// The activity time may be later than the loop start.
+					if (!Data->Stream && GetTickCount() - Data->Active >= DRI_QUERY_IDLE_TIMEOUT)
+						Alive = false;
+				}
+			}
+
+			if (Alive)
+				Client++;
+			else
+			{
+				closesocket(Data->Socket);
+				delete Data;
+				Client = FClients.erase(Client);
+			}
+		}
+	}
+
+	for (std::vector<driQueryClient*>::iterator Client = FClients.begin(); Client != FClients.end(); Client++)
+	{
+		closesocket((*Client)->Socket);
+		delete (*Client);
+	}
+	FClients.clear();
+}
+
+void CDriQueryServer::Accept()
+{
+	while (FClients.size() < DRI_QUERY_MAX_CLIENTS)
+	{
+		SOCKET Socket = accept(FSocket, NULL, NULL);
+		if (Socket == INVALID_SOCKET)
+			break;
+
+		unsigned long NonBlocking = 1;
+		ioctlsocket(Socket, FIONBIO, &NonBlocking);
+		// The answers are written at once: do not wait for the ACKs.
+		BOOL NoDelay = TRUE;
+		setsockopt(Socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&NoDelay, sizeof(NoDelay));
+
+		driQueryClient* Client = new driQueryClient;
+		Client->Socket = Socket;
+		Client->Sent = 0;
+		Client->Stream = false;
+		Client->Version = 0;
+		Client->Closing = false;
+		Client->Active = GetTickCount();
+		FClients.push_back(Client);
+	}
+}
+
+bool CDriQueryServer::Receive(driQueryClient* const Client)
+{
+	char Buffer[DRI_QUERY_RECEIVE_SIZE];
+	while (true)
+	{
+		int Len = recv(Client->Socket, Buffer, DRI_QUERY_RECEIVE_SIZE, 0);
+		if (Len == 0)
+			return false;
+		if (Len == SOCKET_ERROR)
+		{
+			if (WSAGetLastError() != WSAEWOULDBLOCK)
+				return false;
+			break;
+		}
+
+		Client->Active = GetTickCount();
+		// The stream clients do not send anything after the request.
+		if (!Client->Stream)
+		{
+			// Process answers the complete requests one by one; more data
+			// than the longest request is not buffered.
+			if (Client->Input.length() + Len > DRI_QUERY_INPUT_SIZE)
+				return false;
+			Client->Input.append(Buffer, Len);
+		}
+		if (Len < DRI_QUERY_RECEIVE_SIZE)
+			break;
+	}
+
+	Process(Client);
+	return true;
+}
+
+bool CDriQueryServer::Transmit(driQueryClient* const Client)
+{
+	while (Client->Sent < Client->Output.size())
+	{
+		int Len = send(Client->Socket, Client->Output.data() + Client->Sent,
+			(int)(Client->Output.size() - Client->Sent), 0);
+		if (Len == SOCKET_ERROR)
+			return (WSAGetLastError() == WSAEWOULDBLOCK);
+		Client->Sent += Len;
+		Client->Active = GetTickCount();
+	}
+
+	Client->Output.clear();
+	Client->Sent = 0;
+	// The next pipelined request (if any) is already received.
+	if (!Client->Stream && !Client->Closing)
+		Process(Client);
+	return true;
+}
+
+void CDriQueryServer::Process(driQueryClient* const Client)
+{
+	// One request at a time: the next one is taken when the answer is sent.
+	if (Client->Stream || Client->Closing || Client->Output.size() > 0)
+		return;
+
+	size_t End = Client->Input.find("\r\n\r\n");
+	if (End == std::string::npos || End > DRI_QUERY_REQUEST_SIZE)
+	{
+		if (Client->Input.length() > DRI_QUERY_REQUEST_SIZE)
+		{
+			Client->Closing = true;
+			Answer(Client, 431, "text/plain", "Request too large\n");
+		}
+		return;
+	}
+
+	std::string Header = Client->Input.substr(0, End);
+	Client->Input.erase(0, End + 4);
+	FRequests++;
+
+	// The request line: METHOD TARGET VERSION.
+	size_t LineEnd = Header.find("\r\n");
+	std::string Line = Header.substr(0, LineEnd);
+	size_t First = Line.find(' ');
+	size_t Second = (First == std::string::npos) ? std::string::npos : Line.find(' ', First + 1);
+	if (Second == std::string::npos)
+	{
+		Client->Closing = true;
+		Answer(Client, 400, "text/plain", "Bad request\n");
+		return;
+	}
+	std::string Method = Line.substr(0, First);
+	std::string Target = Line.substr(First + 1, Second - First - 1);
+	std::string Version = Line.substr(Second + 1);
+
+	// HTTP/1.1 keeps the connection unless asked otherwise; HTTP/1.0 closes
+	// it. The requests never have a body.
+	if (Version != "HTTP/1.1" || HasToken(Header, "connection", "close"))
+		Client->Closing = true;
+
+	if (Method != "GET")
+	{
+		Client->Closing = true;
+		Answer(Client, 405, "text/plain", "Method not allowed\n");
+		return;
+	}
+
+	std::string Path = Target;
+	driQueryParams Params;
+	size_t Question = Target.find('?');
+	if (Question != std::string::npos)
+	{
+		Path = Target.substr(0, Question);
+		ParseQuery(Target.substr(Question + 1), Params);
+	}
+
+	if (Path == "/drones")
+		ServeDrones(Client, Params);
+	else
+	{
+		if (Path == "/track")
+			ServeTrack(Client, Params);
+		else
+		{
+			if (Path == "/events")
+				ServeEvents(Client);
+			else
+				Answer(Client, 404, "text/plain", "Not found\n");
+		}
+	}
+}
+
+void CDriQueryServer::Push(driQueryClient* const Client)
+{
+	DWORD Now = GetTickCount();
+	// A slow reader is not fed: it gets the coalesced changes later.
+	if (Client->Output.size() - Client->Sent > DRI_QUERY_STREAM_BACKLOG)
+		return;
+
+	if (FPicture->Version == Client->Version)
+	{
+		if (Now - Client->Active >= DRI_QUERY_KEEP_ALIVE)
+		{
+			Client->Output += ":\n\n";
+			Client->Active = Now;
+		}
+		return;
+	}
+
+	bool Reset;
+	Client->Version = FPicture->GetChanges(Client->Version, FDrones, Reset);
+	// The client missed some removals: it starts again from the whole
+	// picture.
+	if (Reset)
+		Client->Output += "event: reset\ndata: {}\n\n";
+	for (std::vector<driPictureDrone>::const_iterator Drone = FDrones.begin(); Drone != FDrones.end(); Drone++)
+	{
+		Client->Output += "data: ";
+		JsonDrone(Client->Output, *Drone);
+		Client->Output += "\n\n";
+	}
+	Client->Active = Now;
+}
+
+void CDriQueryServer::Answer(driQueryClient* const Client, const int Status,
+	const char* const ContentType, const std::string& Body)
+{
+	JsonAppend(Client->Output, "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %u\r\nCache-Control: no-cache\r\n%s\r\n",
+		Status, StatusText(Status), ContentType, (unsigned int)Body.length(),
+		Client->Closing ? "Connection: close\r\n" : "");
+	Client->Output += Body;
+}
+
+void CDriQueryServer::ServeDrones(driQueryClient* const Client,
+	const driQueryParams& Params)
+{
+	driQueryParams::const_iterator Bbox = Params.find("bbox");
+	if (Bbox == Params.end())
+	{
+		// The hot query: built again only when the picture changed.
+		if (FCacheValid && FPicture->Version == FCacheVersion)
+			FCacheHits++;
+		else
+		{
+			FCacheVersion = FPicture->GetDrones(NULL, FDrones);
+			FCache = "[";
+			for (size_t i = 0; i < FDrones.size(); i++)
+			{
+				if (i > 0)
+					FCache += ',';
+				JsonDrone(FCache, FDrones[i]);
+			}
+			FCache += "]\n";
+			FCacheValid = true;
+		}
+		Answer(Client, 200, "application/json", FCache);
+		return;
+	}
+
+	driPictureArea Area;
+	if (sscanf_s(Bbox->second.c_str(), "%lf,%lf,%lf,%lf", &Area.MinLatitude,
+		&Area.MinLongitude, &Area.MaxLatitude, &Area.MaxLongitude) != 4 ||
+		Area.MinLatitude > Area.MaxLatitude || Area.MinLongitude > Area.MaxLongitude)
+	{
+		Answer(Client, 400, "text/plain", "bbox=MinLat,MinLon,MaxLat,MaxLon expected\n");
+		return;
+	}
+
+	FPicture->GetDrones(&Area, FDrones);
+	std::string Body = "[";
+	for (size_t i = 0; i < FDrones.size(); i++)
+	{
+		if (i > 0)
+			Body += ',';
+		JsonDrone(Body, FDrones[i]);
+	}
+	Body += "]\n";
+	Answer(Client, 200, "application/json", Body);
+}
+
+void CDriQueryServer::ServeTrack(driQueryClient* const Client,
+	const driQueryParams& Params)
+{
+	driQueryParams::const_iterator Drone = Params.find("drone");
+	if (Drone == Params.end())
+	{
+		Answer(Client, 400, "text/plain", "drone=Name expected\n");
+		return;
+	}
+
+	unsigned long Minutes = FPicture->TrackSpan;
+	driQueryParams::const_iterator Param = Params.find("minutes");
+	if (Param != Params.end())
+	{
+		unsigned long Value = strtoul(Param->second.c_str(), NULL, 10);
+		if (Value > 0 && Value < Minutes)
+			Minutes = Value;
+	}
+
+	if (!FPicture->GetTrack(Drone->second, FileTimeNow() - Minutes * DRI_FILETIME_MINUTE, FPoints))
+	{
+		Answer(Client, 404, "text/plain", "Drone not found\n");
+		return;
+	}
+
+	// The points are [ts, lat, lon, geo_alt] arrays: the track is the
+	// largest answer.
+	std::string Body = "{";
+	JsonString(Body, "name", Drone->second);
+	Body += ",\"points\":[";
+	for (size_t i = 0; i < FPoints.size(); i++)
+	{
+		const driPicturePoint& Point = FPoints[i];
+		JsonAppend(Body, "%s[%I64d,%.7f,%.7f,%.1f]", (i > 0) ? "," : "",
+			(Point.Timestamp - DRI_UNIX_EPOCH) / 10000, Point.Latitude, Point.Longitude,
+			Point.GeoAltitude);
+	}
+	Body += "]}\n";
+	Answer(Client, 200, "application/json", Body);
+}
+
+void CDriQueryServer::ServeEvents(driQueryClient* const Client)
+{
+	// The stream has no length: it ends when either side closes it.
+	Client->Output += "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\nConnection: keep-alive\r\n\r\n";
+	Client->Stream = true;
+	Client->Closing = false;
+	Client->Input.clear();
+
+	// Start with the whole picture, then only the changes.
+	Client->Version = FPicture->GetDrones(NULL, FDrones);
+	for (std::vector<driPictureDrone>::const_iterator Drone = FDrones.begin(); Drone != FDrones.end(); Drone++)
+	{
+		Client->Output += "data: ";
+		JsonDrone(Client->Output, *Drone);
+		Client->Output += "\n\n";
+	}
+}
+
+int CDriQueryServer::Open(const unsigned short Port)
+{
+	if (FActive)
+		return DRI_E_QUERY_OPENED;
+	if (Port == 0 || FPicture == NULL)
+		return WCL_E_INVALID_ARGUMENT;
+
+	WSADATA Data;
+	if (WSAStartup(MAKEWORD(2, 2), &Data) != 0)
+		return DRI_E_QUERY_WINSOCK_FAILED;
+
+	int Res = WCL_E_SUCCESS;
+	FSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (FSocket == INVALID_SOCKET)
+		Res = DRI_E_QUERY_SOCKET_FAILED;
+	else
+	{
+		// Other process must not steal the port.
+		BOOL Exclusive = TRUE;
+		setsockopt(FSocket, SOL_SOCKET, SO_EXCLUSIVEADDRUSE, (const char*)&Exclusive,
+			sizeof(Exclusive));
+
+		// The picture is served to the local processes only.
+		sockaddr_in Address;
+		ZeroMemory(&Address, sizeof(Address));
+		Address.sin_family = AF_INET;
+		Address.sin_port = htons(Port);
+		Address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		unsigned long NonBlocking = 1;
+		if (bind(FSocket, (const sockaddr*)&Address, sizeof(Address)) == SOCKET_ERROR ||
+			listen(FSocket, SOMAXCONN) == SOCKET_ERROR ||
+			ioctlsocket(FSocket, FIONBIO, &NonBlocking) == SOCKET_ERROR)
+		{
+			Res = DRI_E_QUERY_SOCKET_FAILED;
+		}
+	}
+
+	if (Res == WCL_E_SUCCESS)
+	{
+		FRequests = 0;
+		FCacheHits = 0;
+		FCacheValid = false;
+		FTerminated = 0;
+
+		FThread = wclCreateThread(ThreadProc, this);
+		if (FThread == NULL)
+			Res = DRI_E_QUERY_THREAD_FAILED;
+		else
+			FActive = true;
+	}
+
+	if (Res != WCL_E_SUCCESS)
+	{
+		if (FSocket != INVALID_SOCKET)
+		{
+			closesocket(FSocket);
+			FSocket = INVALID_SOCKET;
+		}
+		WSACleanup();
+	}
+	return Res;
+}
+
+int CDriQueryServer::Close()
+{
+	if (!FActive)
+		return DRI_E_QUERY_CLOSED;
+
+	FActive = false;
+	// The thread checks the flag at least every poll interval and closes the
+	// client connections.
+	InterlockedExchange(&FTerminated, 1);
+	wclWaitAndCloseThread(FThread);
+	FThread = NULL;
+
+	closesocket(FSocket);
+	FSocket = INVALID_SOCKET;
+	FCache.clear();
+	WSACleanup();
+	return WCL_E_SUCCESS;
+}
+
+bool CDriQueryServer::GetActive() const
+{
+	return FActive;
+}
+
+unsigned __int64 CDriQueryServer::GetRequests() const
+{
+	return FRequests;
+}
+
+unsigned __int64 CDriQueryServer::GetCacheHits() const
+{
+	return FCacheHits;
+}
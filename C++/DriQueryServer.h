@@ -0,0 +1,147 @@
+
+// DriQueryServer.h : header file
+//
+
+#pragma once
+
+#include <winsock2.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "wclHelpers.h"
+#include "wclSync.h"
+
+#include "DriErrors.h"
+#include "DriPicture.h"
+
+using namespace wclCommon;
+using namespace wclSync;
+
+/// <summary> The default query server port. </summary>
+#define DRI_QUERY_PORT				8080
+/// <summary> The maximum number of the connected clients. The server uses
+///   one <c>select</c> set. </summary>
+#define DRI_QUERY_MAX_CLIENTS		(FD_SETSIZE - 1)
+
+/// <summary> Serves the drone picture over HTTP on the loopback
+///   interface. </summary>
+/// <remarks> <para> The server answers the <c>GET</c> requests:
+///   <list type="bullet">
+///   <item> <c>/drones</c> - the current drones as a JSON array; </item>
+///   <item> <c>/drones?bbox=MinLat,MinLon,MaxLat,MaxLon</c> - the drones
+///   located in the area; </item>
+///   <item> <c>/track?drone=Name&amp;minutes=N</c> - the track of the drone
+///   over the last N minutes (up to the picture track span); </item>
+///   <item> <c>/events</c> - a Server-Sent Events stream: the current drones
+///   and then every change (a changed drone or
+///   <c>{"name":...,"removed":true}</c>) as one <c>data:</c> event. A
+///   <c>reset</c> event tells the client to drop all its drones: the whole
+///   picture follows. It is sent when the client fell too far behind to get
+///   all the removals. </item>
+///   </list> </para>
+///   <para> One thread runs a non-blocking event loop over all the
+///   connections, so a slow client never stalls the others or the sensor.
+///   The <c>/drones</c> answer is cached and built again only when the
+///   picture version changes. An event stream sends only the changes since
+///   its last event: a slow reader gets the coalesced state, not a growing
+///   backlog. </para> </remarks>
+class CDriQueryServer
+{
+	DISABLE_COPY(CDriQueryServer);
+
+private:
+	typedef struct
+	{
+		SOCKET				Socket;
+		std::string			Input;
+		std::string			Output;
+		// The number of the Output bytes already sent.
+		size_t				Sent;
+		// True for an event stream.
+		bool				Stream;
+		// The picture version the stream client has.
+		unsigned __int64	Version;
+		// Close the connection when the Output is sent.
+		bool				Closing;
+		// The last activity tick count.
+		DWORD				Active;
+	} driQueryClient;
+
+	typedef std::map<std::string, std::string> driQueryParams;
+
+	CDriPicture*					FPicture;
+	SOCKET							FSocket;
+	HANDLE							FThread;
+	volatile LONG					FTerminated;
+	bool							FActive;
+
+	// Used by the server thread only.
+	std::vector<driQueryClient*>	FClients;
+	std::string						FCache;
+	unsigned __int64				FCacheVersion;
+	bool							FCacheValid;
+	std::vector<driPictureDrone>	FDrones;
+	std::vector<driPicturePoint>	FPoints;
+
+	// The server thread counters.
+	unsigned __int64				FRequests;
+	unsigned __int64				FCacheHits;
+
+	static UINT __stdcall ThreadProc(void* Param);
+	void Execute();
+
+	void Accept();
+	bool Receive(driQueryClient* const Client);
+	bool Transmit(driQueryClient* const Client);
+	void Process(driQueryClient* const Client);
+	void Push(driQueryClient* const Client);
+
+	void Answer(driQueryClient* const Client, const int Status,
+		const char* const ContentType, const std::string& Body);
+	void ServeDrones(driQueryClient* const Client, const driQueryParams& Params);
+	void ServeTrack(driQueryClient* const Client, const driQueryParams& Params);
+	void ServeEvents(driQueryClient* const Client);
+
+public:
+	/// <summary> Creates new query server. </summary>
+	/// <param name="Picture"> The drone picture to serve. </param>
+	CDriQueryServer(CDriPicture* const Picture);
+	/// <summary> Closes the server and frees the object. </summary>
+	virtual ~CDriQueryServer();
+
+	/// <summary> Starts serving. </summary>
+	/// <param name="Port"> The TCP port on the loopback interface. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Open(const unsigned short Port);
+	/// <summary> Disconnects the clients and stops serving. </summary>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Close();
+
+	/// <summary> Gets the server state. </summary>
+	/// <returns> <c>True</c> if the server is opened. </returns>
+	bool GetActive() const;
+	/// <summary> Gets the server state. </summary>
+	/// <value> <c>True</c> if the server is opened. </value>
+	__declspec(property(get = GetActive)) bool Active;
+
+	/// <summary> Gets the number of the served requests. </summary>
+	/// <returns> The requests count. </returns>
+	unsigned __int64 GetRequests() const;
+	/// <summary> Gets the number of the served requests. </summary>
+	/// <value> The requests count. </value>
+	__declspec(property(get = GetRequests)) unsigned __int64 Requests;
+
+	/// <summary> Gets the number of the <c>/drones</c> requests answered
+	///   from the cache. </summary>
+	/// <returns> The cache hits count. </returns>
+	unsigned __int64 GetCacheHits() const;
+	/// <summary> Gets the number of the <c>/drones</c> requests answered
+	///   from the cache. </summary>
+	/// <value> The cache hits count. </value>
+	__declspec(property(get = GetCacheHits)) unsigned __int64 CacheHits;
+};
@@ -0,0 +1,222 @@
+
+// DriQueue.h : header file
+//
+
+#pragma once
+
+#include "wclHelpers.h"
+#include "wclSync.h"
+
+using namespace wclCommon;
+using namespace wclSync;
+
+/// <summary> A bounded lock-free multi-producer single-consumer
+///   queue. </summary>
+/// <remarks> <para> The queue is an array of cells; each cell carries a
+///   sequence number telling whether it is free for the producer or filled
+///   for the consumer at the current lap. A producer reserves a cell with one
+///   interlocked compare-exchange, so <c>Push</c> never allocates and never
+///   blocks. A full queue rejects the item. </para>
+///   <para> The consumer event is signaled only when the queue goes from
+///   empty to non-empty. A consumer must drain the queue with <c>Pop</c> or
+///   <c>PopBatch</c> until it fails before calling <c>Wait</c>. </para>
+///   <para> <c>T</c> must be copy-assignable. Any number of threads may call
+///   <c>Push</c>; only one thread may call <c>Pop</c>, <c>PopBatch</c> and
+///   <c>Wait</c>. </para> </remarks>
+template <typename T>
+class CDriMpscQueue
+{
+	DISABLE_COPY(CDriMpscQueue);
+
+private:
+	typedef struct
+	{
+		volatile LONG	Sequence;
+		T				Value;
+	} driQueueCell;
+
+	driQueueCell*			FCells;
+	unsigned long			FMask;
+	// Producers position; changed only with interlocked operations.
+	volatile LONG			FTail;
+	// Consumer position; changed by the consumer only.
+	LONG					FHead;
+	// The number of the published items. It is incremented after an item is
+	// published so the consumer never waits while it can pop.
+	volatile LONG			FCount;
+	volatile LONG			FRejected;
+	CwclAutoResetEvent*		FEvent;
+
+public:
+	/// <summary> Creates new queue. </summary>
+	/// <param name="Capacity"> The maximum number of items. Rounded up to the
+	///   power of 2. </param>
+	CDriMpscQueue(const unsigned long Capacity)
+	{
+		unsigned long Size = 2;
+		while (Size < Capacity && Size < 0x40000000)
+			Size <<= 1;
+
+		FCells = new driQueueCell[Size];
+		for (unsigned long i = 0; i < Size; i++)
+			FCells[i].Sequence = (LONG)i;
+		FMask = Size - 1;
+		FTail = 0;
+		FHead = 0;
+		FCount = 0;
+		FRejected = 0;
+		FEvent = CwclAutoResetEvent::Create();
+	}
+
+	/// <summary> Frees the queue. </summary>
+	/// <remarks> The items still in the queue are not freed. </remarks>
+	virtual ~CDriMpscQueue()
+	{
+		delete FEvent;
+		delete[] FCells;
+	}
+
+	/// <summary> Adds an item to the queue. </summary>
+	/// <param name="Value"> The item. </param>
+	/// <returns> <c>True</c> if the item was added. <c>False</c> if the
+	///   queue is full. </returns>
+	bool Push(const T& Value)
+	{
+		driQueueCell* Cell;
+		LONG Pos = FTail;
+		while (true)
+		{
+			Cell = &FCells[(unsigned long)Pos & FMask];
+			LONG Dif = (LONG)((unsigned long)Cell->Sequence - (unsigned long)Pos);
+			if (Dif == 0)
+			{
+				LONG Prev = InterlockedCompareExchange(&FTail, Pos + 1, Pos);
+				if (Prev == Pos)
+					break;
+				Pos = Prev;
+			}
+			else
+			{
+				if (Dif < 0)
+				{
+					// The consumer did not free the cell yet.
+					InterlockedIncrement(&FRejected);
+					return false;
+				}
+				Pos = FTail;
+			}
+		}
+
+		Cell->Value = Value;
+		InterlockedExchange(&Cell->Sequence, Pos + 1);
+
+		if (InterlockedIncrement(&FCount) == 1 && FEvent != NULL)
+			FEvent->SetEvent();
+		return true;
+	}
+
+	/// <summary> Removes an item from the queue. </summary>
+	/// <param name="Value"> On output contains the item. </param>
+	/// <returns> <c>True</c> if an item was removed. <c>False</c> if the
+	///   queue is empty or the next item is still being written. </returns>
+	/// <remarks> Must be called by the consumer thread only. </remarks>
+	bool Pop(T& Value)
+	{
+		driQueueCell* Cell = &FCells[(unsigned long)FHead & FMask];
+		LONG Dif = (LONG)((unsigned long)Cell->Sequence - (unsigned long)(FHead + 1));
+		if (Dif < 0)
+			return false;
+
+		Value = Cell->Value;
+		InterlockedExchange(&Cell->Sequence, FHead + (LONG)FMask + 1);
+		FHead++;
+		InterlockedDecrement(&FCount);
+		return true;
+	}
+
+	/// <summary> Removes all the ready items from the queue (up to
+	///   <c>Max</c>). </summary>
+	/// <param name="Values"> The array that receives the items. </param>
+	/// <param name="Max"> The array size. </param>
+	/// <returns> The number of items removed. </returns>
+	/// <remarks> Must be called by the consumer thread only. The items count
+	///   is updated once for the whole batch. </remarks>
+	unsigned long PopBatch(T* const Values, const unsigned long Max)
+	{
+		unsigned long Result = 0;
+		while (Result < Max)
+		{
+			driQueueCell* Cell = &FCells[(unsigned long)FHead & FMask];
+			LONG Dif = (LONG)((unsigned long)Cell->Sequence - (unsigned long)(FHead + 1));
+			if (Dif < 0)
+				break;
+
+			Values[Result] = Cell->Value;
+			Result++;
+			// Free the cell at once so producers do not see the queue full
+			// while the batch is being taken.
+			InterlockedExchange(&Cell->Sequence, FHead + (LONG)FMask + 1);
+			FHead++;
+		}
+
+		if (Result > 0)
+			InterlockedExchangeAdd(&FCount, -(LONG)Result);
+		return Result;
+	}
+
+	/// <summary> Waits for the queue to become non-empty. </summary>
+	/// <param name="Timeout"> The wait timeout in milliseconds. </param>
+	/// <remarks> Must be called by the consumer thread only, after the queue
+	///   was drained. Returns at once if an item is published but a
+	///   preceding cell is still being written by other producer. </remarks>
+	void Wait(const unsigned long Timeout)
+	{
+		if (FCount > 0)
+			SwitchToThread();
+		else
+		{
+			if (FEvent != NULL)
+				FEvent->WaitOne(Timeout);
+		}
+	}
+
+	/// <summary> Wakes the consumer (for example to let it check a
+	///   termination flag). </summary>
+	void Wake()
+	{
+		if (FEvent != NULL)
+			FEvent->SetEvent();
+	}
+
+	/// <summary> Gets the number of items in the queue. </summary>
+	/// <returns> The items count. </returns>
+	unsigned long GetCount() const
+	{
+		return (unsigned long)FCount;
+	}
+	/// <summary> Gets the number of items in the queue. </summary>
+	/// <value> The items count. </value>
+	__declspec(property(get = GetCount)) unsigned long Count;
+
+	/// <summary> Gets the queue capacity. </summary>
+	/// <returns> The maximum number of items. </returns>
+	unsigned long GetCapacity() const
+	{
+		return FMask + 1;
+	}
+	/// <summary> Gets the queue capacity. </summary>
+	/// <value> The maximum number of items. </value>
+	__declspec(property(get = GetCapacity)) unsigned long Capacity;
+
+	/// <summary> Gets the number of items rejected because the queue was
+	///   full. </summary>
+	/// <returns> The rejected items count. </returns>
+	unsigned long GetRejected() const
+	{
+		return (unsigned long)FRejected;
+	}
+	/// <summary> Gets the number of items rejected because the queue was
+	///   full. </summary>
+	/// <value> The rejected items count. </value>
+	__declspec(property(get = GetRejected)) unsigned long Rejected;
+};
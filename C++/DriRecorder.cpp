@@ -0,0 +1,212 @@
+
+// DriRecorder.cpp : implementation file
+//
+
+#include "stdafx.h"
+#include "DriRecorder.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+
+// CDriRecorder
+
+CDriRecorder::CDriRecorder(CDriThreadPool* const ThreadPool)
+{
+	FCS = new CwclCriticalSection();
+	FWriter = new CDriRecordingWriter();
+	FQueue = NULL;
+	FPool = new CDriBufferPool();
+	FThreadPool = ThreadPool;
+	FState = new CDriFutex();
+	FBatch = NULL;
+	FDropped = 0;
+	FQueueSize = DRI_RECORDER_QUEUE_SIZE;
+}
+
+CDriRecorder::~CDriRecorder()
+{
+	Close();
+
+	delete FState;
+	delete FWriter;
+	delete FPool;
+	delete FCS;
+}
+
+void __stdcall CDriRecorder::DrainProc(void* Param)
+{
+	((CDriRecorder*)Param)->Drain();
+}
+
+void CDriRecorder::Schedule()
+{
+	// The running task will look at the queue again.
+	if (FState->GetValue() == 2)
+		return;
+
+	if (FState->Exchange(2) == 0)
+	{
+		int Res = DRI_E_POOL_NOT_ACTIVE;
+		if (FThreadPool != NULL)
+			Res = FThreadPool->Submit(DrainProc, this);
+		// No pool: this thread owns the drain now.
+		if (Res != WCL_E_SUCCESS)
+			Drain();
+	}
+}
+
+void CDriRecorder::Drain()
+{
+	do
+	{
+		FState->Exchange(1);
+
+		unsigned long Count;
+		do
+		{
+			Count = FQueue->PopBatch(FBatch, DRI_RECORDER_BATCH_SIZE);
+			if (Count > 0)
+				Write(FBatch, Count);
+		} while (Count > 0);
+
+		// The worker runs other tasks next: give the freed buffers back to
+		// the capture threads. Must be done before the state change.
+		FPool->FlushThread();
+
+		// Frames posted after the last PopBatch set the state to 2 so drain
+		// again. The state change is the last access to the recorder: Close
+		// may free the queue right after.
+	} while (FState->CompareExchange(0, 1) != 1);
+}
+
+void CDriRecorder::Write(driRecordingFrame* const Frames, const unsigned long Count)
+{
+	FWriter->Append(Frames, Count);
+
+	for (unsigned long i = 0; i < Count; i++)
+	{
+		FPool->Free(Frames[i].Data);
+		Frames[i].Data = NULL;
+	}
+}
+
+int CDriRecorder::Open(const tstring& FileName)
+{
+	FCS->Enter();
+	int Res = WCL_E_SUCCESS;
+	if (FQueue != NULL)
+		Res = DRI_E_REC_OPENED;
+	else
+	{
+		Res = FWriter->Open(FileName);
+		if (Res == WCL_E_SUCCESS)
+		{
+			FQueue = new CDriMpscQueue<driRecordingFrame>(FQueueSize);
+			FBatch = new driRecordingFrame[DRI_RECORDER_BATCH_SIZE];
+			FDropped = 0;
+		}
+	}
+	FCS->Leave();
+	return Res;
+}
+
+int CDriRecorder::Close()
+{
+	FCS->Enter();
+	int Res = WCL_E_SUCCESS;
+	if (FQueue == NULL)
+		Res = DRI_E_REC_CLOSED;
+	else
+	{
+		// Wait for the drain task. It writes all the frames posted before.
+		LONG State;
+		while ((State = FState->GetValue()) != 0)
+			FState->Wait(State, INFINITE);
+
+		delete FQueue;
+		FQueue = NULL;
+		delete[] FBatch;
+		FBatch = NULL;
+
+		Res = FWriter->Close();
+	}
+	FCS->Leave();
+	return Res;
+}
+
+int CDriRecorder::Post(const driCaptureTransport Transport,
+	const unsigned char Radio, const __int64 Source, const __int64 Timestamp,
+	const char Rssi, const unsigned char* const Data, const size_t Length,
+	const wclDriAsdId* const Id)
+{
+	if (Data == NULL || Length == 0)
+		return WCL_E_INVALID_ARGUMENT;
+	if (FQueue == NULL)
+		return DRI_E_REC_CLOSED;
+
+	unsigned char* Copy = FPool->Alloc(Length);
+	if (Copy == NULL)
+		return WCL_E_OUT_OF_MEMORY;
+	CopyMemory(Copy, Data, Length);
+
+	driRecordingFrame Item;
+	Item.Data = Copy;
+
+	Item.Transport = Transport;
+	Item.Radio = Radio;
+	Item.Rssi = Rssi;
+	Item.Source = Source;
+	Item.Timestamp = Timestamp;
+	Item.Length = (unsigned long)Length;
+	Item.IdLength = 0;
+	if (Id != NULL && Id->size() > 0)
+	{
+		Item.IdLength = (unsigned char)min(Id->size(), (size_t)DRI_RECORDING_MAX_ID);
+		CopyMemory(Item.Id, &(*Id)[0], Item.IdLength);
+	}
+
+	if (!FQueue->Push(Item))
+	{
+		FPool->Free(Item.Data);
+		InterlockedIncrement(&FDropped);
+		return DRI_E_REC_QUEUE_FULL;
+	}
+
+	Schedule();
+	return WCL_E_SUCCESS;
+}
+
+void CDriRecorder::GetPoolStatistics(std::vector<driPoolStatistics>& Statistics) const
+{
+	FPool->GetStatistics(Statistics);
+}
+
+bool CDriRecorder::GetActive() const
+{
+	return (FQueue != NULL);
+}
+
+unsigned __int64 CDriRecorder::GetFrames() const
+{
+	return FWriter->GetFrames();
+}
+
+unsigned long CDriRecorder::GetDropped() const
+{
+	return (unsigned long)FDropped;
+}
+
+unsigned long CDriRecorder::GetQueueSize() const
+{
+	return FQueueSize;
+}
+
+void CDriRecorder::SetQueueSize(const unsigned long Value)
+{
+	FCS->Enter();
+	if (FQueue == NULL && Value > 0)
+		FQueueSize = Value;
+	FCS->Leave();
+}
@@ -0,0 +1,148 @@
+
+// DriRecorder.h : header file
+//
+
+#pragma once
+
+#include "wclHelpers.h"
+#include "wclSync.h"
+#include "wclDriAsd.h"
+
+#include "DriErrors.h"
+#include "DriPool.h"
+#include "DriQueue.h"
+#include "DriRecording.h"
+#include "DriSync.h"
+#include "DriThreadPool.h"
+
+using namespace wclCommon;
+using namespace wclSync;
+using namespace wclDri;
+
+/// <summary> The default recorder queue capacity (frames). </summary>
+#define DRI_RECORDER_QUEUE_SIZE		16384
+/// <summary> The maximum number of frames the recorder takes from the queue
+///   and writes at once. </summary>
+#define DRI_RECORDER_BATCH_SIZE		256
+
+/// <summary> Writes an indexed DRI recording in background. </summary>
+/// <remarks> The capture thread only copies the frame into a lock-free
+///   queue (see <see cref="CDriMpscQueue" />). A drain task running on the
+///   thread pool writes the frames and builds the index so the disk I/O never
+///   stalls the capture. The task is scheduled when the queue becomes
+///   non-empty; it takes the queued frames in batches (up to
+///   <c>DRI_RECORDER_BATCH_SIZE</c>) and writes each batch under one writer
+///   lock. Only one drain task runs at a time. When the queue is full the
+///   frame is dropped and counted.
+///   The frame copies are taken from a <see cref="CDriBufferPool" /> so the
+///   capture thread does not go to the heap for every frame. The drain task
+///   flushes the buffer cache of its worker thread before it ends, so the
+///   copies it freed go back to the capture thread.
+///   <c>Post</c> can be called from any number of threads but not while
+///   <c>Open</c> or <c>Close</c> is running. </remarks>
+class CDriRecorder
+{
+	DISABLE_COPY(CDriRecorder);
+
+private:
+	CwclCriticalSection*				FCS;
+	CDriRecordingWriter*				FWriter;
+	CDriMpscQueue<driRecordingFrame>*	FQueue;
+	CDriBufferPool*						FPool;
+	CDriThreadPool*						FThreadPool;
+	// 0 - idle, 1 - the drain task is scheduled or running, 2 - the task is
+	// running and new frames were posted.
+	CDriFutex*							FState;
+	driRecordingFrame*					FBatch;
+	volatile LONG						FDropped;
+	unsigned long						FQueueSize;
+
+	static void __stdcall DrainProc(void* Param);
+	void Schedule();
+	void Drain();
+	void Write(driRecordingFrame* const Frames, const unsigned long Count);
+
+public:
+	/// <summary> Creates new recorder. </summary>
+	/// <param name="ThreadPool"> The thread pool that runs the drain task.
+	///   When the pool is not active the frames are written by the thread
+	///   that posts them. </param>
+	CDriRecorder(CDriThreadPool* const ThreadPool);
+	/// <summary> Closes the recording and frees the recorder. </summary>
+	virtual ~CDriRecorder();
+
+	/// <summary> Creates new recording. </summary>
+	/// <param name="FileName"> The log file name. Existing files are
+	///   overwritten. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Open(const tstring& FileName);
+	/// <summary> Writes the queued frames and closes the recording. </summary>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Close();
+
+	/// <summary> Queues a raw DRI frame for recording. </summary>
+	/// <param name="Transport"> The transport the frame was received
+	///   from. </param>
+	/// <param name="Radio"> The receiving radio index. </param>
+	/// <param name="Source"> The source MAC address. </param>
+	/// <param name="Timestamp"> The receive time (FILETIME, UTC). </param>
+	/// <param name="Rssi"> The frame RSSI. </param>
+	/// <param name="Data"> The raw frame bytes. </param>
+	/// <param name="Length"> The raw frame length. </param>
+	/// <param name="Id"> The UAS ID announced by the frame or <c>NULL</c>.
+	///   The source is bound to the ID (see
+	///   <c>CDriRecordingWriter::Identify</c>) before the frame is
+	///   written. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Post(const driCaptureTransport Transport, const unsigned char Radio,
+		const __int64 Source, const __int64 Timestamp, const char Rssi,
+		const unsigned char* const Data, const size_t Length,
+		const wclDriAsdId* const Id);
+
+	/// <summary> Gets the frame buffers pool statistics. </summary>
+	/// <param name="Statistics"> On output contains the statistics of each
+	///   pool size class. </param>
+	/// <seealso cref="CDriBufferPool::GetStatistics" />
+	void GetPoolStatistics(std::vector<driPoolStatistics>& Statistics) const;
+
+	/// <summary> Gets the recorder state. </summary>
+	/// <returns> <c>True</c> if the recording is opened. </returns>
+	bool GetActive() const;
+	/// <summary> Gets the recorder state. </summary>
+	/// <value> <c>True</c> if the recording is opened. </value>
+	__declspec(property(get = GetActive)) bool Active;
+
+	/// <summary> Gets the number of frames written. </summary>
+	/// <returns> The frames count. </returns>
+	unsigned __int64 GetFrames() const;
+	/// <summary> Gets the number of frames written. </summary>
+	/// <value> The frames count. </value>
+	__declspec(property(get = GetFrames)) unsigned __int64 Frames;
+
+	/// <summary> Gets the number of frames dropped because the queue was
+	///   full. </summary>
+	/// <returns> The dropped frames count. </returns>
+	unsigned long GetDropped() const;
+	/// <summary> Gets the number of frames dropped because the queue was
+	///   full. </summary>
+	/// <value> The dropped frames count. </value>
+	__declspec(property(get = GetDropped)) unsigned long Dropped;
+
+	/// <summary> Gets the queue capacity. </summary>
+	/// <returns> The maximum number of the queued frames. </returns>
+	unsigned long GetQueueSize() const;
+	/// <summary> Sets the queue capacity. </summary>
+	/// <param name="Value"> The maximum number of the queued frames. Can be
+	///   changed only when the recording is closed. </param>
+	void SetQueueSize(const unsigned long Value);
+	/// <summary> Gets and sets the queue capacity. </summary>
+	/// <value> The maximum number of the queued frames. </value>
+	__declspec(property(get = GetQueueSize, put = SetQueueSize))
+		unsigned long QueueSize;
+};
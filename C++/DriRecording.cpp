@@ -0,0 +1,671 @@
+
+// DriRecording.cpp : implementation file
+//
+
+#include "stdafx.h"
+#include "DriRecording.h"
+
+#include <algorithm>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+
+// The number of FILETIME units in one second.
+#define DRI_FILETIME_SECOND		10000000
+// The size of the mapped window used for the index.
+#define DRI_INDEX_VIEW_SIZE		(4 * 1024 * 1024)
+// Source to UAS ID bindings are dropped when the table grows over this
+// limit. Sources with random addresses would make it grow endlessly.
+#define DRI_MAX_ALIASES			65536
+
+static bool CompareEntries(const driIndexEntry& A, const driIndexEntry& B)
+{
+	return (A.DroneKey < B.DroneKey);
+}
+
+__int64 DriUasIdKey(const wclDriAsdId& Id)
+{
+	// The ID is a zero padded string so the padding is not a part of the ID.
+	size_t Length = Id.size();
+	while (Length > 0 && Id[Length - 1] == 0)
+		Length--;
+
+	// FNV-1a.
+	unsigned __int64 Hash = 0xCBF29CE484222325ULL;
+	for (size_t i = 0; i < Length; i++)
+	{
+		Hash ^= Id[i];
+		Hash *= 0x100000001B3ULL;
+	}
+	return (__int64)(Hash | 0x8000000000000000ULL);
+}
+
+
+// CDriRecordingWriter
+
+CDriRecordingWriter::CDriRecordingWriter()
+{
+	FCS = new CwclCriticalSection();
+	FLog = new CDriCaptureLogWriter();
+	FIndex = NULL;
+	FIndexOffset = 0;
+	FBucketWidth = 60 * (__int64)DRI_FILETIME_SECOND;
+
+	FBucketStart = 0;
+	ZeroMemory(&FBlock, sizeof(FBlock));
+}
+
+CDriRecordingWriter::~CDriRecordingWriter()
+{
+	Close();
+
+	delete FLog;
+	delete FCS;
+}
+
+int CDriRecordingWriter::WriteIndex(const void* const Data, const unsigned long Size)
+{
+	if (FIndex->Write(Data, Size) != Size)
+		return DRI_E_REC_INDEX_WRITE_FAILED;
+	FIndexOffset += Size;
+	return WCL_E_SUCCESS;
+}
+
+int CDriRecordingWriter::FlushBlock()
+{
+	if (FEntries.size() == 0)
+		return WCL_E_SUCCESS;
+
+	// The block must never refer to log records that may be lost on crash.
+	int Res = FLog->Sync();
+	if (Res == WCL_E_SUCCESS)
+	{
+		// Entries are appended in the log order so the stable sort keeps the
+		// offsets of each drone sorted.
+		std::stable_sort(FEntries.begin(), FEntries.end(), CompareEntries);
+
+		driIndexBlockHeader Header;
+		Header.Magic = DRI_INDEX_BLOCK_MAGIC;
+		Header.Count = (unsigned long)FEntries.size();
+		Header.MinTime = FBlock.MinTime;
+		Header.MaxTime = FBlock.MaxTime;
+		Header.FirstOffset = FBlock.FirstOffset;
+		Header.LastOffset = FBlock.LastOffset;
+
+		FBlock.Offset = FIndexOffset;
+		FBlock.Count = Header.Count;
+
+		Res = WriteIndex(&Header, sizeof(Header));
+		if (Res == WCL_E_SUCCESS)
+		{
+			Res = WriteIndex(&FEntries[0],
+				(unsigned long)(FEntries.size() * sizeof(driIndexEntry)));
+			if (Res == WCL_E_SUCCESS)
+				FBlocks.push_back(FBlock);
+		}
+	}
+
+	FEntries.clear();
+	ZeroMemory(&FBlock, sizeof(FBlock));
+	return Res;
+}
+
+int CDriRecordingWriter::Open(const tstring& FileName)
+{
+	if (FileName == _T(""))
+		return WCL_E_INVALID_ARGUMENT;
+
+	FCS->Enter();
+	int Res = WCL_E_SUCCESS;
+	if (FIndex != NULL)
+		Res = DRI_E_REC_OPENED;
+	else
+	{
+		Res = FLog->Open(FileName);
+		if (Res == WCL_E_SUCCESS)
+		{
+			try
+			{
+				FIndex = new CwclFileStream(IndexFileName(FileName), CREATE_ALWAYS,
+					GENERIC_WRITE, FILE_SHARE_READ);
+			}
+			catch (wclEFileOpenFailed&)
+			{
+				FIndex = NULL;
+				Res = DRI_E_REC_INDEX_OPEN_FAILED;
+			}
+
+			if (Res == WCL_E_SUCCESS)
+			{
+				FIndexOffset = 0;
+				FAliases.clear();
+				FBucketStart = 0;
+				ZeroMemory(&FBlock, sizeof(FBlock));
+				FEntries.clear();
+				FBlocks.clear();
+
+				driIndexFileHeader Header;
+				ZeroMemory(&Header, sizeof(Header));
+				CopyMemory(Header.Magic, DRI_INDEX_MAGIC, sizeof(Header.Magic));
+				Header.Version = DRI_INDEX_VERSION;
+				Header.HeaderSize = sizeof(Header);
+				Header.BucketWidth = FBucketWidth;
+
+				Res = WriteIndex(&Header, sizeof(Header));
+				if (Res != WCL_E_SUCCESS)
+				{
+					delete FIndex;
+					FIndex = NULL;
+				}
+			}
+
+			if (Res != WCL_E_SUCCESS)
+				FLog->Close();
+		}
+	}
+	FCS->Leave();
+	return Res;
+}
+
+int CDriRecordingWriter::Close()
+{
+	FCS->Enter();
+	int Res = WCL_E_SUCCESS;
+	if (FIndex == NULL)
+		Res = DRI_E_REC_CLOSED;
+	else
+	{
+		Res = FlushBlock();
+		if (Res == WCL_E_SUCCESS)
+		{
+			driIndexTrailer Trailer;
+			ZeroMemory(&Trailer, sizeof(Trailer));
+			Trailer.Magic = DRI_INDEX_TRAILER_MAGIC;
+			Trailer.TableOffset = FIndexOffset;
+			Trailer.Count = FBlocks.size();
+
+			if (FBlocks.size() > 0)
+			{
+				Res = WriteIndex(&FBlocks[0],
+					(unsigned long)(FBlocks.size() * sizeof(driIndexBlock)));
+			}
+			if (Res == WCL_E_SUCCESS)
+				Res = WriteIndex(&Trailer, sizeof(Trailer));
+		}
+
+		delete FIndex;
+		FIndex = NULL;
+
+		int LogRes = FLog->Close();
+		if (Res == WCL_E_SUCCESS)
+			Res = LogRes;
+
+		FAliases.clear();
+		FBlocks.clear();
+	}
+	FCS->Leave();
+	return Res;
+}
+
+int CDriRecordingWriter::AppendFrame(const driCaptureTransport Transport,
+	const unsigned char Radio, const __int64 Source, const __int64 Timestamp,
+	const char Rssi, const unsigned char* const Data, const size_t Length)
+{
+	int Res = WCL_E_SUCCESS;
+	// Late frames (the WiFi BSS list is not sorted by time) stay in the
+	// current block and only extend its time range.
+	if (FEntries.size() > 0 && (Timestamp >= FBucketStart + FBucketWidth ||
+		FEntries.size() >= DRI_INDEX_MAX_BLOCK_ENTRIES))
+	{
+		Res = FlushBlock();
+	}
+
+	if (Res == WCL_E_SUCCESS)
+	{
+		unsigned __int64 Offset;
+		Res = FLog->Append(Transport, Radio, Source, Timestamp, Rssi, Data,
+			Length, Offset);
+		if (Res == WCL_E_SUCCESS)
+		{
+			driIndexEntry Entry;
+			Entry.Offset = Offset;
+			std::map<__int64, __int64>::const_iterator Alias = FAliases.find(Source);
+			if (Alias == FAliases.end())
+				Entry.DroneKey = Source;
+			else
+				Entry.DroneKey = Alias->second;
+
+			if (FEntries.size() == 0)
+			{
+				FBucketStart = Timestamp - Timestamp % FBucketWidth;
+				FBlock.MinTime = Timestamp;
+				FBlock.MaxTime = Timestamp;
+				FBlock.FirstOffset = Entry.Offset;
+			}
+			else
+			{
+				if (Timestamp < FBlock.MinTime)
+					FBlock.MinTime = Timestamp;
+				if (Timestamp > FBlock.MaxTime)
+					FBlock.MaxTime = Timestamp;
+			}
+			FBlock.LastOffset = Entry.Offset;
+
+			FEntries.push_back(Entry);
+		}
+	}
+	return Res;
+}
+
+void CDriRecordingWriter::Bind(const __int64 Source, const __int64 DroneKey)
+{
+	if (FAliases.size() >= DRI_MAX_ALIASES)
+		FAliases.clear();
+	FAliases[Source] = DroneKey;
+}
+
+int CDriRecordingWriter::Append(const driCaptureTransport Transport,
+	const unsigned char Radio, const __int64 Source, const __int64 Timestamp,
+	const char Rssi, const unsigned char* const Data, const size_t Length)
+{
+	FCS->Enter();
+	int Res = WCL_E_SUCCESS;
+	if (FIndex == NULL)
+		Res = DRI_E_REC_CLOSED;
+	else
+		Res = AppendFrame(Transport, Radio, Source, Timestamp, Rssi, Data, Length);
+	FCS->Leave();
+	return Res;
+}
+
+int CDriRecordingWriter::Append(const driCaptureTransport Transport,
+	const __int64 Source, const __int64 Timestamp, const char Rssi,
+	const wclDriRawData& Raw)
+{
+	if (Raw.size() == 0)
+		return WCL_E_INVALID_ARGUMENT;
+	return Append(Transport, 0, Source, Timestamp, Rssi, &Raw[0], Raw.size());
+}
+
+int CDriRecordingWriter::Append(const driRecordingFrame* const Frames,
+	const size_t Count)
+{
+	if (Frames == NULL)
+		return WCL_E_INVALID_ARGUMENT;
+
+	FCS->Enter();
+	int Res = WCL_E_SUCCESS;
+	if (FIndex == NULL)
+		Res = DRI_E_REC_CLOSED;
+	else
+	{
+		for (size_t i = 0; i < Count && Res == WCL_E_SUCCESS; i++)
+		{
+			const driRecordingFrame& Frame = Frames[i];
+			if (Frame.IdLength > 0)
+			{
+				Bind(Frame.Source, DriUasIdKey(wclDriAsdId(Frame.Id,
+					Frame.Id + Frame.IdLength)));
+			}
+			Res = AppendFrame(Frame.Transport, Frame.Radio, Frame.Source,
+				Frame.Timestamp, Frame.Rssi, Frame.Data, Frame.Length);
+		}
+	}
+	FCS->Leave();
+	return Res;
+}
+
+void CDriRecordingWriter::Identify(const __int64 Source, const wclDriAsdId& Id)
+{
+	__int64 DroneKey = DriUasIdKey(Id);
+
+	FCS->Enter();
+	Bind(Source, DroneKey);
+	FCS->Leave();
+}
+
+tstring CDriRecordingWriter::IndexFileName(const tstring& FileName)
+{
+	return FileName + _T(".idx");
+}
+
+bool CDriRecordingWriter::GetActive() const
+{
+	return (FIndex != NULL);
+}
+
+unsigned __int64 CDriRecordingWriter::GetFrames() const
+{
+	return FLog->GetFrames();
+}
+
+unsigned long CDriRecordingWriter::GetBucketWidth() const
+{
+	return (unsigned long)(FBucketWidth / DRI_FILETIME_SECOND);
+}
+
+void CDriRecordingWriter::SetBucketWidth(const unsigned long Value)
+{
+	if (FIndex == NULL && Value > 0)
+		FBucketWidth = Value * (__int64)DRI_FILETIME_SECOND;
+}
+
+
+// CDriRecordingReader
+
+CDriRecordingReader::CDriRecordingReader()
+{
+	FLog = new CDriCaptureLogReader();
+	FIndex = new CDriMappedFile(DRI_INDEX_VIEW_SIZE);
+
+	FQuery = false;
+	FFrom = 0;
+	FTo = 0;
+	FFiltered = false;
+	FDroneKey = 0;
+	FBlock = 0;
+	FBlockEntered = false;
+	FPosition = 0;
+	FEntry = 0;
+}
+
+CDriRecordingReader::~CDriRecordingReader()
+{
+	Close();
+
+	delete FIndex;
+	delete FLog;
+}
+
+int CDriRecordingReader::LoadBlocks()
+{
+	unsigned __int64 Size = FIndex->GetSize();
+	if (Size < sizeof(driIndexFileHeader))
+		return DRI_E_REC_INDEX_INVALID_FORMAT;
+
+	const driIndexFileHeader* Header = (const driIndexFileHeader*)
+		FIndex->Map(0, sizeof(driIndexFileHeader));
+	if (Header == NULL)
+		return DRI_E_REC_INDEX_MAP_FAILED;
+	if (memcmp(Header->Magic, DRI_INDEX_MAGIC, sizeof(Header->Magic)) != 0 ||
+		Header->Version != DRI_INDEX_VERSION ||
+		Header->HeaderSize < sizeof(driIndexFileHeader) ||
+		Header->HeaderSize > Size)
+	{
+		return DRI_E_REC_INDEX_INVALID_FORMAT;
+	}
+	unsigned __int64 First = Header->HeaderSize;
+
+	// A closed recording has the block table at the end.
+	if (Size >= First + sizeof(driIndexTrailer))
+	{
+		const driIndexTrailer* Trailer = (const driIndexTrailer*)
+			FIndex->Map(Size - sizeof(driIndexTrailer), sizeof(driIndexTrailer));
+		if (Trailer != NULL && Trailer->Magic == DRI_INDEX_TRAILER_MAGIC &&
+			Trailer->TableOffset >= First &&
+			Trailer->TableOffset + Trailer->Count * sizeof(driIndexBlock) ==
+			Size - sizeof(driIndexTrailer))
+		{
+			unsigned __int64 Count = Trailer->Count;
+			unsigned __int64 Offset = Trailer->TableOffset;
+			FBlocks.reserve((size_t)Count);
+			for (unsigned __int64 i = 0; i < Count; i++)
+			{
+				const driIndexBlock* Block = (const driIndexBlock*)
+					FIndex->Map(Offset, sizeof(driIndexBlock));
+				if (Block == NULL)
+					return DRI_E_REC_INDEX_MAP_FAILED;
+				FBlocks.push_back(*Block);
+				Offset += sizeof(driIndexBlock);
+			}
+			return WCL_E_SUCCESS;
+		}
+	}
+
+	// The recording was not closed (or is still being written): walk the
+	// blocks. Everything after the last complete block is ignored.
+	unsigned __int64 Offset = First;
+	while (Offset + sizeof(driIndexBlockHeader) <= Size)
+	{
+		const driIndexBlockHeader* BlockHeader = (const driIndexBlockHeader*)
+			FIndex->Map(Offset, sizeof(driIndexBlockHeader));
+		if (BlockHeader == NULL || BlockHeader->Magic != DRI_INDEX_BLOCK_MAGIC)
+			break;
+
+		unsigned __int64 BlockSize = sizeof(driIndexBlockHeader) +
+			(unsigned __int64)BlockHeader->Count * sizeof(driIndexEntry);
+		if (Offset + BlockSize > Size)
+			break;
+
+		driIndexBlock Block;
+		Block.MinTime = BlockHeader->MinTime;
+		Block.MaxTime = BlockHeader->MaxTime;
+		Block.FirstOffset = BlockHeader->FirstOffset;
+		Block.LastOffset = BlockHeader->LastOffset;
+		Block.Offset = Offset;
+		Block.Count = BlockHeader->Count;
+		Block.Reserved = 0;
+		FBlocks.push_back(Block);
+
+		Offset += BlockSize;
+	}
+	return WCL_E_SUCCESS;
+}
+
+const driIndexEntry* CDriRecordingReader::GetEntry(const driIndexBlock& Block,
+	const unsigned long Index)
+{
+	if (Index >= Block.Count)
+		return NULL;
+	return (const driIndexEntry*)FIndex->Map(Block.Offset +
+		sizeof(driIndexBlockHeader) + (unsigned __int64)Index * sizeof(driIndexEntry),
+		sizeof(driIndexEntry));
+}
+
+unsigned long CDriRecordingReader::FindDrone(const driIndexBlock& Block,
+	const __int64 DroneKey)
+{
+	// Lower bound. Only the pages on the search path are touched.
+	unsigned long Low = 0;
+	unsigned long High = Block.Count;
+	while (Low < High)
+	{
+		unsigned long Middle = Low + (High - Low) / 2;
+		const driIndexEntry* Entry = GetEntry(Block, Middle);
+		if (Entry == NULL)
+			return Block.Count;
+
+		if (Entry->DroneKey < DroneKey)
+			Low = Middle + 1;
+		else
+			High = Middle;
+	}
+	return Low;
+}
+
+bool CDriRecordingReader::EnterBlock()
+{
+	while (FBlock < FBlocks.size())
+	{
+		const driIndexBlock& Block = FBlocks[FBlock];
+		if (Block.MaxTime >= FFrom && Block.MinTime <= FTo)
+		{
+			if (!FFiltered)
+			{
+				FPosition = Block.FirstOffset;
+				FBlockEntered = true;
+				return true;
+			}
+
+			FEntry = FindDrone(Block, FDroneKey);
+			const driIndexEntry* Entry = GetEntry(Block, FEntry);
+			if (Entry != NULL && Entry->DroneKey == FDroneKey)
+			{
+				FBlockEntered = true;
+				return true;
+			}
+		}
+		FBlock++;
+	}
+	return false;
+}
+
+int CDriRecordingReader::Open(const tstring& FileName)
+{
+	if (FileName == _T(""))
+		return WCL_E_INVALID_ARGUMENT;
+	if (FLog->GetActive())
+		return DRI_E_REC_OPENED;
+
+	int Res = FLog->Open(FileName, true);
+	if (Res == WCL_E_SUCCESS)
+	{
+		Res = FIndex->Open(CDriRecordingWriter::IndexFileName(FileName), false);
+		if (Res == DRI_E_MAPPED_OPEN_FAILED)
+			Res = DRI_E_REC_INDEX_OPEN_FAILED;
+		if (Res == WCL_E_SUCCESS)
+			Res = LoadBlocks();
+
+		if (Res != WCL_E_SUCCESS)
+			Close();
+	}
+	return Res;
+}
+
+int CDriRecordingReader::Close()
+{
+	if (!FLog->GetActive())
+		return DRI_E_REC_CLOSED;
+
+	FQuery = false;
+	FBlocks.clear();
+	FIndex->Close();
+	return FLog->Close();
+}
+
+int CDriRecordingReader::Seek(const __int64 From, const __int64 To)
+{
+	if (!FLog->GetActive())
+		return DRI_E_REC_CLOSED;
+	if (From > To)
+		return WCL_E_INVALID_ARGUMENT;
+
+	FQuery = true;
+	FFrom = From;
+	FTo = To;
+	FFiltered = false;
+	FDroneKey = 0;
+	FBlock = 0;
+	FBlockEntered = false;
+	return WCL_E_SUCCESS;
+}
+
+int CDriRecordingReader::Seek(const __int64 From, const __int64 To,
+	const __int64 DroneKey)
+{
+	int Res = Seek(From, To);
+	if (Res == WCL_E_SUCCESS)
+	{
+		FFiltered = true;
+		FDroneKey = DroneKey;
+	}
+	return Res;
+}
+
+int CDriRecordingReader::Next(driCaptureFrame& Frame)
+{
+	if (!FLog->GetActive())
+		return DRI_E_REC_CLOSED;
+	if (!FQuery)
+		return DRI_E_REC_NO_QUERY;
+
+	while (true)
+	{
+		if (!FBlockEntered && !EnterBlock())
+			return DRI_E_LOG_EOF;
+
+		const driIndexBlock& Block = FBlocks[FBlock];
+		int Res;
+		if (FFiltered)
+		{
+			const driIndexEntry* Entry = GetEntry(Block, FEntry);
+			if (Entry == NULL || Entry->DroneKey != FDroneKey)
+				Res = DRI_E_LOG_EOF;
+			else
+			{
+				FEntry++;
+				Res = FLog->ReadAt(Entry->Offset, Frame);
+				// Skip a damaged record but keep reading the block.
+				if (Res != WCL_E_SUCCESS)
+					continue;
+			}
+		}
+		else
+		{
+			if (FPosition > Block.LastOffset)
+				Res = DRI_E_LOG_EOF;
+			else
+				Res = FLog->Next(FPosition, Frame);
+		}
+
+		if (Res != WCL_E_SUCCESS)
+		{
+			FBlock++;
+			FBlockEntered = false;
+		}
+		else
+		{
+			if (Frame.Timestamp >= FFrom && Frame.Timestamp <= FTo)
+				return WCL_E_SUCCESS;
+		}
+	}
+}
+
+int CDriRecordingReader::GetDrones(const __int64 From, const __int64 To,
+	std::vector<__int64>& DroneKeys)
+{
+	DroneKeys.clear();
+	if (!FLog->GetActive())
+		return DRI_E_REC_CLOSED;
+	if (From > To)
+		return WCL_E_INVALID_ARGUMENT;
+
+	for (std::vector<driIndexBlock>::const_iterator Block = FBlocks.begin();
+		Block != FBlocks.end(); Block++)
+	{
+		if (Block->MaxTime < From || Block->MinTime > To)
+			continue;
+
+		// Entries are sorted by the key so only the key changes are collected.
+		bool First = true;
+		__int64 Last = 0;
+		for (unsigned long i = 0; i < Block->Count; i++)
+		{
+			const driIndexEntry* Entry = GetEntry(*Block, i);
+			if (Entry == NULL)
+				return DRI_E_REC_INDEX_MAP_FAILED;
+			if (First || Entry->DroneKey != Last)
+			{
+				DroneKeys.push_back(Entry->DroneKey);
+				Last = Entry->DroneKey;
+				First = false;
+			}
+		}
+	}
+
+	std::sort(DroneKeys.begin(), DroneKeys.end());
+	DroneKeys.erase(std::unique(DroneKeys.begin(), DroneKeys.end()), DroneKeys.end());
+	return WCL_E_SUCCESS;
+}
+
+bool CDriRecordingReader::GetActive() const
+{
+	return FLog->GetActive();
+}
+
+size_t CDriRecordingReader::GetBlocks() const
+{
+	return FBlocks.size();
+}
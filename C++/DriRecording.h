@@ -0,0 +1,375 @@
+
+// DriRecording.h : header file
+//
+
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include "wclHelpers.h"
+#include "wclSync.h"
+#include "wclDriAsd.h"
+
+#include "DriErrors.h"
+#include "DriMappedFile.h"
+#include "DriCaptureLog.h"
+
+using namespace wclCommon;
+using namespace wclSync;
+using namespace wclDri;
+
+// A recording is a capture log (see DriCaptureLog.h) plus a sidecar index
+// file named <log file name>.idx. The index layout (little-endian):
+//
+//   driIndexFileHeader
+//   block 0: driIndexBlockHeader, Count * driIndexEntry
+//   block 1: ...
+//   ...
+//   Count * driIndexBlock (the block table, written on close)
+//   driIndexTrailer
+//
+// A block covers the frames received within one time bucket (BucketWidth)
+// in the order they were written to the log, so the frames of a block are a
+// contiguous log range [FirstOffset, LastOffset]. Block entries are sorted by
+// drone key and then by log offset so the frames of one drone are found with
+// a binary search. A block is written only after the log data it refers to
+// was synced. If the trailer is missing (the recorder was not closed) the
+// reader rebuilds the block table by walking the blocks.
+
+/// <summary> The recording index file signature. </summary>
+#define DRI_INDEX_MAGIC				"DRIINDEX"
+/// <summary> The recording index format version. </summary>
+#define DRI_INDEX_VERSION			1
+/// <summary> The index block signature. </summary>
+#define DRI_INDEX_BLOCK_MAGIC		0x4B434C42 // "BLCK"
+/// <summary> The index trailer signature. </summary>
+#define DRI_INDEX_TRAILER_MAGIC		0x524C5254 // "TRLR"
+/// <summary> The maximum number of entries in one block. A busy bucket is
+///   split into several blocks. </summary>
+#define DRI_INDEX_MAX_BLOCK_ENTRIES	(256 * 1024)
+
+#pragma pack(push, 1)
+/// <summary> The recording index file header. </summary>
+typedef struct
+{
+	char			Magic[8];
+	unsigned short	Version;
+	unsigned short	HeaderSize;
+	unsigned long	Flags;
+	/// <summary> The time bucket width (FILETIME units). </summary>
+	__int64			BucketWidth;
+	__int64			Reserved;
+} driIndexFileHeader;
+
+/// <summary> The index block header. </summary>
+typedef struct
+{
+	unsigned long		Magic;
+	/// <summary> The number of entries following the header. </summary>
+	unsigned long		Count;
+	/// <summary> The earliest frame timestamp in the block. </summary>
+	__int64				MinTime;
+	/// <summary> The latest frame timestamp in the block. </summary>
+	__int64				MaxTime;
+	/// <summary> The log offset of the first frame in the block. </summary>
+	unsigned __int64	FirstOffset;
+	/// <summary> The log offset of the last frame in the block. </summary>
+	unsigned __int64	LastOffset;
+} driIndexBlockHeader;
+
+/// <summary> The index block entry. </summary>
+typedef struct
+{
+	__int64				DroneKey;
+	/// <summary> The frame record offset in the log. </summary>
+	unsigned __int64	Offset;
+} driIndexEntry;
+
+/// <summary> The block table entry. </summary>
+typedef struct
+{
+	__int64				MinTime;
+	__int64				MaxTime;
+	unsigned __int64	FirstOffset;
+	unsigned __int64	LastOffset;
+	/// <summary> The block header offset in the index file. </summary>
+	unsigned __int64	Offset;
+	unsigned long		Count;
+	unsigned long		Reserved;
+} driIndexBlock;
+
+/// <summary> The index trailer. </summary>
+typedef struct
+{
+	unsigned long		Magic;
+	unsigned long		Reserved;
+	/// <summary> The block table offset in the index file. </summary>
+	unsigned __int64	TableOffset;
+	/// <summary> The number of blocks. </summary>
+	unsigned __int64	Count;
+} driIndexTrailer;
+#pragma pack(pop)
+
+/// <summary> The maximum UAS ID length carried with a frame. </summary>
+#define DRI_RECORDING_MAX_ID		20
+
+/// <summary> A frame for the batch append. </summary>
+typedef struct
+{
+	driCaptureTransport		Transport;
+	/// <summary> The receiving radio index. </summary>
+	unsigned char			Radio;
+	char					Rssi;
+	/// <summary> The UAS ID length. 0 if the frame does not identify the
+	///   drone. </summary>
+	unsigned char			IdLength;
+	/// <summary> The UAS ID from the Basic ID message the frame
+	///   carries. </summary>
+	unsigned char			Id[DRI_RECORDING_MAX_ID];
+	/// <summary> The source MAC address. </summary>
+	__int64					Source;
+	/// <summary> The receive time (FILETIME, UTC). </summary>
+	__int64					Timestamp;
+	unsigned long			Length;
+	const unsigned char*	Data;
+} driRecordingFrame;
+
+/// <summary> Builds the drone key from the UAS ID. </summary>
+/// <param name="Id"> The UAS ID from the Basic ID message. </param>
+/// <returns> The drone key. </returns>
+/// <remarks> The keys built from UAS IDs always have the high bit set so they
+///   never collide with the keys built from MAC addresses. </remarks>
+__int64 DriUasIdKey(const wclDriAsdId& Id);
+
+/// <summary> Writes an indexed DRI recording. </summary>
+/// <remarks> Frames are written to the capture log and the index is built
+///   incrementally as the frames arrive. Each frame is indexed by the drone
+///   key: the key of the UAS ID announced by the frame source (see
+///   <c>Identify</c>) or the source MAC address when the ID is not known yet.
+///   The methods are thread safe. </remarks>
+class CDriRecordingWriter
+{
+	DISABLE_COPY(CDriRecordingWriter);
+
+private:
+	CwclCriticalSection*			FCS;
+	CDriCaptureLogWriter*			FLog;
+	CwclFileStream*					FIndex;
+	unsigned __int64				FIndexOffset;
+	__int64							FBucketWidth;
+
+	std::map<__int64, __int64>		FAliases;
+
+	__int64							FBucketStart;
+	driIndexBlock					FBlock;
+	std::vector<driIndexEntry>		FEntries;
+	std::vector<driIndexBlock>		FBlocks;
+
+	int FlushBlock();
+	int WriteIndex(const void* const Data, const unsigned long Size);
+	int AppendFrame(const driCaptureTransport Transport, const unsigned char Radio,
+		const __int64 Source, const __int64 Timestamp, const char Rssi,
+		const unsigned char* const Data, const size_t Length);
+	void Bind(const __int64 Source, const __int64 DroneKey);
+
+public:
+	/// <summary> Creates new recording writer. </summary>
+	CDriRecordingWriter();
+	/// <summary> Closes the recording and frees the writer. </summary>
+	virtual ~CDriRecordingWriter();
+
+	/// <summary> Creates new recording. </summary>
+	/// <param name="FileName"> The log file name. The index file name is
+	///   built by <c>IndexFileName</c>. Existing files are overwritten. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Open(const tstring& FileName);
+	/// <summary> Writes the last block and the block table and closes the
+	///   recording. </summary>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Close();
+
+	/// <summary> Appends a raw DRI frame to the recording. </summary>
+	/// <param name="Transport"> The transport the frame was received
+	///   from. </param>
+	/// <param name="Radio"> The receiving radio index. </param>
+	/// <param name="Source"> The source MAC address. </param>
+	/// <param name="Timestamp"> The receive time (FILETIME, UTC). </param>
+	/// <param name="Rssi"> The frame RSSI. </param>
+	/// <param name="Data"> The raw frame bytes. </param>
+	/// <param name="Length"> The raw frame length. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Append(const driCaptureTransport Transport, const unsigned char Radio,
+		const __int64 Source, const __int64 Timestamp, const char Rssi,
+		const unsigned char* const Data, const size_t Length);
+	/// <summary> Appends a raw DRI frame to the recording. </summary>
+	/// <param name="Transport"> The transport the frame was received
+	///   from. </param>
+	/// <param name="Source"> The source MAC address. </param>
+	/// <param name="Timestamp"> The receive time (FILETIME, UTC). </param>
+	/// <param name="Rssi"> The frame RSSI. </param>
+	/// <param name="Raw"> The raw frame. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Append(const driCaptureTransport Transport, const __int64 Source,
+		const __int64 Timestamp, const char Rssi, const wclDriRawData& Raw);
+	/// <summary> Appends several raw DRI frames to the recording. </summary>
+	/// <param name="Frames"> The frames. A frame with the UAS ID binds its
+	///   source to the ID (see <c>Identify</c>) before it is
+	///   written. </param>
+	/// <param name="Count"> The number of frames. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	/// <remarks> The writer lock is taken once for all the frames. The method
+	///   stops on the first failed frame. </remarks>
+	int Append(const driRecordingFrame* const Frames, const size_t Count);
+
+	/// <summary> Binds the source MAC address to the UAS ID. </summary>
+	/// <param name="Source"> The source MAC address. </param>
+	/// <param name="Id"> The UAS ID from the Basic ID message. </param>
+	/// <remarks> The frames appended after the call are indexed by the UAS ID
+	///   key so a drone can be found even if it changes its MAC
+	///   address. </remarks>
+	void Identify(const __int64 Source, const wclDriAsdId& Id);
+
+	/// <summary> Builds the index file name for the log file. </summary>
+	/// <param name="FileName"> The log file name. </param>
+	/// <returns> The index file name. </returns>
+	static tstring IndexFileName(const tstring& FileName);
+
+	/// <summary> Gets the writer state. </summary>
+	/// <returns> <c>True</c> if the recording is opened. </returns>
+	bool GetActive() const;
+	/// <summary> Gets the writer state. </summary>
+	/// <value> <c>True</c> if the recording is opened. </value>
+	__declspec(property(get = GetActive)) bool Active;
+
+	/// <summary> Gets the number of frames written. </summary>
+	/// <returns> The frames count. </returns>
+	unsigned __int64 GetFrames() const;
+	/// <summary> Gets the number of frames written. </summary>
+	/// <value> The frames count. </value>
+	__declspec(property(get = GetFrames)) unsigned __int64 Frames;
+
+	/// <summary> Gets the time bucket width. </summary>
+	/// <returns> The bucket width in seconds. </returns>
+	unsigned long GetBucketWidth() const;
+	/// <summary> Sets the time bucket width. </summary>
+	/// <param name="Value"> The bucket width in seconds. Can be changed only
+	///   when the recording is closed. </param>
+	void SetBucketWidth(const unsigned long Value);
+	/// <summary> Gets and sets the time bucket width. </summary>
+	/// <value> The bucket width in seconds. </value>
+	__declspec(property(get = GetBucketWidth, put = SetBucketWidth))
+		unsigned long BucketWidth;
+};
+
+/// <summary> Reads an indexed DRI recording. </summary>
+/// <remarks> Both the log and the index are memory-mapped. A query selects
+///   the blocks overlapping the time range from the block table and reads
+///   only their log ranges or, when filtered by drone, only the records
+///   listed for the drone in the block entries. The reader is not thread
+///   safe. </remarks>
+class CDriRecordingReader
+{
+	DISABLE_COPY(CDriRecordingReader);
+
+private:
+	CDriCaptureLogReader*			FLog;
+	CDriMappedFile*					FIndex;
+	std::vector<driIndexBlock>		FBlocks;
+
+	bool							FQuery;
+	__int64							FFrom;
+	__int64							FTo;
+	bool							FFiltered;
+	__int64							FDroneKey;
+	size_t							FBlock;
+	bool							FBlockEntered;
+	unsigned __int64				FPosition;
+	unsigned long					FEntry;
+
+	int LoadBlocks();
+	const driIndexEntry* GetEntry(const driIndexBlock& Block, const unsigned long Index);
+	unsigned long FindDrone(const driIndexBlock& Block, const __int64 DroneKey);
+	bool EnterBlock();
+
+public:
+	/// <summary> Creates new recording reader. </summary>
+	CDriRecordingReader();
+	/// <summary> Closes the recording and frees the reader. </summary>
+	virtual ~CDriRecordingReader();
+
+	/// <summary> Opens the recording. </summary>
+	/// <param name="FileName"> The log file name. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Open(const tstring& FileName);
+	/// <summary> Closes the recording. </summary>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Close();
+
+	/// <summary> Starts new query for all the drones. </summary>
+	/// <param name="From"> The range start time (FILETIME, UTC). </param>
+	/// <param name="To"> The range end time (FILETIME, UTC). </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Seek(const __int64 From, const __int64 To);
+	/// <summary> Starts new query for one drone. </summary>
+	/// <param name="From"> The range start time (FILETIME, UTC). </param>
+	/// <param name="To"> The range end time (FILETIME, UTC). </param>
+	/// <param name="DroneKey"> The drone key: the MAC address or the value
+	///   returned by <c>DriUasIdKey</c>. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Seek(const __int64 From, const __int64 To, const __int64 DroneKey);
+	/// <summary> Reads the next frame matching the query. </summary>
+	/// <param name="Frame"> If the method completed with success on output
+	///   contains the frame. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. When no more frames match the query the
+	///   method returns <see cref="DRI_E_LOG_EOF" />. </returns>
+	/// <remarks> Frames are returned in the log order. </remarks>
+	int Next(driCaptureFrame& Frame);
+
+	/// <summary> Gets the drones seen within the time range. </summary>
+	/// <param name="From"> The range start time (FILETIME, UTC). </param>
+	/// <param name="To"> The range end time (FILETIME, UTC). </param>
+	/// <param name="DroneKeys"> On output contains the sorted drone
+	///   keys. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	/// <remarks> The method reads the index only. The result is block
+	///   accurate: a drone seen in a block that overlaps the range is
+	///   reported. </remarks>
+	int GetDrones(const __int64 From, const __int64 To,
+		std::vector<__int64>& DroneKeys);
+
+	/// <summary> Gets the reader state. </summary>
+	/// <returns> <c>True</c> if the recording is opened. </returns>
+	bool GetActive() const;
+	/// <summary> Gets the reader state. </summary>
+	/// <value> <c>True</c> if the recording is opened. </value>
+	__declspec(property(get = GetActive)) bool Active;
+
+	/// <summary> Gets the number of index blocks. </summary>
+	/// <returns> The blocks count. </returns>
+	size_t GetBlocks() const;
+	/// <summary> Gets the number of index blocks. </summary>
+	/// <value> The blocks count. </value>
+	__declspec(property(get = GetBlocks)) size_t Blocks;
+};
@@ -0,0 +1,124 @@
+
+// DriRender.cpp : implementation file
+//
+
+#include "stdafx.h"
+#include "DriRender.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+
+// CDriRenderScheduler
+
+CDriRenderScheduler::CDriRenderScheduler()
+{
+	FMaxRate = DRI_RENDER_MAX_RATE;
+	QueryPerformanceFrequency(&FFrequency);
+	FFrameStart.QuadPart = 0;
+
+	Reset();
+}
+
+void CDriRenderScheduler::Reset()
+{
+	FDirty.clear();
+	FMarked.clear();
+	FDetailsDirty = false;
+
+	FTotalFrameTime = 0;
+	ZeroMemory(&FStatistics, sizeof(driRenderStatistics));
+}
+
+void CDriRenderScheduler::MarkDirty(const size_t Drone)
+{
+	FStatistics.Updates++;
+
+	if (Drone >= FMarked.size())
+		FMarked.resize(Drone + 1, false);
+	if (FMarked[Drone])
+		FStatistics.Skipped++;
+	else
+	{
+		FMarked[Drone] = true;
+		FDirty.push_back(Drone);
+	}
+}
+
+void CDriRenderScheduler::MarkDetailsDirty()
+{
+	FStatistics.Updates++;
+
+	if (FDetailsDirty)
+		FStatistics.Skipped++;
+	else
+		FDetailsDirty = true;
+}
+
+bool CDriRenderScheduler::BeginFrame(std::vector<size_t>& Drones, bool& Details)
+{
+	Drones.clear();
+	Details = FDetailsDirty;
+	if (FDirty.size() == 0 && !FDetailsDirty)
+		return false;
+
+	// Swap keeps the capacity of both vectors.
+	Drones.swap(FDirty);
+	for (std::vector<size_t>::const_iterator Drone = Drones.begin(); Drone != Drones.end(); Drone++)
+		FMarked[*Drone] = false;
+	FDetailsDirty = false;
+
+	QueryPerformanceCounter(&FFrameStart);
+	return true;
+}
+
+void CDriRenderScheduler::EndFrame()
+{
+	LARGE_INTEGER Now;
+	QueryPerformanceCounter(&Now);
+
+	double Time = 0;
+	if (FFrequency.QuadPart > 0)
+		Time = (double)(Now.QuadPart - FFrameStart.QuadPart) * 1000.0 / (double)FFrequency.QuadPart;
+
+	FStatistics.Frames++;
+	FStatistics.LastFrameTime = Time;
+	if (Time > FStatistics.MaxFrameTime)
+		FStatistics.MaxFrameTime = Time;
+	FTotalFrameTime += Time;
+	FStatistics.AverageFrameTime = FTotalFrameTime / (double)FStatistics.Frames;
+}
+
+void CDriRenderScheduler::GetStatistics(driRenderStatistics& Statistics) const
+{
+	Statistics = FStatistics;
+}
+
+bool CDriRenderScheduler::GetPending() const
+{
+	return (FDirty.size() > 0 || FDetailsDirty);
+}
+
+unsigned long CDriRenderScheduler::GetMaxRate() const
+{
+	return FMaxRate;
+}
+
+void CDriRenderScheduler::SetMaxRate(const unsigned long Value)
+{
+	if (Value < 1)
+		FMaxRate = 1;
+	else
+	{
+		if (Value > 100)
+			FMaxRate = 100;
+		else
+			FMaxRate = Value;
+	}
+}
+
+unsigned long CDriRenderScheduler::GetInterval() const
+{
+	return 1000 / FMaxRate;
+}
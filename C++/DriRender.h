@@ -0,0 +1,117 @@
+
+// DriRender.h : header file
+//
+
+#pragma once
+
+#include <vector>
+
+#include "wclHelpers.h"
+
+using namespace wclCommon;
+
+/// <summary> The default maximum user interface refresh rate in
+///   frames per second. </summary>
+#define DRI_RENDER_MAX_RATE		10
+
+/// <summary> The render scheduler statistics. </summary>
+typedef struct
+{
+	/// <summary> The number of the applied frames. </summary>
+	unsigned __int64	Frames;
+	/// <summary> The number of the marked updates. </summary>
+	unsigned __int64	Updates;
+	/// <summary> The number of the updates merged into an already pending
+	///   change. They did not cost a repaint. </summary>
+	unsigned __int64	Skipped;
+	/// <summary> The last frame time in milliseconds. </summary>
+	double				LastFrameTime;
+	/// <summary> The longest frame time in milliseconds. </summary>
+	double				MaxFrameTime;
+	/// <summary> The average frame time in milliseconds. </summary>
+	double				AverageFrameTime;
+} driRenderStatistics;
+
+/// <summary> Coalesces the user interface updates. </summary>
+/// <remarks> <para> The data model marks the changed drones dirty when the
+///   messages are received. The owner calls <c>BeginFrame</c> from a timer
+///   running at <c>Interval</c>, applies all the changes accumulated since
+///   the previous frame at once and calls <c>EndFrame</c>. So the controls
+///   are updated at most <c>MaxRate</c> times per second however many
+///   messages are received. </para>
+///   <para> The scheduler is not thread safe; it is used by the UI thread
+///   only. </para> </remarks>
+class CDriRenderScheduler
+{
+	DISABLE_COPY(CDriRenderScheduler);
+
+private:
+	std::vector<size_t>		FDirty;
+	std::vector<bool>		FMarked;
+	bool					FDetailsDirty;
+	unsigned long			FMaxRate;
+
+	LARGE_INTEGER			FFrequency;
+	LARGE_INTEGER			FFrameStart;
+	double					FTotalFrameTime;
+	driRenderStatistics		FStatistics;
+
+public:
+	/// <summary> Creates new render scheduler. </summary>
+	CDriRenderScheduler();
+
+	/// <summary> Drops the pending changes and resets the
+	///   statistics. </summary>
+	void Reset();
+
+	/// <summary> Marks the drone changed. </summary>
+	/// <param name="Drone"> The drone index. </param>
+	void MarkDirty(const size_t Drone);
+	/// <summary> Marks the shown message details changed. </summary>
+	void MarkDetailsDirty();
+
+	/// <summary> Starts a frame. </summary>
+	/// <param name="Drones"> On output contains the changed drones (each
+	///   once, in the order they were marked). </param>
+	/// <param name="Details"> On output is <c>true</c> if the shown message
+	///   details changed. </param>
+	/// <returns> <c>True</c> if there are changes to apply. The caller must
+	///   call <c>EndFrame</c> when they are applied. <c>False</c> if nothing
+	///   changed since the previous frame. </returns>
+	/// <remarks> The pending changes are cleared. </remarks>
+	bool BeginFrame(std::vector<size_t>& Drones, bool& Details);
+	/// <summary> Ends the frame started by <c>BeginFrame</c> and updates
+	///   the frame time. </summary>
+	void EndFrame();
+
+	/// <summary> Gets the scheduler statistics. </summary>
+	/// <param name="Statistics"> On output contains the
+	///   statistics. </param>
+	void GetStatistics(driRenderStatistics& Statistics) const;
+
+	/// <summary> Gets the pending changes state. </summary>
+	/// <returns> <c>True</c> if there are changes not applied yet. </returns>
+	bool GetPending() const;
+	/// <summary> Gets the pending changes state. </summary>
+	/// <value> <c>True</c> if there are changes not applied yet. </value>
+	__declspec(property(get = GetPending)) bool Pending;
+
+	/// <summary> Gets the maximum refresh rate. </summary>
+	/// <returns> The frames per second. </returns>
+	unsigned long GetMaxRate() const;
+	/// <summary> Sets the maximum refresh rate. </summary>
+	/// <param name="Value"> The frames per second (1 to 100). </param>
+	/// <remarks> The owner must restart its timer with the new
+	///   <c>Interval</c>. </remarks>
+	void SetMaxRate(const unsigned long Value);
+	/// <summary> Gets and sets the maximum refresh rate. </summary>
+	/// <value> The frames per second. </value>
+	__declspec(property(get = GetMaxRate, put = SetMaxRate)) unsigned long MaxRate;
+
+	/// <summary> Gets the frame interval. </summary>
+	/// <returns> The interval in milliseconds. </returns>
+	unsigned long GetInterval() const;
+	/// <summary> Gets the frame interval. </summary>
+	/// <value> The interval in milliseconds. </value>
+	__declspec(property(get = GetInterval)) unsigned long Interval;
+};
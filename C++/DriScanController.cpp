@@ -0,0 +1,475 @@
+
+// DriScanController.cpp : implementation file
+//
+
+#include "stdafx.h"
+#include "DriScanController.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+
+// A neighbour profile must capture this much more to be preferred over the
+// current one. Keeps the controller from flapping on noise.
+#define DRI_SCAN_HYSTERESIS		1.1
+
+static double ProfileDuty(const driScanProfile& Profile)
+{
+	return (double)Profile.Window / (double)Profile.Interval;
+}
+
+
+// CDriScanController
+
+CDriScanController::CDriScanController(CwclBluetoothLeBeaconWatcher* const Watcher)
+{
+	FLock = new CDriRwLock();
+	FWatcher = Watcher;
+	FRadio = NULL;
+	FActive = false;
+	FAdaptive = true;
+	FExtended = false;
+
+	// Ordered by cost and by duty cycle within the same cost, so a lower
+	// profile never delivers more advertisements. The 100 ms intervals switch
+	// the advertising channels often; the 300 ms ones stay longer on each
+	// channel which helps with slow advertisers.
+	AddProfile(160, 16, smPassive);
+	AddProfile(160, 40, smPassive);
+	AddProfile(160, 80, smPassive);
+	AddProfile(480, 240, smPassive);
+	AddProfile(160, 80, smActive);
+	AddProfile(160, 120, smPassive);
+	AddProfile(480, 360, smPassive);
+	AddProfile(160, 160, smPassive);
+	FCurrent = 0;
+
+	FDriCount = 0;
+	FAdvertCount = 0;
+	FPeriodStart = 0;
+	FPeriods = 0;
+
+	FDwell = 15;
+	FProbeAge = 8;
+	FMaxCost = 100;
+	FMaxAdvertRate = 0;
+	FIntervalOffset = 0;
+	FDriOnly = false;
+	FCounting = false;
+
+	ZeroMemory(&FMetrics, sizeof(FMetrics));
+}
+
+CDriScanController::~CDriScanController()
+{
+	Stop();
+
+	delete FLock;
+}
+
+void CDriScanController::AddProfile(const unsigned short Interval,
+	const unsigned short Window, const wclBluetoothLeScanningMode Mode)
+{
+	driScanProfileState State;
+	State.Profile.Interval = Interval;
+	State.Profile.Window = Window;
+	State.Profile.Mode = Mode;
+	State.Cost = (unsigned long)Window * 100 / Interval;
+	if (Mode == smActive)
+		State.Cost = State.Cost * 3 / 2;
+	State.Measured = false;
+	State.Score = 0;
+	State.Period = 0;
+	FProfiles.push_back(State);
+}
+
+driScanProfile CDriScanController::Effective(const driScanProfile& Profile) const
+{
+	driScanProfile Result = Profile;
+	if (FIntervalOffset > 0)
+	{
+		unsigned long Interval = (unsigned long)Profile.Interval + FIntervalOffset;
+		if (Interval > 16384)
+			Interval = 16384;
+		Result.Interval = (unsigned short)Interval;
+		Result.Window = (unsigned short)((unsigned long)Profile.Window * Interval / Profile.Interval);
+	}
+	return Result;
+}
+
+bool CDriScanController::Allowed(const size_t Index, const double Density) const
+{
+	const driScanProfileState& State = FProfiles[Index];
+	if (State.Cost > FMaxCost)
+		return false;
+	// The advertisements rate grows with the duty cycle.
+	if (FMaxAdvertRate > 0 && FCounting && Density * ProfileDuty(State.Profile) > FMaxAdvertRate)
+		return false;
+	return true;
+}
+
+size_t CDriScanController::Choose(const double Density) const
+{
+	// The budget changed or the air got busier: go down to the first profile
+	// that fits. The cheapest profile is used if nothing fits.
+	if (!Allowed(FCurrent, Density))
+	{
+		size_t Index = FCurrent;
+		while (Index > 0 && !Allowed(Index, Density))
+			Index--;
+		return Index;
+	}
+
+	size_t Neighbours[2];
+	size_t Count = 0;
+	if (FCurrent + 1 < FProfiles.size() && Allowed(FCurrent + 1, Density))
+		Neighbours[Count++] = FCurrent + 1;
+	if (FCurrent > 0 && Allowed(FCurrent - 1, Density))
+		Neighbours[Count++] = FCurrent - 1;
+
+	// Probe the neighbours with unknown or outdated score first.
+	for (size_t i = 0; i < Count; i++)
+	{
+		const driScanProfileState& State = FProfiles[Neighbours[i]];
+		if (!State.Measured || FPeriods - State.Period >= FProbeAge)
+			return Neighbours[i];
+	}
+
+	size_t Best = FCurrent;
+	for (size_t i = 0; i < Count; i++)
+	{
+		if (FProfiles[Neighbours[i]].Score > FProfiles[Best].Score * DRI_SCAN_HYSTERESIS)
+			Best = Neighbours[i];
+	}
+	return Best;
+}
+
+int CDriScanController::Apply(const driScanProfile& Value)
+{
+	driScanProfile Profile = Effective(Value);
+	try
+	{
+		FWatcher->SetScanParametersType(ptCustom);
+		FWatcher->SetScanningMode(Profile.Mode);
+		// The window must never exceed the interval.
+		if (Profile.Interval >= FWatcher->GetScanWindow())
+		{
+			FWatcher->SetScanInterval(Profile.Interval);
+			FWatcher->SetScanWindow(Profile.Window);
+		}
+		else
+		{
+			FWatcher->SetScanWindow(Profile.Window);
+			FWatcher->SetScanInterval(Profile.Interval);
+		}
+	}
+	catch (wclException&)
+	{
+		return DRI_E_SCAN_INVALID_PROFILE;
+	}
+	return WCL_E_SUCCESS;
+}
+
+void CDriScanController::HookWatcher()
+{
+	// Counting all the advertisements costs an event call per advertisement.
+	// In a crowd almost all of them are phones and headsets.
+	FCounting = !FDriOnly;
+	if (FCounting)
+	{
+		__hook(&CwclBluetoothLeBeaconWatcher::OnAdvertisementReceived, FWatcher,
+			&CDriScanController::WatcherAdvertisementReceived);
+	}
+	__hook(&CwclBluetoothLeBeaconWatcher::OnDriAsdMessage, FWatcher,
+		&CDriScanController::WatcherDriAsdMessage);
+}
+
+void CDriScanController::UnhookWatcher()
+{
+	if (FCounting)
+	{
+		__unhook(&CwclBluetoothLeBeaconWatcher::OnAdvertisementReceived, FWatcher,
+			&CDriScanController::WatcherAdvertisementReceived);
+		FCounting = false;
+	}
+	__unhook(&CwclBluetoothLeBeaconWatcher::OnDriAsdMessage, FWatcher,
+		&CDriScanController::WatcherDriAsdMessage);
+}
+
+int CDriScanController::StartWatcher()
+{
+	FWatcher->SetAllowExtendedAdvertisements(FExtended);
+	return FWatcher->Start(FRadio);
+}
+
+void CDriScanController::SwitchTo(const size_t Index)
+{
+	// The watcher can not change the parameters while running. Stop and start
+	// it back to back, the parameters are set in between so the gap is just
+	// the radio restart time.
+	DWORD Started = GetTickCount();
+	FWatcher->Stop();
+	int Res = Apply(FProfiles[Index].Profile);
+	if (Res == WCL_E_SUCCESS)
+		Res = StartWatcher();
+	DWORD Gap = GetTickCount() - Started;
+
+	if (Res != WCL_E_SUCCESS)
+	{
+		// Return to the working profile.
+		if (Apply(FProfiles[FCurrent].Profile) != WCL_E_SUCCESS || StartWatcher() != WCL_E_SUCCESS)
+		{
+			UnhookWatcher();
+			FActive = false;
+		}
+		// Do not try the profile again until it is outdated.
+		FProfiles[Index].Measured = true;
+		FProfiles[Index].Score = 0;
+		FProfiles[Index].Period = FPeriods;
+		return;
+	}
+
+	FCurrent = Index;
+	FPeriodStart = GetTickCount();
+	InterlockedExchange(&FDriCount, 0);
+	InterlockedExchange(&FAdvertCount, 0);
+
+	driScanMetrics Metrics;
+	FLock->Enter();
+	FMetrics.Profile = (unsigned long)FCurrent;
+	FMetrics.Parameters = Effective(FProfiles[FCurrent].Profile);
+	FMetrics.Duty = (unsigned long)(ProfileDuty(FMetrics.Parameters) * 100);
+	FMetrics.Restarts++;
+	FMetrics.LastGap = Gap;
+	if (Gap > FMetrics.MaxGap)
+		FMetrics.MaxGap = Gap;
+	Metrics = FMetrics;
+	FLock->Leave();
+
+	DoProfileChanged(Metrics);
+}
+
+void CDriScanController::UpdateMetrics(const double DriRate,
+	const double AdvertRate, const LONG Dri, const LONG Adverts)
+{
+	FLock->Enter();
+	FMetrics.DriRate = DriRate;
+	FMetrics.AdvertRate = AdvertRate;
+	FMetrics.DriTotal += Dri;
+	FMetrics.AdvertTotal += Adverts;
+	FLock->Leave();
+}
+
+void CDriScanController::WatcherAdvertisementReceived(void* Sender,
+	const __int64 Address, const __int64 Timestamp, const char Rssi,
+	const wclBluetoothLeAdvertisementFrameRawData& Data)
+{
+	UNREFERENCED_PARAMETER(Sender);
+	UNREFERENCED_PARAMETER(Address);
+	UNREFERENCED_PARAMETER(Timestamp);
+	UNREFERENCED_PARAMETER(Rssi);
+	UNREFERENCED_PARAMETER(Data);
+
+	InterlockedIncrement(&FAdvertCount);
+}
+
+void CDriScanController::WatcherDriAsdMessage(void* Sender,
+	const __int64 Address, const __int64 Timestamp, const char Rssi,
+	const wclDriRawData& Raw)
+{
+	UNREFERENCED_PARAMETER(Sender);
+	UNREFERENCED_PARAMETER(Address);
+	UNREFERENCED_PARAMETER(Timestamp);
+	UNREFERENCED_PARAMETER(Rssi);
+	UNREFERENCED_PARAMETER(Raw);
+
+	InterlockedIncrement(&FDriCount);
+}
+
+void CDriScanController::DoProfileChanged(const driScanMetrics& Metrics)
+{
+	OnProfileChanged(this, Metrics);
+}
+
+int CDriScanController::Start(CwclBluetoothRadio* const Radio)
+{
+	if (Radio == NULL)
+		return WCL_E_INVALID_ARGUMENT;
+	if (FActive)
+		return DRI_E_SCAN_ACTIVE;
+
+	FRadio = Radio;
+	for (size_t i = 0; i < FProfiles.size(); i++)
+	{
+		FProfiles[i].Measured = false;
+		FProfiles[i].Score = 0;
+		FProfiles[i].Period = 0;
+	}
+
+	// Nothing is known about the air yet: start with the most expensive
+	// profile within the budget.
+	FCurrent = FProfiles.size() - 1;
+	while (FCurrent > 0 && !Allowed(FCurrent, 0))
+		FCurrent--;
+
+	HookWatcher();
+
+	int Res = Apply(FProfiles[FCurrent].Profile);
+	if (Res == WCL_E_SUCCESS)
+	{
+		// Not all the radios support extended advertisements.
+		FExtended = true;
+		Res = StartWatcher();
+		if (Res != WCL_E_SUCCESS)
+		{
+			FExtended = false;
+			Res = StartWatcher();
+		}
+	}
+
+	if (Res != WCL_E_SUCCESS)
+	{
+		UnhookWatcher();
+		FRadio = NULL;
+	}
+	else
+	{
+		FActive = true;
+		FDriCount = 0;
+		FAdvertCount = 0;
+		FPeriodStart = GetTickCount();
+		FPeriods = 0;
+
+		FLock->Enter();
+		ZeroMemory(&FMetrics, sizeof(FMetrics));
+		FMetrics.Profile = (unsigned long)FCurrent;
+		FMetrics.Parameters = Effective(FProfiles[FCurrent].Profile);
+		FMetrics.Duty = (unsigned long)(ProfileDuty(FMetrics.Parameters) * 100);
+		FLock->Leave();
+	}
+	return Res;
+}
+
+int CDriScanController::Stop()
+{
+	if (!FActive)
+		return DRI_E_SCAN_NOT_ACTIVE;
+
+	UnhookWatcher();
+
+	FActive = false;
+	FRadio = NULL;
+	return FWatcher->Stop();
+}
+
+void CDriScanController::Tick()
+{
+	if (!FActive)
+		return;
+
+	DWORD Elapsed = GetTickCount() - FPeriodStart;
+	if (Elapsed < FDwell * 1000)
+		return;
+
+	LONG Dri = InterlockedExchange(&FDriCount, 0);
+	LONG Adverts = InterlockedExchange(&FAdvertCount, 0);
+	double DriRate = Dri * 1000.0 / Elapsed;
+	double AdvertRate = Adverts * 1000.0 / Elapsed;
+	UpdateMetrics(DriRate, AdvertRate, Dri, Adverts);
+
+	FPeriods++;
+	FPeriodStart = GetTickCount();
+
+	driScanProfileState& State = FProfiles[FCurrent];
+	if (State.Measured)
+		State.Score = (State.Score + DriRate) / 2;
+	else
+		State.Score = DriRate;
+	State.Measured = true;
+	State.Period = FPeriods;
+
+	if (FAdaptive)
+	{
+		// The advertisements per second per 100% duty cycle.
+		double Density = AdvertRate / ProfileDuty(State.Profile);
+		size_t Index = Choose(Density);
+		if (Index != FCurrent)
+			SwitchTo(Index);
+	}
+}
+
+void CDriScanController::GetMetrics(driScanMetrics& Metrics) const
+{
+	FLock->EnterShared();
+	Metrics = FMetrics;
+	FLock->LeaveShared();
+}
+
+bool CDriScanController::GetActive() const
+{
+	return FActive;
+}
+
+bool CDriScanController::GetAdaptive() const
+{
+	return FAdaptive;
+}
+
+void CDriScanController::SetAdaptive(const bool Value)
+{
+	FAdaptive = Value;
+}
+
+unsigned long CDriScanController::GetDwell() const
+{
+	return FDwell;
+}
+
+void CDriScanController::SetDwell(const unsigned long Value)
+{
+	if (Value > 0)
+		FDwell = Value;
+}
+
+unsigned long CDriScanController::GetMaxCost() const
+{
+	return FMaxCost;
+}
+
+void CDriScanController::SetMaxCost(const unsigned long Value)
+{
+	FMaxCost = Value;
+}
+
+unsigned long CDriScanController::GetMaxAdvertRate() const
+{
+	return FMaxAdvertRate;
+}
+
+void CDriScanController::SetMaxAdvertRate(const unsigned long Value)
+{
+	FMaxAdvertRate = Value;
+}
+
+unsigned short CDriScanController::GetIntervalOffset() const
+{
+	return FIntervalOffset;
+}
+
+void CDriScanController::SetIntervalOffset(const unsigned short Value)
+{
+	if (!FActive)
+		FIntervalOffset = Value;
+}
+
+bool CDriScanController::GetDriOnly() const
+{
+	return FDriOnly;
+}
+
+void CDriScanController::SetDriOnly(const bool Value)
+{
+	if (!FActive)
+		FDriOnly = Value;
+}
@@ -0,0 +1,263 @@
+
+// DriScanController.h : header file
+//
+
+#pragma once
+
+#include <vector>
+
+#include "wclHelpers.h"
+#include "wclSync.h"
+#include "wclBluetooth.h"
+#include "wclDriCommon.h"
+
+#include "DriErrors.h"
+#include "DriSync.h"
+
+using namespace wclCommon;
+using namespace wclSync;
+using namespace wclBluetooth;
+using namespace wclDri;
+
+/// <summary> The Bluetooth LE scan profile. </summary>
+typedef struct
+{
+	/// <summary> The scan interval in 0.625 ms units. </summary>
+	unsigned short				Interval;
+	/// <summary> The scan window in 0.625 ms units. </summary>
+	unsigned short				Window;
+	wclBluetoothLeScanningMode	Mode;
+} driScanProfile;
+
+/// <summary> The scan controller metrics. </summary>
+typedef struct
+{
+	/// <summary> The current profile index. </summary>
+	unsigned long				Profile;
+	/// <summary> The current scan parameters. </summary>
+	driScanProfile				Parameters;
+	/// <summary> The radio duty cycle of the current profile in
+	///   percents. </summary>
+	unsigned long				Duty;
+	/// <summary> The DRI advertisements per second measured during the last
+	///   period. </summary>
+	double						DriRate;
+	/// <summary> All the advertisements per second measured during the last
+	///   period (the RF congestion). 0 in the DRI only mode. </summary>
+	double						AdvertRate;
+	/// <summary> The total number of DRI advertisements received. </summary>
+	unsigned __int64			DriTotal;
+	/// <summary> The total number of advertisements received. </summary>
+	unsigned __int64			AdvertTotal;
+	/// <summary> The number of watcher restarts made to change the
+	///   profile. </summary>
+	unsigned long				Restarts;
+	/// <summary> The scan gap of the last restart in milliseconds. </summary>
+	unsigned long				LastGap;
+	/// <summary> The longest scan gap in milliseconds. </summary>
+	unsigned long				MaxGap;
+} driScanMetrics;
+
+/// <summary> Adapts the Bluetooth LE scan parameters to the DRI traffic. </summary>
+/// <remarks> <para> The controller runs the beacon watcher with one of the
+///   predefined scan profiles (interval, window and scanning mode) ordered by
+///   the radio cost and the duty cycle. Every <c>Dwell</c> seconds it measures the DRI and the
+///   total advertisement rates of the current profile and hill-climbs to a
+///   neighbour profile that captures more DRI advertisements. Neighbours that
+///   were not measured recently are probed. Profiles over the cost budget
+///   (<c>MaxCost</c>) or that are expected to deliver more advertisements
+///   than <c>MaxAdvertRate</c> (the CPU budget) are never used. </para>
+///   <para> The radio cost of a profile is its duty cycle in percents; active
+///   scanning costs 1.5 times more as it transmits scan requests. </para>
+///   <para> <c>Tick</c> must be called periodically (once a second is
+///   enough) from the thread that owns the watcher. </para> </remarks>
+class CDriScanController
+{
+	DISABLE_COPY(CDriScanController);
+
+private:
+	typedef struct
+	{
+		driScanProfile	Profile;
+		unsigned long	Cost;
+		bool			Measured;
+		double			Score;
+		unsigned long	Period;
+	} driScanProfileState;
+
+	CDriRwLock*							FLock;
+	CwclBluetoothLeBeaconWatcher*		FWatcher;
+	CwclBluetoothRadio*					FRadio;
+	bool								FActive;
+	bool								FAdaptive;
+	bool								FExtended;
+
+	std::vector<driScanProfileState>	FProfiles;
+	size_t								FCurrent;
+
+	volatile LONG						FDriCount;
+	volatile LONG						FAdvertCount;
+	DWORD								FPeriodStart;
+	unsigned long						FPeriods;
+
+	unsigned long						FDwell;
+	unsigned long						FProbeAge;
+	unsigned long						FMaxCost;
+	unsigned long						FMaxAdvertRate;
+	unsigned short						FIntervalOffset;
+	bool								FDriOnly;
+	bool								FCounting;
+
+	driScanMetrics						FMetrics;
+
+	void AddProfile(const unsigned short Interval, const unsigned short Window,
+		const wclBluetoothLeScanningMode Mode);
+	driScanProfile Effective(const driScanProfile& Profile) const;
+	bool Allowed(const size_t Index, const double Density) const;
+	size_t Choose(const double Density) const;
+	int Apply(const driScanProfile& Profile);
+	void HookWatcher();
+	void UnhookWatcher();
+	int StartWatcher();
+	void SwitchTo(const size_t Index);
+	void UpdateMetrics(const double DriRate, const double AdvertRate,
+		const LONG Dri, const LONG Adverts);
+
+	void WatcherAdvertisementReceived(void* Sender, const __int64 Address,
+		const __int64 Timestamp, const char Rssi,
+		const wclBluetoothLeAdvertisementFrameRawData& Data);
+	void WatcherDriAsdMessage(void* Sender, const __int64 Address,
+		const __int64 Timestamp, const char Rssi, const wclDriRawData& Raw);
+
+protected:
+	/// <summary> Fires the <c>OnProfileChanged</c> event. </summary>
+	/// <param name="Metrics"> The controller metrics after the
+	///   switch. </param>
+	virtual void DoProfileChanged(const driScanMetrics& Metrics);
+
+public:
+	/// <summary> Creates new scan controller. </summary>
+	/// <param name="Watcher"> The beacon watcher to control. </param>
+	CDriScanController(CwclBluetoothLeBeaconWatcher* const Watcher);
+	/// <summary> Stops the controller and frees the object. </summary>
+	virtual ~CDriScanController();
+
+	/// <summary> Starts the watcher on the radio. </summary>
+	/// <param name="Radio"> The Bluetooth LE radio. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	/// <remarks> The watcher starts with the most expensive profile within the
+	///   budget. </remarks>
+	int Start(CwclBluetoothRadio* const Radio);
+	/// <summary> Stops the watcher. </summary>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Stop();
+
+	/// <summary> Measures the rates and retunes the watcher when the dwell
+	///   time of the current profile expired. </summary>
+	void Tick();
+
+	/// <summary> Gets the controller metrics. </summary>
+	/// <param name="Metrics"> On output contains the metrics. </param>
+	void GetMetrics(driScanMetrics& Metrics) const;
+
+	/// <summary> Gets the controller state. </summary>
+	/// <returns> <c>True</c> if the watcher is controlled. </returns>
+	bool GetActive() const;
+	/// <summary> Gets the controller state. </summary>
+	/// <value> <c>True</c> if the watcher is controlled. </value>
+	__declspec(property(get = GetActive)) bool Active;
+
+	/// <summary> Gets the adaptation mode. </summary>
+	/// <returns> <c>True</c> if the profiles are changed
+	///   automatically. </returns>
+	bool GetAdaptive() const;
+	/// <summary> Sets the adaptation mode. </summary>
+	/// <param name="Value"> <c>True</c> to change the profiles
+	///   automatically. <c>False</c> to keep the current profile and only
+	///   measure the rates. </param>
+	void SetAdaptive(const bool Value);
+	/// <summary> Gets and sets the adaptation mode. </summary>
+	/// <value> <c>True</c> if the profiles are changed
+	///   automatically. </value>
+	__declspec(property(get = GetAdaptive, put = SetAdaptive)) bool Adaptive;
+
+	/// <summary> Gets the profile dwell time. </summary>
+	/// <returns> The dwell time in seconds. </returns>
+	unsigned long GetDwell() const;
+	/// <summary> Sets the profile dwell time. </summary>
+	/// <param name="Value"> The dwell time in seconds. Must be at least 1
+	///   second. </param>
+	void SetDwell(const unsigned long Value);
+	/// <summary> Gets and sets the profile dwell time. </summary>
+	/// <value> The dwell time in seconds. </value>
+	__declspec(property(get = GetDwell, put = SetDwell)) unsigned long Dwell;
+
+	/// <summary> Gets the radio cost budget. </summary>
+	/// <returns> The maximum profile cost. </returns>
+	unsigned long GetMaxCost() const;
+	/// <summary> Sets the radio cost budget. </summary>
+	/// <param name="Value"> The maximum profile cost: the duty cycle in percents
+	///   (1.5 times more for active scanning). </param>
+	void SetMaxCost(const unsigned long Value);
+	/// <summary> Gets and sets the radio cost budget. </summary>
+	/// <value> The maximum profile cost. </value>
+	__declspec(property(get = GetMaxCost, put = SetMaxCost)) unsigned long MaxCost;
+
+	/// <summary> Gets the CPU budget. </summary>
+	/// <returns> The maximum advertisements per second. 0 means no
+	///   limit. </returns>
+	unsigned long GetMaxAdvertRate() const;
+	/// <summary> Sets the CPU budget. </summary>
+	/// <param name="Value"> The maximum advertisements per second. 0 means no
+	///   limit. </param>
+	/// <remarks> The budget is not applied in the <c>DriOnly</c> mode as the
+	///   advertisements are not counted. </remarks>
+	void SetMaxAdvertRate(const unsigned long Value);
+	/// <summary> Gets and sets the CPU budget. </summary>
+	/// <value> The maximum advertisements per second. 0 means no
+	///   limit. </value>
+	__declspec(property(get = GetMaxAdvertRate, put = SetMaxAdvertRate))
+		unsigned long MaxAdvertRate;
+
+	/// <summary> Gets the scan interval offset. </summary>
+	/// <returns> The offset in 0.625 ms units. </returns>
+	unsigned short GetIntervalOffset() const;
+	/// <summary> Sets the scan interval offset. </summary>
+	/// <param name="Value"> The offset in 0.625 ms units added to the interval
+	///   of every profile (the window is scaled to keep the duty cycle). Can be
+	///   changed only when the controller is not active. </param>
+	/// <remarks> Radios scanning with different intervals change the
+	///   advertising channels at different moments so several radios running
+	///   at the same time cover more channels at once. </remarks>
+	void SetIntervalOffset(const unsigned short Value);
+	/// <summary> Gets and sets the scan interval offset. </summary>
+	/// <value> The offset in 0.625 ms units. </value>
+	__declspec(property(get = GetIntervalOffset, put = SetIntervalOffset))
+		unsigned short IntervalOffset;
+
+	/// <summary> Gets the DRI only mode. </summary>
+	/// <returns> <c>True</c> if only the DRI advertisements are
+	///   handled. </returns>
+	bool GetDriOnly() const;
+	/// <summary> Sets the DRI only mode. </summary>
+	/// <param name="Value"> <c>True</c> to handle only the DRI advertisements.
+	///   The other advertisements are not counted so <c>AdvertRate</c> is 0.
+	///   <c>False</c> to count all the advertisements. Can be changed only when
+	///   the controller is not active. </param>
+	void SetDriOnly(const bool Value);
+	/// <summary> Gets and sets the DRI only mode. </summary>
+	/// <value> <c>True</c> if only the DRI advertisements are
+	///   handled. </value>
+	__declspec(property(get = GetDriOnly, put = SetDriOnly)) bool DriOnly;
+
+	/// <summary> The event fires when the controller switched the watcher to
+	///   other scan profile. </summary>
+	/// <param name="Sender"> The object initiates the event. </param>
+	/// <param name="Metrics"> The controller metrics after the
+	///   switch. </param>
+	__event void OnProfileChanged(void* Sender, const driScanMetrics& Metrics);
+};
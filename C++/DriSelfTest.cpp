@@ -0,0 +1,1502 @@
+
+// DriSelfTest.cpp : implementation file
+//
+
+#include "stdafx.h"
+#include "DriSelfTest.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include "DriAsterix.h"
+#include "DriCaptureLog.h"
+#include "DriExport.h"
+#include "DriFormat.h"
+#include "DriLocate.h"
+#include "DriQueryServer.h"
+#include "DriSharedTable.h"
+#include "DriTrackArchive.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+
+// The longest wait for an answer in milliseconds.
+#define DRI_SELFTEST_TIMEOUT		5000
+// The number of the drones the query server test feeds. More than the
+// remembered removals so clearing the picture resets the event streams.
+#define DRI_SELFTEST_QUERY_DRONES	(DRI_PICTURE_REMOVALS + 44)
+// The size of one send of the endless request header.
+#define DRI_SELFTEST_GARBAGE_SIZE	4096
+// The number of the Location messages the format check sweeps.
+#define DRI_SELFTEST_FORMAT_VALUES	200000
+// The temporary track archive.
+#define DRI_SELFTEST_TRACK_FILE		_T("DriSelfTest.trk")
+// The number of the drones and the samples per drone of the track archive
+// check. 10 samples per second: more than one chunk span per drone.
+#define DRI_SELFTEST_TRACK_DRONES	3
+#define DRI_SELFTEST_TRACK_SAMPLES	5000
+// The key the first drone has before its UAS ID is known and the sample
+// the ID comes with.
+#define DRI_SELFTEST_TRACK_ADDRESS	0x0000A1B2C3D4E5F6
+#define DRI_SELFTEST_TRACK_REKEY	20
+#define DRI_SELFTEST_CAPTURE_FILE	_T("DriSelfTest.cap")
+// The number of the frames of the capture log benchmark.
+#define DRI_SELFTEST_CAPTURE_FRAMES	1000000
+// The sync interval of the capture log test.
+#define DRI_SELFTEST_CAPTURE_SYNC	1000
+// The surveillance block size of the ASTERIX test: one UDP datagram.
+#define DRI_SELFTEST_ASTERIX_BLOCK	1400
+// The number of the drones split into the blocks. More than one largest
+// block holds.
+#define DRI_SELFTEST_ASTERIX_DRONES	1000
+// The sensor identification of the ASTERIX test.
+#define DRI_SELFTEST_ASTERIX_SOURCE	0x1234
+// The number of the locator test sensors: on a circle of 1 km around 47N 8E.
+#define DRI_SELFTEST_LOCATE_SENSORS	4
+// The allowed error of the noise free location in meters.
+#define DRI_SELFTEST_LOCATE_ERROR	10.0
+// The shared drone table of the self test (a POSIX shared memory object
+// out of Windows).
+#define DRI_SELFTEST_TABLE_NAME		_T("DroneRemoteIdSelfTest")
+#define DRI_SELFTEST_TABLE_SLOTS	4
+// The number of the reads racing the writer.
+#define DRI_SELFTEST_TABLE_READS	1000000
+// The export benchmark: the post rate per second and the number of the
+// posted messages.
+#define DRI_SELFTEST_EXPORT_RATE	50000
+#define DRI_SELFTEST_EXPORT_MESSAGES	100000
+// The number of the drones of the binary export check.
+#define DRI_SELFTEST_EXPORT_DRONES	250
+// The socket receive buffer of the export sink.
+#define DRI_SELFTEST_EXPORT_BUFFER	(4 * 1024 * 1024)
+
+static void PutWord(wclDriRawData& Data, const size_t Offset, const unsigned short Value)
+{
+	// The ASD messages are little endian.
+	Data[Offset] = (unsigned char)Value;
+	Data[Offset + 1] = (unsigned char)(Value >> 8);
+}
+
+static void PutLong(wclDriRawData& Data, const size_t Offset, const long Value)
+{
+	PutWord(Data, Offset, (unsigned short)Value);
+	PutWord(Data, Offset + 2, (unsigned short)((unsigned long)Value >> 16));
+}
+
+static long Degrees(const double Value)
+{
+	// 1e-7 degree units.
+	return (long)((Value < 0) ? Value * 10000000.0 - 0.5 : Value * 10000000.0 + 0.5);
+}
+
+static unsigned short Altitude(const float Value)
+{
+	// 0.5 m units from -1000 m.
+	return (unsigned short)((Value + 1000.0f) * 2.0f + 0.5f);
+}
+
+// Builds the raw ASD Location message (ASTM F3411): airborne, heading 90,
+// 5 m/s and the height of 50 m.
+static void LocationData(const double Latitude, const double Longitude,
+	const float GeoAltitude, wclDriRawData& Data)
+{
+	Data.assign(25, 0);
+	// The message type and the protocol version.
+	Data[0] = (mtLocation << 4) | 2;
+	// The status; the height over the take off point, east direction, the
+	// speed multiplier is 0.25.
+	Data[1] = (usAirborne << 4);
+	Data[2] = 90;
+	Data[3] = 20;
+	Data[4] = 0;
+	PutLong(Data, 5, Degrees(Latitude));
+	PutLong(Data, 9, Degrees(Longitude));
+	PutWord(Data, 13, Altitude(GeoAltitude));
+	PutWord(Data, 15, Altitude(GeoAltitude));
+	PutWord(Data, 17, Altitude(50.0f));
+	Data[19] = (va3M << 4) | ha3M;
+	Data[20] = (va3M << 4) | sa1Ms;
+	PutWord(Data, 21, 0);
+	Data[23] = ta01s;
+}
+
+static __int64 FileTimeNow()
+{
+	FILETIME Now;
+	GetSystemTimeAsFileTime(&Now);
+	return (__int64)(((unsigned __int64)Now.dwHighDateTime << 32) | Now.dwLowDateTime);
+}
+
+static double Seconds(const LARGE_INTEGER& Start)
+{
+	LARGE_INTEGER Now;
+	LARGE_INTEGER Frequency;
+	QueryPerformanceCounter(&Now);
+	QueryPerformanceFrequency(&Frequency);
+	return (double)(Now.QuadPart - Start.QuadPart) / (double)Frequency.QuadPart;
+}
+
+// Feeds the Location of the drone "drone <Index>" near 47N 8E.
+static void FeedDrone(CDriPicture& Picture, const unsigned long Index)
+{
+	wclDriRawData Data;
+	LocationData(47.0 + Index * 0.0001, 8.0 + Index * 0.0001, 450.0f, Data);
+	CwclDriAsdLocationMessage Location(0, Data);
+
+	driFrame Frame;
+	Frame.Transport = ctBluetooth;
+	Frame.Radio = 0;
+	Frame.Source = Index;
+	Frame.Timestamp = FileTimeNow();
+	Frame.Rssi = -60;
+	Frame.Raw = &Data;
+
+	TCHAR Name[32];
+	_stprintf_s(Name, 32, _T("drone %u"), (unsigned int)Index);
+	Picture.Update(Frame, Name, &Location);
+}
+
+// Compares the formatted row with the CRT "%f" output.
+static bool SameAsCrt(const driDetailRows& Rows, const TCHAR* const Name,
+	const double Value, const bool Invalid)
+{
+	TCHAR Expected[64];
+	if (Invalid)
+		_tcscpy_s(Expected, 64, _T("Invalid"));
+	else
+		_stprintf_s(Expected, 64, _T("%f"), Value);
+	for (driDetailRows::const_iterator Row = Rows.begin(); Row != Rows.end(); Row++)
+	{
+		if (_tcscmp(Row->Name, Name) == 0)
+			return (Row->Value == Expected);
+	}
+	return false;
+}
+
+// Builds a sample with the values the archive keeps exactly.
+static void TrackSample(const __int64 DroneKey, const unsigned long Index,
+	unsigned long& Random, driTrackSample& Sample)
+{
+	Random = Random * 1103515245 + 12345;
+	long Jump = (long)((Random >> 16) % 2001) - 1000;
+	Sample.DroneKey = DroneKey;
+	// 100 ms apart with some jitter, in whole milliseconds.
+	Sample.Timestamp = (13300000000000 + Index * 100 + ((Random >> 28) & 0x0F)) * 10000;
+	Sample.Latitude = (double)(470000000 + (long)Index * 7 + Jump) / 10000000.0;
+	Sample.Longitude = (double)(-80000000 - (long)Index * 11 + Jump) / 10000000.0;
+	Sample.GeoAltitude = (float)((long)(Index % 900) - 100) / 2;
+	Sample.Height = (float)(Jump / 4) / 2;
+	Sample.HorizontalSpeed = (Index % 50 == 0) ? 255.0f : (float)(Index % 200) / 4;
+	Sample.VerticalSpeed = (float)(Jump % 63) / 2;
+	Sample.Direction = (unsigned short)(Index % 362);
+	Sample.Status = (unsigned char)(Random >> 24) & 0x0F;
+	Sample.HeightReference = (unsigned char)(Index & 1);
+	Sample.HorizontalAccuracy = (unsigned char)(Index % 13);
+}
+
+static bool SameSample(const driTrackSample& a, const driTrackSample& b)
+{
+	return (a.DroneKey == b.DroneKey && a.Timestamp == b.Timestamp &&
+		a.Latitude == b.Latitude && a.Longitude == b.Longitude &&
+		a.GeoAltitude == b.GeoAltitude && a.Height == b.Height &&
+		a.HorizontalSpeed == b.HorizontalSpeed && a.VerticalSpeed == b.VerticalSpeed &&
+		a.Direction == b.Direction && a.Status == b.Status &&
+		a.HeightReference == b.HeightReference &&
+		a.HorizontalAccuracy == b.HorizontalAccuracy);
+}
+
+// Reads the track of the drone and compares it with the written one.
+static bool SameTrack(CDriTrackArchiveReader& Reader, const __int64 DroneKey,
+	const std::vector<driTrackSample>& Written, const size_t Count)
+{
+	driTrackQuery Query;
+	ZeroMemory(&Query, sizeof(Query));
+	Query.From = 0;
+	Query.To = MAXLONGLONG;
+	Query.Filtered = true;
+	Query.DroneKey = DroneKey;
+	std::vector<driTrackSample> Samples;
+	if (Reader.Select(Query, DRI_TRACK_ALL_COLUMNS, Samples) != WCL_E_SUCCESS ||
+		Samples.size() != Count)
+	{
+		return false;
+	}
+	for (size_t i = 0; i < Count; i++)
+	{
+		if (!SameSample(Samples[i], Written[i]))
+			return false;
+	}
+	return true;
+}
+
+static bool CutFile(const tstring& FileName, const unsigned __int64 Size)
+{
+	HANDLE File = CreateFile(FileName.c_str(), GENERIC_WRITE, 0, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	if (File == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER Position;
+	Position.QuadPart = (LONGLONG)Size;
+	bool Result = (SetFilePointerEx(File, Position, NULL, FILE_BEGIN) &&
+		SetEndOfFile(File));
+	CloseHandle(File);
+	return Result;
+}
+
+static bool PatchFile(const tstring& FileName, const unsigned __int64 Offset,
+	const void* const Data, const DWORD Size)
+{
+	HANDLE File = CreateFile(FileName.c_str(), GENERIC_WRITE, 0, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	if (File == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER Position;
+	Position.QuadPart = (LONGLONG)Offset;
+	DWORD Written = 0;
+	bool Result = (SetFilePointerEx(File, Position, NULL, FILE_BEGIN) &&
+		WriteFile(File, Data, Size, &Written, NULL) && Written == Size);
+	CloseHandle(File);
+	return Result;
+}
+
+// The raw frame of the capture log test: 25 to 56 bytes that tell the
+// index.
+static size_t CaptureFrame(const unsigned long Index, unsigned char* const Data)
+{
+	size_t Length = 25 + Index % 32;
+	for (size_t i = 0; i < Length; i++)
+		Data[i] = (unsigned char)(Index + i * 7);
+	return Length;
+}
+
+// Reads the whole capture log and compares the frames with the written ones.
+static bool SameCapture(CDriCaptureLogReader& Reader, const unsigned long Count)
+{
+	unsigned char Expected[64];
+	unsigned __int64 Position = Reader.First();
+	driCaptureFrame Frame;
+	unsigned long Index = 0;
+	int Res;
+	while ((Res = Reader.Next(Position, Frame)) == WCL_E_SUCCESS)
+	{
+		size_t Length = CaptureFrame(Index, Expected);
+		if (Index >= Count || Frame.Length != Length || memcmp(Frame.Data, Expected, Length) != 0 ||
+			Frame.Source != (__int64)Index || Frame.Timestamp != (__int64)Index * 1000 ||
+			Frame.Transport != (driCaptureTransport)(Index & 1))
+		{
+			return false;
+		}
+		Index++;
+	}
+	return (Res == DRI_E_LOG_EOF && Index == Count);
+}
+
+// Builds the raw ASD message with the ID at the offset 2: the Basic ID or the
+// Operator ID.
+static void IdData(const wclDriAsdMessageType MessageType, const unsigned char Type,
+	const char* const Id, wclDriRawData& Data)
+{
+	Data.assign(25, 0);
+	Data[0] = (unsigned char)((MessageType << 4) | 2);
+	Data[1] = Type;
+	CopyMemory(&Data[2], Id, min(strlen(Id), (size_t)DRI_ASTERIX_ID_SIZE));
+}
+
+// Builds the raw ASD System message: EU classification, the take off
+// location, one aircraft in the area of 50 m from 0 m to 120 m.
+static void SystemData(const double Latitude, const double Longitude, wclDriRawData& Data)
+{
+	Data.assign(25, 0);
+	Data[0] = (mtSystem << 4) | 2;
+	Data[1] = (1 << 2) | 1;
+	PutLong(Data, 2, Degrees(Latitude));
+	PutLong(Data, 6, Degrees(Longitude));
+	PutWord(Data, 10, 1);
+	Data[12] = 5;
+	PutWord(Data, 13, Altitude(120.0f));
+	PutWord(Data, 15, Altitude(0.0f));
+	Data[17] = (1 << 4) | 2;
+	PutWord(Data, 18, Altitude(430.0f));
+}
+
+// Fills the drone "drone <Index>" with the messages of the Mask bits: 1 -
+// Basic ID, 2 - Location, 4 - System, 8 - Operator ID. The invalid drone has
+// no position, no altitudes and no operator position.
+static void AsterixDrone(const unsigned long Index, const unsigned long Mask,
+	const bool Invalid, driDrone& Drone)
+{
+	TCHAR Name[32];
+	_stprintf_s(Name, 32, _T("drone %u"), (unsigned int)Index);
+	Drone.Ssid = Name;
+	for (size_t Slot = 0; Slot < DRI_MESSAGE_SLOTS; Slot++)
+	{
+		Drone.Slots[Slot].Message = NULL;
+		Drone.Slots[Slot].Formatted = false;
+	}
+
+	char Id[32];
+	wclDriRawData Data;
+	if ((Mask & 1) != 0)
+	{
+		sprintf_s(Id, 32, "SN%05u", (unsigned int)Index);
+		IdData(mtBasicId, (1 << 4) | utCopter, Id, Data);
+		Drone.Slots[CDriDroneList::SlotOf(mtBasicId)].Message = new CwclDriAsdBasicIdMessage(0, Data);
+	}
+	if ((Mask & 2) != 0)
+	{
+		if (Invalid)
+		{
+			LocationData(0, 0, -1000.0f, Data);
+			PutWord(Data, 17, Altitude(-1000.0f));
+		}
+		else
+			LocationData(47.0 + Index * 0.001, 8.0 - Index * 0.001, 450.0f + Index, Data);
+		// The unknown speed, the climb and the descent.
+		Data[3] = (unsigned char)(Index * 7);
+		Data[4] = (unsigned char)(Index % 41) - 20;
+		Drone.Slots[CDriDroneList::SlotOf(mtLocation)].Message = new CwclDriAsdLocationMessage(0, Data);
+	}
+	if ((Mask & 4) != 0)
+	{
+		if (Invalid)
+			SystemData(0, 0, Data);
+		else
+			SystemData(-33.0 - Index * 0.001, 151.0 + Index * 0.001, Data);
+		Drone.Slots[CDriDroneList::SlotOf(mtSystem)].Message = new CwclDriAsdSystemMessage(0, Data);
+	}
+	if ((Mask & 8) != 0)
+	{
+		sprintf_s(Id, 32, "OP%05u", (unsigned int)Index);
+		IdData(mtOperatorId, 0, Id, Data);
+		Drone.Slots[CDriDroneList::SlotOf(mtOperatorId)].Message = new CwclDriAsdOperatorIdMessage(0, Data);
+	}
+}
+
+static void FreeDrone(driDrone& Drone)
+{
+	for (size_t Slot = 0; Slot < DRI_MESSAGE_SLOTS; Slot++)
+	{
+		delete Drone.Slots[Slot].Message;
+		Drone.Slots[Slot].Message = NULL;
+	}
+}
+
+static bool SameText(const char* const Text, const wclDriAsdId& Id)
+{
+	return (strncmp(Text, (const char*)&Id[0], DRI_ASTERIX_ID_SIZE) == 0);
+}
+
+// Compares the decoded target with the messages of the drone "drone <Index>".
+static bool SameTarget(const driAsterixTarget& Target, const unsigned long Index,
+	const driDrone& Drone, const unsigned long TimeOfDay)
+{
+	const CwclDriAsdBasicIdMessage* Basic = (const CwclDriAsdBasicIdMessage*)Drone.Slots[CDriDroneList::SlotOf(mtBasicId)].Message;
+	const CwclDriAsdLocationMessage* Location = (const CwclDriAsdLocationMessage*)Drone.Slots[CDriDroneList::SlotOf(mtLocation)].Message;
+	const CwclDriAsdSystemMessage* System = (const CwclDriAsdSystemMessage*)Drone.Slots[CDriDroneList::SlotOf(mtSystem)].Message;
+	const CwclDriAsdOperatorIdMessage* Operator = (const CwclDriAsdOperatorIdMessage*)Drone.Slots[CDriDroneList::SlotOf(mtOperatorId)].Message;
+
+	char Name[DRI_ASTERIX_NAME_SIZE + 1];
+	sprintf_s(Name, DRI_ASTERIX_NAME_SIZE + 1, "drone %u", (unsigned int)Index);
+	if (Target.Source != DRI_SELFTEST_ASTERIX_SOURCE || Target.Target != (unsigned short)Index ||
+		Target.TimeOfDay != TimeOfDay || strcmp(Target.Name, Name) != 0)
+	{
+		return false;
+	}
+
+	// The invalid values must be left out, not sent.
+	unsigned long Items = (1 << aiSource) | (1 << aiTarget) | (1 << aiTimeOfDay) | (1 << aiName);
+	if (Basic != NULL)
+	{
+		Items |= (1 << aiBasicId);
+		if (Target.IdType != (unsigned char)Basic->IdType ||
+			Target.UavType != (unsigned char)Basic->UavType || !SameText(Target.Id, Basic->Id))
+		{
+			return false;
+		}
+	}
+	if (Location != NULL)
+	{
+		Items |= (1 << aiVelocity) | (1 << aiStatus);
+		if (Location->Latitude != 0 || Location->Longitude != 0)
+		{
+			Items |= (1 << aiPosition);
+			if (fabs(Target.Latitude - Location->Latitude) > 1e-9 ||
+				fabs(Target.Longitude - Location->Longitude) > 1e-9)
+			{
+				return false;
+			}
+		}
+		if (Location->GeoAltitude != -1000 || Location->BaroAltitude != -1000 ||
+			Location->Height != -1000)
+		{
+			Items |= (1 << aiAltitude);
+			if (Target.GeoAltitude != Location->GeoAltitude ||
+				Target.BaroAltitude != Location->BaroAltitude ||
+				Target.Height != Location->Height ||
+				Target.HeightReference != (unsigned char)Location->HeightReference)
+			{
+				return false;
+			}
+		}
+		if (fabs(Target.HorizontalSpeed - Location->HorizontalSpeed) > 0.005f ||
+			Target.VerticalSpeed != Location->VerticalSpeed ||
+			Target.Direction != Location->Direction ||
+			Target.Status != (unsigned char)Location->Status ||
+			Target.HorizontalAccuracy != (unsigned char)Location->HorizontalAccuracy ||
+			Target.VerticalAccuracy != (unsigned char)Location->VerticalAccuracy ||
+			Target.BaroAccuracy != (unsigned char)Location->BaroAccuracy ||
+			Target.SpeedAccuracy != (unsigned char)Location->SpeedAccuracy)
+		{
+			return false;
+		}
+	}
+	if (System != NULL)
+	{
+		Items |= (1 << aiArea);
+		if (System->OperatorLatitude != 0 || System->OperatorLongitude != 0)
+		{
+			Items |= (1 << aiOperator);
+			if (fabs(Target.OperatorLatitude - System->OperatorLatitude) > 1e-9 ||
+				fabs(Target.OperatorLongitude - System->OperatorLongitude) > 1e-9 ||
+				Target.OperatorAltitude != System->OperatorAltitude ||
+				Target.OperatorLocation != (unsigned char)System->OperatorLocation)
+			{
+				return false;
+			}
+		}
+		if (Target.AreaCount != System->AreaCount || Target.AreaRadius != System->AreaRadius ||
+			Target.AreaCeiling != System->AreaCeiling || Target.AreaFloor != System->AreaFloor ||
+			Target.OperatorClassification != (unsigned char)System->OperatorClassification ||
+			Target.UavEuCategory != (unsigned char)System->UavEuCategory ||
+			Target.UavEuClass != (unsigned char)System->UavEuClass)
+		{
+			return false;
+		}
+	}
+	if (Operator != NULL)
+	{
+		Items |= (1 << aiOperatorId);
+		if (Target.OperatorIdType != Operator->IdType || !SameText(Target.OperatorId, Operator->Id))
+			return false;
+	}
+	return (Target.Items == Items);
+}
+
+static SOCKET Connect(const unsigned short Port)
+{
+	SOCKET Socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (Socket == INVALID_SOCKET)
+		return INVALID_SOCKET;
+
+	sockaddr_in Address;
+	ZeroMemory(&Address, sizeof(Address));
+	Address.sin_family = AF_INET;
+	Address.sin_port = htons(Port);
+	Address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(Socket, (const sockaddr*)&Address, sizeof(Address)) == SOCKET_ERROR)
+	{
+		closesocket(Socket);
+		return INVALID_SOCKET;
+	}
+
+	BOOL NoDelay = TRUE;
+	setsockopt(Socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&NoDelay, sizeof(NoDelay));
+	return Socket;
+}
+
+static bool SendText(const SOCKET Socket, const std::string& Text)
+{
+	size_t Sent = 0;
+	while (Sent < Text.length())
+	{
+		int Len = send(Socket, Text.data() + Sent, (int)(Text.length() - Sent), 0);
+		if (Len == SOCKET_ERROR)
+			return false;
+		Sent += Len;
+	}
+	return true;
+}
+
+// Receives more data. Returns false when the connection is closed or
+// nothing comes in time.
+static bool ReceiveMore(const SOCKET Socket, std::string& Buffer)
+{
+	fd_set ReadSet;
+	FD_ZERO(&ReadSet);
+	FD_SET(Socket, &ReadSet);
+	timeval Timeout;
+	Timeout.tv_sec = DRI_SELFTEST_TIMEOUT / 1000;
+	Timeout.tv_usec = 0;
+	if (select(0, &ReadSet, NULL, NULL, &Timeout) != 1)
+		return false;
+
+	char Data[4096];
+	int Len = recv(Socket, Data, sizeof(Data), 0);
+	if (Len <= 0)
+		return false;
+	Buffer.append(Data, Len);
+	return true;
+}
+
+// Reads one answer of the keep-alive connection. The rest of the data
+// stays in the buffer.
+static bool ReadAnswer(const SOCKET Socket, std::string& Buffer, int& Status,
+	std::string& Body)
+{
+	while (true)
+	{
+		size_t End = Buffer.find("\r\n\r\n");
+		if (End != std::string::npos)
+		{
+			size_t Length = Buffer.find("Content-Length: ");
+			if (Length == std::string::npos || Length > End)
+				return false;
+			size_t Size = strtoul(Buffer.c_str() + Length + 16, NULL, 10);
+			if (Buffer.length() >= End + 4 + Size)
+			{
+				Status = atoi(Buffer.c_str() + 9);
+				Body = Buffer.substr(End + 4, Size);
+				Buffer.erase(0, End + 4 + Size);
+				return true;
+			}
+		}
+
+		if (!ReceiveMore(Socket, Buffer))
+			return false;
+	}
+}
+
+// Checks that the server closes the connection (the answer, if any, is
+// skipped).
+static bool Closed(const SOCKET Socket)
+{
+	fd_set ReadSet;
+	char Data[4096];
+	while (true)
+	{
+		FD_ZERO(&ReadSet);
+		FD_SET(Socket, &ReadSet);
+		timeval Timeout;
+		Timeout.tv_sec = DRI_SELFTEST_TIMEOUT / 1000;
+		Timeout.tv_usec = 0;
+		if (select(0, &ReadSet, NULL, NULL, &Timeout) != 1)
+			return false;
+		// A reset connection is closed as well.
+		if (recv(Socket, Data, sizeof(Data), 0) <= 0)
+			return true;
+	}
+}
+
+static size_t CountText(const std::string& Buffer, const char* const Text)
+{
+	size_t Count = 0;
+	size_t Pos = Buffer.find(Text);
+	while (Pos != std::string::npos)
+	{
+		Count++;
+		Pos = Buffer.find(Text, Pos + 1);
+	}
+	return Count;
+}
+
+// Reads the event stream until the text is received the number of times.
+static bool ReadEvents(const SOCKET Socket, std::string& Buffer,
+	const char* const Text, const size_t Count)
+{
+	while (CountText(Buffer, Text) < Count)
+	{
+		if (!ReceiveMore(Socket, Buffer))
+			return false;
+	}
+	return true;
+}
+
+typedef struct
+{
+	unsigned long	Requests;
+	unsigned long	Done;
+} driLoadClient;
+
+static UINT __stdcall LoadProc(void* Param)
+{
+	driLoadClient* Client = (driLoadClient*)Param;
+	SOCKET Socket = Connect(DRI_SELFTEST_QUERY_PORT);
+	if (Socket != INVALID_SOCKET)
+	{
+		std::string Buffer;
+		std::string Body;
+		int Status;
+		while (Client->Done < Client->Requests)
+		{
+			if (!SendText(Socket, "GET /drones HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n") ||
+				!ReadAnswer(Socket, Buffer, Status, Body) || Status != 200)
+			{
+				break;
+			}
+			Client->Done++;
+		}
+		closesocket(Socket);
+	}
+	return 0;
+}
+
+typedef struct
+{
+	CDriPicture*	Picture;
+	volatile LONG	Terminated;
+} driLoadFeeder;
+
+static UINT __stdcall FeedProc(void* Param)
+{
+	driLoadFeeder* Feeder = (driLoadFeeder*)Param;
+	unsigned long Index = 0;
+	while (Feeder->Terminated == 0)
+	{
+		FeedDrone(*Feeder->Picture, Index % DRI_SELFTEST_QUERY_DRONES);
+		Index++;
+		Sleep(1);
+	}
+	return 0;
+}
+
+typedef struct
+{
+	CDriSharedTable*	Table;
+	driDrone*			Drones[2];
+	volatile LONG		Terminated;
+	unsigned long		Updates;
+} driTableFeeder;
+
+// Publishes the two drones into the first slot in turn.
+static UINT __stdcall TableProc(void* Param)
+{
+	driTableFeeder* Feeder = (driTableFeeder*)Param;
+	while (Feeder->Terminated == 0)
+	{
+		Feeder->Table->Update(0, *Feeder->Drones[Feeder->Updates & 1]);
+		Feeder->Updates++;
+	}
+	return 0;
+}
+
+// Compares the slot copies without the update time.
+static bool SameTableDrone(const driTableDrone& a, const driTableDrone& b)
+{
+	driTableDrone Left = a;
+	driTableDrone Right = b;
+	Left.Updated = 0;
+	Right.Updated = 0;
+	return (memcmp(&Left, &Right, sizeof(driTableDrone)) == 0);
+}
+
+typedef struct
+{
+	// The UDP socket or the listening TCP socket.
+	SOCKET			Socket;
+	bool			Stream;
+	volatile LONG	Terminated;
+	// Everything received.
+	std::string		Data;
+	unsigned long	Datagrams;
+} driExportSink;
+
+// Receives the exported data. A datagram sink stops after Terminated when
+// nothing comes for 100 ms; a stream sink stops when the exporter
+// disconnects.
+static UINT __stdcall SinkProc(void* Param)
+{
+	driExportSink* Sink = (driExportSink*)Param;
+	SOCKET Socket = Sink->Socket;
+	if (Sink->Stream)
+		Socket = accept(Sink->Socket, NULL, NULL);
+
+	char Buffer[65536];
+	while (Socket != INVALID_SOCKET)
+	{
+		fd_set Read;
+		FD_ZERO(&Read);
+		FD_SET(Socket, &Read);
+		timeval Timeout;
+		Timeout.tv_sec = 0;
+		Timeout.tv_usec = 100000;
+		int Res = select(0, &Read, NULL, NULL, &Timeout);
+		if (Res == SOCKET_ERROR)
+			break;
+		if (Res == 0)
+		{
+			if (Sink->Terminated != 0 && !Sink->Stream)
+				break;
+		}
+		else
+		{
+			int Len = recv(Socket, Buffer, sizeof(Buffer), 0);
+			if (Len <= 0)
+				break;
+			Sink->Data.append(Buffer, Len);
+			Sink->Datagrams++;
+		}
+	}
+
+	if (Sink->Stream && Socket != INVALID_SOCKET)
+		closesocket(Socket);
+	return 0;
+}
+
+// Opens the export sink on the loopback port.
+static SOCKET SinkSocket(const bool Stream)
+{
+	SOCKET Socket;
+	if (Stream)
+		Socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	else
+		Socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (Socket == INVALID_SOCKET)
+		return INVALID_SOCKET;
+
+	int Size = DRI_SELFTEST_EXPORT_BUFFER;
+	setsockopt(Socket, SOL_SOCKET, SO_RCVBUF, (const char*)&Size, sizeof(Size));
+
+	sockaddr_in Address;
+	ZeroMemory(&Address, sizeof(Address));
+	Address.sin_family = AF_INET;
+	Address.sin_port = htons(DRI_SELFTEST_EXPORT_PORT);
+	Address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(Socket, (const sockaddr*)&Address, sizeof(Address)) == SOCKET_ERROR ||
+		(Stream && listen(Socket, 1) == SOCKET_ERROR))
+	{
+		closesocket(Socket);
+		return INVALID_SOCKET;
+	}
+	return Socket;
+}
+
+static void ExportFrame(const driDrone& Drone, driFrame& Frame)
+{
+	Frame.Transport = ctWiFi;
+	Frame.Radio = 1;
+	Frame.Source = 0x0000A1B2C3D4E5F6;
+	Frame.Timestamp = FileTimeNow();
+	Frame.Rssi = -60;
+	Frame.Ssid = Drone.Ssid;
+	Frame.Raw = NULL;
+}
+
+// Checks the binary records of the drones posted in the index order.
+static bool SameRecords(const std::string& Data, const unsigned long Count)
+{
+	size_t Offset = 0;
+	driDrone Drone;
+	bool Passed = true;
+	for (unsigned long Index = 0; Index < Count && Passed; Index++)
+	{
+		AsterixDrone(Index, 0x0F, false, Drone);
+		char Name[32];
+		sprintf_s(Name, 32, "drone %u", (unsigned int)Index);
+		for (size_t Slot = 0; Slot < DRI_MESSAGE_SLOTS && Passed; Slot++)
+		{
+			const CwclDriAsdMessage* Message = Drone.Slots[Slot].Message;
+			if (Message == NULL)
+				continue;
+
+			wclDriRawData Raw = Message->Data;
+			const driExportRecordHeader* Header = (const driExportRecordHeader*)(Data.data() + Offset);
+			Passed = (Offset + sizeof(driExportRecordHeader) <= Data.size() &&
+				Offset + Header->Length <= Data.size() &&
+				Header->Length == sizeof(driExportRecordHeader) + Header->NameLength + Header->DataLength &&
+				Header->MessageType == (unsigned char)Message->MessageType &&
+				Header->Transport == ctWiFi && Header->Rssi == -60 &&
+				Header->Source == DRI_SELFTEST_ASTERIX_SOURCE &&
+				Header->NameLength == strlen(Name) && Header->DataLength == Raw.size());
+			if (Passed)
+			{
+				const char* Text = (const char*)(Header + 1);
+				Passed = (memcmp(Text, Name, Header->NameLength) == 0 &&
+					memcmp(Text + Header->NameLength, &Raw[0], Raw.size()) == 0);
+				Offset += Header->Length;
+			}
+		}
+		FreeDrone(Drone);
+	}
+	return (Passed && Offset == Data.size());
+}
+
+
+// CDriSelfTest
+
+CDriSelfTest::CDriSelfTest()
+{
+	FPassed = 0;
+	FFailed = 0;
+}
+
+CDriSelfTest::~CDriSelfTest()
+{
+}
+
+void CDriSelfTest::Check(const bool Passed, const TCHAR* const Name)
+{
+	if (Passed)
+		FPassed++;
+	else
+		FFailed++;
+	_tprintf(_T("%s %s\n"), Passed ? _T("PASS") : _T("FAIL"), Name);
+}
+
+void CDriSelfTest::TestFormat()
+{
+	wclDriRawData Data;
+	driDetailRows Rows;
+	tstring Ssid(_T("drone"));
+	unsigned long Random = 1;
+	unsigned long Failed = 0;
+	for (unsigned long i = 0; i < DRI_SELFTEST_FORMAT_VALUES && Failed == 0; i++)
+	{
+		// The random latitudes, the longitudes with the tie at the 7th digit
+		// and all the altitude codes.
+		Random = Random * 1103515245 + 12345;
+		LocationData(0, 0, 0, Data);
+		PutLong(Data, 5, (long)(Random % 1800000001) - 900000000);
+		PutLong(Data, 9, 339358925 + (long)i * 10);
+		PutWord(Data, 15, (unsigned short)i);
+		Data[4] = (unsigned char)i;
+		CwclDriAsdLocationMessage Location(0, Data);
+		CDriFormatter::Format(Ssid, &Location, Rows);
+
+		if (!SameAsCrt(Rows, _T("Latitude"), Location.Latitude, Location.Latitude == 0) ||
+			!SameAsCrt(Rows, _T("Longitude"), Location.Longitude, Location.Longitude == 0) ||
+			!SameAsCrt(Rows, _T("Geo Altitude"), Location.GeoAltitude, Location.GeoAltitude == -1000) ||
+			!SameAsCrt(Rows, _T("Vertical Speed"), Location.VerticalSpeed, false))
+		{
+			_tprintf(_T("     format: %f %f %f differ from the CRT\n"), Location.Latitude,
+				Location.Longitude, (double)Location.GeoAltitude);
+			Failed++;
+		}
+	}
+	Check(Failed == 0, _T("format: the numbers match the CRT %f"));
+}
+
+void CDriSelfTest::TestTrackArchive()
+{
+	tstring FileName(DRI_SELFTEST_TRACK_FILE);
+	std::vector<driTrackSample> Written[DRI_SELFTEST_TRACK_DRONES];
+	unsigned long Random = 7;
+
+	// The first drone is known by its address until it sends the UAS ID.
+	CDriTrackArchiveWriter* Writer = new CDriTrackArchiveWriter();
+	bool Passed = (Writer->Open(FileName) == WCL_E_SUCCESS);
+	for (unsigned long i = 0; i < DRI_SELFTEST_TRACK_SAMPLES && Passed; i++)
+	{
+		if (i == DRI_SELFTEST_TRACK_REKEY)
+			Passed = (Writer->Rekey(DRI_SELFTEST_TRACK_ADDRESS, 1) == WCL_E_SUCCESS);
+		for (unsigned long Drone = 0; Drone < DRI_SELFTEST_TRACK_DRONES && Passed; Drone++)
+		{
+			__int64 DroneKey = Drone + 1;
+			if (Drone == 0 && i < DRI_SELFTEST_TRACK_REKEY)
+				DroneKey = DRI_SELFTEST_TRACK_ADDRESS;
+			driTrackSample Sample;
+			TrackSample(DroneKey, i, Random, Sample);
+			Passed = (Writer->Append(Sample) == WCL_E_SUCCESS);
+			Sample.DroneKey = Drone + 1;
+			Written[Drone].push_back(Sample);
+		}
+	}
+	if (Writer->Close() != WCL_E_SUCCESS)
+		Passed = false;
+	Check(Passed && Writer->Lost == 0, _T("track: write the archive"));
+	delete Writer;
+
+	// The closed archive: all the tracks come back, the first one under the
+	// UAS ID only.
+	CDriTrackArchiveReader* Reader = new CDriTrackArchiveReader();
+	Passed = (Reader->Open(FileName) == WCL_E_SUCCESS);
+	for (unsigned long Drone = 0; Drone < DRI_SELFTEST_TRACK_DRONES && Passed; Drone++)
+		Passed = SameTrack(*Reader, Drone + 1, Written[Drone], Written[Drone].size());
+	size_t Chunks = Reader->Chunks;
+	Check(Passed && Chunks > DRI_SELFTEST_TRACK_DRONES, _T("track: read the closed archive back"));
+	Passed = SameTrack(*Reader, DRI_SELFTEST_TRACK_ADDRESS, Written[0], 0);
+	Check(Passed, _T("track: the re-keyed samples left the address"));
+
+	// The archive that was not closed, with a part of the last chunk: the
+	// reader walks the chunks before it.
+	unsigned __int64 Cut = 0;
+	const driTrackChunk* Last = NULL;
+	if (Chunks > 0)
+	{
+		Last = Reader->GetChunk(Chunks - 1);
+		Cut = Last->Offset + sizeof(driTrackChunkHeader) + 5;
+	}
+	__int64 LastKey = (Last != NULL) ? Last->Header.DroneKey : 0;
+	size_t LastCount = (Last != NULL) ? Last->Header.Count : 0;
+	Reader->Close();
+	Passed = (Last != NULL && CutFile(FileName, Cut) &&
+		Reader->Open(FileName) == WCL_E_SUCCESS && Reader->Chunks == Chunks - 1);
+	for (unsigned long Drone = 0; Drone < DRI_SELFTEST_TRACK_DRONES && Passed; Drone++)
+	{
+		size_t Count = Written[Drone].size();
+		if ((__int64)(Drone + 1) == LastKey)
+			Count -= LastCount;
+		Passed = SameTrack(*Reader, Drone + 1, Written[Drone], Count);
+	}
+	Check(Passed, _T("track: recover the archive that was not closed"));
+	Reader->Close();
+	delete Reader;
+
+	DeleteFile(FileName.c_str());
+}
+
+void CDriSelfTest::TestCaptureLog()
+{
+	tstring FileName(DRI_SELFTEST_CAPTURE_FILE);
+	unsigned char Data[64];
+
+	LARGE_INTEGER Start;
+	QueryPerformanceCounter(&Start);
+	CDriCaptureLogWriter* Writer = new CDriCaptureLogWriter();
+	Writer->SyncInterval = DRI_SELFTEST_CAPTURE_SYNC;
+	bool Passed = (Writer->Open(FileName) == WCL_E_SUCCESS);
+	// The offset of the sync record after the frame 5 * DRI_SELFTEST_CAPTURE_SYNC.
+	unsigned __int64 Sync = 0;
+	for (unsigned long i = 0; i < DRI_SELFTEST_CAPTURE_FRAMES && Passed; i++)
+	{
+		size_t Length = CaptureFrame(i, Data);
+		unsigned __int64 Offset;
+		Passed = (Writer->Append((driCaptureTransport)(i & 1), 0, i, (__int64)i * 1000, -60,
+			Data, Length, Offset) == WCL_E_SUCCESS);
+		if (i == 5 * DRI_SELFTEST_CAPTURE_SYNC - 1)
+		{
+			Sync = Offset + ((sizeof(driCaptureRecordHeader) + Length + DRI_CAPTURE_ALIGN - 1) &
+				~((unsigned __int64)DRI_CAPTURE_ALIGN - 1));
+		}
+	}
+	if (Writer->Close() != WCL_E_SUCCESS)
+		Passed = false;
+	delete Writer;
+	double Written = Seconds(Start);
+
+	QueryPerformanceCounter(&Start);
+	CDriCaptureLogReader* Reader = new CDriCaptureLogReader();
+	Passed = (Passed && Reader->Open(FileName) == WCL_E_SUCCESS &&
+		Reader->Frames == DRI_SELFTEST_CAPTURE_FRAMES &&
+		SameCapture(*Reader, DRI_SELFTEST_CAPTURE_FRAMES));
+	double Read = Seconds(Start);
+	unsigned __int64 Size = Reader->Size;
+	Reader->Close();
+	_tprintf(_T("     capture: %u frames written in %.2f s (%.0f frames/s), read in %.2f s (%.0f frames/s)\n"),
+		(unsigned int)DRI_SELFTEST_CAPTURE_FRAMES, Written, DRI_SELFTEST_CAPTURE_FRAMES / Written,
+		Read, DRI_SELFTEST_CAPTURE_FRAMES / Read);
+	Check(Passed, _T("capture: write and read the log"));
+
+	// The torn tail: the frames after the last sync point are not read.
+	Passed = (CutFile(FileName, Size - 100) && Reader->Open(FileName) == WCL_E_SUCCESS &&
+		Reader->Frames == DRI_SELFTEST_CAPTURE_FRAMES - DRI_SELFTEST_CAPTURE_SYNC &&
+		SameCapture(*Reader, DRI_SELFTEST_CAPTURE_FRAMES - DRI_SELFTEST_CAPTURE_SYNC));
+	Reader->Close();
+	Check(Passed, _T("capture: stop at the last sync point of a torn log"));
+
+	// The damaged sync point ends the log: its frame count is wrong.
+	unsigned __int64 Frames = 0;
+	Passed = (Sync > 0 && PatchFile(FileName, Sync + sizeof(driCaptureRecordHeader) +
+		offsetof(driCaptureSyncPoint, Frames), &Frames, sizeof(Frames)) &&
+		Reader->Open(FileName) == WCL_E_SUCCESS &&
+		Reader->Frames == 4 * DRI_SELFTEST_CAPTURE_SYNC &&
+		SameCapture(*Reader, 4 * DRI_SELFTEST_CAPTURE_SYNC));
+	Reader->Close();
+	Check(Passed, _T("capture: stop before a damaged sync point"));
+	delete Reader;
+
+	DeleteFile(FileName.c_str());
+}
+
+void CDriSelfTest::TestAsterix()
+{
+	CDriAsterixEncoder* Encoder = new CDriAsterixEncoder(DRI_SELFTEST_ASTERIX_BLOCK);
+	Encoder->Source = DRI_SELFTEST_ASTERIX_SOURCE;
+	CDriAsterixDecoder* Decoder = new CDriAsterixDecoder();
+	std::vector<driAsterixTarget> Targets;
+	driDrone Drone;
+
+	// Every combination of the messages, with the valid and the invalid
+	// values.
+	bool Passed = true;
+	for (unsigned long Mask = 0; Mask < 16 && Passed; Mask++)
+	{
+		for (unsigned long Invalid = 0; Invalid < 2 && Passed; Invalid++)
+		{
+			unsigned long Index = Mask * 2 + Invalid;
+			unsigned long TimeOfDay = 0x0A0B0C + Index;
+			AsterixDrone(Index, Mask, Invalid != 0, Drone);
+			Encoder->Reset();
+			Passed = Encoder->Add((unsigned short)Index, Drone, TimeOfDay);
+			if (Passed)
+			{
+				// The drone without the encoded messages has no record.
+				if (Mask == 0)
+					Passed = (Encoder->Count == 0);
+				else
+				{
+					Passed = (Decoder->Decode(Encoder->Data, Encoder->Length, Targets) == WCL_E_SUCCESS &&
+						Targets.size() == 1 && SameTarget(Targets[0], Index, Drone, TimeOfDay));
+				}
+			}
+			FreeDrone(Drone);
+		}
+	}
+	Check(Passed, _T("asterix: decode all the item combinations"));
+
+	// The damaged datagram: every cut with the original block length and
+	// with the block length of the cut.
+	AsterixDrone(1, 0x0F, false, Drone);
+	Encoder->Reset();
+	Encoder->Add(1, Drone, 0);
+	FreeDrone(Drone);
+	std::vector<unsigned char> Block(Encoder->Data, Encoder->Data + Encoder->Length);
+	Passed = true;
+	for (size_t Length = 1; Length < Block.size() && Passed; Length++)
+	{
+		Passed = (Decoder->Decode(&Block[0], Length, Targets) == DRI_E_ASTERIX_INVALID_BLOCK &&
+			Targets.size() == 0);
+		if (Passed && Length > DRI_ASTERIX_HEADER_SIZE)
+		{
+			std::vector<unsigned char> Cut(Block.begin(), Block.begin() + Length);
+			Cut[1] = (unsigned char)(Length >> 8);
+			Cut[2] = (unsigned char)Length;
+			Passed = (Decoder->Decode(&Cut[0], Length, Targets) == DRI_E_ASTERIX_INVALID_RECORD &&
+				Targets.size() == 0);
+		}
+	}
+	Block[0]++;
+	if (Decoder->Decode(&Block[0], Block.size(), Targets) != DRI_E_ASTERIX_INVALID_BLOCK)
+		Passed = false;
+	Check(Passed, _T("asterix: reject the damaged datagrams"));
+
+	// Many drones: the full blocks are sent and new ones started; the
+	// largest block still fits its length field.
+	CDriAsterixEncoder* Largest = new CDriAsterixEncoder(DRI_ASTERIX_MAX_BLOCK * 2);
+	Largest->Source = DRI_SELFTEST_ASTERIX_SOURCE;
+	std::vector<unsigned char> Datagram;
+	unsigned long Blocks = 0;
+	bool Full = false;
+	Encoder->Reset();
+	Passed = true;
+	for (unsigned long Index = 0; Index < DRI_SELFTEST_ASTERIX_DRONES && Passed; Index++)
+	{
+		AsterixDrone(Index, 0x0F, false, Drone);
+		if (!Encoder->Add((unsigned short)Index, Drone, Index))
+		{
+			Datagram.insert(Datagram.end(), Encoder->Data, Encoder->Data + Encoder->Length);
+			Blocks++;
+			Encoder->Reset();
+			Passed = Encoder->Add((unsigned short)Index, Drone, Index);
+		}
+		if (!Full)
+			Full = !Largest->Add((unsigned short)Index, Drone, Index);
+		FreeDrone(Drone);
+	}
+	Datagram.insert(Datagram.end(), Encoder->Data, Encoder->Data + Encoder->Length);
+	Passed = (Passed && Blocks > 0 &&
+		Decoder->Decode(&Datagram[0], Datagram.size(), Targets) == WCL_E_SUCCESS &&
+		Targets.size() == DRI_SELFTEST_ASTERIX_DRONES);
+	for (unsigned long Index = 0; Index < Targets.size() && Passed; Index++)
+	{
+		AsterixDrone(Index, 0x0F, false, Drone);
+		Passed = SameTarget(Targets[Index], Index, Drone, Index);
+		FreeDrone(Drone);
+	}
+	Check(Passed, _T("asterix: split many drones into the blocks"));
+	Passed = (Full && Largest->Length <= DRI_ASTERIX_MAX_BLOCK &&
+		Largest->Length + DRI_ASTERIX_MAX_RECORD > DRI_ASTERIX_MAX_BLOCK &&
+		Decoder->Decode(Largest->Data, Largest->Length, Targets) == WCL_E_SUCCESS &&
+		Targets.size() == Largest->Count);
+	Check(Passed, _T("asterix: cap the block at the length field"));
+
+	delete Largest;
+	delete Decoder;
+	delete Encoder;
+}
+
+void CDriSelfTest::TestLocator()
+{
+	CDriLocator* Locator = new CDriLocator();
+	double Latitude[DRI_SELFTEST_LOCATE_SENSORS];
+	double Longitude[DRI_SELFTEST_LOCATE_SENSORS];
+	bool Passed = true;
+	for (unsigned short i = 0; i < DRI_SELFTEST_LOCATE_SENSORS && Passed; i++)
+	{
+		double Angle = i * 2 * 3.14159265358979 / DRI_SELFTEST_LOCATE_SENSORS;
+		Latitude[i] = 47.0 + sin(Angle) * 0.009;
+		Longitude[i] = 8.0 + cos(Angle) * 0.013;
+		Passed = (Locator->AddSensor(i, Latitude[i], Longitude[i], 400.0) == WCL_E_SUCCESS);
+	}
+
+	// The noise free RSSI of the transmitter 100 m over the sensors at the
+	// expected power.
+	const double DroneLatitude = 47.002;
+	const double DroneLongitude = 8.003;
+	double K = 10 * DRI_LOCATE_PATH_LOSS / log(10.0);
+
+	// The empty frame, the frame of too few sensors and the frame of the
+	// unknown sensor must stay invalid; they share the batch with a good one.
+	Locator->Clear();
+	size_t Empty = Locator->AddFrame(500.0, NULL);
+	size_t Good = Locator->AddFrame(500.0, NULL);
+	for (unsigned short i = 0; i < DRI_SELFTEST_LOCATE_SENSORS && Passed; i++)
+	{
+		double Distance = Locator->Distance(Latitude[i], Longitude[i], DroneLatitude, DroneLongitude);
+		double Rssi = DRI_LOCATE_POWER - 0.5 * K * log(Distance * Distance + 100.0 * 100.0 + 1);
+		Passed = Locator->AddObservation(i, Rssi, 0);
+	}
+	size_t Few = Locator->AddFrame(500.0, NULL);
+	Locator->AddObservation(0, -80.0, 0);
+	Locator->AddObservation(1, -80.0, 0);
+	size_t Unknown = Locator->AddFrame(500.0, NULL);
+	if (Locator->AddObservation(DRI_SELFTEST_LOCATE_SENSORS, -80.0, 0))
+		Passed = false;
+	Locator->Solve();
+
+	driLocateResult Result;
+	Locator->GetResult(Empty, Result);
+	Passed = (Passed && !Result.Valid && Result.Sensors == 0);
+	Locator->GetResult(Few, Result);
+	Passed = (Passed && !Result.Valid && Result.Sensors == 2);
+	Locator->GetResult(Unknown, Result);
+	Passed = (Passed && !Result.Valid && Result.Sensors == 0);
+	Check(Passed, _T("locate: reject the empty and the short frames"));
+
+	Locator->GetResult(Good, Result);
+	Passed = (Result.Valid && Result.Sensors == DRI_SELFTEST_LOCATE_SENSORS &&
+		Locator->Distance(Result.Latitude, Result.Longitude, DroneLatitude, DroneLongitude) <
+		DRI_SELFTEST_LOCATE_ERROR);
+	Check(Passed, _T("locate: locate the transmitter"));
+
+	delete Locator;
+}
+
+void CDriSelfTest::TestSharedTable()
+{
+	CDriSharedTable* Table = new CDriSharedTable();
+	CDriSharedTable* Other = new CDriSharedTable();
+	CDriSharedTableReader* Reader = new CDriSharedTableReader();
+	bool Passed = (Table->Open(DRI_SELFTEST_TABLE_NAME, DRI_SELFTEST_TABLE_SLOTS) == WCL_E_SUCCESS &&
+		Other->Open(DRI_SELFTEST_TABLE_NAME, DRI_SELFTEST_TABLE_SLOTS) == DRI_E_TABLE_EXISTS &&
+		Reader->Open(DRI_SELFTEST_TABLE_NAME) == WCL_E_SUCCESS);
+	Check(Passed, _T("table: open the shared section"));
+	if (Passed)
+	{
+		driDrone First;
+		driDrone Second;
+		AsterixDrone(1, 0x0F, false, First);
+		AsterixDrone(2, 0x0B, false, Second);
+
+		driTableDrone Drone;
+		driTableDrone Expected[2];
+		Table->Update(0, First);
+		Table->Update(1, Second);
+		Passed = (Reader->Count == 2 && Reader->Read(0, Expected[0]) &&
+			Reader->Read(1, Expected[1]) && !Reader->Read(2, Drone));
+		Passed = (Passed && Expected[0].Drone == 0 && Expected[0].Present == 0x0F &&
+			strcmp(Expected[0].Name, "drone 1") == 0 && strcmp(Expected[0].Id, "SN00001") == 0 &&
+			strcmp(Expected[0].OperatorId, "OP00001") == 0 &&
+			fabs(Expected[0].Latitude - 47.001) < 1E-6 && fabs(Expected[0].Longitude - 7.999) < 1E-6 &&
+			fabs(Expected[0].OperatorLatitude + 33.001) < 1E-6);
+		Passed = (Passed && Expected[1].Drone == 1 && Expected[1].Present == 0x0B &&
+			strcmp(Expected[1].Name, "drone 2") == 0 && Expected[1].OperatorLatitude == 0);
+		Check(Passed, _T("table: publish the drones"));
+
+		// The reader races the writer on one slot: every copy it takes must
+		// be one of the two drones, never a mix.
+		Table->Update(0, Second);
+		Reader->Read(0, Expected[1]);
+		Table->Update(0, First);
+		Reader->Read(0, Expected[0]);
+		driTableFeeder Feeder;
+		Feeder.Table = Table;
+		Feeder.Drones[0] = &First;
+		Feeder.Drones[1] = &Second;
+		Feeder.Terminated = 0;
+		Feeder.Updates = 0;
+		HANDLE Thread = wclCreateThread(TableProc, &Feeder);
+
+		unsigned long Torn = 0;
+		unsigned long Missed = 0;
+		LARGE_INTEGER Start;
+		QueryPerformanceCounter(&Start);
+		for (unsigned long i = 0; i < DRI_SELFTEST_TABLE_READS; i++)
+		{
+			if (!Reader->Read(0, Drone))
+				Missed++;
+			else
+			{
+				if (!SameTableDrone(Drone, Expected[0]) && !SameTableDrone(Drone, Expected[1]))
+					Torn++;
+			}
+		}
+		double Time = Seconds(Start);
+
+		InterlockedExchange(&Feeder.Terminated, 1);
+		bool Started = (Thread != NULL);
+		if (Started)
+			wclWaitAndCloseThread(Thread);
+
+		_tprintf(_T("     table: %u reads in %.2f s (%.0f reads/s), %u retried out, %u updates\n"),
+			(unsigned int)DRI_SELFTEST_TABLE_READS, Time,
+			(Time > 0) ? DRI_SELFTEST_TABLE_READS / Time : 0.0, (unsigned int)Missed,
+			(unsigned int)Feeder.Updates);
+		Check(Started && Feeder.Updates > 0 && Torn == 0 && Missed < DRI_SELFTEST_TABLE_READS,
+			_T("table: consistent reads while the writer changes the slot"));
+
+		// The drones out of the slots are counted once.
+		Table->Update(DRI_SELFTEST_TABLE_SLOTS + 1, First);
+		Table->Update(DRI_SELFTEST_TABLE_SLOTS, Second);
+		Passed = (Table->Unpublished == 2 && Reader->Unpublished == 2 && Reader->Count == 2);
+		Table->Clear();
+		Passed = (Passed && Table->Unpublished == 0 && Reader->Unpublished == 0 &&
+			Reader->Count == 0);
+		Check(Passed, _T("table: count the drones out of the slots"));
+
+		FreeDrone(Second);
+		FreeDrone(First);
+	}
+
+	// The closed table can not be opened anymore.
+	Reader->Close();
+	Table->Close();
+	Check(Reader->Open(DRI_SELFTEST_TABLE_NAME) == DRI_E_TABLE_MAP_FAILED,
+		_T("table: remove the closed section"));
+
+	delete Reader;
+	delete Other;
+	delete Table;
+}
+
+void CDriSelfTest::TestExporter()
+{
+	// The paced benchmark: JSON lines over UDP.
+	driExportSink Sink;
+	Sink.Socket = SinkSocket(false);
+	Sink.Stream = false;
+	Sink.Terminated = 0;
+	Sink.Datagrams = 0;
+	CDriExporter* Exporter = new CDriExporter();
+	Exporter->Source = DRI_SELFTEST_ASTERIX_SOURCE;
+	bool Passed = (Sink.Socket != INVALID_SOCKET &&
+		Exporter->Open(_T("127.0.0.1"), DRI_SELFTEST_EXPORT_PORT) == WCL_E_SUCCESS);
+	Check(Passed, _T("export: open the UDP exporter"));
+	if (Passed)
+	{
+		HANDLE Thread = wclCreateThread(SinkProc, &Sink);
+
+		driDrone Drone;
+		driFrame Frame;
+		AsterixDrone(1, 0x02, false, Drone);
+		ExportFrame(Drone, Frame);
+		const CwclDriAsdMessage* Message = Drone.Slots[CDriDroneList::SlotOf(mtLocation)].Message;
+
+		LARGE_INTEGER Start;
+		QueryPerformanceCounter(&Start);
+		for (unsigned long i = 0; i < DRI_SELFTEST_EXPORT_MESSAGES; i++)
+		{
+			// Wait when ahead of the rate.
+			while (i > Seconds(Start) * DRI_SELFTEST_EXPORT_RATE)
+				Sleep(1);
+			Exporter->Post(Frame, Drone.Ssid, Message);
+		}
+		double Time = Seconds(Start);
+		// Sends the rest.
+		Exporter->Close();
+		FreeDrone(Drone);
+
+		InterlockedExchange(&Sink.Terminated, 1);
+		bool Started = (Thread != NULL);
+		if (Started)
+			wclWaitAndCloseThread(Thread);
+
+		_tprintf(_T("     export: %u messages in %.2f s (%.0f messages/s), %I64u datagrams, max latency %u ms\n"),
+			(unsigned int)DRI_SELFTEST_EXPORT_MESSAGES, Time,
+			(Time > 0) ? DRI_SELFTEST_EXPORT_MESSAGES / Time : 0.0, Exporter->Datagrams,
+			(unsigned int)Exporter->MaxLatency);
+		Passed = (Started && Exporter->Records == DRI_SELFTEST_EXPORT_MESSAGES &&
+			Exporter->Dropped == 0 && Exporter->Errors == 0 &&
+			Sink.Datagrams == Exporter->Datagrams &&
+			CountText(Sink.Data, "{\"ts\":") == DRI_SELFTEST_EXPORT_MESSAGES &&
+			CountText(Sink.Data, "}\n") == DRI_SELFTEST_EXPORT_MESSAGES);
+		Check(Passed, _T("export: 50000 JSON lines/s over UDP"));
+	}
+	if (Sink.Socket != INVALID_SOCKET)
+		closesocket(Sink.Socket);
+	delete Exporter;
+
+	// The binary records over TCP: every message of the drones in order.
+	Sink.Socket = SinkSocket(true);
+	Sink.Stream = true;
+	Sink.Terminated = 0;
+	Sink.Data.clear();
+	Sink.Datagrams = 0;
+	Exporter = new CDriExporter();
+	Exporter->Source = DRI_SELFTEST_ASTERIX_SOURCE;
+	Exporter->Format = efBinary;
+	Exporter->Protocol = epTcp;
+	HANDLE Thread = NULL;
+	if (Sink.Socket != INVALID_SOCKET)
+		Thread = wclCreateThread(SinkProc, &Sink);
+	Passed = (Thread != NULL &&
+		Exporter->Open(_T("127.0.0.1"), DRI_SELFTEST_EXPORT_PORT) == WCL_E_SUCCESS);
+	if (Passed)
+	{
+		driDrone Drone;
+		driFrame Frame;
+		for (unsigned long Index = 0; Index < DRI_SELFTEST_EXPORT_DRONES; Index++)
+		{
+			AsterixDrone(Index, 0x0F, false, Drone);
+			ExportFrame(Drone, Frame);
+			for (size_t Slot = 0; Slot < DRI_MESSAGE_SLOTS; Slot++)
+			{
+				if (Drone.Slots[Slot].Message != NULL)
+					Exporter->Post(Frame, Drone.Ssid, Drone.Slots[Slot].Message);
+			}
+			FreeDrone(Drone);
+		}
+		// The sink stops when the exporter disconnects.
+		Exporter->Close();
+	}
+	if (Thread != NULL)
+		wclWaitAndCloseThread(Thread);
+	Passed = (Passed && Exporter->Dropped == 0 && Exporter->Errors == 0 &&
+		SameRecords(Sink.Data, DRI_SELFTEST_EXPORT_DRONES));
+	Check(Passed, _T("export: binary records over TCP"));
+	if (Sink.Socket != INVALID_SOCKET)
+		closesocket(Sink.Socket);
+	delete Exporter;
+}
+
+void CDriSelfTest::TestQueryServer()
+{
+	CDriPicture* Picture = new CDriPicture();
+	CDriQueryServer* Server = new CDriQueryServer(Picture);
+	int Res = Server->Open(DRI_SELFTEST_QUERY_PORT);
+	Check(Res == WCL_E_SUCCESS, _T("query: open the server"));
+	if (Res == WCL_E_SUCCESS)
+	{
+		for (unsigned long i = 0; i < DRI_SELFTEST_QUERY_DRONES; i++)
+			FeedDrone(*Picture, i);
+
+		std::string Buffer;
+		std::string Body;
+		int Status = 0;
+
+		SOCKET Socket = Connect(DRI_SELFTEST_QUERY_PORT);
+		bool Passed = (SendText(Socket, "GET /drones HTTP/1.1\r\n\r\n") &&
+			ReadAnswer(Socket, Buffer, Status, Body) && Status == 200 &&
+			CountText(Body, "\"name\"") == DRI_SELFTEST_QUERY_DRONES);
+		Check(Passed, _T("query: /drones lists all the drones"));
+		// The header value may go without the space.
+		Passed = (SendText(Socket, "GET /drones HTTP/1.1\r\nConnection:Close\r\n\r\n") &&
+			ReadAnswer(Socket, Buffer, Status, Body) && Status == 200 && Closed(Socket));
+		Check(Passed, _T("query: Connection:close closes the connection"));
+		closesocket(Socket);
+
+		// A header that never ends must not grow the buffer.
+		Socket = Connect(DRI_SELFTEST_QUERY_PORT);
+		std::string Garbage(DRI_SELFTEST_GARBAGE_SIZE, 'a');
+		for (int i = 0; i < 16; i++)
+			SendText(Socket, Garbage);
+		Check(Closed(Socket), _T("query: an endless header closes the connection"));
+		closesocket(Socket);
+
+		// The event stream: the whole picture, then the changes. Clearing
+		// more drones than the remembered removals resets the stream.
+		Socket = Connect(DRI_SELFTEST_QUERY_PORT);
+		Buffer.clear();
+		Passed = (SendText(Socket, "GET /events HTTP/1.1\r\n\r\n") &&
+			ReadEvents(Socket, Buffer, "data: ", DRI_SELFTEST_QUERY_DRONES));
+		Check(Passed, _T("query: /events starts with the whole picture"));
+		FeedDrone(*Picture, 0);
+		Passed = ReadEvents(Socket, Buffer, "data: ", DRI_SELFTEST_QUERY_DRONES + 1);
+		Check(Passed, _T("query: /events sends a change"));
+		Picture->Clear();
+		FeedDrone(*Picture, 1);
+		Passed = (ReadEvents(Socket, Buffer, "event: reset", 1) &&
+			ReadEvents(Socket, Buffer, "\"drone 1\"", 2));
+		Check(Passed, _T("query: /events resets a reader that missed removals"));
+		closesocket(Socket);
+
+		// The load: keep-alive clients ask for the drones while the picture
+		// changes.
+		driLoadFeeder Feeder;
+		Feeder.Picture = Picture;
+		Feeder.Terminated = 0;
+		HANDLE FeedThread = wclCreateThread(FeedProc, &Feeder);
+
+		driLoadClient Clients[DRI_SELFTEST_LOAD_CLIENTS];
+		HANDLE Threads[DRI_SELFTEST_LOAD_CLIENTS];
+		LARGE_INTEGER Start;
+		QueryPerformanceCounter(&Start);
+		for (int i = 0; i < DRI_SELFTEST_LOAD_CLIENTS; i++)
+		{
+			Clients[i].Requests = DRI_SELFTEST_LOAD_REQUESTS;
+			Clients[i].Done = 0;
+			Threads[i] = wclCreateThread(LoadProc, &Clients[i]);
+		}
+		unsigned long Done = 0;
+		for (int i = 0; i < DRI_SELFTEST_LOAD_CLIENTS; i++)
+		{
+			if (Threads[i] != NULL)
+				wclWaitAndCloseThread(Threads[i]);
+			Done += Clients[i].Done;
+		}
+		double Time = Seconds(Start);
+
+		InterlockedExchange(&Feeder.Terminated, 1);
+		if (FeedThread != NULL)
+			wclWaitAndCloseThread(FeedThread);
+
+		_tprintf(_T("     query load: %u clients, %u requests in %.2f s (%.0f requests/s), cache hits %I64u\n"),
+			(unsigned int)DRI_SELFTEST_LOAD_CLIENTS, (unsigned int)Done, Time,
+			(Time > 0) ? Done / Time : 0.0, Server->CacheHits);
+		Check(Done == DRI_SELFTEST_LOAD_CLIENTS * DRI_SELFTEST_LOAD_REQUESTS,
+			_T("query: keep-alive load without failures"));
+
+		Server->Close();
+	}
+	delete Server;
+	delete Picture;
+}
+
+bool CDriSelfTest::Run()
+{
+	FPassed = 0;
+	FFailed = 0;
+
+	TestFormat();
+	TestTrackArchive();
+	TestCaptureLog();
+	TestAsterix();
+	TestLocator();
+	TestSharedTable();
+
+	WSADATA Data;
+	if (WSAStartup(MAKEWORD(2, 2), &Data) != 0)
+	{
+		Check(false, _T("initialize Windows Sockets"));
+		return false;
+	}
+
+	TestQueryServer();
+	TestExporter();
+
+	WSACleanup();
+
+	_tprintf(_T("Passed %u, failed %u\n"), (unsigned int)FPassed, (unsigned int)FFailed);
+	return (FFailed == 0);
+}
+
+unsigned long CDriSelfTest::GetPassed() const
+{
+	return FPassed;
+}
+
+unsigned long CDriSelfTest::GetFailed() const
+{
+	return FFailed;
+}
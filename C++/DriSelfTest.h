@@ -0,0 +1,75 @@
+
+// DriSelfTest.h : header file
+//
+
+#pragma once
+
+#include "wclHelpers.h"
+
+using namespace wclCommon;
+
+/// <summary> The loopback port the self test runs the query server
+///   on. </summary>
+#define DRI_SELFTEST_QUERY_PORT		18080
+/// <summary> The loopback port of the export sink. </summary>
+#define DRI_SELFTEST_EXPORT_PORT	18081
+/// <summary> The number of the keep-alive clients of the query server load
+///   test. </summary>
+#define DRI_SELFTEST_LOAD_CLIENTS	32
+/// <summary> The number of the requests of every load test
+///   client. </summary>
+#define DRI_SELFTEST_LOAD_REQUESTS	2000
+
+/// <summary> Checks and measures the sensor core without radios. </summary>
+/// <remarks> <para> The service runs it with the <c>/selftest</c> option.
+///   The checks feed the DRI classes with synthetic ASD messages and compare
+///   what comes out; the benchmarks print their rates. Every check prints
+///   one <c>PASS</c> or <c>FAIL</c> line. </para>
+///   <para> The test uses the loopback port
+///   <see cref="DRI_SELFTEST_QUERY_PORT" />, the UDP and TCP loopback port
+///   <see cref="DRI_SELFTEST_EXPORT_PORT" />, temporary files and a shared
+///   memory section. </para>
+///   </remarks>
+class CDriSelfTest
+{
+	DISABLE_COPY(CDriSelfTest);
+
+private:
+	unsigned long	FPassed;
+	unsigned long	FFailed;
+
+	void Check(const bool Passed, const TCHAR* const Name);
+
+	void TestFormat();
+	void TestTrackArchive();
+	void TestCaptureLog();
+	void TestAsterix();
+	void TestLocator();
+	void TestSharedTable();
+	void TestExporter();
+	void TestQueryServer();
+
+public:
+	/// <summary> Creates new self test. </summary>
+	CDriSelfTest();
+	/// <summary> Frees the object. </summary>
+	virtual ~CDriSelfTest();
+
+	/// <summary> Runs all the checks and benchmarks. </summary>
+	/// <returns> <c>True</c> if all the checks passed. </returns>
+	bool Run();
+
+	/// <summary> Gets the number of the passed checks. </summary>
+	/// <returns> The passed checks count. </returns>
+	unsigned long GetPassed() const;
+	/// <summary> Gets the number of the passed checks. </summary>
+	/// <value> The passed checks count. </value>
+	__declspec(property(get = GetPassed)) unsigned long Passed;
+
+	/// <summary> Gets the number of the failed checks. </summary>
+	/// <returns> The failed checks count. </returns>
+	unsigned long GetFailed() const;
+	/// <summary> Gets the number of the failed checks. </summary>
+	/// <value> The failed checks count. </value>
+	__declspec(property(get = GetFailed)) unsigned long Failed;
+};
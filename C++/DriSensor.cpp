@@ -0,0 +1,805 @@
+
+// DriSensor.cpp : implementation file
+//
+
+#include "stdafx.h"
+#include "DriSensor.h"
+
+#include <stdarg.h>
+#include <time.h>
+
+#include "DriIe.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+
+// The SSID element identifier.
+#define DRI_IE_SSID				0x00
+// The maximum SSID length.
+#define DRI_SSID_SIZE			32
+// The trace message buffer size.
+#define DRI_SENSOR_TRACE_SIZE	256
+
+// The Bluetooth LE drones are named by the advertiser address.
+static tstring SourceName(const __int64 Source)
+{
+	TCHAR Name[17];
+	_stprintf_s(Name, 17, _T("%.4X%.8X"), (unsigned int)((Source >> 32) & 0x0000FFFF),
+		(unsigned int)(Source & 0xFFFFFFFF));
+	return tstring(Name);
+}
+
+// Gets the network name from the SSID element of a recorded beacon.
+static tstring SsidOf(const unsigned char* const Data, const size_t Size)
+{
+	CDriIeIterator Iterator(Data, Size);
+	driIeView Element;
+	while (Iterator.Next(Element))
+	{
+		if (Element.Id == DRI_IE_SSID)
+		{
+			if (Element.Length == 0 || Element.Length > DRI_SSID_SIZE)
+				break;
+
+			TCHAR Ssid[DRI_SSID_SIZE + 1];
+#ifdef _UNICODE
+			int Len = MultiByteToWideChar(CP_UTF8, 0, (LPCSTR)Element.Data,
+				(int)Element.Length, Ssid, DRI_SSID_SIZE);
+#else
+			int Len = (int)Element.Length;
+			CopyMemory(Ssid, Element.Data, Len);
+#endif
+			return tstring(Ssid, Len);
+		}
+	}
+	return tstring();
+}
+
+// Builds the file name in the recordings folder from the current local
+// time.
+static tstring RecordFileName(const tstring& Path, const TCHAR* const Format)
+{
+	time_t Now = time(NULL);
+	TCHAR Name[32];
+	_tcsftime(Name, 32, Format, localtime(&Now));
+
+	tstring FileName = Path;
+	if (FileName == _T(""))
+		FileName = CDriSensor::AppPath();
+	else
+	{
+		if (FileName[FileName.length() - 1] != _T('\\'))
+			FileName += _T('\\');
+	}
+	return FileName + Name;
+}
+
+static __int64 FileTimeNow()
+{
+	FILETIME Now;
+	GetSystemTimeAsFileTime(&Now);
+	return (__int64)(((unsigned __int64)Now.dwHighDateTime << 32) | Now.dwLowDateTime);
+}
+
+
+// CDriSensor
+
+CDriSensor::CDriSensor()
+	: FRecording(&FThreadPool),
+	FLog(&FThreadPool),
+	FEncoder(DRI_EXPORT_DATAGRAM_SIZE),
+	FQuery(&FPicture)
+{
+	FCS = new CwclCriticalSection();
+	DefaultConfig(FConfig);
+	FOpened = false;
+	FFrames = 0;
+	FErrors = 0;
+
+	__hook(&CDriCaptureManager::OnDriFrame, &FCapture, &CDriSensor::CaptureDriFrame);
+	__hook(&CDriCaptureManager::OnDriFrames, &FCapture, &CDriSensor::CaptureDriFrames);
+	__hook(&CDriCaptureManager::OnRadioStateChanged, &FCapture, &CDriSensor::CaptureRadioStateChanged);
+	__hook(&CDriCaptureManager::OnScanProfileChanged, &FCapture, &CDriSensor::CaptureScanProfileChanged);
+}
+
+CDriSensor::~CDriSensor()
+{
+	Close();
+
+	__unhook(&FCapture);
+
+	FDrones.Clear();
+	delete FCS;
+}
+
+void CDriSensor::Trace(const driEventSeverity Severity, const TCHAR* const Format, ...)
+{
+	TCHAR Text[DRI_SENSOR_TRACE_SIZE];
+
+	va_list Args;
+	va_start(Args, Format);
+	_vstprintf_s(Text, DRI_SENSOR_TRACE_SIZE, Format, Args);
+	va_end(Args);
+
+	FLog.Add(Severity, Text);
+}
+
+void CDriSensor::TraceStatistics()
+{
+	std::vector<driRadioStatistics> Statistics;
+	FCapture.GetStatistics(Statistics);
+	for (std::vector<driRadioStatistics>::iterator Radio = Statistics.begin(); Radio != Statistics.end(); Radio++)
+	{
+		Trace(esInfo, _T("%s %s: frames %I64u, unique %I64u"),
+			(Radio->Transport == ctWiFi) ? _T("WiFi") : _T("Bluetooth"),
+			Radio->Name.c_str(), Radio->Frames, Radio->Unique);
+	}
+
+	Trace(esInfo, _T("Sensor: frames %I64u, errors %I64u, drones %u"), FFrames, FErrors,
+		(unsigned int)FDrones.Count);
+}
+
+void CDriSensor::OpenRecording()
+{
+	tstring FileName = RecordFileName(FConfig.RecordPath, _T("DRI_%Y%m%d_%H%M%S.dricap"));
+	int Res = FRecording.Open(FileName);
+	if (Res != WCL_E_SUCCESS)
+		Trace(esError, _T("Open recording failed: 0x%.8X"), Res);
+	else
+		Trace(esInfo, _T("Recording: %s"), FileName.c_str());
+}
+
+void CDriSensor::CloseRecording()
+{
+	if (FRecording.Active)
+	{
+		// The recorder writes the queued frames on close so the counters are
+		// final only after it.
+		int Res = FRecording.Close();
+		if (Res != WCL_E_SUCCESS)
+			Trace(esError, _T("Close recording failed: 0x%.8X"), Res);
+		else
+		{
+			Trace(esInfo, _T("Recording closed. Frames: %I64u, dropped: %u"),
+				FRecording.Frames, FRecording.Dropped);
+
+			std::vector<driPoolStatistics> Pool;
+			FRecording.GetPoolStatistics(Pool);
+			for (std::vector<driPoolStatistics>::iterator Class = Pool.begin(); Class != Pool.end(); Class++)
+			{
+				if (Class->Allocations > 0)
+				{
+					double Hits = (double)(Class->CacheHits + Class->ListHits) * 100 / Class->Allocations;
+					if (Class->Size == 0)
+						Trace(esDebug, _T("Pool oversized: allocations %I64u"), Class->Allocations);
+					else
+					{
+						Trace(esDebug, _T("Pool %u bytes: allocations %I64u, hits %.1f%%"),
+							(unsigned int)Class->Size, Class->Allocations, Hits);
+					}
+				}
+			}
+		}
+	}
+}
+
+void CDriSensor::OpenArchive()
+{
+	tstring FileName = RecordFileName(FConfig.RecordPath, _T("DRI_%Y%m%d_%H%M%S.dritrk"));
+	int Res = FArchive.Open(FileName);
+	if (Res != WCL_E_SUCCESS)
+		Trace(esError, _T("Open track archive failed: 0x%.8X"), Res);
+	else
+		Trace(esInfo, _T("Track archive: %s"), FileName.c_str());
+}
+
+void CDriSensor::CloseArchive()
+{
+	if (FArchive.Active)
+	{
+		// The pending samples are written on close.
+		int Res = FArchive.Close();
+		if (Res != WCL_E_SUCCESS)
+		{
+			Trace(esError, _T("Close track archive failed: 0x%.8X, lost samples: %I64u"),
+				Res, FArchive.Lost);
+		}
+		else
+		{
+			Trace(esInfo, _T("Track archive closed. Samples: %I64u, lost: %I64u, size: %I64u"),
+				FArchive.Samples, FArchive.Lost, FArchive.Size);
+		}
+	}
+}
+
+bool CDriSensor::FindDroneId(const wclDriMessages& Messages, wclDriAsdId& Id) const
+{
+	for (wclDriMessages::const_iterator Message = Messages.begin(); Message != Messages.end(); Message++)
+	{
+		if ((*Message)->Vendor == driAsd)
+		{
+			CwclDriAsdMessage* AsdMessage = (CwclDriAsdMessage*)(*Message);
+			if (AsdMessage->MessageType == mtBasicId)
+			{
+				// The property returns a copy.
+				Id = ((CwclDriAsdBasicIdMessage*)AsdMessage)->Id;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void CDriSensor::OpenExporter()
+{
+	FExporter.Latency = FConfig.ExportLatency;
+	FExporter.Source = FConfig.ExportSource;
+	FExporter.Format = FConfig.ExportBinary ? efBinary : efJson;
+	FExporter.Protocol = FConfig.ExportTcp ? epTcp : epUdp;
+	FEncoder.Source = FConfig.ExportSource;
+	int Res = FExporter.Open(FConfig.ExportHost, FConfig.ExportPort);
+	if (Res != WCL_E_SUCCESS)
+		Trace(esError, _T("Open export failed: 0x%.8X"), Res);
+	else
+	{
+		Trace(esInfo, _T("Export: %s %s:%u"), FConfig.ExportTcp ? _T("tcp") : _T("udp"),
+			FConfig.ExportHost.c_str(), (unsigned int)FConfig.ExportPort);
+	}
+}
+
+void CDriSensor::CloseExporter()
+{
+	if (FExporter.Active)
+	{
+		// The exporter sends the queued records on close.
+		FExporter.Close();
+		Trace(esInfo, _T("Export closed. Records %I64u, datagrams %I64u, dropped %I64u, errors %I64u, max latency %u ms"),
+			FExporter.Records, FExporter.Datagrams, FExporter.Dropped, FExporter.Errors,
+			(unsigned int)FExporter.MaxLatency);
+	}
+}
+
+void CDriSensor::ExportTargets()
+{
+	unsigned long Time = CDriAsterixEncoder::TimeOfDay();
+
+	FCS->Enter();
+	FEncoder.Reset();
+	for (size_t Drone = 0; Drone < FDrones.Count; Drone++)
+	{
+		const driDrone* Data = FDrones.GetDrone(Drone);
+		if (!FEncoder.Add((unsigned short)Drone, *Data, Time))
+		{
+			// The block is full: send it and retry in the new one.
+			FExporter.PostDatagram(FEncoder.Data, FEncoder.Length);
+			FEncoder.Reset();
+			FEncoder.Add((unsigned short)Drone, *Data, Time);
+		}
+	}
+	if (FEncoder.Count > 0)
+		FExporter.PostDatagram(FEncoder.Data, FEncoder.Length);
+	FCS->Leave();
+}
+
+void CDriSensor::ArchiveLocation(const driFrame& Frame, const size_t Drone,
+	const CwclDriAsdLocationMessage* const Location)
+{
+	// The track is keyed by the UAS ID once the drone sent its Basic ID so
+	// the samples of a drone changing the address stay together.
+	const CwclDriAsdBasicIdMessage* Basic = (const CwclDriAsdBasicIdMessage*)
+		FDrones.GetDrone(Drone)->Slots[CDriDroneList::SlotOf(mtBasicId)].Message;
+	__int64 DroneKey = Frame.Source;
+	if (Basic != NULL)
+		DroneKey = DriUasIdKey(Basic->Id);
+	FArchive.Append(DroneKey, Frame.Timestamp, Location);
+}
+
+void CDriSensor::ArchiveBasicId(const driFrame& Frame, const size_t Drone,
+	const CwclDriAsdBasicIdMessage* const Basic)
+{
+	// The first Basic ID: the samples collected under the address join the
+	// track of the UAS ID.
+	if (FDrones.GetDrone(Drone)->Slots[CDriDroneList::SlotOf(mtBasicId)].Message == NULL)
+		FArchive.Rekey(Frame.Source, DriUasIdKey(Basic->Id));
+}
+
+void CDriSensor::UpdateMessages(const driFrame& Frame, const tstring& Name,
+	wclDriMessages& Messages)
+{
+	bool Added;
+	size_t Drone = FDrones.Add(Name, Added);
+	if (Added)
+		DoDroneChanged(Drone, DRI_NO_SLOT, true);
+
+	for (wclDriMessages::iterator Message = Messages.begin(); Message != Messages.end(); Message++)
+	{
+		if ((*Message)->Vendor != driAsd)
+			delete (*Message);
+		else
+		{
+			// Serialize before the list takes the message.
+			if (FConfig.ExportMessages)
+				FExporter.Post(Frame, Name, (CwclDriAsdMessage*)(*Message));
+			if (FArchive.Active)
+			{
+				if (((CwclDriAsdMessage*)(*Message))->MessageType == mtLocation)
+					ArchiveLocation(Frame, Drone, (CwclDriAsdLocationMessage*)(*Message));
+				else
+				{
+					if (((CwclDriAsdMessage*)(*Message))->MessageType == mtBasicId)
+						ArchiveBasicId(Frame, Drone, (CwclDriAsdBasicIdMessage*)(*Message));
+				}
+			}
+			if (FQuery.Active)
+				FPicture.Update(Frame, Name, (CwclDriAsdMessage*)(*Message));
+			size_t Slot = FDrones.Update(Drone, (CwclDriAsdMessage*)(*Message), Added);
+			DoDroneChanged(Drone, Slot, Added);
+		}
+	}
+
+	// Publish once per frame, not per message.
+	if (FTable.Active)
+		FTable.Update(Drone, *FDrones.GetDrone(Drone));
+}
+
+void CDriSensor::CaptureDriFrame(void* Sender, const driFrame& Frame)
+{
+	UNREFERENCED_PARAMETER(Sender);
+
+	ProcessFrame(Frame);
+}
+
+void CDriSensor::CaptureDriFrames(void* Sender,
+	const driFrameRecord* const Records, const size_t Count,
+	const unsigned char* const Data)
+{
+	UNREFERENCED_PARAMETER(Sender);
+
+	// The parsers need the raw data vector: reuse one for the whole batch.
+	// The frame is built under the lock because the buffer is shared with
+	// Replay.
+	driFrame Frame;
+	Frame.Raw = &FBatchRaw;
+
+	FCS->Enter();
+	for (size_t i = 0; i < Count; i++)
+	{
+		const driFrameRecord& Record = Records[i];
+		Frame.Transport = Record.Transport;
+		Frame.Radio = Record.Radio;
+		Frame.Source = Record.Source;
+		Frame.Timestamp = Record.Timestamp;
+		Frame.Rssi = Record.Rssi;
+		if (Record.SsidLength > 0)
+			Frame.Ssid.assign((const TCHAR*)(Data + Record.SsidOffset), Record.SsidLength);
+		else
+			Frame.Ssid.clear();
+		FBatchRaw.assign(Data + Record.Offset, Data + Record.Offset + Record.Length);
+
+		ProcessFrame(Frame);
+	}
+	FCS->Leave();
+}
+
+void CDriSensor::CaptureRadioStateChanged(void* Sender,
+	const unsigned char Radio, const bool Active)
+{
+	UNREFERENCED_PARAMETER(Sender);
+
+	std::vector<driRadioStatistics> Statistics;
+	FCapture.GetStatistics(Statistics);
+	if (Radio < Statistics.size())
+	{
+		Trace(esInfo, Active ? _T("%s: capture started") : _T("%s: capture stopped"),
+			Statistics[Radio].Name.c_str());
+	}
+}
+
+void CDriSensor::CaptureScanProfileChanged(void* Sender,
+	const unsigned char Radio, const driScanMetrics& Metrics)
+{
+	UNREFERENCED_PARAMETER(Sender);
+
+	Trace(esInfo, _T("Radio %u scan profile: interval %u, window %u, %s (last period DRI %.1f/s), gap %u ms"),
+		Radio, Metrics.Parameters.Interval, Metrics.Parameters.Window,
+		(Metrics.Parameters.Mode == smActive) ? _T("active") : _T("passive"),
+		Metrics.DriRate, Metrics.LastGap);
+}
+
+void CDriSensor::DoDroneChanged(const size_t Drone, const size_t Slot,
+	const bool Added)
+{
+	OnDroneChanged(this, Drone, Slot, Added);
+}
+
+void CDriSensor::DefaultConfig(driSensorConfig& Config)
+{
+	Config.MessageProcessing = mpSync;
+	Config.DedupWindow = 2000;
+	Config.DriOnly = false;
+	Config.BatchSize = 64;
+	Config.BatchLatency = 100;
+	Config.Workers = 0;
+	Config.Record = true;
+	Config.RecordPath = _T("");
+	Config.Archive = false;
+	Config.LogFile = _T("");
+	Config.ExportHost = _T("");
+	Config.ExportPort = DRI_EXPORT_PORT;
+	Config.ExportLatency = DRI_EXPORT_LATENCY;
+	Config.ExportMessages = true;
+	Config.ExportBinary = false;
+	Config.ExportTcp = false;
+	Config.ExportTargets = false;
+	Config.ExportSource = 0;
+	Config.SharedTable = _T("");
+	Config.SharedSlots = DRI_TABLE_SLOTS;
+	Config.QueryPort = 0;
+	Config.QuerySpan = DRI_PICTURE_TRACK_SPAN;
+}
+
+int CDriSensor::LoadConfig(const tstring& FileName, driSensorConfig& Config)
+{
+	if (FileName == _T(""))
+		return WCL_E_INVALID_ARGUMENT;
+	if (GetFileAttributes(FileName.c_str()) == INVALID_FILE_ATTRIBUTES)
+		return DRI_E_SENSOR_NO_CONFIG;
+
+	const TCHAR* File = FileName.c_str();
+	TCHAR Value[MAX_PATH];
+
+	GetPrivateProfileString(DRI_SENSOR_CONFIG_SECTION, _T("MessageProcessing"),
+		_T(""), Value, MAX_PATH, File);
+	if (_tcsicmp(Value, _T("async")) == 0)
+		Config.MessageProcessing = mpAsync;
+	else
+	{
+		if (_tcsicmp(Value, _T("sync")) == 0)
+			Config.MessageProcessing = mpSync;
+	}
+
+	Config.DedupWindow = GetPrivateProfileInt(DRI_SENSOR_CONFIG_SECTION,
+		_T("DedupWindow"), Config.DedupWindow, File);
+	Config.DriOnly = (GetPrivateProfileInt(DRI_SENSOR_CONFIG_SECTION,
+		_T("DriOnly"), Config.DriOnly ? 1 : 0, File) != 0);
+	Config.BatchSize = GetPrivateProfileInt(DRI_SENSOR_CONFIG_SECTION,
+		_T("BatchSize"), Config.BatchSize, File);
+	Config.BatchLatency = GetPrivateProfileInt(DRI_SENSOR_CONFIG_SECTION,
+		_T("BatchLatency"), Config.BatchLatency, File);
+	Config.Workers = GetPrivateProfileInt(DRI_SENSOR_CONFIG_SECTION,
+		_T("Workers"), Config.Workers, File);
+	Config.Record = (GetPrivateProfileInt(DRI_SENSOR_CONFIG_SECTION,
+		_T("Record"), Config.Record ? 1 : 0, File) != 0);
+
+	GetPrivateProfileString(DRI_SENSOR_CONFIG_SECTION, _T("RecordPath"),
+		Config.RecordPath.c_str(), Value, MAX_PATH, File);
+	Config.RecordPath = Value;
+	Config.Archive = (GetPrivateProfileInt(DRI_SENSOR_CONFIG_SECTION,
+		_T("Archive"), Config.Archive ? 1 : 0, File) != 0);
+	GetPrivateProfileString(DRI_SENSOR_CONFIG_SECTION, _T("LogFile"),
+		Config.LogFile.c_str(), Value, MAX_PATH, File);
+	Config.LogFile = Value;
+
+	GetPrivateProfileString(DRI_SENSOR_CONFIG_SECTION, _T("ExportHost"),
+		Config.ExportHost.c_str(), Value, MAX_PATH, File);
+	Config.ExportHost = Value;
+	Config.ExportPort = (unsigned short)GetPrivateProfileInt(DRI_SENSOR_CONFIG_SECTION,
+		_T("ExportPort"), Config.ExportPort, File);
+	Config.ExportLatency = GetPrivateProfileInt(DRI_SENSOR_CONFIG_SECTION,
+		_T("ExportLatency"), Config.ExportLatency, File);
+	Config.ExportMessages = (GetPrivateProfileInt(DRI_SENSOR_CONFIG_SECTION,
+		_T("ExportMessages"), Config.ExportMessages ? 1 : 0, File) != 0);
+	Config.ExportBinary = (GetPrivateProfileInt(DRI_SENSOR_CONFIG_SECTION,
+		_T("ExportBinary"), Config.ExportBinary ? 1 : 0, File) != 0);
+	Config.ExportTcp = (GetPrivateProfileInt(DRI_SENSOR_CONFIG_SECTION,
+		_T("ExportTcp"), Config.ExportTcp ? 1 : 0, File) != 0);
+	Config.ExportTargets = (GetPrivateProfileInt(DRI_SENSOR_CONFIG_SECTION,
+		_T("ExportTargets"), Config.ExportTargets ? 1 : 0, File) != 0);
+	Config.ExportSource = (unsigned short)GetPrivateProfileInt(DRI_SENSOR_CONFIG_SECTION,
+		_T("ExportSource"), Config.ExportSource, File);
+
+	GetPrivateProfileString(DRI_SENSOR_CONFIG_SECTION, _T("SharedTable"),
+		Config.SharedTable.c_str(), Value, MAX_PATH, File);
+	Config.SharedTable = Value;
+	Config.SharedSlots = GetPrivateProfileInt(DRI_SENSOR_CONFIG_SECTION,
+		_T("SharedSlots"), Config.SharedSlots, File);
+	Config.QueryPort = (unsigned short)GetPrivateProfileInt(DRI_SENSOR_CONFIG_SECTION,
+		_T("QueryPort"), Config.QueryPort, File);
+	Config.QuerySpan = GetPrivateProfileInt(DRI_SENSOR_CONFIG_SECTION,
+		_T("QuerySpan"), Config.QuerySpan, File);
+
+	return WCL_E_SUCCESS;
+}
+
+tstring CDriSensor::AppPath()
+{
+	TCHAR Path[MAX_PATH];
+	DWORD Len = GetModuleFileName(NULL, Path, MAX_PATH);
+	while (Len > 0 && Path[Len - 1] != _T('\\'))
+		Len--;
+	return tstring(Path, Len);
+}
+
+int CDriSensor::Open(const driSensorConfig& Config)
+{
+	if (FOpened)
+		return DRI_E_SENSOR_OPENED;
+
+	FConfig = Config;
+	FCapture.MessageProcessing = FConfig.MessageProcessing;
+	FCapture.DedupWindow = FConfig.DedupWindow;
+	FCapture.DriOnly = FConfig.DriOnly;
+	FCapture.BatchSize = FConfig.BatchSize;
+	FCapture.BatchLatency = FConfig.BatchLatency;
+
+	int Res = FThreadPool.Start(FConfig.Workers);
+	if (Res != WCL_E_SUCCESS)
+		Trace(esError, _T("Start thread pool failed: 0x%.8X"), Res);
+
+	if (FConfig.LogFile != _T(""))
+	{
+		Res = FLog.Open(FConfig.LogFile);
+		if (Res != WCL_E_SUCCESS)
+			Trace(esError, _T("Open event log file failed: 0x%.8X"), Res);
+	}
+
+	if (FConfig.ExportHost != _T(""))
+		OpenExporter();
+
+	if (FConfig.SharedTable != _T(""))
+	{
+		Res = FTable.Open(FConfig.SharedTable, FConfig.SharedSlots);
+		if (Res != WCL_E_SUCCESS)
+			Trace(esError, _T("Publish drone table failed: 0x%.8X"), Res);
+		else
+		{
+			Trace(esInfo, _T("Drone table: %s, %u slots"), FConfig.SharedTable.c_str(),
+				FConfig.SharedSlots);
+		}
+	}
+
+	if (FConfig.QueryPort != 0)
+	{
+		FPicture.Clear();
+		FPicture.TrackSpan = FConfig.QuerySpan;
+		Res = FQuery.Open(FConfig.QueryPort);
+		if (Res != WCL_E_SUCCESS)
+			Trace(esError, _T("Start query server failed: 0x%.8X"), Res);
+		else
+			Trace(esInfo, _T("Query server: 127.0.0.1:%u"), (unsigned int)FConfig.QueryPort);
+	}
+
+	FFrames = 0;
+	FErrors = 0;
+	FOpened = true;
+	return WCL_E_SUCCESS;
+}
+
+int CDriSensor::Close()
+{
+	if (!FOpened)
+		return DRI_E_SENSOR_CLOSED;
+
+	Stop();
+	if (FQuery.Active)
+	{
+		Trace(esInfo, _T("Query server: %I64u requests, %I64u cached"),
+			FQuery.Requests, FQuery.CacheHits);
+		FQuery.Close();
+	}
+	if (FTable.Active)
+	{
+		if (FTable.Unpublished > 0)
+		{
+			Trace(esWarning, _T("Drone table: %u drones did not fit the slots"),
+				(unsigned int)FTable.Unpublished);
+		}
+		FTable.Close();
+	}
+	CloseExporter();
+	FLog.Close();
+	// The recording and the event log are closed so no tasks are left.
+	FThreadPool.Stop();
+
+	FOpened = false;
+	return WCL_E_SUCCESS;
+}
+
+int CDriSensor::Start()
+{
+	if (!FOpened)
+		return DRI_E_SENSOR_CLOSED;
+	if (FCapture.Active)
+		return DRI_E_SENSOR_ACTIVE;
+
+	int Res = FCapture.Start();
+	if (Res != WCL_E_SUCCESS)
+		Trace(esError, _T("Start capture failed: 0x%.8X"), Res);
+	else
+	{
+		if (FConfig.Record)
+			OpenRecording();
+		if (FConfig.Archive)
+			OpenArchive();
+	}
+	return Res;
+}
+
+int CDriSensor::Stop()
+{
+	if (!FCapture.Active)
+		return DRI_E_SENSOR_NOT_ACTIVE;
+
+	FCapture.Stop();
+
+	TraceStatistics();
+	CloseRecording();
+	CloseArchive();
+	return WCL_E_SUCCESS;
+}
+
+void CDriSensor::Tick()
+{
+	FCapture.Tick();
+	if (FExporter.Active && FConfig.ExportTargets)
+		ExportTargets();
+	if (FArchive.Active)
+		FArchive.FlushIdle(FileTimeNow());
+	if (FQuery.Active)
+		FPicture.Expire(FileTimeNow());
+}
+
+void CDriSensor::Flush()
+{
+	FCapture.Flush();
+	FLog.Flush();
+}
+
+int CDriSensor::ProcessFrame(const driFrame& Frame)
+{
+	wclDriMessages Messages;
+	int Res;
+
+	FCS->Enter();
+	FFrames++;
+	if (Frame.Transport == ctWiFi)
+	{
+		// Give the parser only the DRI element so it does not split and copy
+		// every element of the beacon.
+		driIeView Element;
+		if (CDriIeIterator::FindVendor(Frame.Raw->data(), Frame.Raw->size(),
+			DRI_IE_ASD_OUI, DRI_IE_ASD_TYPE, Element))
+		{
+			FDriElement.assign(Element.Element, Element.Data + Element.Length);
+			Res = FParser.ParseDriMessages(FDriElement, Messages);
+		}
+		else
+			Res = WCL_E_INVALID_ARGUMENT;
+	}
+	else
+		Res = FBtParser.Parse(*Frame.Raw, Messages);
+
+	if (Res != WCL_E_SUCCESS)
+		FErrors++;
+
+	if (FRecording.Active)
+	{
+		wclDriAsdId Id;
+		bool Found = (Res == WCL_E_SUCCESS && FindDroneId(Messages, Id));
+		FRecording.Post(Frame.Transport, Frame.Radio, Frame.Source, Frame.Timestamp,
+			Frame.Rssi, Frame.Raw->data(), Frame.Raw->size(), Found ? &Id : NULL);
+	}
+
+	if (Res == WCL_E_SUCCESS && Messages.size() > 0)
+	{
+		if (Frame.Transport == ctWiFi)
+			UpdateMessages(Frame, Frame.Ssid, Messages);
+		else
+			UpdateMessages(Frame, SourceName(Frame.Source), Messages);
+	}
+	FCS->Leave();
+
+	return Res;
+}
+
+int CDriSensor::Replay(const tstring& FileName)
+{
+	if (FCapture.Active)
+		return DRI_E_SENSOR_ACTIVE;
+
+	CDriCaptureLogReader* Reader = new CDriCaptureLogReader();
+	int Res = Reader->Open(FileName);
+	if (Res == WCL_E_SUCCESS)
+	{
+		driFrame Frame;
+		Frame.Raw = &FBatchRaw;
+
+		unsigned __int64 Position = Reader->First();
+		driCaptureFrame Record;
+		FCS->Enter();
+		while ((Res = Reader->Next(Position, Record)) == WCL_E_SUCCESS)
+		{
+			Frame.Transport = Record.Transport;
+			Frame.Radio = Record.Radio;
+			Frame.Source = Record.Source;
+			Frame.Timestamp = Record.Timestamp;
+			Frame.Rssi = Record.Rssi;
+			if (Record.Transport == ctWiFi)
+				Frame.Ssid = SsidOf(Record.Data, Record.Length);
+			else
+				Frame.Ssid.clear();
+			FBatchRaw.assign(Record.Data, Record.Data + Record.Length);
+
+			ProcessFrame(Frame);
+		}
+		FCS->Leave();
+
+		if (Res == DRI_E_LOG_EOF)
+			Res = WCL_E_SUCCESS;
+		Reader->Close();
+	}
+	delete Reader;
+
+	if (Res != WCL_E_SUCCESS)
+		Trace(esError, _T("Replay %s failed: 0x%.8X"), FileName.c_str(), Res);
+	else
+		Trace(esInfo, _T("Replay %s: frames %I64u, errors %I64u, drones %u"), FileName.c_str(),
+			FFrames, FErrors, (unsigned int)FDrones.Count);
+	return Res;
+}
+
+void CDriSensor::Clear()
+{
+	FCS->Enter();
+	FDrones.Clear();
+	FTable.Clear();
+	FPicture.Clear();
+	FCS->Leave();
+}
+
+void CDriSensor::Lock()
+{
+	FCS->Enter();
+}
+
+void CDriSensor::Unlock()
+{
+	FCS->Leave();
+}
+
+void CDriSensor::GetStatistics(std::vector<driRadioStatistics>& Statistics) const
+{
+	FCapture.GetStatistics(Statistics);
+}
+
+bool CDriSensor::GetActive() const
+{
+	return FCapture.Active;
+}
+
+CDriDroneList* CDriSensor::GetDrones()
+{
+	return &FDrones;
+}
+
+CDriEventLog* CDriSensor::GetLog()
+{
+	return &FLog;
+}
+
+CDriExporter* CDriSensor::GetExporter()
+{
+	return &FExporter;
+}
+
+unsigned __int64 CDriSensor::GetFrames() const
+{
+	return FFrames;
+}
+
+unsigned __int64 CDriSensor::GetErrors() const
+{
+	return FErrors;
+}
@@ -0,0 +1,348 @@
+
+// DriSensor.h : header file
+//
+
+#pragma once
+
+#include "wclHelpers.h"
+#include "wclSync.h"
+#include "wclWiFi.h"
+#include "wclBluetooth.h"
+#include "wclDriAsd.h"
+
+#include "DriErrors.h"
+#include "DriCaptureLog.h"
+#include "DriCaptureManager.h"
+#include "DriAsterix.h"
+#include "DriDroneList.h"
+#include "DriEventLog.h"
+#include "DriExport.h"
+#include "DriQueryServer.h"
+#include "DriRecorder.h"
+#include "DriSharedTable.h"
+#include "DriTrackArchive.h"
+#include "DriThreadPool.h"
+
+using namespace wclCommon;
+using namespace wclSync;
+using namespace wclWiFi;
+using namespace wclBluetooth;
+using namespace wclDri;
+
+/// <summary> The recommended <c>Tick</c> call interval in
+///   milliseconds. </summary>
+#define DRI_SENSOR_TICK_INTERVAL	1000
+/// <summary> The recommended <c>Flush</c> call interval in
+///   milliseconds. </summary>
+#define DRI_SENSOR_FLUSH_INTERVAL	50
+/// <summary> The configuration file section name. </summary>
+#define DRI_SENSOR_CONFIG_SECTION	_T("Sensor")
+
+/// <summary> The sensor configuration. </summary>
+typedef struct
+{
+	/// <summary> The message processing method of the radio events.
+	///   <c>mpAsync</c> for the services and console applications. </summary>
+	wclMessageProcessingMethod	MessageProcessing;
+	/// <summary> The duplicates window in milliseconds. </summary>
+	unsigned long				DedupWindow;
+	/// <summary> <c>True</c> if the Bluetooth LE radios handle only the DRI
+	///   advertisements. </summary>
+	bool						DriOnly;
+	/// <summary> The capture batch size (0 - no batching). </summary>
+	unsigned long				BatchSize;
+	/// <summary> The capture batch latency in milliseconds. </summary>
+	unsigned long				BatchLatency;
+	/// <summary> The number of the thread pool workers (0 - one per
+	///   processor). </summary>
+	unsigned long				Workers;
+	/// <summary> <c>True</c> to record the captured frames. </summary>
+	bool						Record;
+	/// <summary> The recordings folder. Empty for the application
+	///   folder. </summary>
+	tstring						RecordPath;
+	/// <summary> <c>True</c> to archive the drone tracks (the decoded
+	///   locations) in the recordings folder. </summary>
+	bool						Archive;
+	/// <summary> The event log file name. Empty to keep the events in memory
+	///   only. </summary>
+	tstring						LogFile;
+	/// <summary> The export destination host. Empty to not
+	///   export. </summary>
+	tstring						ExportHost;
+	/// <summary> The export destination UDP or TCP port. </summary>
+	unsigned short				ExportPort;
+	/// <summary> The maximum export latency in milliseconds. </summary>
+	unsigned long				ExportLatency;
+	/// <summary> <c>True</c> to export every decoded message. </summary>
+	bool						ExportMessages;
+	/// <summary> <c>True</c> to export the messages as binary records,
+	///   <c>false</c> as JSON lines. </summary>
+	bool						ExportBinary;
+	/// <summary> <c>True</c> to export over TCP, <c>false</c> over
+	///   UDP. </summary>
+	bool						ExportTcp;
+	/// <summary> <c>True</c> to export the binary (ASTERIX layout) target
+	///   reports of all the drones on every <c>Tick</c>. </summary>
+	bool						ExportTargets;
+	/// <summary> The sensor identification (SAC and SIC) of the JSON lines
+	///   and the target reports. </summary>
+	unsigned short				ExportSource;
+	/// <summary> The shared memory section name of the live drone table.
+	///   Empty to not publish the table. </summary>
+	tstring						SharedTable;
+	/// <summary> The number of the shared table slots. </summary>
+	unsigned long				SharedSlots;
+	/// <summary> The local query server TCP port (0 - no server). The usual
+	///   port is <see cref="DRI_QUERY_PORT" />. </summary>
+	unsigned short				QueryPort;
+	/// <summary> The track history length of the query server in
+	///   minutes. </summary>
+	unsigned long				QuerySpan;
+} driSensorConfig;
+
+/// <summary> The headless DRI sensor. </summary>
+/// <remarks> <para> The sensor is the processing core shared by the user
+///   interface and the service: it runs the
+///   <see cref="CDriCaptureManager" />, parses the captured frames, keeps the
+///   per-drone state in a <see cref="CDriDroneList" />, records the frames
+///   and logs the events. It does not depend on MFC and does not need a
+///   window or a message loop when <c>MessageProcessing</c> is
+///   <c>mpAsync</c>. </para>
+///   <para> The owner calls <c>Tick</c> every
+///   <see cref="DRI_SENSOR_TICK_INTERVAL" /> and <c>Flush</c> every
+///   <see cref="DRI_SENSOR_FLUSH_INTERVAL" /> milliseconds from a timer or
+///   its main loop. </para>
+///   <para> The frames can also be fed from a recording (<c>Replay</c>) so
+///   the parsing and the drone state can be checked without radios. </para>
+///   <para> The drone list is changed under the sensor lock in the thread
+///   that delivers the frames (the library thread with <c>mpAsync</c>). A
+///   reader running in another thread must hold the lock (<c>Lock</c> and
+///   <c>Unlock</c>) while it uses the list. </para> </remarks>
+class CDriSensor
+{
+	DISABLE_COPY(CDriSensor);
+
+private:
+	CwclCriticalSection*	FCS;
+	CDriCaptureManager		FCapture;
+	CwclDriAsdParser		FBtParser;
+	CwclWiFiDriParser		FParser;
+	CDriThreadPool			FThreadPool;
+	CDriRecorder			FRecording;
+	CDriEventLog			FLog;
+	CDriExporter			FExporter;
+	CDriAsterixEncoder		FEncoder;
+	CDriSharedTable			FTable;
+	CDriTrackArchiveWriter	FArchive;
+	CDriDroneList			FDrones;
+	CDriPicture				FPicture;
+	CDriQueryServer			FQuery;
+
+	driSensorConfig			FConfig;
+	bool					FOpened;
+	unsigned __int64		FFrames;
+	unsigned __int64		FErrors;
+	// The frame data buffers reused for every frame.
+	wclDriRawData			FBatchRaw;
+	wclWiFiIeRawData		FDriElement;
+
+	void Trace(const driEventSeverity Severity, const TCHAR* const Format, ...);
+	void TraceStatistics();
+
+	void OpenRecording();
+	void CloseRecording();
+	void OpenArchive();
+	void CloseArchive();
+
+	bool FindDroneId(const wclDriMessages& Messages, wclDriAsdId& Id) const;
+	void OpenExporter();
+	void CloseExporter();
+	void ExportTargets();
+
+	void ArchiveLocation(const driFrame& Frame, const size_t Drone,
+		const CwclDriAsdLocationMessage* const Location);
+	void ArchiveBasicId(const driFrame& Frame, const size_t Drone,
+		const CwclDriAsdBasicIdMessage* const Basic);
+	void UpdateMessages(const driFrame& Frame, const tstring& Name,
+		wclDriMessages& Messages);
+
+	void CaptureDriFrame(void* Sender, const driFrame& Frame);
+	void CaptureDriFrames(void* Sender, const driFrameRecord* const Records,
+		const size_t Count, const unsigned char* const Data);
+	void CaptureRadioStateChanged(void* Sender, const unsigned char Radio,
+		const bool Active);
+	void CaptureScanProfileChanged(void* Sender, const unsigned char Radio,
+		const driScanMetrics& Metrics);
+
+protected:
+	/// <summary> Fires the <c>OnDroneChanged</c> event. </summary>
+	/// <param name="Drone"> The drone index. </param>
+	/// <param name="Slot"> The message slot or <see cref="DRI_NO_SLOT" />
+	///   if the drone was added. </param>
+	/// <param name="Added"> <c>True</c> if the drone or the slot is
+	///   new. </param>
+	virtual void DoDroneChanged(const size_t Drone, const size_t Slot,
+		const bool Added);
+
+public:
+	/// <summary> Creates new sensor. </summary>
+	CDriSensor();
+	/// <summary> Closes the sensor and frees the object. </summary>
+	virtual ~CDriSensor();
+
+	/// <summary> Fills the configuration with the default values. </summary>
+	/// <param name="Config"> On output contains the default
+	///   configuration. </param>
+	static void DefaultConfig(driSensorConfig& Config);
+	/// <summary> Reads the configuration from an INI file. </summary>
+	/// <param name="FileName"> The configuration file name. </param>
+	/// <param name="Config"> On input contains the default values. On output
+	///   contains the configuration. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	/// <remarks> The values are read from the <c>[Sensor]</c> section:
+	///   <c>MessageProcessing</c> (<c>async</c> or <c>sync</c>),
+	///   <c>DedupWindow</c>, <c>DriOnly</c>, <c>BatchSize</c>,
+	///   <c>BatchLatency</c>, <c>Workers</c>, <c>Record</c>,
+	///   <c>RecordPath</c>, <c>Archive</c>, <c>LogFile</c>,
+	///   <c>ExportHost</c>, <c>ExportPort</c>, <c>ExportLatency</c>,
+	///   <c>ExportMessages</c>, <c>ExportBinary</c>, <c>ExportTcp</c>,
+	///   <c>ExportTargets</c>, <c>ExportSource</c>,
+	///   <c>SharedTable</c>, <c>SharedSlots</c>, <c>QueryPort</c> and
+	///   <c>QuerySpan</c>. A missing value keeps the input value. </remarks>
+	static int LoadConfig(const tstring& FileName, driSensorConfig& Config);
+	/// <summary> Gets the application folder. </summary>
+	/// <returns> The folder of the executable with the trailing
+	///   backslash. </returns>
+	static tstring AppPath();
+
+	/// <summary> Opens the sensor. </summary>
+	/// <param name="Config"> The sensor configuration. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	/// <remarks> Starts the thread pool, opens the event log file, starts
+	///   the export, publishes the shared drone table and starts the query
+	///   server. If they fail the error is logged and the sensor works
+	///   without them (the tasks run in the calling thread, the events are
+	///   kept in memory, nothing is exported, published or served). </remarks>
+	int Open(const driSensorConfig& Config);
+	/// <summary> Stops capturing and closes the sensor. </summary>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Close();
+
+	/// <summary> Starts capturing. </summary>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	/// <remarks> The recording and the track archive are opened when the
+	///   configuration asks for them. </remarks>
+	int Start();
+	/// <summary> Stops capturing. </summary>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	/// <remarks> The statistics are logged and the recording and the track
+	///   archive are closed. </remarks>
+	int Stop();
+
+	/// <summary> Runs the capture periodic tasks, exports the target
+	///   reports and archives the tracks of the lost drones. </summary>
+	void Tick();
+	/// <summary> Delivers the collected frames and schedules writing the
+	///   logged events. </summary>
+	void Flush();
+
+	/// <summary> Processes one frame. </summary>
+	/// <param name="Frame"> The captured frame. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns the
+	///   parser error. </returns>
+	/// <remarks> The frame is parsed, recorded (if the recording is active),
+	///   the decoded messages are exported (if the export is active) and the
+	///   drone list and the shared table are updated. </remarks>
+	int ProcessFrame(const driFrame& Frame);
+	/// <summary> Processes all the frames of a capture log. </summary>
+	/// <param name="FileName"> The capture log (recording) file
+	///   name. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	/// <remarks> The frames are processed in the calling thread. The capture
+	///   must not be active. </remarks>
+	int Replay(const tstring& FileName);
+
+	/// <summary> Removes all the drones. </summary>
+	void Clear();
+
+	/// <summary> Locks the drone list. </summary>
+	void Lock();
+	/// <summary> Unlocks the drone list. </summary>
+	void Unlock();
+
+	/// <summary> Gets the per-radio statistics. </summary>
+	/// <param name="Statistics"> On output contains the statistics. The index
+	///   in the array is the radio index. </param>
+	void GetStatistics(std::vector<driRadioStatistics>& Statistics) const;
+
+	/// <summary> Gets the capture state. </summary>
+	/// <returns> <c>True</c> if capturing. </returns>
+	bool GetActive() const;
+	/// <summary> Gets the capture state. </summary>
+	/// <value> <c>True</c> if capturing. </value>
+	__declspec(property(get = GetActive)) bool Active;
+
+	/// <summary> Gets the drone list. </summary>
+	/// <returns> The drone list. </returns>
+	CDriDroneList* GetDrones();
+	/// <summary> Gets the drone list. </summary>
+	/// <value> The drone list. </value>
+	__declspec(property(get = GetDrones)) CDriDroneList* Drones;
+
+	/// <summary> Gets the event log. </summary>
+	/// <returns> The event log. </returns>
+	CDriEventLog* GetLog();
+	/// <summary> Gets the event log. </summary>
+	/// <value> The event log. </value>
+	__declspec(property(get = GetLog)) CDriEventLog* Log;
+
+	/// <summary> Gets the JSON exporter. </summary>
+	/// <returns> The exporter. </returns>
+	CDriExporter* GetExporter();
+	/// <summary> Gets the JSON exporter. </summary>
+	/// <value> The exporter. </value>
+	__declspec(property(get = GetExporter)) CDriExporter* Exporter;
+
+	/// <summary> Gets the number of the processed frames. </summary>
+	/// <returns> The frames count. </returns>
+	unsigned __int64 GetFrames() const;
+	/// <summary> Gets the number of the processed frames. </summary>
+	/// <value> The frames count. </value>
+	__declspec(property(get = GetFrames)) unsigned __int64 Frames;
+
+	/// <summary> Gets the number of the frames the parsers
+	///   rejected. </summary>
+	/// <returns> The rejected frames count. </returns>
+	unsigned __int64 GetErrors() const;
+	/// <summary> Gets the number of the frames the parsers
+	///   rejected. </summary>
+	/// <value> The rejected frames count. </value>
+	__declspec(property(get = GetErrors)) unsigned __int64 Errors;
+
+	/// <summary> The event fires when a drone was added or its message
+	///   changed. </summary>
+	/// <param name="Sender"> The object initiates the event. </param>
+	/// <param name="Drone"> The drone index. </param>
+	/// <param name="Slot"> The changed message slot or
+	///   <see cref="DRI_NO_SLOT" /> if the drone was added. </param>
+	/// <param name="Added"> <c>True</c> if the drone or the slot is
+	///   new. </param>
+	/// <remarks> The event fires under the sensor lock in the thread that
+	///   delivered the frame. </remarks>
+	__event void OnDroneChanged(void* Sender, const size_t Drone,
+		const size_t Slot, const bool Added);
+};
@@ -0,0 +1,431 @@
+
+// DriSharedTable.cpp : implementation file
+//
+
+#include "stdafx.h"
+#include "DriSharedTable.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+
+// Copies the text zero padded (or truncated) to Size bytes.
+static void CopyText(char* const Dest, const size_t Size, const char* const Text,
+	const size_t Len)
+{
+	size_t Copy = min(Len, Size);
+	if (Copy > 0)
+		CopyMemory(Dest, Text, Copy);
+	if (Copy < Size)
+		ZeroMemory(Dest + Copy, Size - Copy);
+}
+
+static void CopyId(char* const Dest, const wclDriAsdId& Id)
+{
+	if (Id.size() == 0)
+		CopyText(Dest, DRI_TABLE_ID_SIZE, "", 0);
+	else
+		CopyText(Dest, DRI_TABLE_ID_SIZE, (const char*)&Id[0], Id.size());
+}
+
+static const CwclDriAsdMessage* SlotMessage(const driDrone& Drone,
+	const wclDriAsdMessageType MessageType)
+{
+	return Drone.Slots[CDriDroneList::SlotOf(MessageType)].Message;
+}
+
+#ifndef _WIN32
+// The POSIX shared memory object name: the section name (ASCII) with the
+// leading slash.
+static std::string ObjectName(const tstring& Name)
+{
+	std::string Res = "/";
+	for (size_t i = 0; i < Name.length(); i++)
+		Res += (char)Name[i];
+	return Res;
+}
+#endif
+
+
+// CDriSharedTable
+
+CDriSharedTable::CDriSharedTable()
+{
+#ifdef _WIN32
+	FMapping = NULL;
+#else
+	FSize = 0;
+#endif
+	FHeader = NULL;
+	FSlots = NULL;
+}
+
+CDriSharedTable::~CDriSharedTable()
+{
+	Close();
+}
+
+int CDriSharedTable::Open(const tstring& Name, const unsigned long Slots)
+{
+	if (Name == _T("") || Slots == 0)
+		return WCL_E_INVALID_ARGUMENT;
+	if (FHeader != NULL)
+		return DRI_E_TABLE_OPENED;
+
+	DWORD Size = sizeof(driTableHeader) + Slots * sizeof(driTableSlot);
+	int Res = WCL_E_SUCCESS;
+#ifdef _WIN32
+	FMapping = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, Size,
+		Name.c_str());
+	if (FMapping == NULL)
+		return DRI_E_TABLE_MAP_FAILED;
+
+	// Do not write into a table of other publisher.
+	if (GetLastError() == ERROR_ALREADY_EXISTS)
+		Res = DRI_E_TABLE_EXISTS;
+	else
+	{
+		FHeader = (driTableHeader*)MapViewOfFile(FMapping, FILE_MAP_WRITE, 0, 0, Size);
+		if (FHeader == NULL)
+			Res = DRI_E_TABLE_MAP_FAILED;
+	}
+
+	if (Res != WCL_E_SUCCESS)
+	{
+		CloseHandle(FMapping);
+		FMapping = NULL;
+	}
+#else
+	std::string Object = ObjectName(Name);
+	// Do not write into a table of other publisher.
+	int Handle = shm_open(Object.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (Handle == -1)
+		return (errno == EEXIST ? DRI_E_TABLE_EXISTS : DRI_E_TABLE_MAP_FAILED);
+
+	if (ftruncate(Handle, Size) == -1)
+		Res = DRI_E_TABLE_MAP_FAILED;
+	else
+	{
+		void* View = mmap(NULL, Size, PROT_READ | PROT_WRITE, MAP_SHARED, Handle, 0);
+		if (View == MAP_FAILED)
+			Res = DRI_E_TABLE_MAP_FAILED;
+		else
+		{
+			FHeader = (driTableHeader*)View;
+			FName = Object;
+			FSize = Size;
+		}
+	}
+	// The mapping keeps the object.
+	close(Handle);
+	if (Res != WCL_E_SUCCESS)
+		shm_unlink(Object.c_str());
+#endif
+
+	if (Res == WCL_E_SUCCESS)
+	{
+		// The new section is zeroed. The signature is written last so a reader
+		// never takes a half initialized header.
+		FSlots = (driTableSlot*)(FHeader + 1);
+		FHeader->Version = DRI_TABLE_VERSION;
+		FHeader->SlotSize = sizeof(driTableSlot);
+		FHeader->Slots = Slots;
+		FHeader->Count = 0;
+		FHeader->Updates = 0;
+		FHeader->Unpublished = 0;
+		MemoryBarrier();
+		FHeader->Magic = DRI_TABLE_MAGIC;
+	}
+	return Res;
+}
+
+int CDriSharedTable::Close()
+{
+	if (FHeader == NULL)
+		return DRI_E_TABLE_CLOSED;
+
+#ifdef _WIN32
+	UnmapViewOfFile(FHeader);
+	CloseHandle(FMapping);
+	FMapping = NULL;
+#else
+	// The readers keep their mappings; new readers do not find the table.
+	munmap(FHeader, FSize);
+	shm_unlink(FName.c_str());
+	FName = "";
+	FSize = 0;
+#endif
+	FHeader = NULL;
+	FSlots = NULL;
+	return WCL_E_SUCCESS;
+}
+
+void CDriSharedTable::Update(const size_t Index, const driDrone& Drone)
+{
+	if (FHeader == NULL)
+		return;
+	if (Index >= FHeader->Slots)
+	{
+		// The drone indexes are used in order: the drones from the first
+		// one out of the slots to this one are not published.
+		LONG Unpublished = (LONG)(Index - FHeader->Slots + 1);
+		if (Unpublished > FHeader->Unpublished)
+		{
+			InterlockedExchange(&FHeader->Unpublished, Unpublished);
+			InterlockedIncrement(&FHeader->Updates);
+		}
+		return;
+	}
+
+	// Build the state first: the slot is locked only for the copy.
+	driTableDrone Data;
+	ZeroMemory(&Data, sizeof(driTableDrone));
+	Data.Drone = (unsigned int)Index;
+
+	FILETIME Now;
+	GetSystemTimeAsFileTime(&Now);
+	Data.Updated = ((unsigned __int64)Now.dwHighDateTime << 32) | Now.dwLowDateTime;
+
+#ifdef _UNICODE
+	int Len = WideCharToMultiByte(CP_UTF8, 0, Drone.Ssid.c_str(), (int)Drone.Ssid.length(),
+		Data.Name, DRI_TABLE_NAME_SIZE, NULL, NULL);
+	UNREFERENCED_PARAMETER(Len);
+#else
+	CopyText(Data.Name, DRI_TABLE_NAME_SIZE, Drone.Ssid.c_str(), Drone.Ssid.length());
+#endif
+
+	const CwclDriAsdBasicIdMessage* Basic = (const CwclDriAsdBasicIdMessage*)SlotMessage(Drone, mtBasicId);
+	if (Basic != NULL)
+	{
+		Data.Present |= DRI_TABLE_BASIC_ID;
+		Data.IdType = (unsigned char)Basic->IdType;
+		Data.UavType = (unsigned char)Basic->UavType;
+		CopyId(Data.Id, Basic->Id);
+	}
+
+	const CwclDriAsdLocationMessage* Location = (const CwclDriAsdLocationMessage*)SlotMessage(Drone, mtLocation);
+	if (Location != NULL)
+	{
+		Data.Present |= DRI_TABLE_LOCATION;
+		Data.Status = (unsigned char)Location->Status;
+		Data.HeightReference = (unsigned char)Location->HeightReference;
+		Data.Direction = Location->Direction;
+		Data.Latitude = Location->Latitude;
+		Data.Longitude = Location->Longitude;
+		Data.GeoAltitude = Location->GeoAltitude;
+		Data.BaroAltitude = Location->BaroAltitude;
+		Data.Height = Location->Height;
+		Data.HorizontalSpeed = Location->HorizontalSpeed;
+		Data.VerticalSpeed = Location->VerticalSpeed;
+	}
+
+	const CwclDriAsdSystemMessage* System = (const CwclDriAsdSystemMessage*)SlotMessage(Drone, mtSystem);
+	if (System != NULL)
+	{
+		Data.Present |= DRI_TABLE_SYSTEM;
+		Data.OperatorAltitude = System->OperatorAltitude;
+		Data.OperatorLatitude = System->OperatorLatitude;
+		Data.OperatorLongitude = System->OperatorLongitude;
+	}
+
+	const CwclDriAsdOperatorIdMessage* Operator = (const CwclDriAsdOperatorIdMessage*)SlotMessage(Drone, mtOperatorId);
+	if (Operator != NULL)
+	{
+		Data.Present |= DRI_TABLE_OPERATOR_ID;
+		Data.OperatorIdType = Operator->IdType;
+		CopyId(Data.OperatorId, Operator->Id);
+	}
+
+	// The interlocked operations are full barriers: the odd sequence is
+	// visible before the data changes and the data before the even one.
+	driTableSlot* Slot = &FSlots[Index];
+	InterlockedIncrement(&Slot->Sequence);
+	CopyMemory(&Slot->Drone, &Data, sizeof(driTableDrone));
+	InterlockedIncrement(&Slot->Sequence);
+
+	if ((LONG)Index >= FHeader->Count)
+		InterlockedExchange(&FHeader->Count, (LONG)Index + 1);
+	InterlockedIncrement(&FHeader->Updates);
+}
+
+void CDriSharedTable::Clear()
+{
+	if (FHeader == NULL)
+		return;
+
+	// Hide the slots first so the readers do not take the old drones.
+	LONG Count = InterlockedExchange(&FHeader->Count, 0);
+	for (LONG i = 0; i < Count; i++)
+	{
+		driTableSlot* Slot = &FSlots[i];
+		InterlockedIncrement(&Slot->Sequence);
+		ZeroMemory(&Slot->Drone, sizeof(driTableDrone));
+		InterlockedIncrement(&Slot->Sequence);
+	}
+	InterlockedExchange(&FHeader->Unpublished, 0);
+	InterlockedIncrement(&FHeader->Updates);
+}
+
+bool CDriSharedTable::GetActive() const
+{
+	return (FHeader != NULL);
+}
+
+unsigned long CDriSharedTable::GetUnpublished() const
+{
+	if (FHeader == NULL)
+		return 0;
+	return (unsigned long)FHeader->Unpublished;
+}
+
+
+// CDriSharedTableReader
+
+CDriSharedTableReader::CDriSharedTableReader()
+{
+#ifdef _WIN32
+	FMapping = NULL;
+#else
+	FSize = 0;
+#endif
+	FHeader = NULL;
+	FSlots = NULL;
+}
+
+CDriSharedTableReader::~CDriSharedTableReader()
+{
+	Close();
+}
+
+int CDriSharedTableReader::Open(const tstring& Name)
+{
+	if (Name == _T(""))
+		return WCL_E_INVALID_ARGUMENT;
+	if (FHeader != NULL)
+		return DRI_E_TABLE_OPENED;
+
+	int Res = WCL_E_SUCCESS;
+	// The size of the mapped view; unknown for the Windows section.
+	size_t Size = 0;
+#ifdef _WIN32
+	FMapping = OpenFileMapping(FILE_MAP_READ, FALSE, Name.c_str());
+	if (FMapping == NULL)
+		return DRI_E_TABLE_MAP_FAILED;
+
+	FHeader = (const driTableHeader*)MapViewOfFile(FMapping, FILE_MAP_READ, 0, 0, 0);
+	if (FHeader == NULL)
+		Res = DRI_E_TABLE_MAP_FAILED;
+#else
+	int Handle = shm_open(ObjectName(Name).c_str(), O_RDONLY, 0);
+	if (Handle == -1)
+		return DRI_E_TABLE_MAP_FAILED;
+
+	struct stat Stat;
+	if (fstat(Handle, &Stat) == -1 || (size_t)Stat.st_size < sizeof(driTableHeader))
+		Res = DRI_E_TABLE_MAP_FAILED;
+	else
+	{
+		void* View = mmap(NULL, (size_t)Stat.st_size, PROT_READ, MAP_SHARED, Handle, 0);
+		if (View == MAP_FAILED)
+			Res = DRI_E_TABLE_MAP_FAILED;
+		else
+		{
+			FHeader = (const driTableHeader*)View;
+			FSize = (size_t)Stat.st_size;
+			Size = FSize;
+		}
+	}
+	close(Handle);
+#endif
+
+	if (Res == WCL_E_SUCCESS)
+	{
+		if (FHeader->Magic != DRI_TABLE_MAGIC || FHeader->Version != DRI_TABLE_VERSION ||
+			FHeader->SlotSize != sizeof(driTableSlot) || (Size > 0 &&
+			Size < sizeof(driTableHeader) + (size_t)FHeader->Slots * sizeof(driTableSlot)))
+		{
+			Res = DRI_E_TABLE_INVALID_FORMAT;
+		}
+		else
+			FSlots = (const driTableSlot*)(FHeader + 1);
+	}
+
+	if (Res != WCL_E_SUCCESS)
+		Close();
+	return Res;
+}
+
+void CDriSharedTableReader::Close()
+{
+	if (FHeader != NULL)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(FHeader);
+#else
+		munmap((void*)FHeader, FSize);
+		FSize = 0;
+#endif
+		FHeader = NULL;
+		FSlots = NULL;
+	}
+#ifdef _WIN32
+	if (FMapping != NULL)
+	{
+		CloseHandle(FMapping);
+		FMapping = NULL;
+	}
+#endif
+}
+
+bool CDriSharedTableReader::Read(const size_t Index, driTableDrone& Drone) const
+{
+	if (FSlots == NULL || Index >= GetCount())
+		return false;
+
+	const driTableSlot* Slot = &FSlots[Index];
+	for (unsigned long i = 0; i < DRI_TABLE_READ_RETRIES; i++)
+	{
+		LONG Sequence = Slot->Sequence;
+		if ((Sequence & 1) == 0)
+		{
+			MemoryBarrier();
+			CopyMemory(&Drone, (const void*)&Slot->Drone, sizeof(driTableDrone));
+			// The copy must be complete before the sequence is checked again.
+			MemoryBarrier();
+			if (Slot->Sequence == Sequence)
+				return true;
+		}
+		YieldProcessor();
+	}
+	return false;
+}
+
+size_t CDriSharedTableReader::GetCount() const
+{
+	if (FHeader == NULL)
+		return 0;
+	return (size_t)min((unsigned int)FHeader->Count, FHeader->Slots);
+}
+
+unsigned long CDriSharedTableReader::GetUpdates() const
+{
+	if (FHeader == NULL)
+		return 0;
+	return (unsigned long)FHeader->Updates;
+}
+
+unsigned long CDriSharedTableReader::GetUnpublished() const
+{
+	if (FHeader == NULL)
+		return 0;
+	return (unsigned long)FHeader->Unpublished;
+}
@@ -0,0 +1,296 @@
+
+// DriSharedTable.h : header file
+//
+
+#pragma once
+
+#include <string>
+
+#include "wclHelpers.h"
+
+#include "DriErrors.h"
+#include "DriDroneList.h"
+
+using namespace wclCommon;
+
+/// <summary> The table signature ("DRIT"). </summary>
+#define DRI_TABLE_MAGIC			0x54495244
+/// <summary> The table layout version. </summary>
+#define DRI_TABLE_VERSION		1
+/// <summary> The default number of the table slots. </summary>
+#define DRI_TABLE_SLOTS			256
+/// <summary> The size of the drone name field. </summary>
+#define DRI_TABLE_NAME_SIZE		32
+/// <summary> The size of the UAS and the operator ID fields. </summary>
+#define DRI_TABLE_ID_SIZE		20
+/// <summary> The number of the attempts to read a consistent
+///   slot. </summary>
+#define DRI_TABLE_READ_RETRIES	64
+
+/// <summary> The <c>Present</c> flag: the Basic ID fields are
+///   valid. </summary>
+#define DRI_TABLE_BASIC_ID		0x01
+/// <summary> The <c>Present</c> flag: the Location fields are
+///   valid. </summary>
+#define DRI_TABLE_LOCATION		0x02
+/// <summary> The <c>Present</c> flag: the System fields are
+///   valid. </summary>
+#define DRI_TABLE_SYSTEM		0x04
+/// <summary> The <c>Present</c> flag: the Operator ID fields are
+///   valid. </summary>
+#define DRI_TABLE_OPERATOR_ID	0x08
+
+#pragma pack(push, 1)
+/// <summary> The drone state of a table slot. </summary>
+/// <remarks> The layout is fixed: the structure is packed, every field is
+///   placed at its natural alignment by the explicit padding and the 32-bit
+///   fields are <c>int</c>, so a reader built by other compiler (32 or 64
+///   bit) maps the same bytes. There are no pointers. The text fields are
+///   UTF-8 (the IDs are ASCII) and zero padded. </remarks>
+typedef struct
+{
+	/// <summary> The drone index (the same as the slot index). </summary>
+	unsigned int		Drone;
+	/// <summary> The <c>DRI_TABLE_XXX</c> flags of the valid
+	///   fields. </summary>
+	unsigned int		Present;
+	/// <summary> The last update time (FILETIME, UTC). </summary>
+	unsigned __int64	Updated;
+	/// <summary> The drone SSID or the Bluetooth address. </summary>
+	char				Name[DRI_TABLE_NAME_SIZE];
+
+	/// <summary> Basic ID: the ID type. </summary>
+	unsigned char		IdType;
+	/// <summary> Basic ID: the UA type. </summary>
+	unsigned char		UavType;
+	/// <summary> Basic ID: the UAS ID. </summary>
+	char				Id[DRI_TABLE_ID_SIZE];
+
+	/// <summary> Location: the status. </summary>
+	unsigned char		Status;
+	/// <summary> Location: the height reference. </summary>
+	unsigned char		HeightReference;
+	/// <summary> Location: the direction in degrees. Above 360 if
+	///   unknown. </summary>
+	unsigned short		Direction;
+	unsigned char		Reserved1[6];
+	/// <summary> Location: the latitude in degrees. </summary>
+	double				Latitude;
+	/// <summary> Location: the longitude in degrees. </summary>
+	double				Longitude;
+	/// <summary> Location: the geodetic altitude in meters. </summary>
+	float				GeoAltitude;
+	/// <summary> Location: the barometric altitude in meters. </summary>
+	float				BaroAltitude;
+	/// <summary> Location: the height in meters. </summary>
+	float				Height;
+	/// <summary> Location: the horizontal speed in m/s. 255 if
+	///   unknown. </summary>
+	float				HorizontalSpeed;
+	/// <summary> Location: the vertical speed in m/s. </summary>
+	float				VerticalSpeed;
+
+	/// <summary> System: the operator altitude in meters. </summary>
+	float				OperatorAltitude;
+	/// <summary> System: the operator latitude in degrees. </summary>
+	double				OperatorLatitude;
+	/// <summary> System: the operator longitude in degrees. </summary>
+	double				OperatorLongitude;
+
+	/// <summary> Operator ID: the ID type. </summary>
+	unsigned char		OperatorIdType;
+	/// <summary> Operator ID: the operator ID. </summary>
+	char				OperatorId[DRI_TABLE_ID_SIZE];
+	unsigned char		Reserved2[3];
+} driTableDrone;
+
+/// <summary> A table slot. </summary>
+typedef struct
+{
+	/// <summary> The slot sequence: odd while the writer changes the
+	///   slot. </summary>
+	volatile LONG		Sequence;
+	LONG				Reserved;
+	/// <summary> The drone state. </summary>
+	driTableDrone		Drone;
+} driTableSlot;
+
+/// <summary> The table header at the beginning of the shared
+///   memory. </summary>
+typedef struct
+{
+	/// <summary> <see cref="DRI_TABLE_MAGIC" />. </summary>
+	unsigned int		Magic;
+	/// <summary> <see cref="DRI_TABLE_VERSION" />. </summary>
+	unsigned int		Version;
+	/// <summary> The size of a slot in bytes. </summary>
+	unsigned int		SlotSize;
+	/// <summary> The number of the slots. </summary>
+	unsigned int		Slots;
+	/// <summary> The number of the used slots. Slots are used in order and
+	///   are never released while the table is published. </summary>
+	volatile LONG		Count;
+	/// <summary> Incremented after every slot update. A reader may poll it
+	///   to find out that something changed. </summary>
+	volatile LONG		Updates;
+	/// <summary> The number of the drones that do not fit the slots and are
+	///   not published. </summary>
+	volatile LONG		Unpublished;
+	LONG				Reserved;
+} driTableHeader;
+#pragma pack(pop)
+
+// The readers on the other platforms depend on these sizes; the slots
+// follow the header 8-byte aligned.
+static_assert(sizeof(LONG) == 4, "LONG must be 32 bits");
+static_assert(sizeof(driTableDrone) == 160, "driTableDrone layout changed");
+static_assert(sizeof(driTableSlot) == 168, "driTableSlot layout changed");
+static_assert(sizeof(driTableHeader) == 32, "driTableHeader layout changed");
+
+/// <summary> Publishes the live drone table in a named shared memory
+///   section. </summary>
+/// <remarks> <para> The section is the <see cref="driTableHeader" />
+///   followed by the array of the <see cref="driTableSlot" />. The slot index
+///   is the drone index of the <see cref="CDriDroneList" />; the drones that
+///   do not fit are not published, the header counts them. </para>
+///   <para> Each slot is protected by a sequence lock: the writer makes the
+///   sequence odd, changes the slot and makes it even again. A reader copies
+///   the slot and retries if the sequence was odd or changed meanwhile, so
+///   the readers never block the writer and never see a half-written
+///   drone. Use <see cref="CDriSharedTableReader" /> to read the
+///   table. </para>
+///   <para> There is one writer; the owner serializes
+///   <c>Update</c> calls. </para>
+///   <para> On Windows the section is a named file mapping. On the other
+///   platforms it is a POSIX shared memory object (<c>shm_open</c>) named
+///   by the section name with a leading slash. </para> </remarks>
+class CDriSharedTable
+{
+	DISABLE_COPY(CDriSharedTable);
+
+private:
+#ifdef _WIN32
+	HANDLE				FMapping;
+#else
+	std::string			FName;
+	size_t				FSize;
+#endif
+	driTableHeader*		FHeader;
+	driTableSlot*		FSlots;
+
+public:
+	/// <summary> Creates new shared table. </summary>
+	CDriSharedTable();
+	/// <summary> Closes the table and frees the object. </summary>
+	virtual ~CDriSharedTable();
+
+	/// <summary> Creates the shared memory section. </summary>
+	/// <param name="Name"> The section name (for example
+	///   <c>Local\DroneRemoteId</c>; a service publishing to the user sessions
+	///   needs a <c>Global\</c> name). </param>
+	/// <param name="Slots"> The number of the slots. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Open(const tstring& Name, const unsigned long Slots);
+	/// <summary> Closes the section. </summary>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	/// <remarks> The section lives while any reader keeps it
+	///   mapped. </remarks>
+	int Close();
+
+	/// <summary> Publishes the drone state. </summary>
+	/// <param name="Index"> The drone index. </param>
+	/// <param name="Drone"> The drone. </param>
+	/// <remarks> Does nothing if the table is not opened. A drone out of the
+	///   slots is not published but counted in
+	///   <see cref="Unpublished" />. </remarks>
+	void Update(const size_t Index, const driDrone& Drone);
+	/// <summary> Removes all the drones. </summary>
+	void Clear();
+
+	/// <summary> Gets the table state. </summary>
+	/// <returns> <c>True</c> if the table is opened. </returns>
+	bool GetActive() const;
+	/// <summary> Gets the table state. </summary>
+	/// <value> <c>True</c> if the table is opened. </value>
+	__declspec(property(get = GetActive)) bool Active;
+
+	/// <summary> Gets the number of the drones that do not fit the
+	///   slots. </summary>
+	/// <returns> The number of the drones not published. </returns>
+	unsigned long GetUnpublished() const;
+	/// <summary> Gets the number of the drones that do not fit the
+	///   slots. </summary>
+	/// <value> The number of the drones not published. </value>
+	__declspec(property(get = GetUnpublished)) unsigned long Unpublished;
+};
+
+/// <summary> Reads the drone table published by
+///   <see cref="CDriSharedTable" /> in other process. </summary>
+/// <remarks> The reader maps the section read-only. The class is not thread
+///   safe. </remarks>
+class CDriSharedTableReader
+{
+	DISABLE_COPY(CDriSharedTableReader);
+
+private:
+#ifdef _WIN32
+	HANDLE						FMapping;
+#else
+	size_t						FSize;
+#endif
+	const driTableHeader*		FHeader;
+	const driTableSlot*			FSlots;
+
+public:
+	/// <summary> Creates new table reader. </summary>
+	CDriSharedTableReader();
+	/// <summary> Closes the reader and frees the object. </summary>
+	virtual ~CDriSharedTableReader();
+
+	/// <summary> Opens the shared memory section. </summary>
+	/// <param name="Name"> The section name. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Open(const tstring& Name);
+	/// <summary> Closes the section. </summary>
+	void Close();
+
+	/// <summary> Reads a consistent copy of a drone. </summary>
+	/// <param name="Index"> The drone index. </param>
+	/// <param name="Drone"> On output contains the drone state. </param>
+	/// <returns> <c>True</c> if the drone was read. <c>False</c> if the index
+	///   is out of the used slots or the writer kept changing the slot for
+	///   <see cref="DRI_TABLE_READ_RETRIES" /> attempts. </returns>
+	bool Read(const size_t Index, driTableDrone& Drone) const;
+
+	/// <summary> Gets the number of the published drones. </summary>
+	/// <returns> The drones count. </returns>
+	size_t GetCount() const;
+	/// <summary> Gets the number of the published drones. </summary>
+	/// <value> The drones count. </value>
+	__declspec(property(get = GetCount)) size_t Count;
+
+	/// <summary> Gets the update counter. </summary>
+	/// <returns> The number of the slot updates. Changes when any drone
+	///   changes. </returns>
+	unsigned long GetUpdates() const;
+	/// <summary> Gets the update counter. </summary>
+	/// <value> The number of the slot updates. </value>
+	__declspec(property(get = GetUpdates)) unsigned long Updates;
+
+	/// <summary> Gets the number of the drones the writer could not
+	///   publish. </summary>
+	/// <returns> The number of the drones that do not fit the
+	///   slots. </returns>
+	unsigned long GetUnpublished() const;
+	/// <summary> Gets the number of the drones the writer could not
+	///   publish. </summary>
+	/// <value> The number of the drones that do not fit the
+	///   slots. </value>
+	__declspec(property(get = GetUnpublished)) unsigned long Unpublished;
+};
@@ -0,0 +1,187 @@
+
+// DriSync.cpp : implementation file
+//
+
+#include "stdafx.h"
+#include "DriSync.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+
+// CDriRwLock
+
+CDriRwLock::CDriRwLock()
+{
+	InitializeSRWLock(&FLock);
+}
+
+CDriRwLock::~CDriRwLock()
+{
+	// SRW lock does not need to be destroyed.
+}
+
+void CDriRwLock::Enter()
+{
+	AcquireSRWLockExclusive(&FLock);
+}
+
+void CDriRwLock::Leave()
+{
+	ReleaseSRWLockExclusive(&FLock);
+}
+
+bool CDriRwLock::TryEnter()
+{
+	return (TryAcquireSRWLockExclusive(&FLock) != FALSE);
+}
+
+void CDriRwLock::EnterShared()
+{
+	AcquireSRWLockShared(&FLock);
+}
+
+void CDriRwLock::LeaveShared()
+{
+	ReleaseSRWLockShared(&FLock);
+}
+
+bool CDriRwLock::TryEnterShared()
+{
+	return (TryAcquireSRWLockShared(&FLock) != FALSE);
+}
+
+
+// CDriSpinMutex
+
+CDriSpinMutex::CDriSpinMutex(const unsigned long SpinCount)
+{
+	FState = 0;
+	FSpinCount = SpinCount;
+	FContentions = 0;
+}
+
+CDriSpinMutex::~CDriSpinMutex()
+{
+}
+
+void CDriSpinMutex::Enter()
+{
+	if (InterlockedCompareExchange(&FState, 1, 0) == 0)
+		return;
+
+	for (unsigned long i = 0; i < FSpinCount; i++)
+	{
+		YieldProcessor();
+		// Read first so spinning threads do not fight for the cache line.
+		if (FState == 0 && InterlockedCompareExchange(&FState, 1, 0) == 0)
+			return;
+	}
+
+	// Mark the mutex contended so the owner wakes us on leave. The thread that
+	// takes the mutex here keeps the contended state as it does not know if
+	// other threads are still blocked.
+	InterlockedIncrement(&FContentions);
+	LONG Contended = 2;
+	while (InterlockedExchange(&FState, 2) != 0)
+		WaitOnAddress(&FState, &Contended, sizeof(FState), INFINITE);
+}
+
+void CDriSpinMutex::Leave()
+{
+	if (InterlockedExchange(&FState, 0) == 2)
+		WakeByAddressSingle((PVOID)&FState);
+}
+
+bool CDriSpinMutex::TryEnter()
+{
+	return (InterlockedCompareExchange(&FState, 1, 0) == 0);
+}
+
+unsigned long CDriSpinMutex::GetSpinCount() const
+{
+	return FSpinCount;
+}
+
+void CDriSpinMutex::SetSpinCount(const unsigned long Value)
+{
+	FSpinCount = Value;
+}
+
+unsigned long CDriSpinMutex::GetContentions() const
+{
+	return (unsigned long)FContentions;
+}
+
+
+// CDriFutex
+
+CDriFutex::CDriFutex(const LONG Value)
+{
+	FValue = Value;
+}
+
+CDriFutex::~CDriFutex()
+{
+}
+
+unsigned long CDriFutex::Wait(const LONG Expected, const unsigned long Timeout)
+{
+	LONG Compare = Expected;
+	if (WaitOnAddress(&FValue, &Compare, sizeof(FValue), Timeout))
+		return WCL_WAIT_OBJECT_0;
+	if (GetLastError() == ERROR_TIMEOUT)
+		return WCL_WAIT_TIMEOUT;
+	return WCL_WAIT_FAILED;
+}
+
+void CDriFutex::NotifyOne()
+{
+	WakeByAddressSingle((PVOID)&FValue);
+}
+
+void CDriFutex::NotifyAll()
+{
+	WakeByAddressAll((PVOID)&FValue);
+}
+
+LONG CDriFutex::Exchange(const LONG Value)
+{
+	LONG Result = InterlockedExchange(&FValue, Value);
+	if (Result != Value)
+		NotifyAll();
+	return Result;
+}
+
+LONG CDriFutex::Add(const LONG Value)
+{
+	LONG Result = InterlockedExchangeAdd(&FValue, Value) + Value;
+	if (Value != 0)
+		NotifyAll();
+	return Result;
+}
+
+LONG CDriFutex::CompareExchange(const LONG Value, const LONG Comparand)
+{
+	LONG Result = InterlockedCompareExchange(&FValue, Value, Comparand);
+	if (Result == Comparand && Value != Comparand)
+		NotifyAll();
+	return Result;
+}
+
+void CDriFutex::Signal()
+{
+	InterlockedIncrement(&FValue);
+	NotifyOne();
+}
+
+LONG CDriFutex::GetValue() const
+{
+	return FValue;
+}
+
+void CDriFutex::SetValue(const LONG Value)
+{
+	Exchange(Value);
+}
@@ -0,0 +1,180 @@
+
+// DriSync.h : header file
+//
+
+#pragma once
+
+#include "wclHelpers.h"
+#include "wclSync.h"
+
+using namespace wclCommon;
+using namespace wclSync;
+
+/// <summary> The default number of spins of <see cref="CDriSpinMutex" />
+///   before it blocks. </summary>
+#define DRI_SPIN_COUNT		4000
+
+/// <summary> The class represents a slim reader/writer lock. </summary>
+/// <remarks> Any number of threads can own the lock in shared mode (to read)
+///   while only one thread can own it in exclusive mode (to change the
+///   protected data). The lock is not recursive: a thread must not enter it
+///   again until it leaves. The lock takes the size of a pointer and is not
+///   a kernel object. </remarks>
+/// <seealso cref="CwclSyncObject" />
+class CDriRwLock : public CwclSyncObject
+{
+	DISABLE_COPY(CDriRwLock);
+
+private:
+	SRWLOCK		FLock;
+
+public:
+	/// <summary> Creates and initializes the lock. </summary>
+	CDriRwLock();
+	/// <summary> Destroys the lock. </summary>
+	virtual ~CDriRwLock();
+
+	/// <summary> Waits for exclusive ownership of the lock. </summary>
+	void Enter();
+	/// <summary> Releases exclusive ownership of the lock. </summary>
+	void Leave();
+	/// <summary> Tries to take exclusive ownership of the lock without
+	///   waiting. </summary>
+	/// <returns> <c>True</c> if the lock is owned. </returns>
+	bool TryEnter();
+
+	/// <summary> Waits for shared ownership of the lock. </summary>
+	void EnterShared();
+	/// <summary> Releases shared ownership of the lock. </summary>
+	void LeaveShared();
+	/// <summary> Tries to take shared ownership of the lock without
+	///   waiting. </summary>
+	/// <returns> <c>True</c> if the lock is owned. </returns>
+	bool TryEnterShared();
+};
+
+/// <summary> The class represents a mutex that spins before it
+///   blocks. </summary>
+/// <remarks> <para> A thread that finds the mutex owned spins up to
+///   <c>SpinCount</c> times expecting the owner to leave soon. Only then it
+///   blocks on the mutex state address (see <see cref="CDriFutex" />). Leaving
+///   an uncontended mutex is one interlocked operation. </para>
+///   <para> The mutex suits short critical sections. The mutex is not
+///   recursive. </para> </remarks>
+/// <seealso cref="CwclSyncObject" />
+class CDriSpinMutex : public CwclSyncObject
+{
+	DISABLE_COPY(CDriSpinMutex);
+
+private:
+	// 0 - free, 1 - owned, 2 - owned and there may be blocked threads.
+	volatile LONG	FState;
+	unsigned long	FSpinCount;
+	volatile LONG	FContentions;
+
+public:
+	/// <summary> Creates new mutex. </summary>
+	/// <param name="SpinCount"> The number of spins before the thread
+	///   blocks. </param>
+	CDriSpinMutex(const unsigned long SpinCount = DRI_SPIN_COUNT);
+	/// <summary> Destroys the mutex. </summary>
+	virtual ~CDriSpinMutex();
+
+	/// <summary> Waits for ownership of the mutex. </summary>
+	void Enter();
+	/// <summary> Releases ownership of the mutex. </summary>
+	void Leave();
+	/// <summary> Tries to take ownership of the mutex without
+	///   waiting. </summary>
+	/// <returns> <c>True</c> if the mutex is owned. </returns>
+	bool TryEnter();
+
+	/// <summary> Gets the number of spins before the thread
+	///   blocks. </summary>
+	/// <returns> The spin count. </returns>
+	unsigned long GetSpinCount() const;
+	/// <summary> Sets the number of spins before the thread
+	///   blocks. </summary>
+	/// <param name="Value"> The spin count. 0 to block at once. </param>
+	void SetSpinCount(const unsigned long Value);
+	/// <summary> Gets and sets the number of spins before the thread
+	///   blocks. </summary>
+	/// <value> The spin count. </value>
+	__declspec(property(get = GetSpinCount, put = SetSpinCount))
+		unsigned long SpinCount;
+
+	/// <summary> Gets the number of times a thread had to block. </summary>
+	/// <returns> The contentions count. </returns>
+	unsigned long GetContentions() const;
+	/// <summary> Gets the number of times a thread had to block. </summary>
+	/// <value> The contentions count. </value>
+	__declspec(property(get = GetContentions)) unsigned long Contentions;
+};
+
+/// <summary> The class represents a 32 bit value threads can wait
+///   on. </summary>
+/// <remarks> <para> A thread waits while the value equals the expected one;
+///   other thread changes the value and wakes the waiters. Unlike an event
+///   there is no kernel object: when nobody waits changing the value and
+///   notifying cost only interlocked operations. </para>
+///   <para> Wakeups can be spurious so the waiter must check the value again
+///   after <c>Wait</c> returns. </para> </remarks>
+/// <seealso cref="CwclSyncObject" />
+class CDriFutex : public CwclSyncObject
+{
+	DISABLE_COPY(CDriFutex);
+
+private:
+	volatile LONG	FValue;
+
+public:
+	/// <summary> Creates new futex. </summary>
+	/// <param name="Value"> The initial value. </param>
+	CDriFutex(const LONG Value = 0);
+	/// <summary> Destroys the futex. </summary>
+	virtual ~CDriFutex();
+
+	/// <summary> Waits while the value equals <c>Expected</c>. </summary>
+	/// <param name="Expected"> The value to wait on. </param>
+	/// <param name="Timeout"> The wait timeout in milliseconds. </param>
+	/// <returns> <see cref="WCL_WAIT_OBJECT_0" /> if the value is different
+	///   or the thread was woken. <see cref="WCL_WAIT_TIMEOUT" /> if the
+	///   time-out elapsed. <see cref="WCL_WAIT_FAILED" /> if the wait
+	///   failed. </returns>
+	unsigned long Wait(const LONG Expected, const unsigned long Timeout);
+	/// <summary> Wakes one waiting thread. </summary>
+	void NotifyOne();
+	/// <summary> Wakes all the waiting threads. </summary>
+	void NotifyAll();
+
+	/// <summary> Changes the value and wakes all the waiting
+	///   threads. </summary>
+	/// <param name="Value"> The new value. </param>
+	/// <returns> The previous value. </returns>
+	LONG Exchange(const LONG Value);
+	/// <summary> Adds to the value and wakes all the waiting threads. </summary>
+	/// <param name="Value"> The value to add. </param>
+	/// <returns> The new value. </returns>
+	LONG Add(const LONG Value);
+	/// <summary> Changes the value if it equals <c>Comparand</c> and wakes all
+	///   the waiting threads. </summary>
+	/// <param name="Value"> The new value. </param>
+	/// <param name="Comparand"> The value to compare with. </param>
+	/// <returns> The previous value. </returns>
+	LONG CompareExchange(const LONG Value, const LONG Comparand);
+	/// <summary> Increments the value and wakes one waiting thread. </summary>
+	/// <remarks> Used as an event count: a waiter reads the value, checks its
+	///   condition and waits on the read value; a signal made after the read
+	///   is never lost. </remarks>
+	void Signal();
+
+	/// <summary> Gets the value. </summary>
+	/// <returns> The current value. </returns>
+	LONG GetValue() const;
+	/// <summary> Sets the value and wakes all the waiting threads. </summary>
+	/// <param name="Value"> The new value. </param>
+	void SetValue(const LONG Value);
+	/// <summary> Gets and sets the value. </summary>
+	/// <value> The current value. </value>
+	__declspec(property(get = GetValue, put = SetValue)) LONG Value;
+};
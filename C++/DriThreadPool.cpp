@@ -0,0 +1,405 @@
+
+// DriThreadPool.cpp : implementation file
+//
+
+#include "stdafx.h"
+#include "DriThreadPool.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+
+// The parallel for splits the range into this number of chunks per worker
+// so the workers that finish early can take more.
+#define DRI_FOR_CHUNKS_PER_WORKER	4
+
+
+// CDriThreadPool
+
+CDriThreadPool::CDriThreadPool()
+{
+	FCS = new CwclCriticalSection();
+	FLock = new CDriSpinMutex();
+	FSignal = new CDriFutex();
+	FTls = TlsAlloc();
+	FTerminated = 0;
+	FActive = false;
+}
+
+CDriThreadPool::~CDriThreadPool()
+{
+	Stop();
+
+	if (FTls != TLS_OUT_OF_INDEXES)
+		TlsFree(FTls);
+	delete FSignal;
+	delete FLock;
+	delete FCS;
+}
+
+UINT __stdcall CDriThreadPool::ThreadProc(void* Param)
+{
+	driWorker* Worker = (driWorker*)Param;
+	Worker->Pool->Execute(Worker);
+	return 0;
+}
+
+void CDriThreadPool::Execute(driWorker* const Worker)
+{
+	if (FTls != TLS_OUT_OF_INDEXES)
+		TlsSetValue(FTls, Worker);
+
+	while (true)
+	{
+		// Read the event count before looking for a task so a task submitted
+		// after the look up changes the count and the wait returns at once.
+		LONG Signal = FSignal->GetValue();
+		// Read the flag before looking for a task too: all the tasks queued
+		// before the pool stopped are then found.
+		bool Terminated = (FTerminated != 0);
+
+		driTask Task;
+		if (Take(Worker, Task))
+			Run(Worker, Task);
+		else
+		{
+			// Exit only when there is no more work.
+			if (Terminated)
+				break;
+			FSignal->Wait(Signal, INFINITE);
+		}
+	}
+}
+
+CDriThreadPool::driWorker* CDriThreadPool::CurrentWorker() const
+{
+	if (FTls == TLS_OUT_OF_INDEXES)
+		return NULL;
+	return (driWorker*)TlsGetValue(FTls);
+}
+
+bool CDriThreadPool::PopLocal(driWorker* const Worker, const size_t Priority,
+	driTask& Task)
+{
+	bool Result = false;
+	Worker->Lock->Enter();
+	std::deque<driTask>& Tasks = Worker->Tasks[Priority];
+	if (Tasks.size() > 0)
+	{
+		// The newest task: its data is most likely still in the cache.
+		Task = Tasks.back();
+		Tasks.pop_back();
+		Result = true;
+	}
+	Worker->Lock->Leave();
+	return Result;
+}
+
+bool CDriThreadPool::PopShared(const size_t Priority, driTask& Task)
+{
+	bool Result = false;
+	FLock->Enter();
+	std::deque<driTask>& Tasks = FTasks[Priority];
+	if (Tasks.size() > 0)
+	{
+		Task = Tasks.front();
+		Tasks.pop_front();
+		Result = true;
+	}
+	FLock->Leave();
+	return Result;
+}
+
+bool CDriThreadPool::Steal(driWorker* const Thief, const size_t Priority,
+	driTask& Task)
+{
+	// The workers list does not change until all the threads have exited.
+	size_t Count = FWorkers.size();
+	if (Count == 0)
+		return false;
+
+	// Start from the next worker so the thieves do not all rob the first one.
+	size_t Start = 0;
+	if (Thief != NULL)
+	{
+		for (size_t i = 0; i < Count; i++)
+		{
+			if (FWorkers[i] == Thief)
+			{
+				Start = i + 1;
+				break;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < Count; i++)
+	{
+		driWorker* Victim = FWorkers[(Start + i) % Count];
+		if (Victim == Thief)
+			continue;
+
+		bool Found = false;
+		Victim->Lock->Enter();
+		std::deque<driTask>& Tasks = Victim->Tasks[Priority];
+		if (Tasks.size() > 0)
+		{
+			// The oldest task: the owner works on the other end.
+			Task = Tasks.front();
+			Tasks.pop_front();
+			Found = true;
+		}
+		Victim->Lock->Leave();
+
+		if (Found)
+		{
+			if (Thief != NULL)
+				InterlockedIncrement64(&Thief->Stolen);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool CDriThreadPool::Take(driWorker* const Worker, driTask& Task)
+{
+	for (size_t Priority = 0; Priority < DRI_TASK_PRIORITIES; Priority++)
+	{
+		if (Worker != NULL && PopLocal(Worker, Priority, Task))
+			return true;
+		if (PopShared(Priority, Task))
+			return true;
+		if (Steal(Worker, Priority, Task))
+			return true;
+	}
+	return false;
+}
+
+void CDriThreadPool::Run(driWorker* const Worker, const driTask& Task)
+{
+	Task.Proc(Task.Param);
+	if (Worker != NULL)
+		InterlockedIncrement64(&Worker->Executed);
+}
+
+void CDriThreadPool::StopWorkers()
+{
+	InterlockedExchange(&FTerminated, 1);
+	FSignal->Add(1);
+
+	// A running worker may still steal from the others: free the workers
+	// only when all the threads have exited.
+	for (std::vector<driWorker*>::iterator Worker = FWorkers.begin(); Worker != FWorkers.end(); Worker++)
+	{
+		if ((*Worker)->Thread != NULL)
+		{
+			wclWaitAndCloseThread((*Worker)->Thread);
+			(*Worker)->Thread = NULL;
+		}
+	}
+	for (std::vector<driWorker*>::iterator Worker = FWorkers.begin(); Worker != FWorkers.end(); Worker++)
+	{
+		delete (*Worker)->Lock;
+		delete (*Worker);
+	}
+	FWorkers.clear();
+}
+
+int CDriThreadPool::Start(const unsigned long Workers)
+{
+	FCS->Enter();
+	int Res = WCL_E_SUCCESS;
+	if (FActive)
+		Res = DRI_E_POOL_ACTIVE;
+	else
+	{
+		unsigned long Count = Workers;
+		if (Count == 0)
+		{
+			SYSTEM_INFO Info;
+			GetSystemInfo(&Info);
+			Count = max(Info.dwNumberOfProcessors, (DWORD)1);
+		}
+
+		FTerminated = 0;
+		// Create all the workers first: the threads steal from each other.
+		for (unsigned long i = 0; i < Count; i++)
+		{
+			driWorker* Worker = new driWorker;
+			Worker->Pool = this;
+			Worker->Thread = NULL;
+			Worker->Lock = new CDriSpinMutex();
+			Worker->Executed = 0;
+			Worker->Stolen = 0;
+			FWorkers.push_back(Worker);
+		}
+
+		for (std::vector<driWorker*>::iterator Worker = FWorkers.begin(); Worker != FWorkers.end(); Worker++)
+		{
+			(*Worker)->Thread = wclCreateThread(ThreadProc, (*Worker));
+			if ((*Worker)->Thread == NULL)
+			{
+				Res = DRI_E_POOL_THREAD_FAILED;
+				break;
+			}
+		}
+
+		if (Res != WCL_E_SUCCESS)
+			StopWorkers();
+		else
+		{
+			FLock->Enter();
+			FActive = true;
+			FLock->Leave();
+		}
+	}
+	FCS->Leave();
+	return Res;
+}
+
+int CDriThreadPool::Stop()
+{
+	FCS->Enter();
+	int Res = WCL_E_SUCCESS;
+	if (!FActive)
+		Res = DRI_E_POOL_NOT_ACTIVE;
+	else
+	{
+		// Submit checks the state under the same lock: no task gets into the
+		// shared queue once the workers may exit.
+		FLock->Enter();
+		FActive = false;
+		FLock->Leave();
+		StopWorkers();
+	}
+	FCS->Leave();
+	return Res;
+}
+
+int CDriThreadPool::Submit(const PdriTaskProc Proc, void* const Param,
+	const driTaskPriority Priority)
+{
+	if (Proc == NULL)
+		return WCL_E_INVALID_ARGUMENT;
+
+	driTask Task;
+	Task.Proc = Proc;
+	Task.Param = Param;
+
+	int Res = WCL_E_SUCCESS;
+	driWorker* Worker = CurrentWorker();
+	if (Worker != NULL)
+	{
+		// The worker runs its own tasks before it exits, even when the pool
+		// is stopping.
+		Worker->Lock->Enter();
+		Worker->Tasks[Priority].push_back(Task);
+		Worker->Lock->Leave();
+	}
+	else
+	{
+		FLock->Enter();
+		if (FActive)
+			FTasks[Priority].push_back(Task);
+		else
+			Res = DRI_E_POOL_NOT_ACTIVE;
+		FLock->Leave();
+	}
+
+	if (Res == WCL_E_SUCCESS)
+		FSignal->Signal();
+	return Res;
+}
+
+void CDriThreadPool::RunChunks(driForState* const State)
+{
+	while (true)
+	{
+		size_t First = (size_t)(InterlockedIncrement(&State->Next) - 1) * State->Chunk;
+		if (First >= State->Count)
+			break;
+
+		size_t Last = min(First + State->Chunk, State->Count);
+		for (size_t i = First; i < Last; i++)
+			State->Proc(State->Param, i);
+	}
+}
+
+void __stdcall CDriThreadPool::HelperProc(void* Param)
+{
+	driForState* State = (driForState*)Param;
+	RunChunks(State);
+	// The last access to the state: the caller may return right after.
+	State->Running->Add(-1);
+}
+
+void CDriThreadPool::ParallelFor(const size_t Count, const PdriForProc Proc,
+	void* const Param, const size_t Grain)
+{
+	if (Count == 0 || Proc == NULL)
+		return;
+
+	size_t Workers = FActive ? FWorkers.size() : 0;
+	size_t Chunk = Grain;
+	if (Chunk == 0)
+		Chunk = max(Count / ((Workers + 1) * DRI_FOR_CHUNKS_PER_WORKER), (size_t)1);
+	size_t Chunks = (Count + Chunk - 1) / Chunk;
+	size_t Helpers = min(Workers, Chunks - 1);
+
+	// The helpers count down when they finish; the state lives on this stack
+	// so the method returns only when all of them did.
+	CDriFutex Running((LONG)Helpers);
+	driForState State;
+	State.Proc = Proc;
+	State.Param = Param;
+	State.Count = Count;
+	State.Chunk = Chunk;
+	State.Next = 0;
+	State.Running = &Running;
+
+	for (size_t i = 0; i < Helpers; i++)
+	{
+		if (Submit(HelperProc, &State, tpHigh) != WCL_E_SUCCESS)
+			Running.Add(-1);
+	}
+
+	RunChunks(&State);
+
+	// Help with other tasks while waiting: a helper may sit in the deque of
+	// this very thread.
+	driWorker* Worker = CurrentWorker();
+	LONG Left;
+	while ((Left = Running.GetValue()) != 0)
+	{
+		driTask Task;
+		if (Take(Worker, Task))
+			Run(Worker, Task);
+		else
+			Running.Wait(Left, INFINITE);
+	}
+}
+
+void CDriThreadPool::GetStatistics(std::vector<driWorkerStatistics>& Statistics) const
+{
+	FCS->Enter();
+	Statistics.clear();
+	for (std::vector<driWorker*>::const_iterator Worker = FWorkers.begin(); Worker != FWorkers.end(); Worker++)
+	{
+		// Atomic 64 bit reads on the 32 bit platform too.
+		driWorkerStatistics Worked;
+		Worked.Executed = InterlockedCompareExchange64(&(*Worker)->Executed, 0, 0);
+		Worked.Stolen = InterlockedCompareExchange64(&(*Worker)->Stolen, 0, 0);
+		Statistics.push_back(Worked);
+	}
+	FCS->Leave();
+}
+
+bool CDriThreadPool::GetActive() const
+{
+	return FActive;
+}
+
+size_t CDriThreadPool::GetWorkers() const
+{
+	return FWorkers.size();
+}
@@ -0,0 +1,182 @@
+
+// DriThreadPool.h : header file
+//
+
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "wclHelpers.h"
+#include "wclSync.h"
+
+#include "DriErrors.h"
+#include "DriSync.h"
+
+using namespace wclCommon;
+using namespace wclSync;
+
+/// <summary> The task procedure. </summary>
+/// <param name="Param"> The task parameter. </param>
+typedef void (__stdcall *PdriTaskProc)(void* Param);
+/// <summary> The parallel for body procedure. </summary>
+/// <param name="Param"> The user defined parameter. </param>
+/// <param name="Index"> The iteration index. </param>
+typedef void (__stdcall *PdriForProc)(void* Param, const size_t Index);
+
+/// <summary> The task priority. </summary>
+typedef enum
+{
+	/// <summary> The task runs before any normal priority task. </summary>
+	tpHigh = 0,
+	/// <summary> The normal priority. </summary>
+	tpNormal = 1
+} driTaskPriority;
+
+/// <summary> The number of the task priorities. </summary>
+#define DRI_TASK_PRIORITIES		2
+
+/// <summary> The worker statistics. </summary>
+typedef struct
+{
+	/// <summary> The number of tasks executed by the worker. </summary>
+	unsigned __int64	Executed;
+	/// <summary> The number of tasks the worker took from other
+	///   workers. </summary>
+	unsigned __int64	Stolen;
+} driWorkerStatistics;
+
+/// <summary> A work-stealing thread pool. </summary>
+/// <remarks> <para> Every worker thread has its own task deque. A task
+///   submitted by a worker goes to the worker's deque and the worker takes it
+///   back in LIFO order (the data the task needs is most likely still in the
+///   cache). Tasks submitted by other threads go to the shared queue. An
+///   idle worker takes a task from the shared queue or steals the oldest task
+///   of other worker. High priority tasks are always taken before normal
+///   ones. </para>
+///   <para> Idle workers block on a <see cref="CDriFutex" /> event count so
+///   submitting a task to a busy pool costs no kernel call. </para>
+///   <para> Tasks must not block for long: a pool of N workers runs at most
+///   N tasks at once. Use a dedicated thread for the blocking
+///   work. </para> </remarks>
+class CDriThreadPool
+{
+	DISABLE_COPY(CDriThreadPool);
+
+private:
+	typedef struct
+	{
+		PdriTaskProc	Proc;
+		void*			Param;
+	} driTask;
+
+	typedef struct
+	{
+		CDriThreadPool*		Pool;
+		HANDLE				Thread;
+		CDriSpinMutex*		Lock;
+		std::deque<driTask>	Tasks[DRI_TASK_PRIORITIES];
+		// The statistics are read by other threads.
+		volatile __int64	Executed;
+		volatile __int64	Stolen;
+	} driWorker;
+
+	typedef struct
+	{
+		PdriForProc			Proc;
+		void*				Param;
+		size_t				Count;
+		size_t				Chunk;
+		volatile LONG		Next;
+		CDriFutex*			Running;
+	} driForState;
+
+	CwclCriticalSection*		FCS;
+	CDriSpinMutex*				FLock;
+	std::deque<driTask>			FTasks[DRI_TASK_PRIORITIES];
+	std::vector<driWorker*>		FWorkers;
+	CDriFutex*					FSignal;
+	DWORD						FTls;
+	volatile LONG				FTerminated;
+	// Changed under FLock so no task is queued after the workers exit.
+	bool						FActive;
+
+	static UINT __stdcall ThreadProc(void* Param);
+	static void RunChunks(driForState* const State);
+	static void __stdcall HelperProc(void* Param);
+	void Execute(driWorker* const Worker);
+
+	driWorker* CurrentWorker() const;
+	bool PopLocal(driWorker* const Worker, const size_t Priority, driTask& Task);
+	bool PopShared(const size_t Priority, driTask& Task);
+	bool Steal(driWorker* const Thief, const size_t Priority, driTask& Task);
+	bool Take(driWorker* const Worker, driTask& Task);
+	void Run(driWorker* const Worker, const driTask& Task);
+	void StopWorkers();
+
+public:
+	/// <summary> Creates new thread pool. </summary>
+	CDriThreadPool();
+	/// <summary> Stops the pool and frees the object. </summary>
+	virtual ~CDriThreadPool();
+
+	/// <summary> Starts the worker threads. </summary>
+	/// <param name="Workers"> The number of workers. 0 to start one worker
+	///   per processor. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Start(const unsigned long Workers = 0);
+	/// <summary> Stops the worker threads. </summary>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	/// <remarks> The method waits until all the submitted tasks complete.
+	///   Must not be called from a task. </remarks>
+	int Stop();
+
+	/// <summary> Schedules a task. </summary>
+	/// <param name="Proc"> The task procedure. </param>
+	/// <param name="Param"> The task parameter. </param>
+	/// <param name="Priority"> The task priority. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	/// <remarks> Other threads can not submit once <see cref="Stop" /> has
+	///   begun: the method returns <see cref="DRI_E_POOL_NOT_ACTIVE" />. A
+	///   task still can: its worker runs it before it exits. </remarks>
+	int Submit(const PdriTaskProc Proc, void* const Param,
+		const driTaskPriority Priority = tpNormal);
+
+	/// <summary> Runs the body for every index from 0 to <c>Count</c> - 1
+	///   on the pool workers and waits for completion. </summary>
+	/// <param name="Count"> The number of iterations. </param>
+	/// <param name="Proc"> The body procedure. </param>
+	/// <param name="Param"> The body parameter. </param>
+	/// <param name="Grain"> The minimal number of iterations per task. 0 to
+	///   split the range into about 4 chunks per worker. </param>
+	/// <remarks> The calling thread runs the iterations too, so the method
+	///   works from a task and when the pool is not active (then the loop runs
+	///   on the calling thread only). </remarks>
+	void ParallelFor(const size_t Count, const PdriForProc Proc,
+		void* const Param, const size_t Grain = 0);
+
+	/// <summary> Gets the workers statistics. </summary>
+	/// <param name="Statistics"> On output contains the statistics of every
+	///   worker. </param>
+	void GetStatistics(std::vector<driWorkerStatistics>& Statistics) const;
+
+	/// <summary> Gets the pool state. </summary>
+	/// <returns> <c>True</c> if the workers are running. </returns>
+	bool GetActive() const;
+	/// <summary> Gets the pool state. </summary>
+	/// <value> <c>True</c> if the workers are running. </value>
+	__declspec(property(get = GetActive)) bool Active;
+
+	/// <summary> Gets the number of workers. </summary>
+	/// <returns> The workers count. </returns>
+	size_t GetWorkers() const;
+	/// <summary> Gets the number of workers. </summary>
+	/// <value> The workers count. </value>
+	__declspec(property(get = GetWorkers)) size_t Workers;
+};
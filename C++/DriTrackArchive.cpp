@@ -0,0 +1,926 @@
+
+// DriTrackArchive.cpp : implementation file
+//
+
+#include "stdafx.h"
+#include "DriTrackArchive.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+
+// The number of FILETIME units in one second.
+#define DRI_FILETIME_SECOND			10000000
+// The number of FILETIME units in one millisecond.
+#define DRI_FILETIME_MILLISECOND	10000
+// The size of the mapped window used by the reader.
+#define DRI_TRACK_VIEW_SIZE			(4 * 1024 * 1024)
+// The maximum size of an encoded 64 bit varint.
+#define DRI_VARINT_SIZE				10
+
+// The bit widths of the packed columns.
+#define DRI_STATUS_BITS				4
+#define DRI_HEIGHT_REFERENCE_BITS	1
+#define DRI_ACCURACY_BITS			4
+
+// The varint and zigzag coding. Small deltas of any sign take one or two
+// bytes.
+
+static unsigned __int64 ZigZag(const __int64 Val)
+{
+	return ((unsigned __int64)Val << 1) ^ (unsigned __int64)(Val >> 63);
+}
+
+static __int64 UnZigZag(const unsigned __int64 Val)
+{
+	return (__int64)(Val >> 1) ^ -(__int64)(Val & 1);
+}
+
+static void PutVarInt(std::vector<unsigned char>& Column, const __int64 Val)
+{
+	unsigned __int64 Bits = ZigZag(Val);
+	while (Bits >= 0x80)
+	{
+		Column.push_back((unsigned char)(Bits | 0x80));
+		Bits >>= 7;
+	}
+	Column.push_back((unsigned char)Bits);
+}
+
+// Reads a varint. The pointer is advanced; false if the data ends or the
+// varint is too long.
+static bool GetVarInt(const unsigned char*& p, const unsigned char* const End,
+	__int64& Val)
+{
+	unsigned __int64 Bits = 0;
+	for (unsigned long Shift = 0; Shift < DRI_VARINT_SIZE * 7; Shift += 7)
+	{
+		if (p >= End)
+			return false;
+		unsigned char Byte = *p++;
+		Bits |= (unsigned __int64)(Byte & 0x7F) << Shift;
+		if ((Byte & 0x80) == 0)
+		{
+			Val = UnZigZag(Bits);
+			return true;
+		}
+	}
+	return false;
+}
+
+// The bit packing: the values are packed LSB first, Width bits each.
+
+static void PutBits(std::vector<unsigned char>& Column, const size_t Index,
+	const unsigned long Width, const unsigned long Val)
+{
+	size_t Bit = Index * Width;
+	for (unsigned long i = 0; i < Width; i++, Bit++)
+	{
+		if ((Val & (1UL << i)) != 0)
+			Column[Bit / 8] |= (unsigned char)(1 << (Bit % 8));
+	}
+}
+
+static unsigned long GetBits(const unsigned char* const Data, const size_t Index,
+	const unsigned long Width)
+{
+	unsigned long Val = 0;
+	size_t Bit = Index * Width;
+	for (unsigned long i = 0; i < Width; i++, Bit++)
+	{
+		if ((Data[Bit / 8] & (1 << (Bit % 8))) != 0)
+			Val |= (1UL << i);
+	}
+	return Val;
+}
+
+static size_t PackedSize(const size_t Count, const unsigned long Width)
+{
+	return (Count * Width + 7) / 8;
+}
+
+// The quantization to the ASD resolutions.
+
+static long LatLon(const double Val)
+{
+	return (long)(Val * 10000000.0 + ((Val < 0) ? -0.5 : 0.5));
+}
+
+static long Quantize(const float Val, const float Scale)
+{
+	float Units = Val * Scale;
+	return (long)(Units + ((Units < 0) ? -0.5f : 0.5f));
+}
+
+// The column value of a sample.
+static __int64 ColumnValue(const driTrackSample& Sample, const size_t Column)
+{
+	switch (Column)
+	{
+	case tcTime:
+		return Sample.Timestamp / DRI_FILETIME_MILLISECOND;
+	case tcLatitude:
+		return LatLon(Sample.Latitude);
+	case tcLongitude:
+		return LatLon(Sample.Longitude);
+	case tcGeoAltitude:
+		return Quantize(Sample.GeoAltitude, 2);
+	case tcHeight:
+		return Quantize(Sample.Height, 2);
+	case tcSpeed:
+		return Quantize(Sample.HorizontalSpeed, 4);
+	case tcVerticalSpeed:
+		return Quantize(Sample.VerticalSpeed, 2);
+	case tcDirection:
+		return Sample.Direction;
+	}
+	return 0;
+}
+
+// Sets the sample field from the column value.
+static void SetColumnValue(driTrackSample& Sample, const size_t Column,
+	const __int64 Val)
+{
+	switch (Column)
+	{
+	case tcTime:
+		Sample.Timestamp = Val * DRI_FILETIME_MILLISECOND;
+		break;
+	case tcLatitude:
+		Sample.Latitude = (double)Val / 10000000.0;
+		break;
+	case tcLongitude:
+		Sample.Longitude = (double)Val / 10000000.0;
+		break;
+	case tcGeoAltitude:
+		Sample.GeoAltitude = (float)Val / 2;
+		break;
+	case tcHeight:
+		Sample.Height = (float)Val / 2;
+		break;
+	case tcSpeed:
+		Sample.HorizontalSpeed = (float)Val / 4;
+		break;
+	case tcVerticalSpeed:
+		Sample.VerticalSpeed = (float)Val / 2;
+		break;
+	case tcDirection:
+		Sample.Direction = (unsigned short)Val;
+		break;
+	}
+}
+
+// The width of a packed column or 0 for a varint column.
+static unsigned long ColumnBits(const size_t Column)
+{
+	switch (Column)
+	{
+	case tcStatus:
+		return DRI_STATUS_BITS;
+	case tcHeightReference:
+		return DRI_HEIGHT_REFERENCE_BITS;
+	case tcAccuracy:
+		return DRI_ACCURACY_BITS;
+	}
+	return 0;
+}
+
+static unsigned long PackedValue(const driTrackSample& Sample, const size_t Column)
+{
+	switch (Column)
+	{
+	case tcStatus:
+		return Sample.Status;
+	case tcHeightReference:
+		return Sample.HeightReference;
+	case tcAccuracy:
+		return Sample.HorizontalAccuracy;
+	}
+	return 0;
+}
+
+static void SetPackedValue(driTrackSample& Sample, const size_t Column,
+	const unsigned long Val)
+{
+	switch (Column)
+	{
+	case tcStatus:
+		Sample.Status = (unsigned char)Val;
+		break;
+	case tcHeightReference:
+		Sample.HeightReference = (unsigned char)Val;
+		break;
+	case tcAccuracy:
+		Sample.HorizontalAccuracy = (unsigned char)Val;
+		break;
+	}
+}
+
+static void EncodeColumn(const std::vector<driTrackSample>& Samples,
+	const size_t Column, std::vector<unsigned char>& Data)
+{
+	Data.clear();
+
+	unsigned long Width = ColumnBits(Column);
+	if (Width > 0)
+	{
+		Data.resize(PackedSize(Samples.size(), Width), 0);
+		for (size_t i = 0; i < Samples.size(); i++)
+			PutBits(Data, i, Width, PackedValue(Samples[i], Column) & ((1UL << Width) - 1));
+		return;
+	}
+
+	// The time is regular (the drones broadcast at a fixed rate) so the
+	// second difference is near zero. The other values change smoothly.
+	__int64 Prev = 0;
+	__int64 PrevDelta = 0;
+	for (size_t i = 0; i < Samples.size(); i++)
+	{
+		__int64 Val = ColumnValue(Samples[i], Column);
+		__int64 Delta = Val - Prev;
+		if (Column == tcTime && i > 0)
+		{
+			PutVarInt(Data, Delta - PrevDelta);
+			PrevDelta = Delta;
+		}
+		else
+			PutVarInt(Data, Delta);
+		Prev = Val;
+	}
+}
+
+static bool DecodeColumn(const unsigned char* const Data, const unsigned long Size,
+	const size_t Column, std::vector<driTrackSample>& Samples)
+{
+	unsigned long Width = ColumnBits(Column);
+	if (Width > 0)
+	{
+		if (Size < PackedSize(Samples.size(), Width))
+			return false;
+		for (size_t i = 0; i < Samples.size(); i++)
+			SetPackedValue(Samples[i], Column, GetBits(Data, i, Width));
+		return true;
+	}
+
+	const unsigned char* p = Data;
+	const unsigned char* End = Data + Size;
+	__int64 Prev = 0;
+	__int64 PrevDelta = 0;
+	for (size_t i = 0; i < Samples.size(); i++)
+	{
+		__int64 Delta;
+		if (!GetVarInt(p, End, Delta))
+			return false;
+		if (Column == tcTime && i > 0)
+		{
+			Delta += PrevDelta;
+			PrevDelta = Delta;
+		}
+		Prev += Delta;
+		SetColumnValue(Samples[i], Column, Prev);
+	}
+	return true;
+}
+
+// Clears the sample fields of a column the caller did not ask for.
+static void ClearColumn(driTrackSample& Sample, const size_t Column)
+{
+	if (ColumnBits(Column) > 0)
+		SetPackedValue(Sample, Column, 0);
+	else
+		SetColumnValue(Sample, Column, 0);
+}
+
+static bool IsChunkHeader(const driTrackChunkHeader* const Header)
+{
+	if (Header == NULL || Header->Magic != DRI_TRACK_CHUNK_MAGIC ||
+		Header->Count == 0 || Header->Count > DRI_TRACK_CHUNK_SAMPLES)
+	{
+		return false;
+	}
+	// A packed column has the fixed size.
+	for (size_t Column = 0; Column < DRI_TRACK_COLUMNS; Column++)
+	{
+		unsigned long Width = ColumnBits(Column);
+		unsigned long Size = Header->ColumnSize[Column];
+		if (Width > 0 && Size != PackedSize(Header->Count, Width))
+			return false;
+		if (Width == 0 && Size > Header->Count * DRI_VARINT_SIZE)
+			return false;
+	}
+	return true;
+}
+
+static unsigned __int64 ChunkDataSize(const driTrackChunkHeader& Header)
+{
+	unsigned __int64 Size = 0;
+	for (size_t Column = 0; Column < DRI_TRACK_COLUMNS; Column++)
+		Size += Header.ColumnSize[Column];
+	return Size;
+}
+
+
+// CDriTrackArchiveWriter
+
+CDriTrackArchiveWriter::CDriTrackArchiveWriter()
+{
+	FCS = new CwclCriticalSection();
+	FStream = NULL;
+	FOffset = 0;
+	FChunkSpan = 60 * (__int64)DRI_FILETIME_SECOND;
+	FSamples = 0;
+	FLost = 0;
+}
+
+CDriTrackArchiveWriter::~CDriTrackArchiveWriter()
+{
+	Close();
+
+	delete FCS;
+}
+
+int CDriTrackArchiveWriter::Write(const void* const Data, const unsigned long Size)
+{
+	// The offset follows the real end of the file so the chunks written after
+	// a failed one still point to their data.
+	unsigned long Written = FStream->Write(Data, Size);
+	FOffset += Written;
+	if (Written != Size)
+		return DRI_E_TRACK_WRITE_FAILED;
+	return WCL_E_SUCCESS;
+}
+
+int CDriTrackArchiveWriter::Truncate(const unsigned __int64 Offset)
+{
+	LARGE_INTEGER Position;
+	Position.QuadPart = (LONGLONG)Offset;
+	if (!SetFilePointerEx(FStream->GetHandle(), Position, NULL, FILE_BEGIN) ||
+		!SetEndOfFile(FStream->GetHandle()))
+	{
+		return DRI_E_TRACK_WRITE_FAILED;
+	}
+	FOffset = Offset;
+	return WCL_E_SUCCESS;
+}
+
+int CDriTrackArchiveWriter::FlushChunk(const __int64 DroneKey,
+	std::vector<driTrackSample>& Samples)
+{
+	if (Samples.size() == 0)
+		return WCL_E_SUCCESS;
+
+	driTrackChunk Chunk;
+	ZeroMemory(&Chunk, sizeof(Chunk));
+	driTrackChunkHeader& Header = Chunk.Header;
+	Header.Magic = DRI_TRACK_CHUNK_MAGIC;
+	Header.Count = (unsigned long)Samples.size();
+	Header.DroneKey = DroneKey;
+
+	// The statistics are taken from the quantized values so they match
+	// exactly what the reader decodes.
+	for (size_t i = 0; i < Samples.size(); i++)
+	{
+		__int64 Time = ColumnValue(Samples[i], tcTime) * DRI_FILETIME_MILLISECOND;
+		long Latitude = (long)ColumnValue(Samples[i], tcLatitude);
+		long Longitude = (long)ColumnValue(Samples[i], tcLongitude);
+		long Altitude = (long)ColumnValue(Samples[i], tcGeoAltitude);
+		if (i == 0)
+		{
+			Header.MinTime = Header.MaxTime = Time;
+			Header.MinLatitude = Header.MaxLatitude = Latitude;
+			Header.MinLongitude = Header.MaxLongitude = Longitude;
+			Header.MinAltitude = Header.MaxAltitude = Altitude;
+		}
+		else
+		{
+			Header.MinTime = min(Header.MinTime, Time);
+			Header.MaxTime = max(Header.MaxTime, Time);
+			Header.MinLatitude = min(Header.MinLatitude, Latitude);
+			Header.MaxLatitude = max(Header.MaxLatitude, Latitude);
+			Header.MinLongitude = min(Header.MinLongitude, Longitude);
+			Header.MaxLongitude = max(Header.MaxLongitude, Longitude);
+			Header.MinAltitude = min(Header.MinAltitude, Altitude);
+			Header.MaxAltitude = max(Header.MaxAltitude, Altitude);
+		}
+	}
+
+	for (size_t Column = 0; Column < DRI_TRACK_COLUMNS; Column++)
+	{
+		EncodeColumn(Samples, Column, FColumns[Column]);
+		Header.ColumnSize[Column] = (unsigned long)FColumns[Column].size();
+	}
+
+	Chunk.Offset = FOffset;
+	int Res = Write(&Header, sizeof(Header));
+	for (size_t Column = 0; Column < DRI_TRACK_COLUMNS && Res == WCL_E_SUCCESS; Column++)
+	{
+		if (FColumns[Column].size() > 0)
+			Res = Write(&FColumns[Column][0], (unsigned long)FColumns[Column].size());
+	}
+	// A partially written chunk is not added to the table so its samples are
+	// lost. It is cut off too: the reader of an archive that was not closed
+	// walks the chunks and would stop at it.
+	if (Res == WCL_E_SUCCESS)
+		FChunks.push_back(Chunk);
+	else
+	{
+		FLost += Samples.size();
+		Truncate(Chunk.Offset);
+	}
+
+	Samples.clear();
+	return Res;
+}
+
+int CDriTrackArchiveWriter::Open(const tstring& FileName)
+{
+	if (FileName == _T(""))
+		return WCL_E_INVALID_ARGUMENT;
+
+	FCS->Enter();
+	int Res = WCL_E_SUCCESS;
+	if (FStream != NULL)
+		Res = DRI_E_TRACK_OPENED;
+	else
+	{
+		try
+		{
+			FStream = new CwclFileStream(FileName, CREATE_ALWAYS, GENERIC_WRITE,
+				FILE_SHARE_READ);
+		}
+		catch (wclEFileOpenFailed&)
+		{
+			FStream = NULL;
+			Res = DRI_E_TRACK_OPEN_FAILED;
+		}
+
+		if (Res == WCL_E_SUCCESS)
+		{
+			FOffset = 0;
+			FSamples = 0;
+			FLost = 0;
+			FPending.clear();
+			FChunks.clear();
+
+			driTrackFileHeader Header;
+			ZeroMemory(&Header, sizeof(Header));
+			CopyMemory(Header.Magic, DRI_TRACK_MAGIC, sizeof(Header.Magic));
+			Header.Version = DRI_TRACK_VERSION;
+			Header.HeaderSize = sizeof(Header);
+
+			Res = Write(&Header, sizeof(Header));
+			if (Res != WCL_E_SUCCESS)
+			{
+				delete FStream;
+				FStream = NULL;
+			}
+		}
+	}
+	FCS->Leave();
+	return Res;
+}
+
+int CDriTrackArchiveWriter::Close()
+{
+	FCS->Enter();
+	int Res = WCL_E_SUCCESS;
+	if (FStream == NULL)
+		Res = DRI_E_TRACK_CLOSED;
+	else
+	{
+		for (driTrackPending::iterator Drone = FPending.begin();
+			Drone != FPending.end() && Res == WCL_E_SUCCESS; Drone++)
+		{
+			Res = FlushChunk(Drone->first, Drone->second);
+		}
+
+		if (Res == WCL_E_SUCCESS)
+		{
+			driTrackTrailer Trailer;
+			ZeroMemory(&Trailer, sizeof(Trailer));
+			Trailer.Magic = DRI_TRACK_TRAILER_MAGIC;
+			Trailer.TableOffset = FOffset;
+			Trailer.Count = FChunks.size();
+
+			if (FChunks.size() > 0)
+			{
+				Res = Write(&FChunks[0],
+					(unsigned long)(FChunks.size() * sizeof(driTrackChunk)));
+			}
+			if (Res == WCL_E_SUCCESS)
+				Res = Write(&Trailer, sizeof(Trailer));
+		}
+
+		delete FStream;
+		FStream = NULL;
+
+		// The drones not flushed after a failure.
+		for (driTrackPending::iterator Drone = FPending.begin();
+			Drone != FPending.end(); Drone++)
+		{
+			FLost += Drone->second.size();
+		}
+		FPending.clear();
+		FChunks.clear();
+	}
+	FCS->Leave();
+	return Res;
+}
+
+int CDriTrackArchiveWriter::Append(const driTrackSample& Sample)
+{
+	FCS->Enter();
+	int Res = WCL_E_SUCCESS;
+	if (FStream == NULL)
+		Res = DRI_E_TRACK_CLOSED;
+	else
+	{
+		std::vector<driTrackSample>& Samples = FPending[Sample.DroneKey];
+		if (Samples.size() >= DRI_TRACK_CHUNK_SAMPLES || (Samples.size() > 0 &&
+			Sample.Timestamp >= Samples[0].Timestamp + FChunkSpan))
+		{
+			Res = FlushChunk(Sample.DroneKey, Samples);
+		}
+
+		if (Res == WCL_E_SUCCESS)
+		{
+			if (Samples.capacity() == 0)
+				Samples.reserve(DRI_TRACK_CHUNK_SAMPLES);
+			Samples.push_back(Sample);
+			FSamples++;
+		}
+	}
+	FCS->Leave();
+	return Res;
+}
+
+int CDriTrackArchiveWriter::Append(const __int64 DroneKey, const __int64 Timestamp,
+	const CwclDriAsdLocationMessage* const Location)
+{
+	if (Location == NULL)
+		return WCL_E_INVALID_ARGUMENT;
+
+	driTrackSample Sample;
+	Sample.DroneKey = DroneKey;
+	Sample.Timestamp = Timestamp;
+	Sample.Latitude = Location->Latitude;
+	Sample.Longitude = Location->Longitude;
+	Sample.GeoAltitude = Location->GeoAltitude;
+	Sample.Height = Location->Height;
+	Sample.HorizontalSpeed = Location->HorizontalSpeed;
+	Sample.VerticalSpeed = Location->VerticalSpeed;
+	Sample.Direction = Location->Direction;
+	Sample.Status = (unsigned char)Location->Status;
+	Sample.HeightReference = (unsigned char)Location->HeightReference;
+	Sample.HorizontalAccuracy = (unsigned char)Location->HorizontalAccuracy;
+	return Append(Sample);
+}
+
+int CDriTrackArchiveWriter::FlushIdle(const __int64 Now)
+{
+	FCS->Enter();
+	int Res = WCL_E_SUCCESS;
+	if (FStream == NULL)
+		Res = DRI_E_TRACK_CLOSED;
+	else
+	{
+		driTrackPending::iterator Drone = FPending.begin();
+		while (Drone != FPending.end() && Res == WCL_E_SUCCESS)
+		{
+			std::vector<driTrackSample>& Samples = Drone->second;
+			if (Samples.size() > 0 && Samples.back().Timestamp + FChunkSpan > Now)
+				Drone++;
+			else
+			{
+				// The drone is gone: write what it has and release the buffer.
+				Res = FlushChunk(Drone->first, Samples);
+				Drone = FPending.erase(Drone);
+			}
+		}
+	}
+	FCS->Leave();
+	return Res;
+}
+
+int CDriTrackArchiveWriter::Rekey(const __int64 From, const __int64 To)
+{
+	FCS->Enter();
+	int Res = WCL_E_SUCCESS;
+	if (FStream == NULL)
+		Res = DRI_E_TRACK_CLOSED;
+	else
+	{
+		driTrackPending::iterator Drone = FPending.find(From);
+		if (Drone != FPending.end() && From != To)
+		{
+			std::vector<driTrackSample> Moved;
+			Moved.swap(Drone->second);
+			FPending.erase(Drone);
+
+			std::vector<driTrackSample>& Samples = FPending[To];
+			for (std::vector<driTrackSample>::iterator Sample = Moved.begin();
+				Sample != Moved.end(); Sample++)
+			{
+				if (Samples.size() >= DRI_TRACK_CHUNK_SAMPLES)
+				{
+					// A failed chunk counts its samples as lost; the rest
+					// still go on.
+					int Flushed = FlushChunk(To, Samples);
+					if (Flushed != WCL_E_SUCCESS)
+						Res = Flushed;
+				}
+				Sample->DroneKey = To;
+				Samples.push_back(*Sample);
+			}
+		}
+	}
+	FCS->Leave();
+	return Res;
+}
+
+bool CDriTrackArchiveWriter::GetActive() const
+{
+	return (FStream != NULL);
+}
+
+unsigned __int64 CDriTrackArchiveWriter::GetSamples() const
+{
+	return FSamples;
+}
+
+unsigned __int64 CDriTrackArchiveWriter::GetLost() const
+{
+	return FLost;
+}
+
+unsigned __int64 CDriTrackArchiveWriter::GetSize() const
+{
+	return FOffset;
+}
+
+unsigned long CDriTrackArchiveWriter::GetChunkSpan() const
+{
+	return (unsigned long)(FChunkSpan / DRI_FILETIME_SECOND);
+}
+
+void CDriTrackArchiveWriter::SetChunkSpan(const unsigned long Value)
+{
+	if (FStream == NULL && Value > 0)
+		FChunkSpan = Value * (__int64)DRI_FILETIME_SECOND;
+}
+
+
+// CDriTrackArchiveReader
+
+CDriTrackArchiveReader::CDriTrackArchiveReader()
+{
+	FFile = new CDriMappedFile(DRI_TRACK_VIEW_SIZE);
+}
+
+CDriTrackArchiveReader::~CDriTrackArchiveReader()
+{
+	Close();
+
+	delete FFile;
+}
+
+int CDriTrackArchiveReader::LoadChunks()
+{
+	unsigned __int64 Size = FFile->GetSize();
+	if (Size < sizeof(driTrackFileHeader))
+		return DRI_E_TRACK_INVALID_FORMAT;
+
+	const driTrackFileHeader* Header = (const driTrackFileHeader*)
+		FFile->Map(0, sizeof(driTrackFileHeader));
+	if (Header == NULL)
+		return DRI_E_MAPPED_MAP_FAILED;
+	if (memcmp(Header->Magic, DRI_TRACK_MAGIC, sizeof(Header->Magic)) != 0 ||
+		Header->Version != DRI_TRACK_VERSION ||
+		Header->HeaderSize < sizeof(driTrackFileHeader) ||
+		Header->HeaderSize > Size)
+	{
+		return DRI_E_TRACK_INVALID_FORMAT;
+	}
+	unsigned __int64 First = Header->HeaderSize;
+
+	// A closed archive has the chunk table at the end.
+	if (Size >= First + sizeof(driTrackTrailer))
+	{
+		const driTrackTrailer* Trailer = (const driTrackTrailer*)
+			FFile->Map(Size - sizeof(driTrackTrailer), sizeof(driTrackTrailer));
+		if (Trailer != NULL && Trailer->Magic == DRI_TRACK_TRAILER_MAGIC &&
+			Trailer->TableOffset >= First &&
+			Trailer->TableOffset + Trailer->Count * sizeof(driTrackChunk) ==
+			Size - sizeof(driTrackTrailer))
+		{
+			unsigned __int64 Count = Trailer->Count;
+			unsigned __int64 Offset = Trailer->TableOffset;
+			FChunks.reserve((size_t)Count);
+			for (unsigned __int64 i = 0; i < Count; i++)
+			{
+				const driTrackChunk* Chunk = (const driTrackChunk*)
+					FFile->Map(Offset, sizeof(driTrackChunk));
+				if (Chunk == NULL)
+					return DRI_E_MAPPED_MAP_FAILED;
+				FChunks.push_back(*Chunk);
+				Offset += sizeof(driTrackChunk);
+			}
+			return WCL_E_SUCCESS;
+		}
+	}
+
+	// The archive was not closed: walk the chunks. Everything after the last
+	// complete chunk is ignored.
+	unsigned __int64 Offset = First;
+	while (Offset + sizeof(driTrackChunkHeader) <= Size)
+	{
+		const driTrackChunkHeader* ChunkHeader = (const driTrackChunkHeader*)
+			FFile->Map(Offset, sizeof(driTrackChunkHeader));
+		if (!IsChunkHeader(ChunkHeader))
+			break;
+
+		unsigned __int64 ChunkSize = sizeof(driTrackChunkHeader) +
+			ChunkDataSize(*ChunkHeader);
+		if (Offset + ChunkSize > Size)
+			break;
+
+		driTrackChunk Chunk;
+		Chunk.Header = *ChunkHeader;
+		Chunk.Offset = Offset;
+		FChunks.push_back(Chunk);
+
+		Offset += ChunkSize;
+	}
+	return WCL_E_SUCCESS;
+}
+
+bool CDriTrackArchiveReader::Matches(const driTrackChunkHeader& Header,
+	const driTrackQuery& Query) const
+{
+	if (Header.MaxTime < Query.From || Header.MinTime > Query.To)
+		return false;
+	if (Query.Filtered && Header.DroneKey != Query.DroneKey)
+		return false;
+	if (Query.Area)
+	{
+		if (Header.MaxLatitude < LatLon(Query.MinLatitude) ||
+			Header.MinLatitude > LatLon(Query.MaxLatitude) ||
+			Header.MaxLongitude < LatLon(Query.MinLongitude) ||
+			Header.MinLongitude > LatLon(Query.MaxLongitude))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+int CDriTrackArchiveReader::DecodeChunk(const driTrackChunk& Chunk,
+	const unsigned long Columns, std::vector<driTrackSample>& Samples)
+{
+	const driTrackChunkHeader& Header = Chunk.Header;
+	if (!IsChunkHeader(&Header))
+		return DRI_E_TRACK_CORRUPTED;
+
+	// Map the column data once; only the pages of the decoded columns are
+	// touched.
+	unsigned __int64 Size = ChunkDataSize(Header);
+	unsigned __int64 Offset = Chunk.Offset + sizeof(driTrackChunkHeader);
+	if (Offset + Size > FFile->GetSize())
+		return DRI_E_TRACK_CORRUPTED;
+	const unsigned char* Data = FFile->Map(Offset, (unsigned long)Size);
+	if (Data == NULL)
+		return DRI_E_MAPPED_MAP_FAILED;
+
+	driTrackSample Empty;
+	ZeroMemory(&Empty, sizeof(Empty));
+	Empty.DroneKey = Header.DroneKey;
+	Samples.assign(Header.Count, Empty);
+
+	for (size_t Column = 0; Column < DRI_TRACK_COLUMNS; Column++)
+	{
+		if ((Columns & DRI_TRACK_COLUMN(Column)) != 0)
+		{
+			if (!DecodeColumn(Data, Header.ColumnSize[Column], Column, Samples))
+				return DRI_E_TRACK_CORRUPTED;
+		}
+		Data += Header.ColumnSize[Column];
+	}
+	return WCL_E_SUCCESS;
+}
+
+int CDriTrackArchiveReader::Open(const tstring& FileName)
+{
+	if (FileName == _T(""))
+		return WCL_E_INVALID_ARGUMENT;
+	if (FFile->GetActive())
+		return DRI_E_TRACK_OPENED;
+
+	int Res = FFile->Open(FileName, false);
+	if (Res == WCL_E_SUCCESS)
+	{
+		Res = LoadChunks();
+		if (Res != WCL_E_SUCCESS)
+			Close();
+	}
+	return Res;
+}
+
+int CDriTrackArchiveReader::Close()
+{
+	if (!FFile->GetActive())
+		return DRI_E_TRACK_CLOSED;
+
+	FChunks.clear();
+	FFile->Close();
+	return WCL_E_SUCCESS;
+}
+
+int CDriTrackArchiveReader::Select(const driTrackQuery& Query,
+	const unsigned long Columns, std::vector<driTrackSample>& Samples)
+{
+	Samples.clear();
+	if (!FFile->GetActive())
+		return DRI_E_TRACK_CLOSED;
+	if (Query.From > Query.To || (Columns & ~DRI_TRACK_ALL_COLUMNS) != 0)
+		return WCL_E_INVALID_ARGUMENT;
+
+	long MinLatitude = 0;
+	long MaxLatitude = 0;
+	long MinLongitude = 0;
+	long MaxLongitude = 0;
+	if (Query.Area)
+	{
+		MinLatitude = LatLon(Query.MinLatitude);
+		MaxLatitude = LatLon(Query.MaxLatitude);
+		MinLongitude = LatLon(Query.MinLongitude);
+		MaxLongitude = LatLon(Query.MaxLongitude);
+	}
+
+	std::vector<driTrackSample> Decoded;
+	for (std::vector<driTrackChunk>::const_iterator Chunk = FChunks.begin();
+		Chunk != FChunks.end(); Chunk++)
+	{
+		const driTrackChunkHeader& Header = Chunk->Header;
+		if (!Matches(Header, Query))
+			continue;
+
+		// The filter columns are decoded only if the chunk statistics do not
+		// prove that all the samples pass.
+		bool CheckTime = (Header.MinTime < Query.From || Header.MaxTime > Query.To);
+		bool CheckArea = Query.Area && (Header.MinLatitude < MinLatitude ||
+			Header.MaxLatitude > MaxLatitude || Header.MinLongitude < MinLongitude ||
+			Header.MaxLongitude > MaxLongitude);
+		unsigned long Decode = Columns;
+		if (CheckTime)
+			Decode |= DRI_TRACK_COLUMN(tcTime);
+		if (CheckArea)
+			Decode |= DRI_TRACK_COLUMN(tcLatitude) | DRI_TRACK_COLUMN(tcLongitude);
+
+		int Res = DecodeChunk(*Chunk, Decode, Decoded);
+		if (Res != WCL_E_SUCCESS)
+			return Res;
+
+		for (std::vector<driTrackSample>::iterator Sample = Decoded.begin();
+			Sample != Decoded.end(); Sample++)
+		{
+			if (CheckTime && (Sample->Timestamp < Query.From || Sample->Timestamp > Query.To))
+				continue;
+			if (CheckArea)
+			{
+				long Latitude = LatLon(Sample->Latitude);
+				long Longitude = LatLon(Sample->Longitude);
+				if (Latitude < MinLatitude || Latitude > MaxLatitude ||
+					Longitude < MinLongitude || Longitude > MaxLongitude)
+				{
+					continue;
+				}
+			}
+
+			for (size_t Column = 0; Column < DRI_TRACK_COLUMNS; Column++)
+			{
+				if ((Decode & ~Columns & DRI_TRACK_COLUMN(Column)) != 0)
+					ClearColumn(*Sample, Column);
+			}
+			Samples.push_back(*Sample);
+		}
+	}
+	return WCL_E_SUCCESS;
+}
+
+const driTrackChunk* CDriTrackArchiveReader::GetChunk(const size_t Index) const
+{
+	if (Index >= FChunks.size())
+		return NULL;
+	return &FChunks[Index];
+}
+
+bool CDriTrackArchiveReader::GetActive() const
+{
+	return FFile->GetActive();
+}
+
+size_t CDriTrackArchiveReader::GetChunks() const
+{
+	return FChunks.size();
+}
@@ -0,0 +1,393 @@
+
+// DriTrackArchive.h : header file
+//
+
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include "wclHelpers.h"
+#include "wclSync.h"
+#include "wclDriAsd.h"
+
+#include "DriErrors.h"
+#include "DriMappedFile.h"
+
+using namespace wclCommon;
+using namespace wclSync;
+using namespace wclDri;
+
+// A track archive keeps the decoded location samples (not the raw frames)
+// in column chunks. The file layout (little-endian):
+//
+//   driTrackFileHeader
+//   chunk 0: driTrackChunkHeader, column 0 data, column 1 data, ...
+//   chunk 1: ...
+//   ...
+//   Count * driTrackChunk (the chunk table, written on close)
+//   driTrackTrailer
+//
+// A chunk holds the samples of one drone in the order they were appended.
+// The columns are encoded as:
+//
+//   tcTime            milliseconds, delta-of-delta, zigzag varint
+//   tcLatitude        1E-7 degrees, delta, zigzag varint
+//   tcLongitude       1E-7 degrees, delta, zigzag varint
+//   tcGeoAltitude     0.5 m, delta, zigzag varint
+//   tcHeight          0.5 m, delta, zigzag varint
+//   tcSpeed           0.25 m/s, delta, zigzag varint
+//   tcVerticalSpeed   0.5 m/s, delta, zigzag varint
+//   tcDirection       degrees, delta, zigzag varint
+//   tcStatus          4 bits per sample
+//   tcHeightReference 1 bit per sample
+//   tcAccuracy        4 bits per sample (the horizontal accuracy)
+//
+// The resolutions are the ASD message resolutions so the quantization does
+// not lose anything the drone sent (except the sub-millisecond receive
+// time). The chunk header carries the time, position and altitude ranges so
+// a query skips the chunks that can not match without reading them. If the
+// trailer is missing (the archive was not closed) the reader rebuilds the
+// chunk table by walking the chunks.
+
+/// <summary> The track archive file signature. </summary>
+#define DRI_TRACK_MAGIC				"DRITRACK"
+/// <summary> The track archive format version. </summary>
+#define DRI_TRACK_VERSION			1
+/// <summary> The chunk signature. </summary>
+#define DRI_TRACK_CHUNK_MAGIC		0x4B435254 // "TRCK"
+/// <summary> The archive trailer signature. </summary>
+#define DRI_TRACK_TRAILER_MAGIC		0x524C5254 // "TRLR"
+/// <summary> The number of the columns. </summary>
+#define DRI_TRACK_COLUMNS			11
+/// <summary> The maximum number of samples in one chunk. </summary>
+#define DRI_TRACK_CHUNK_SAMPLES		4096
+
+/// <summary> The track archive columns. </summary>
+typedef enum
+{
+	tcTime = 0,
+	tcLatitude = 1,
+	tcLongitude = 2,
+	tcGeoAltitude = 3,
+	tcHeight = 4,
+	tcSpeed = 5,
+	tcVerticalSpeed = 6,
+	tcDirection = 7,
+	tcStatus = 8,
+	tcHeightReference = 9,
+	tcAccuracy = 10
+} driTrackColumn;
+
+/// <summary> Builds the column mask bit. </summary>
+#define DRI_TRACK_COLUMN(Column)	(1UL << (Column))
+/// <summary> The mask of all the columns. </summary>
+#define DRI_TRACK_ALL_COLUMNS		((1UL << DRI_TRACK_COLUMNS) - 1)
+
+#pragma pack(push, 1)
+/// <summary> The track archive file header. </summary>
+typedef struct
+{
+	char			Magic[8];
+	unsigned short	Version;
+	unsigned short	HeaderSize;
+	unsigned long	Flags;
+	__int64			Reserved;
+} driTrackFileHeader;
+
+/// <summary> The chunk header. </summary>
+typedef struct
+{
+	unsigned long		Magic;
+	/// <summary> The number of samples. </summary>
+	unsigned long		Count;
+	/// <summary> The drone key (see <c>DriUasIdKey</c>). </summary>
+	__int64				DroneKey;
+	/// <summary> The earliest sample time (FILETIME, UTC, millisecond
+	///   precision). </summary>
+	__int64				MinTime;
+	/// <summary> The latest sample time. </summary>
+	__int64				MaxTime;
+	/// <summary> The latitude range in 1E-7 degrees. </summary>
+	long				MinLatitude;
+	long				MaxLatitude;
+	/// <summary> The longitude range in 1E-7 degrees. </summary>
+	long				MinLongitude;
+	long				MaxLongitude;
+	/// <summary> The geodetic altitude range in 0.5 m. </summary>
+	long				MinAltitude;
+	long				MaxAltitude;
+	/// <summary> The column sizes in bytes. The columns follow the header
+	///   in the column order. </summary>
+	unsigned long		ColumnSize[DRI_TRACK_COLUMNS];
+} driTrackChunkHeader;
+
+/// <summary> The chunk table entry. </summary>
+typedef struct
+{
+	/// <summary> The copy of the chunk header. </summary>
+	driTrackChunkHeader	Header;
+	/// <summary> The chunk header offset in the file. </summary>
+	unsigned __int64	Offset;
+} driTrackChunk;
+
+/// <summary> The archive trailer. </summary>
+typedef struct
+{
+	unsigned long		Magic;
+	unsigned long		Reserved;
+	/// <summary> The chunk table offset in the file. </summary>
+	unsigned __int64	TableOffset;
+	/// <summary> The number of chunks. </summary>
+	unsigned __int64	Count;
+} driTrackTrailer;
+#pragma pack(pop)
+
+/// <summary> A location sample. </summary>
+typedef struct
+{
+	/// <summary> The drone key. </summary>
+	__int64				DroneKey;
+	/// <summary> The receive time (FILETIME, UTC). </summary>
+	__int64				Timestamp;
+	/// <summary> The latitude in degrees. </summary>
+	double				Latitude;
+	/// <summary> The longitude in degrees. </summary>
+	double				Longitude;
+	/// <summary> The geodetic altitude in meters. </summary>
+	float				GeoAltitude;
+	/// <summary> The height in meters. </summary>
+	float				Height;
+	/// <summary> The horizontal speed in m/s. 255 if unknown. </summary>
+	float				HorizontalSpeed;
+	/// <summary> The vertical speed in m/s. </summary>
+	float				VerticalSpeed;
+	/// <summary> The direction in degrees. Above 360 if unknown. </summary>
+	unsigned short		Direction;
+	/// <summary> The status (<c>wclDriAsdUavStatus</c>). </summary>
+	unsigned char		Status;
+	/// <summary> The height reference
+	///   (<c>wclDriAsdUavHeightReference</c>). </summary>
+	unsigned char		HeightReference;
+	/// <summary> The horizontal accuracy
+	///   (<c>wclDriAsdUavHorizontalAccuracy</c>). </summary>
+	unsigned char		HorizontalAccuracy;
+} driTrackSample;
+
+/// <summary> A track archive query. </summary>
+typedef struct
+{
+	/// <summary> The range start time (FILETIME, UTC). </summary>
+	__int64		From;
+	/// <summary> The range end time (FILETIME, UTC). </summary>
+	__int64		To;
+	/// <summary> <c>True</c> to select only one drone. </summary>
+	bool		Filtered;
+	/// <summary> The drone key when <c>Filtered</c> is
+	///   <c>true</c>. </summary>
+	__int64		DroneKey;
+	/// <summary> <c>True</c> to select only the samples within the
+	///   area. </summary>
+	bool		Area;
+	/// <summary> The area bounds in degrees when <c>Area</c> is
+	///   <c>true</c>. </summary>
+	double		MinLatitude;
+	double		MaxLatitude;
+	double		MinLongitude;
+	double		MaxLongitude;
+} driTrackQuery;
+
+/// <summary> Writes a track archive. </summary>
+/// <remarks> The samples are collected per drone and a drone chunk is
+///   encoded and written when it is full, when it spans more than
+///   <c>ChunkSpan</c> or when <c>FlushIdle</c> finds the drone silent for
+///   <c>ChunkSpan</c>. The methods are thread safe. </remarks>
+class CDriTrackArchiveWriter
+{
+	DISABLE_COPY(CDriTrackArchiveWriter);
+
+private:
+	typedef std::map<__int64, std::vector<driTrackSample>> driTrackPending;
+
+	CwclCriticalSection*			FCS;
+	CwclFileStream*					FStream;
+	unsigned __int64				FOffset;
+	__int64							FChunkSpan;
+	unsigned __int64				FSamples;
+	unsigned __int64				FLost;
+
+	driTrackPending					FPending;
+	std::vector<driTrackChunk>		FChunks;
+	// The column encoding buffers reused for every chunk.
+	std::vector<unsigned char>		FColumns[DRI_TRACK_COLUMNS];
+
+	int Write(const void* const Data, const unsigned long Size);
+	int Truncate(const unsigned __int64 Offset);
+	int FlushChunk(const __int64 DroneKey, std::vector<driTrackSample>& Samples);
+
+public:
+	/// <summary> Creates new track archive writer. </summary>
+	CDriTrackArchiveWriter();
+	/// <summary> Closes the archive and frees the writer. </summary>
+	virtual ~CDriTrackArchiveWriter();
+
+	/// <summary> Creates new archive. </summary>
+	/// <param name="FileName"> The archive file name. An existing file is
+	///   overwritten. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Open(const tstring& FileName);
+	/// <summary> Writes the collected samples and the chunk table and closes
+	///   the archive. </summary>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Close();
+
+	/// <summary> Appends a location sample. </summary>
+	/// <param name="Sample"> The sample. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Append(const driTrackSample& Sample);
+	/// <summary> Appends a location sample. </summary>
+	/// <param name="DroneKey"> The drone key. </param>
+	/// <param name="Timestamp"> The receive time (FILETIME, UTC). </param>
+	/// <param name="Location"> The Location message. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Append(const __int64 DroneKey, const __int64 Timestamp,
+		const CwclDriAsdLocationMessage* const Location);
+	/// <summary> Writes the chunks of the drones silent for
+	///   <c>ChunkSpan</c>. </summary>
+	/// <param name="Now"> The current time (FILETIME, UTC). </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int FlushIdle(const __int64 Now);
+	/// <summary> Moves the collected samples of a drone to other
+	///   key. </summary>
+	/// <param name="From"> The old drone key. </param>
+	/// <param name="To"> The new drone key. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	/// <remarks> A drone is known by its address until it sends the UAS ID.
+	///   The samples not yet written then join the track of the UAS ID. The
+	///   chunks already written keep the old key. </remarks>
+	int Rekey(const __int64 From, const __int64 To);
+
+	/// <summary> Gets the writer state. </summary>
+	/// <returns> <c>True</c> if the archive is opened. </returns>
+	bool GetActive() const;
+	/// <summary> Gets the writer state. </summary>
+	/// <value> <c>True</c> if the archive is opened. </value>
+	__declspec(property(get = GetActive)) bool Active;
+
+	/// <summary> Gets the number of the appended samples. </summary>
+	/// <returns> The samples count. </returns>
+	unsigned __int64 GetSamples() const;
+	/// <summary> Gets the number of the appended samples. </summary>
+	/// <value> The samples count. </value>
+	__declspec(property(get = GetSamples)) unsigned __int64 Samples;
+
+	/// <summary> Gets the number of the appended samples that were not written
+	///   because of a write failure. </summary>
+	/// <returns> The lost samples count. </returns>
+	unsigned __int64 GetLost() const;
+	/// <summary> Gets the number of the appended samples that were not written
+	///   because of a write failure. </summary>
+	/// <value> The lost samples count. </value>
+	__declspec(property(get = GetLost)) unsigned __int64 Lost;
+
+	/// <summary> Gets the number of the written bytes. </summary>
+	/// <returns> The archive size. </returns>
+	unsigned __int64 GetSize() const;
+	/// <summary> Gets the number of the written bytes. </summary>
+	/// <value> The archive size. </value>
+	__declspec(property(get = GetSize)) unsigned __int64 Size;
+
+	/// <summary> Gets the maximum chunk time span. </summary>
+	/// <returns> The span in seconds. </returns>
+	unsigned long GetChunkSpan() const;
+	/// <summary> Sets the maximum chunk time span. </summary>
+	/// <param name="Value"> The span in seconds. </param>
+	void SetChunkSpan(const unsigned long Value);
+	/// <summary> Gets and sets the maximum chunk time span. </summary>
+	/// <value> The span in seconds. </value>
+	__declspec(property(get = GetChunkSpan, put = SetChunkSpan))
+		unsigned long ChunkSpan;
+};
+
+/// <summary> Reads a track archive. </summary>
+/// <remarks> The archive is memory-mapped. A query selects the chunks by the
+///   statistics of the chunk table and decodes only the requested columns
+///   (plus the columns the query filters on) of the selected chunks. The
+///   reader is not thread safe. </remarks>
+class CDriTrackArchiveReader
+{
+	DISABLE_COPY(CDriTrackArchiveReader);
+
+private:
+	CDriMappedFile*					FFile;
+	std::vector<driTrackChunk>		FChunks;
+
+	int LoadChunks();
+	bool Matches(const driTrackChunkHeader& Header, const driTrackQuery& Query) const;
+	int DecodeChunk(const driTrackChunk& Chunk, const unsigned long Columns,
+		std::vector<driTrackSample>& Samples);
+
+public:
+	/// <summary> Creates new track archive reader. </summary>
+	CDriTrackArchiveReader();
+	/// <summary> Closes the archive and frees the reader. </summary>
+	virtual ~CDriTrackArchiveReader();
+
+	/// <summary> Opens the archive. </summary>
+	/// <param name="FileName"> The archive file name. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Open(const tstring& FileName);
+	/// <summary> Closes the archive. </summary>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Close();
+
+	/// <summary> Reads the samples matching the query. </summary>
+	/// <param name="Query"> The query. </param>
+	/// <param name="Columns"> The mask of the columns to decode (see
+	///   <see cref="DRI_TRACK_COLUMN" />). The fields of the other columns
+	///   are zero. </param>
+	/// <param name="Samples"> On output contains the samples. The samples of
+	///   each chunk are appended in the order they were written. </param>
+	/// <returns> If the function succeed the return value is
+	///   <see cref="WCL_E_SUCCESS" />. Otherwise the method returns one of
+	///   the WCL error codes. </returns>
+	int Select(const driTrackQuery& Query, const unsigned long Columns,
+		std::vector<driTrackSample>& Samples);
+
+	/// <summary> Gets the chunk table entry. </summary>
+	/// <param name="Index"> The chunk index. </param>
+	/// <returns> The chunk or <c>NULL</c> if the index is invalid. </returns>
+	/// <remarks> The chunk statistics give the archive overview without
+	///   decoding. </remarks>
+	const driTrackChunk* GetChunk(const size_t Index) const;
+
+	/// <summary> Gets the reader state. </summary>
+	/// <returns> <c>True</c> if the archive is opened. </returns>
+	bool GetActive() const;
+	/// <summary> Gets the reader state. </summary>
+	/// <value> <c>True</c> if the archive is opened. </value>
+	__declspec(property(get = GetActive)) bool Active;
+
+	/// <summary> Gets the number of chunks. </summary>
+	/// <returns> The chunks count. </returns>
+	size_t GetChunks() const;
+	/// <summary> Gets the number of chunks. </summary>
+	/// <value> The chunks count. </value>
+	__declspec(property(get = GetChunks)) size_t Chunks;
+};
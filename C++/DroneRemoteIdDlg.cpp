@@ -11,6 +11,23 @@
 #define new DEBUG_NEW
 #endif
 
+// The sensor periodic tasks timer.
+#define CAPTURE_TIMER			1
+// The sensor batch flush timer.
+#define FLUSH_TIMER				2
+// The UI refresh timer.
+#define RENDER_TIMER			3
+// The event log file name (in the application folder).
+#define EVENT_LOG_FILE			_T("DroneRemoteId.log")
+
+// The drone tree item data: the drone index + 1 in the high bits and the
+// message slot + 1 in the low 4 bits. The root node data is 0 and the drone
+// node has no slot.
+#define TREE_NO_SLOT			((size_t)-1)
+#define TREE_NODE(Drone, Slot)	((((DWORD_PTR)(Drone) + 1) << 4) | (((DWORD_PTR)(Slot) + 1) & 0x0F))
+#define TREE_DRONE(Data)		((size_t)((DWORD_PTR)(Data) >> 4) - 1)
+#define TREE_SLOT(Data)			((size_t)((DWORD_PTR)(Data) & 0x0F) - 1)
+
 
 // CDroneRemoteIdDlg dialog
 
@@ -29,17 +46,22 @@ void CDroneRemoteIdDlg::DoDataExchange(CDataExchange* pDX)
 	DDX_Control(pDX, IDC_LIST_DETAILS, lvDetails);
 	DDX_Control(pDX, IDC_BUTTON_START, btStart);
 	DDX_Control(pDX, IDC_BUTTON_STOP, btStop);
-	DDX_Control(pDX, IDC_LIST_LOG, lbLog);
+	DDX_Control(pDX, IDC_LIST_LOG, lvLog);
 }
 
 BEGIN_MESSAGE_MAP(CDroneRemoteIdDlg, CDialogEx)
 	ON_WM_PAINT()
 	ON_WM_QUERYDRAGICON()
 	ON_NOTIFY(TVN_SELCHANGED, IDC_TREE_DRONES, &CDroneRemoteIdDlg::OnTvnSelchangedTreeDrones)
+	ON_NOTIFY(TVN_GETDISPINFO, IDC_TREE_DRONES, &CDroneRemoteIdDlg::OnTvnGetdispinfoTreeDrones)
+	ON_NOTIFY(TVN_ITEMEXPANDING, IDC_TREE_DRONES, &CDroneRemoteIdDlg::OnTvnItemexpandingTreeDrones)
+	ON_NOTIFY(LVN_GETDISPINFO, IDC_LIST_DETAILS, &CDroneRemoteIdDlg::OnLvnGetdispinfoListDetails)
+	ON_NOTIFY(LVN_GETDISPINFO, IDC_LIST_LOG, &CDroneRemoteIdDlg::OnLvnGetdispinfoListLog)
 	ON_BN_CLICKED(IDC_BUTTON_CLEAR, &CDroneRemoteIdDlg::OnBnClickedButtonClear)
 	ON_BN_CLICKED(IDC_BUTTON_START, &CDroneRemoteIdDlg::OnBnClickedButtonStart)
 	ON_BN_CLICKED(IDC_BUTTON_STOP, &CDroneRemoteIdDlg::OnBnClickedButtonStop)
 	ON_WM_DESTROY()
+	ON_WM_TIMER()
 END_MESSAGE_MAP()
 
 
@@ -58,26 +80,32 @@ BOOL CDroneRemoteIdDlg::OnInitDialog()
 	lvDetails.InsertColumn(0, _T("Parameters"), 0, 100);
 	lvDetails.InsertColumn(1, _T("Value"), 0, 540);
 
-	__hook(&CwclWiFiClient::AfterOpen, &WiFiClient, &CDroneRemoteIdDlg::WiFiClientAfterOpen);
-	__hook(&CwclWiFiClient::BeforeClose, &WiFiClient, &CDroneRemoteIdDlg::WiFiClientBeforeClose);
-
-	__hook(&CwclWiFiEvents::OnAcmInterfaceArrival, &WiFiEvents, &CDroneRemoteIdDlg::WiFiEventsAcmInterfaceArrival);
-	__hook(&CwclWiFiEvents::OnAcmInterfaceRemoval, &WiFiEvents, &CDroneRemoteIdDlg::WiFiEventsAcmInterfaceRemoval);
-	__hook(&CwclWiFiEvents::OnAcmScanComplete, &WiFiEvents, &CDroneRemoteIdDlg::WiFiEventsAcmScanComplete);
-	__hook(&CwclWiFiEvents::OnAcmScanFail, &WiFiEvents, &CDroneRemoteIdDlg::WiFiEventsAcmScanFail);
-	__hook(&CwclWiFiEvents::AfterOpen, &WiFiEvents, &CDroneRemoteIdDlg::WiFiEventsAfterOpen);
-	__hook(&CwclWiFiEvents::BeforeClose, &WiFiEvents, &CDroneRemoteIdDlg::WiFiEventsBeforeClose);
-	__hook(&CwclWiFiEvents::OnMsmRadioStateChange, &WiFiEvents, &CDroneRemoteIdDlg::WiFiEventsMsmRadioStateChange);
-
-	__hook(&CwclBluetoothLeBeaconWatcher::OnDriAsdMessage, &BeaconWatcher, &CDroneRemoteIdDlg::BeaconWatcherDriAsdMessage);
-	__hook(&CwclBluetoothLeBeaconWatcher::OnStarted, &BeaconWatcher, &CDroneRemoteIdDlg::BeaconWatcherStarted);
-	__hook(&CwclBluetoothLeBeaconWatcher::OnStopped, &BeaconWatcher, &CDroneRemoteIdDlg::BeaconWatcherStopped);
+	lvLog.InsertColumn(0, _T("Time"), 0, 90);
+	lvLog.InsertColumn(1, _T("Severity"), 0, 60);
+	lvLog.InsertColumn(2, _T("Message"), 0, 780);
+	FLogFirst = 0;
+	FLogNext = 0;
+	FLogSequence = -1;
 
-	__hook(&CwclBluetoothManager::AfterOpen, &BluetoothManager, &CDroneRemoteIdDlg::BluetoothManagerAfterOpen);
-	__hook(&CwclBluetoothManager::OnClosed, &BluetoothManager, &CDroneRemoteIdDlg::BluetoothManagerClosed);
+	__hook(&CDriSensor::OnDroneChanged, &FSensor, &CDroneRemoteIdDlg::SensorDroneChanged);
 
 	FScanActive = false;
 	FRootNode = NULL;
+	FSelectedDrone = DRI_NO_DRONE;
+	FSelectedSlot = TREE_NO_SLOT;
+
+	// The dialog uses the sensor in the UI thread (mpSync) so the drone list
+	// is read without locking.
+	driSensorConfig Config;
+	CDriSensor::DefaultConfig(Config);
+	Config.LogFile = CDriSensor::AppPath() + EVENT_LOG_FILE;
+	int Res = FSensor.Open(Config);
+	if (Res != WCL_E_SUCCESS)
+		Trace(_T("Open sensor failed"), Res);
+
+	SetTimer(CAPTURE_TIMER, DRI_SENSOR_TICK_INTERVAL, NULL);
+	SetTimer(FLUSH_TIMER, DRI_SENSOR_FLUSH_INTERVAL, NULL);
+	SetTimer(RENDER_TIMER, FRender.Interval, NULL);
 
 	btStart.EnableWindow(TRUE);
 	btStop.EnableWindow(FALSE);
@@ -125,842 +153,307 @@ void CDroneRemoteIdDlg::OnTvnSelchangedTreeDrones(NMHDR *pNMHDR, LRESULT *pResul
 {
 	LPNMTREEVIEW pNMTreeView = reinterpret_cast<LPNMTREEVIEW>(pNMHDR);
 
-	ClearMessageDetails();
-
-	if (tvDrones.GetSelectedCount() != 0)
+	FSelectedDrone = DRI_NO_DRONE;
+	FSelectedSlot = TREE_NO_SLOT;
+	if (pNMTreeView->itemNew.hItem != NULL)
 	{
-		if (tvDrones.GetItemData(tvDrones.GetSelectedItem()) != NULL)
+		DWORD_PTR Data = tvDrones.GetItemData(pNMTreeView->itemNew.hItem);
+		if (Data != 0 && TREE_SLOT(Data) != TREE_NO_SLOT)
 		{
-			UpdateMessageDetails(tvDrones.GetItemText(tvDrones.GetParentItem(tvDrones.GetSelectedItem())),
-				(CwclDriMessage*)tvDrones.GetItemData(tvDrones.GetSelectedItem()));
+			FSelectedDrone = TREE_DRONE(Data);
+			FSelectedSlot = TREE_SLOT(Data);
 		}
 	}
+	ShowMessageDetails();
 
 	*pResult = 0;
 }
 
-CString CDroneRemoteIdDlg::IntToHex(const int Val) const
-{
-	CString s;
-	s.Format(_T("%.8X"), Val);
-	return s;
-}
-
-CString CDroneRemoteIdDlg::IntToHex(const unsigned char Val) const
-{
-	CString s;
-	s.Format(_T("%.2X"), Val);
-	return s;
-}
-
-CString CDroneRemoteIdDlg::IntToHex(const __int64 i) const
-{
-	CString s;
-	s.Format(_T("%.4X%.8X"), static_cast<INT32>((i >> 32) & 0x00000FFFF),
-		static_cast<INT32>(i) & 0xFFFFFFFF);
-	return s;
-}
-
-CString CDroneRemoteIdDlg::FloatToStr(const float Val) const
-{
-	CString s;
-	s.Format(_T("%f"), Val);
-	return s;
-}
-
-CString CDroneRemoteIdDlg::FloatToStr(const double Val) const
-{
-	CString s;
-	s.Format(_T("%f"), Val);
-	return s;
-}
-
-CString CDroneRemoteIdDlg::IntToStr(const unsigned short Val) const
+void CDroneRemoteIdDlg::OnTvnGetdispinfoTreeDrones(NMHDR *pNMHDR, LRESULT *pResult)
 {
-	CString s;
-	s.Format(_T("%d"), Val);
-	return s;
-}
+	LPNMTVDISPINFO pTVDispInfo = reinterpret_cast<LPNMTVDISPINFO>(pNMHDR);
 
-CString CDroneRemoteIdDlg::GuidToString(const GUID& Guid) const
-{
-	LPOLESTR GuidStr;
-	StringFromCLSID(Guid, &GuidStr);
-	CString ResStr(GuidStr);
-	CoTaskMemFree(GuidStr);
-	return ResStr;
-}
-
-CString CDroneRemoteIdDlg::DateTimeToStr(const time_t Time) const
-{
-	tm* ptm = localtime(&Time);
-	TCHAR Buffer[32];
-	// Format: Mo, 15.06.2009 20:20:00
-	_tcsftime(Buffer, 32, _T("%a, %d.%m.%Y %H:%M:%S"), ptm);
-	return CString(Buffer);
-}
-
-void CDroneRemoteIdDlg::Trace(const CString& Msg)
-{
-	lbLog.AddString(Msg);
-	lbLog.SetTopIndex(lbLog.GetCount() - 1);
-}
-
-void CDroneRemoteIdDlg::Trace(const CString& Msg, int Res)
-{
-	Trace(Msg + _T(": 0x") + IntToHex(Res));
-}
-
-void CDroneRemoteIdDlg::AdapterDisabled()
-{
-	StopScan();
-	FId = wclWiFi::GUID_NULL;
-}
-
-void CDroneRemoteIdDlg::ClearMessageDetails()
-{
-	lvDetails.DeleteAllItems();
-}
-
-void CDroneRemoteIdDlg::EnumInterfaces()
-{
-	wclWiFiInterfaces Ifaces;
-	int Res = WiFiClient.EnumInterfaces(Ifaces);
-	if (Res != WCL_E_SUCCESS)
-		Trace(_T("Enum interfaces failed"), Res);
-	else
+	const driDrone* Drone = FSensor.Drones->GetDrone(TREE_DRONE(pTVDispInfo->item.lParam));
+	if (Drone != NULL)
 	{
-		if (Ifaces.size() == 0)
-			Trace(_T("No one WiFi interface found"));
-		else
+		size_t Slot = TREE_SLOT(pTVDispInfo->item.lParam);
+		if ((pTVDispInfo->item.mask & TVIF_TEXT) != 0)
 		{
-			bool Found = false;
-			for (wclWiFiInterfaces::iterator Data = Ifaces.begin(); Data != Ifaces.end(); Data++)
+			const TCHAR* Text;
+			if (Slot == TREE_NO_SLOT)
+				Text = Drone->Ssid.c_str();
+			else
+				Text = CDriDroneList::SlotText(Slot);
+			_tcsncpy_s(pTVDispInfo->item.pszText, pTVDispInfo->item.cchTextMax, Text, _TRUNCATE);
+		}
+
+		if ((pTVDispInfo->item.mask & TVIF_CHILDREN) != 0)
+		{
+			pTVDispInfo->item.cChildren = 0;
+			if (Slot == TREE_NO_SLOT)
 			{
-				CwclWiFiInterface* Iface = new CwclWiFiInterface(Data->Id);
-				if (Iface->Open() == WCL_E_SUCCESS)
+				for (size_t i = 0; i < DRI_MESSAGE_SLOTS; i++)
 				{
-					wclWiFiPhyRadioStates States;
-					Res = Iface->GetRadioState(States);
-					if (Res == WCL_E_SUCCESS)
+					if (Drone->Slots[i].Message != NULL)
 					{
-						if (States.size() > 0)
-						{
-							bool Enabled = false;
-							for (wclWiFiPhyRadioStates::iterator State = States.begin(); State != States.end(); State++)
-							{
-								Enabled = (State->SoftwareState == rsOn && State->HardwareState == rsOn);
-								if (!Enabled)
-									break;
-							}
-							Found = Enabled;
-						}
+						pTVDispInfo->item.cChildren = 1;
+						break;
 					}
-
-					if (Found)
-						FId = Iface->Id;
-					Iface->Close();
 				}
-				delete Iface;
-
-				if (Found)
-					break;
 			}
-
-			if (Found)
-				Trace(_T("Use WiFi interface ") + GuidToString(FId));
 		}
 	}
+
+	*pResult = 0;
 }
 
-HTREEITEM CDroneRemoteIdDlg::FindDrone(const CString& Ssid)
+void CDroneRemoteIdDlg::OnTvnItemexpandingTreeDrones(NMHDR *pNMHDR, LRESULT *pResult)
 {
-	HTREEITEM Result = NULL;
+	LPNMTREEVIEW pNMTreeView = reinterpret_cast<LPNMTREEVIEW>(pNMHDR);
 
-	HTREEITEM DroneNode = tvDrones.GetChildItem(FRootNode);
-	while (DroneNode != NULL)
+	// Create the message nodes when the drone is expanded first time.
+	DWORD_PTR Data = pNMTreeView->itemNew.lParam;
+	if (pNMTreeView->action == TVE_EXPAND && Data != 0 && TREE_SLOT(Data) == TREE_NO_SLOT &&
+		(pNMTreeView->itemNew.state & TVIS_EXPANDEDONCE) == 0)
 	{
-		if (tvDrones.GetItemText(DroneNode) == Ssid)
+		size_t Drone = TREE_DRONE(Data);
+		const driDrone* Info = FSensor.Drones->GetDrone(Drone);
+		if (Info != NULL)
 		{
-			Result = DroneNode;
-			break;
+			for (size_t i = 0; i < DRI_MESSAGE_SLOTS; i++)
+			{
+				if (Info->Slots[i].Message != NULL && (FDroneNodes[Drone].Slots & (1 << i)) == 0)
+					InsertMessageNode(Drone, i);
+			}
 		}
-		DroneNode = tvDrones.GetNextSiblingItem(DroneNode);
-	}
-
-	if (Result == NULL)
-	{
-		tvDrones.InsertItem(Ssid, FRootNode);
-		tvDrones.Expand(FRootNode, TVE_EXPAND);
-	}
-	return Result;
-}
-
-CString CDroneRemoteIdDlg::MessageTypeToText(const CwclDriAsdMessage* const Message) const
-{
-	switch (Message->MessageType)
-	{
-		case mtBasicId:
-			return _T("BASIC ID");
-		case mtLocation:
-			return _T("LOCATION");
-		case mtAuth:
-			return _T("AUTH");
-		case mtSelfId:
-			return _T("SELF ID");
-		case mtSystem:
-			return _T("SYSTEM");
-		case mtOperatorId:
-			return _T("OPERATOR ID");
-		default:
-			return _T("UNKNOWN");
 	}
-}
 
-CString CDroneRemoteIdDlg::AsdVerticalAccuracyToText(
-	const wclDriAsdUavVerticalAccuracy Accuracy) const
-{
-	switch (Accuracy)
-	{
-		case vaUnknown:
-			return _T("Unknow");
-		case va150M:
-			return _T("150 m");
-		case va45M:
-			return _T("45 m");
-		case va25M:
-			return _T("25 m");
-		case va10M:
-			return _T("10 m");
-		case va3M:
-			return _T("3 m");
-		case va1M:
-			return _T("1 m");
-		default:
-			return _T("Raw value: 0x") + IntToHex(((unsigned char)Accuracy));
-	}
-}
-
-CString CDroneRemoteIdDlg::AsdHeightReferenceToText(
-	const wclDriAsdUavHeightReference Reference) const
-{
-	switch (Reference)
-	{
-		case hrTakeOff:
-			return _T("Take off");
-		case hrGround:
-			return _T("Ground");
-		default:
-			return _T("Raw value: 0x") + IntToHex((unsigned char)Reference);
-	}
+	*pResult = 0;
 }
 
-CString CDroneRemoteIdDlg::AsdHorizontalAccuracyToText(
-	const wclDriAsdUavHorizontalAccuracy Accuracy) const
+void CDroneRemoteIdDlg::OnLvnGetdispinfoListLog(NMHDR *pNMHDR, LRESULT *pResult)
 {
-	switch (Accuracy)
-	{
-		case haUnknown:
-			return _T("Unknown");
-		case ha10Nm:
-			return _T("10 miles");
-		case ha4Nm:
-			return _T("4 miles");
-		case ha2Nm:
-			return _T("2 miles");
-		case ha1Nm:
-			return _T("1 mile");
-		case ha05Nm:
-			return _T("0.5 mile");
-		case ha03Nm:
-			return _T("0.3 mile");
-		case ha01Nm:
-			return _T("0.1 mile");
-		case ha005Nm:
-			return _T("0.05 mile");
-		case ha30M:
-			return _T("30 meters");
-		case ha10M:
-			return _T("10 meters");
-		case ha3M:
-			return _T("3 meters");
-		case ha1M:
-			return _T("1 meter");
-		default:
-			return _T("Raw value: 0x") + IntToHex((unsigned char)Accuracy);
-	}
-}
+	NMLVDISPINFO* pDispInfo = reinterpret_cast<NMLVDISPINFO*>(pNMHDR);
 
-CString CDroneRemoteIdDlg::AsdSpeedAccuracyToText(
-	const wclDriAsdUavSpeedAccuracy Accuracy) const
-{
-	switch (Accuracy)
+	if ((pDispInfo->item.mask & LVIF_TEXT) != 0)
 	{
-		case saUnknown:
-			return _T("Unknown");
-		case sa10MS:
-			return _T("10 m/s");
-		case sa3MS:
-			return _T("3 m/s");
-		case sa1Ms:
-			return _T("1 m/s");
-		case sa03Ms:
-			return _T("0.3 m/s");
-		default:
-			return _T("Raw value: 0x") + IntToHex((unsigned char)Accuracy);
-	}
-}
+		// Each column asks for the same event: copy it once.
+		__int64 Sequence = FLogFirst + pDispInfo->item.iItem;
+		if (Sequence != FLogSequence)
+		{
+			// Not cached if it failed: the event can be still being written.
+			if (FSensor.Log->Get(Sequence, FLogEvent))
+				FLogSequence = Sequence;
+			else
+			{
+				FLogSequence = -1;
+				FLogEvent.Timestamp = 0;
+				FLogEvent.Severity = esInfo;
+				FLogEvent.Text[0] = 0;
+			}
+		}
 
-CString CDroneRemoteIdDlg::AsdStatusToText(const wclDriAsdUavStatus Status) const
-{
-	switch (Status)
-	{
-		case usUndeclared:
-			return _T("Undeclared");
-		case usGround:
-			return _T("Ground");
-		case usAirborne:
-			return _T("Airborne");
-		case usEmergency:
-			return _T("Emergency");
-		case usFailure:
-			return _T("Failure");
-		default:
-			return _T("Raw value: 0x") + IntToHex((unsigned char)Status);
+		switch (pDispInfo->item.iSubItem)
+		{
+			case 0:
+				{
+					FILETIME Utc;
+					Utc.dwLowDateTime = (DWORD)FLogEvent.Timestamp;
+					Utc.dwHighDateTime = (DWORD)(FLogEvent.Timestamp >> 32);
+					FILETIME Local;
+					SYSTEMTIME Time;
+					if (FLogEvent.Timestamp == 0 || !FileTimeToLocalFileTime(&Utc, &Local) ||
+						!FileTimeToSystemTime(&Local, &Time))
+					{
+						pDispInfo->item.pszText[0] = 0;
+					}
+					else
+					{
+						_stprintf_s(pDispInfo->item.pszText, pDispInfo->item.cchTextMax,
+							_T("%.2u:%.2u:%.2u.%.3u"), Time.wHour, Time.wMinute, Time.wSecond,
+							Time.wMilliseconds);
+					}
+				}
+				break;
+			case 1:
+				pDispInfo->item.pszText = (LPTSTR)CDriEventLog::SeverityText(FLogEvent.Severity);
+				break;
+			default:
+				pDispInfo->item.pszText = FLogEvent.Text;
+				break;
+		}
 	}
-}
 
-CString CDroneRemoteIdDlg::AsdTimestampAccuracyToText(
-	const wclDriAsdUavTimestampAccuracy Accuracy) const
-{
-	switch (Accuracy)
-	{
-		case taUnknown:
-			return _T("Unknown");
-		case ta01s:
-			return _T("0.1 second");
-		case ta02s:
-			return _T("0.2 second");
-		case ta03s:
-			return _T("0.3 second");
-		case ta04s:
-			return _T("0.4 second");
-		case ta05s:
-			return _T("0.5 second");
-		case ta06s:
-			return _T("0.6 second");
-		case ta07s:
-			return _T("0.7 second");
-		case ta08s:
-			return _T("0.8 second");
-		case ta09s:
-			return _T("0.9 second");
-		case ta1s:
-			return _T("1 second");
-		case ta11s:
-			return _T("1.1 second");
-		case ta12s:
-			return _T("1.2 second");
-		case ta13s:
-			return _T("1.3 second");
-		case ta14s:
-			return _T("1.4 second");
-		case ta15s:
-			return _T("1.5 second");
-		default:
-			return _T("Raw value: 0x") + IntToHex((unsigned char)Accuracy);
-	}
+	*pResult = 0;
 }
 
-CString CDroneRemoteIdDlg::AsdAltitudeToText(const float Altitude) const
+void CDroneRemoteIdDlg::OnLvnGetdispinfoListDetails(NMHDR *pNMHDR, LRESULT *pResult)
 {
-	if (Altitude == -1000)
-		return _T("Invalid");
-	return FloatToStr(Altitude);
-}
+	NMLVDISPINFO* pDispInfo = reinterpret_cast<NMLVDISPINFO*>(pNMHDR);
 
-CString CDroneRemoteIdDlg::AsdDescriptionTypeToText(
-	const wclDriAsdDescriptionType DescriptionType) const
-{
-	switch (DescriptionType)
+	if ((pDispInfo->item.mask & LVIF_TEXT) != 0)
 	{
-		case dtText:
-			return _T("Text");
-		case dtEmergency:
-			return _T("Emergency");
-		case dtExtended:
-			return _T("Extended");
-		default:
-			return _T("Raw value: 0x") + IntToHex((unsigned char)DescriptionType);
+		// The rows are formatted already: hand out the cached strings.
+		const driDetailRows* Rows = FSensor.Drones->GetDetails(FSelectedDrone, FSelectedSlot);
+		if (Rows != NULL && pDispInfo->item.iItem >= 0 && (size_t)pDispInfo->item.iItem < Rows->size())
+		{
+			const driDetailRow& Row = (*Rows)[pDispInfo->item.iItem];
+			if (pDispInfo->item.iSubItem == 0)
+				pDispInfo->item.pszText = (LPTSTR)Row.Name;
+			else
+				pDispInfo->item.pszText = (LPTSTR)Row.Value.c_str();
+		}
 	}
-}
-
-CString CDroneRemoteIdDlg::AsdDirectionToText(const unsigned short Direction) const
-{
-	if (Direction > 360)
-		return _T("Invalid");
-	return IntToStr(Direction);
-}
 
-CString CDroneRemoteIdDlg::AsdHorizontalSpeedToText(const float Speed) const
-{
-	if (Speed == 255)
-		return _T("Invalid");
-	return FloatToStr(Speed);
-}
-
-CString CDroneRemoteIdDlg::AsdLatLonToText(const double LatLon) const
-{
-	if (LatLon == 0)
-		return _T("Invalid");
-	return FloatToStr(LatLon);
+	*pResult = 0;
 }
 
-CString CDroneRemoteIdDlg::AsdOperatorClassificationToText(
-	const wclDriAsdOperatorClassification Classification) const
+CString CDroneRemoteIdDlg::IntToHex(const int Val) const
 {
-	switch (Classification)
-	{
-		case ocUndeclared:
-			return _T("Undeclared");
-		case ocEu:
-			return _T("EU");
-		default:
-			return _T("Raw value: 0x") + IntToHex((unsigned char)Classification);
-	}
+	CString s;
+	s.Format(_T("%.8X"), Val);
+	return s;
 }
 
-CString CDroneRemoteIdDlg::AsdLocationTypeToText(
-	const wclDriAsdOperatorLocationType Location) const
+CString CDroneRemoteIdDlg::GuidToString(const GUID& Guid) const
 {
-	switch (Location)
-	{
-		case ltTakeOff:
-			return _T("Take off");
-		case ltLiveGnss:
-			return _T("Live GNSS");
-		case ltFixed:
-			return _T("Fixed");
-		default:
-			return _T("Raw value: 0x") + IntToHex((unsigned char)Location);
-	}
+	LPOLESTR GuidStr;
+	StringFromCLSID(Guid, &GuidStr);
+	CString ResStr(GuidStr);
+	CoTaskMemFree(GuidStr);
+	return ResStr;
 }
 
-CString CDroneRemoteIdDlg::AsdEuUavCategoryToText(
-	const wclDriAsdUavEuCategory Category) const
+void CDroneRemoteIdDlg::Trace(const CString& Msg)
 {
-	switch (Category)
-	{
-		case ucUndeclared:
-			return _T("Undeclared");
-		case ucOpen:
-			return _T("Open");
-		case ucSpecific:
-			return _T("Specific");
-		case ucCertified:
-			return _T("Certified");
-		default:
-			return _T("Raw value: 0x") + IntToHex((unsigned char)Category);
-	}
+	FSensor.Log->Add(esInfo, Msg);
 }
 
-CString CDroneRemoteIdDlg::AsdEuUavClassToText(const wclDriAsdUavEuClass UavClass) const
+void CDroneRemoteIdDlg::Trace(const CString& Msg, int Res)
 {
-	switch (UavClass)
-	{
-		case ucUnspecified:
-			return _T("Unspecified");
-		case ucClass0:
-			return _T("Class 0");
-		case ucClass1:
-			return _T("Class 1");
-		case ucClass2:
-			return _T("Class 2");
-		case ucClass3:
-			return _T("Class 3");
-		case ucClass4:
-			return _T("Class 4");
-		case ucClass5:
-			return _T("Class 5");
-		case ucClass6:
-			return _T("Class 6");
-		default:
-			return _T("Raw value: 0x") + IntToHex((unsigned char)UavClass);
-	}
+	FSensor.Log->Add(esError, Msg + _T(": 0x") + IntToHex(Res));
 }
 
-CString CDroneRemoteIdDlg::AsdIdTypeToText(const wclDriAsdIdType IdType) const
+void CDroneRemoteIdDlg::RenderLog()
 {
-	switch (IdType)
+	__int64 First = FSensor.Log->First;
+	__int64 Next = FSensor.Log->Next;
+	if (First != FLogFirst || Next != FLogNext)
 	{
-		case itNone:
-			return _T("None");
-		case itSerialNumber:
-			return _T("Serial number");
-		case itCaaRegistrationId:
-			return _T("CAA registration ID");
-		case itUtmAssignedUuid:
-			return _T("UTM assigned UUID");
-		case itSpecificSessionId:
-			return _T("Specific session ID");
-		default:
-			return _T("Raw value: 0x") + IntToHex((unsigned char)IdType);
-	}
-}
+		// When the first event changed the items are shifted: repaint all.
+		DWORD Flags = LVSICF_NOSCROLL;
+		if (First == FLogFirst)
+			Flags |= LVSICF_NOINVALIDATEALL;
+		else
+			FLogSequence = -1;
 
-CString CDroneRemoteIdDlg::AsdUavTypeToText(const wclDriAsdUavType UavType) const
-{
-	switch (UavType)
-	{
-		case utNone:
-			return _T("None");
-		case utAeroplane:
-			return _T("Aeroplane");
-		case utCopter:
-			return _T("Copter");
-		case utGyroplane:
-			return _T("Gyroplane");
-		case utHybridLift:
-			return _T("Hybrid");
-		case utOrnithopter:
-			return _T("Ornithopter");
-		case utGlider:
-			return _T("Glider");
-		case utKite:
-			return _T("Kite");
-		case utFreeBalloon:
-			return _T("Free balloon");
-		case utCaptiveBalloon:
-			return _T("Captive balloon");
-		case utAirship:
-			return _T("Airship");
-		case utFreeFallParachute:
-			return _T("Free fall parachute");
-		case utRocket:
-			return _T("Rocket");
-		case utTetheredPoweredAircraft:
-			return _T("Tethered powered aircraft");
-		case utGroundObstacle:
-			return _T("Ground obstacle");
-		default:
-			return _T("Raw value: 0x") + IntToHex((unsigned char)UavType);
-	}
-}
+		FLogFirst = First;
+		FLogNext = Next;
 
-CString CDroneRemoteIdDlg::VendorToText(const CwclDriMessage* const Message) const
-{
-	switch (Message->Vendor)
-	{
-		case driAsd:
-			return _T("ASD");
-		default:
-			return _T("UKNOWN");
+		int Count = (int)(Next - First);
+		lvLog.SetItemCountEx(Count, Flags);
+		if (Count > 0)
+			lvLog.EnsureVisible(Count - 1, FALSE);
 	}
 }
 
-void CDroneRemoteIdDlg::ShowAsdLocationMessage(
-	const CwclDriAsdLocationMessage* const Message)
-{
-	int Item = lvDetails.GetItemCount();
-	lvDetails.InsertItem(Item, _T("Baro Altitude"));
-	lvDetails.SetItemText(Item, 1, AsdAltitudeToText(Message->BaroAltitude));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("Baro Accuracy"));
-	lvDetails.SetItemText(Item, 1, AsdVerticalAccuracyToText(Message->BaroAccuracy));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("Direction"));
-	lvDetails.SetItemText(Item, 1, AsdDirectionToText(Message->Direction));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("Geo Altitude"));
-	lvDetails.SetItemText(Item, 1, AsdAltitudeToText(Message->GeoAltitude));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("Height"));
-	lvDetails.SetItemText(Item, 1, AsdAltitudeToText(Message->Height));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("Height Reference"));
-	lvDetails.SetItemText(Item, 1, AsdHeightReferenceToText(Message->HeightReference));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("Horizontal Accuracy"));
-	lvDetails.SetItemText(Item, 1, AsdHorizontalAccuracyToText(Message->HorizontalAccuracy));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("Horizontal Speed"));
-	lvDetails.SetItemText(Item, 1, AsdHorizontalSpeedToText(Message->HorizontalSpeed));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("Latitude"));
-	lvDetails.SetItemText(Item, 1, AsdLatLonToText(Message->Latitude));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("Longitude"));
-	lvDetails.SetItemText(Item, 1, AsdLatLonToText(Message->Longitude));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("Speed Accuracy"));
-	lvDetails.SetItemText(Item, 1, AsdSpeedAccuracyToText(Message->SpeedAccuracy));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("Status"));
-	lvDetails.SetItemText(Item, 1, AsdStatusToText(Message->Status));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("Timestamp"));
-	lvDetails.SetItemText(Item, 1, FloatToStr(Message->Timestamp));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("Timestamp Accuracy"));
-	lvDetails.SetItemText(Item, 1, AsdTimestampAccuracyToText(Message->TimestampAccuracy));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("Vertical Accuracy"));
-	lvDetails.SetItemText(Item, 1, AsdVerticalAccuracyToText(Message->VerticalAccuracy));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("Vertical Speed"));
-	lvDetails.SetItemText(Item, 1, FloatToStr(Message->VerticalSpeed));
-}
-
-void CDroneRemoteIdDlg::ShowAsdSelfIdMessage(const CwclDriAsdSelfIdMessage* const Message)
-{
-	int Item = lvDetails.GetItemCount();
-	lvDetails.InsertItem(Item, _T("Description"));
-	lvDetails.SetItemText(Item, 1, CString(Message->Description.c_str()));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("Description Type"));
-	lvDetails.SetItemText(Item, 1, AsdDescriptionTypeToText(Message->DescriptionType));
-	Item++;
-}
-
-void CDroneRemoteIdDlg::ShowAsdOperatorIdMessage(
-	const CwclDriAsdOperatorIdMessage* const Message)
+void CDroneRemoteIdDlg::ClearMessageDetails()
 {
-	int Item = lvDetails.GetItemCount();
-	lvDetails.InsertItem(Item, _T("ID"));
-	lvDetails.SetItemText(Item, 1, CString((char*)&Message->Id[0]));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("ID Type"));
-	lvDetails.SetItemText(Item, 1, _T("0x") + IntToHex(Message->IdType));
+	lvDetails.DeleteAllItems();
 }
 
-void CDroneRemoteIdDlg::ShowAsdSystemMessage(const CwclDriAsdSystemMessage* const Message)
+void CDroneRemoteIdDlg::ClearDrones()
 {
-	int Item = lvDetails.GetItemCount();
-	lvDetails.InsertItem(Item, _T("Area ceiling"));
-	lvDetails.SetItemText(Item, 1, AsdAltitudeToText(Message->AreaCeiling));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("Area count"));
-	lvDetails.SetItemText(Item, 1, IntToStr(Message->AreaCount));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("Area floor"));
-	lvDetails.SetItemText(Item, 1, AsdAltitudeToText(Message->AreaFloor));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("Area radius"));
-	lvDetails.SetItemText(Item, 1, IntToStr(Message->AreaRadius));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("Operator altitude"));
-	lvDetails.SetItemText(Item, 1, FloatToStr(Message->OperatorAltitude));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("Operator classification"));
-	lvDetails.SetItemText(Item, 1, AsdOperatorClassificationToText(Message->OperatorClassification));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("Operator latitude"));
-	lvDetails.SetItemText(Item, 1, AsdLatLonToText(Message->OperatorLatitude));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("Operator longitude"));
-	lvDetails.SetItemText(Item, 1, AsdLatLonToText(Message->OperatorLongitude));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("Location type"));
-	lvDetails.SetItemText(Item, 1, AsdLocationTypeToText(Message->OperatorLocation));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("Timestamp"));
-	lvDetails.SetItemText(Item, 1, DateTimeToStr(Message->Timestamp));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("UAV EU category"));
-	lvDetails.SetItemText(Item, 1, AsdEuUavCategoryToText(Message->UavEuCategory));
-	Item++;
+	FSelectedDrone = DRI_NO_DRONE;
+	FSelectedSlot = TREE_NO_SLOT;
+	ClearMessageDetails();
 
-	lvDetails.InsertItem(Item, _T("UAV EU class"));
-	lvDetails.SetItemText(Item, 1, AsdEuUavClassToText(Message->UavEuClass));
+	tvDrones.DeleteAllItems();
+	FRootNode = NULL;
+	FDroneNodes.clear();
+	FSensor.Clear();
+	FRender.Reset();
 }
 
-void CDroneRemoteIdDlg::ShowAsdBassicIdMessage(const CwclDriAsdBasicIdMessage* const Message)
+void CDroneRemoteIdDlg::InsertMessageNode(const size_t Drone, const size_t Slot)
 {
-	int Item = lvDetails.GetItemCount();
-	lvDetails.InsertItem(Item, _T("ID"));
-	lvDetails.SetItemText(Item, 1, CString((char*)&Message->Id[0]));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("ID type"));
-	lvDetails.SetItemText(Item, 1, AsdIdTypeToText(Message->IdType));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T("UAV type"));
-	lvDetails.SetItemText(Item, 1, AsdUavTypeToText(Message->UavType));
+	TVINSERTSTRUCT Item;
+	ZeroMemory(&Item, sizeof(TVINSERTSTRUCT));
+	Item.hParent = FDroneNodes[Drone].Node;
+	Item.hInsertAfter = TVI_LAST;
+	Item.item.mask = TVIF_TEXT | TVIF_PARAM;
+	Item.item.pszText = LPSTR_TEXTCALLBACK;
+	Item.item.lParam = (LPARAM)TREE_NODE(Drone, Slot);
+	tvDrones.InsertItem(&Item);
+	FDroneNodes[Drone].Slots |= (unsigned char)(1 << Slot);
 }
 
-void CDroneRemoteIdDlg::ShowUnknownAsdMessage(const CwclDriAsdMessage* const Message)
+void CDroneRemoteIdDlg::RenderDrone(const size_t Drone)
 {
-	int Item = lvDetails.GetItemCount();
-	lvDetails.InsertItem(Item, _T("Message type"));
-	lvDetails.SetItemText(Item, 1, IntToHex((unsigned char)Message->MessageType));
-	Item++;
-
-	CString Str = _T("");
-	if (Message->Data.size() > 0)
+	// The drones are added to the model in the index order so all the
+	// missing nodes are created.
+	while (FDroneNodes.size() <= Drone)
 	{
-		for (wclWiFiIeRawData::iterator b = Message->Data.begin(); b != Message->Data.end(); b++)
-			Str += IntToHex(*b);
-	}
-	lvDetails.InsertItem(Item, _T("Raw date"));
-	lvDetails.SetItemText(Item, 1, Str);
-}
-
-void CDroneRemoteIdDlg::UpdateAsdMessageDetails(const CString& Ssid,
-	const CwclDriAsdMessage* const Message)
-{
-	int Item = lvDetails.GetItemCount();
-	lvDetails.InsertItem(Item, _T("SSID"));
-	lvDetails.SetItemText(Item, 1, Ssid);
-	Item++;
+		TVINSERTSTRUCT Item;
+		ZeroMemory(&Item, sizeof(TVINSERTSTRUCT));
+		Item.hParent = FRootNode;
+		Item.hInsertAfter = TVI_LAST;
+		Item.item.mask = TVIF_TEXT | TVIF_PARAM | TVIF_CHILDREN;
+		Item.item.pszText = LPSTR_TEXTCALLBACK;
+		Item.item.cChildren = I_CHILDRENCALLBACK;
+		Item.item.lParam = (LPARAM)TREE_NODE(FDroneNodes.size(), TREE_NO_SLOT);
 
-	lvDetails.InsertItem(Item, _T("Vendor"));
-	lvDetails.SetItemText(Item, 1, VendorToText(Message));
-	Item++;
-
-	lvDetails.InsertItem(Item, _T(""));
-	lvDetails.SetItemText(Item, 1, _T(""));
-
-	switch (Message->MessageType)
-	{
-		case mtBasicId:
-			ShowAsdBassicIdMessage((CwclDriAsdBasicIdMessage*)Message);
-			break;
-		case mtLocation:
-			ShowAsdLocationMessage((CwclDriAsdLocationMessage*)Message);
-			break;
-		case mtAuth:
-			ShowUnknownAsdMessage(Message);
-			break;
-		case mtSelfId:
-			ShowAsdSelfIdMessage((CwclDriAsdSelfIdMessage*)Message);
-			break;
-		case mtSystem:
-			ShowAsdSystemMessage((CwclDriAsdSystemMessage*)Message);
-			break;
-		case mtOperatorId:
-			ShowAsdOperatorIdMessage((CwclDriAsdOperatorIdMessage*)Message);
-			break;
-		default:
-			ShowUnknownAsdMessage(Message);
-			break;
+		driDroneNode Node;
+		Node.Node = tvDrones.InsertItem(&Item);
+		Node.Slots = 0;
+		FDroneNodes.push_back(Node);
+		if (FDroneNodes.size() == 1)
+			tvDrones.Expand(FRootNode, TVE_EXPAND);
 	}
-}
 
-void CDroneRemoteIdDlg::UpdateDroneMessages(const HTREEITEM Node,
-	wclDriMessages& Messages)
-{
-	for (wclDriMessages::iterator Message = Messages.begin(); Message != Messages.end(); Message++)
+	// The message nodes of a collapsed drone are created when it is
+	// expanded.
+	if ((tvDrones.GetItemState(FDroneNodes[Drone].Node, TVIS_EXPANDEDONCE) & TVIS_EXPANDEDONCE) != 0)
 	{
-		if ((*Message)->Vendor != driAsd)
-			delete (*Message);
-		else
+		const driDrone* Info = FSensor.Drones->GetDrone(Drone);
+		for (size_t i = 0; i < DRI_MESSAGE_SLOTS; i++)
 		{
-			CwclDriAsdMessage* AsdMessage = (CwclDriAsdMessage*)(*Message);
-			CString MessageType = MessageTypeToText(AsdMessage);
-
-			HTREEITEM MessageNode = tvDrones.GetChildItem(Node);
-			while (MessageNode != NULL)
-			{
-				if (tvDrones.GetItemText(MessageNode) == MessageType)
-				{
-					delete (CwclDriMessage*)tvDrones.GetItemData(MessageNode);
-					tvDrones.SetItemData(MessageNode, NULL);
-					break;
-				}
-
-				MessageNode = tvDrones.GetNextSiblingItem(MessageNode);
-			}
-			
-			if (MessageNode == NULL)
-				MessageNode  = tvDrones.InsertItem(MessageType, Node);
-			tvDrones.SetItemData(MessageNode, (DWORD_PTR)AsdMessage);
-			if (tvDrones.GetSelectedItem() == MessageNode)
-				UpdateMessageDetails(tvDrones.GetItemText(tvDrones.GetParentItem(MessageNode)), AsdMessage);
+			if (Info->Slots[i].Message != NULL && (FDroneNodes[Drone].Slots & (1 << i)) == 0)
+				InsertMessageNode(Drone, i);
 		}
 	}
 }
 
-void CDroneRemoteIdDlg::UpdateMessageDetails(const CString& Ssid, const CwclDriMessage* const Message)
+void CDroneRemoteIdDlg::Render()
 {
-	ClearMessageDetails();
-
-	if (Message->Vendor == driAsd)
-		UpdateAsdMessageDetails(Ssid, (CwclDriAsdMessage*)Message);
-}
-
-void CDroneRemoteIdDlg::UpdateMessages(const CString& Ssid, wclDriMessages& Messages)
-{
-	HTREEITEM DroneNode = FindDrone(Ssid);
-	if (DroneNode != NULL)
+	bool Details;
+	if (FRender.BeginFrame(FRenderDrones, Details))
 	{
-		UpdateDroneMessages(DroneNode, Messages);
-		tvDrones.Expand(DroneNode, TVE_EXPAND);
-	}
-}
-
-void CDroneRemoteIdDlg::GetDriInfo()
-{
-	wclWiFiBssArray BssList;
-	int Res  = WiFiClient.EnumBss(FId, _T(""), bssAny, true, BssList);
-	if (Res != WCL_E_SUCCESS)
-		Trace(_T("Enum BSS failed"), Res);
-	else
-	{
-		if (BssList.size() > 0)
+		if (FRenderDrones.size() > 0)
 		{
-			wclDriMessages Messages;
-			for (wclWiFiBssArray::iterator Bss = BssList.begin(); Bss != BssList.end(); Bss++)
-			{
-				if (Bss->IeRaw.size() > 0)
-				{
-					FParser.ParseDriMessages(*Bss, Messages);
-					if (Messages.size() > 0)
-						UpdateMessages(CString(Bss->Ssid.c_str()), Messages);
-				}
-			}
+			tvDrones.SetRedraw(FALSE);
+			for (std::vector<size_t>::const_iterator Drone = FRenderDrones.begin(); Drone != FRenderDrones.end(); Drone++)
+				RenderDrone(*Drone);
+			tvDrones.SetRedraw(TRUE);
+			tvDrones.Invalidate(FALSE);
 		}
+
+		if (Details)
+			ShowMessageDetails();
+
+		FRender.EndFrame();
 	}
 }
 
-void CDroneRemoteIdDlg::RestartScan()
+void CDroneRemoteIdDlg::ShowMessageDetails()
 {
-	if (FScanActive)
+	const driDetailRows* Rows = FSensor.Drones->GetDetails(FSelectedDrone, FSelectedSlot);
+	if (Rows == NULL)
+		ClearMessageDetails();
+	else
 	{
-		int Res = WiFiClient.Scan(FId);
-		if (Res != WCL_E_SUCCESS)
-		{
-			Trace(_T("Restart scan failed"), Res);
-
-			StopScan();
-		}
+		// The list requests the visible rows when it paints them.
+		lvDetails.SetItemCountEx((int)Rows->size(), LVSICF_NOSCROLL);
 	}
 }
 
@@ -968,66 +461,15 @@ void CDroneRemoteIdDlg::StartScan()
 {
 	if (!FScanActive)
 	{
-		FId = wclWiFi::GUID_NULL;
-		
-		int Res = WiFiClient.Open();
-		if (Res != WCL_E_SUCCESS)
-			Trace(_T("WiFiClient open failed"), Res);
-		else
-		{
-			Res = WiFiEvents.Open();
-			if (Res != WCL_E_SUCCESS)
-				Trace(_T("WiFiEvents open failed"), Res);
-			else
-				EnumInterfaces();
-
-			if (Res != WCL_E_SUCCESS)
-				WiFiClient.Close();
-		}
-
-		if (FId != wclWiFi::GUID_NULL)
-		{
-			int Res = WiFiClient.Scan(FId);
-			if (Res != WCL_E_SUCCESS)
-				Trace(_T("Start WiFi scan failed"), Res);
-			else
-				Trace(_T("WiFI scan started"));
-		}
-		
-		Res = BluetoothManager.Open();
-		if (Res != WCL_E_SUCCESS)
-			Trace(_T("Bluetooth manager open failed"), Res);
-		else
-		{
-			CwclBluetoothRadio* Radio;
-			Res = BluetoothManager.GetLeRadio(Radio);
-			if (Res != WCL_E_SUCCESS)
-				Trace(_T("Get LE radio failed"), Res);
-			else
-			{
-				BeaconWatcher.AllowExtendedAdvertisements = true;
-				Res = BeaconWatcher.Start(Radio);
-				if (Res != WCL_E_SUCCESS)
-				{
-					BeaconWatcher.AllowExtendedAdvertisements = false;
-					Res = BeaconWatcher.Start(Radio);
-				}
-
-				if (Res != WCL_E_SUCCESS)
-					Trace(_T("Start Bluetooth scan failed"), Res);
-			}
-
-			if (Res != WCL_E_SUCCESS)
-				BluetoothManager.Close();
-		}
-		
-		FScanActive = (BeaconWatcher.Monitoring || WiFiClient.Active);
-		if (FScanActive)
+		// The sensor logs the failure.
+		if (FSensor.Start() == WCL_E_SUCCESS)
 		{
 			FRootNode = tvDrones.InsertItem(_T("Drones"));
 
 			btStart.EnableWindow(FALSE);
 			btStop.EnableWindow(TRUE);
+
+			FScanActive = true;
 		}
 	}
 }
@@ -1036,122 +478,36 @@ void CDroneRemoteIdDlg::StopScan()
 {
 	if (FScanActive)
 	{
-		WiFiEvents.Close();
-		WiFiClient.Close();
-
-		BeaconWatcher.Stop();
-		BluetoothManager.Close();
+		// The sensor logs the capture and the recording statistics.
+		FSensor.Stop();
+		TraceStatistics();
 
 		btStart.EnableWindow(TRUE);
 		btStop.EnableWindow(FALSE);
 
 		FScanActive = false;
 
-		tvDrones.DeleteAllItems();
-		FRootNode = NULL;
-
-		ClearMessageDetails();
+		ClearDrones();
 
 		Trace(_T("Scan sopped"));
 	}
 }
 
-void CDroneRemoteIdDlg::WiFiEventsMsmRadioStateChange(void* sender, const GUID& IfaceId,
-	const wclWiFiPhyRadioState& State)
-{
-	UNREFERENCED_PARAMETER(sender);
-
-	if (FId == wclWiFi::GUID_NULL)
-		EnumInterfaces();
-	else
-	{
-		if (FId == IfaceId)
-		{
-			if (State.SoftwareState == rsOff || State.HardwareState == rsOff)
-			{
-				Trace(_T("Adapter disabled"));
-
-				AdapterDisabled();
-			}
-		}
-	}
-}
-
-void CDroneRemoteIdDlg::WiFiEventsBeforeClose(void* sender)
-{
-	UNREFERENCED_PARAMETER(sender);
-
-	Trace(_T("WiFi Events closed"));
-}
-
-void CDroneRemoteIdDlg::WiFiEventsAfterOpen(void* sender)
-{
-	UNREFERENCED_PARAMETER(sender);
-
-	Trace(_T("WiFi Events opened"));
-}
-
-void CDroneRemoteIdDlg::WiFiEventsAcmScanFail(void* sender, const GUID& IfaceId, const int Reason)
-{
-	UNREFERENCED_PARAMETER(sender);
-
-	if (FScanActive && FId == IfaceId)
-	{
-		Trace(_T("Scan failed"), Reason);
-
-		RestartScan();
-	}
-}
-
-void CDroneRemoteIdDlg::WiFiEventsAcmScanComplete(void* sender, const GUID& IfaceId)
-{
-	UNREFERENCED_PARAMETER(sender);
-
-	if (FScanActive && FId == IfaceId)
-	{
-		GetDriInfo();
-
-		RestartScan();
-	}
-}
-
-void CDroneRemoteIdDlg::WiFiEventsAcmInterfaceRemoval(void* sender, const GUID& IfaceId)
-{
-	UNREFERENCED_PARAMETER(sender);
-
-	if (FId == IfaceId)
-	{
-		Trace(_T("Adapter removed"));
-
-		AdapterDisabled();
-	}
-}
-
-void CDroneRemoteIdDlg::WiFiEventsAcmInterfaceArrival(void* sender, const GUID& IfaceId)
+void CDroneRemoteIdDlg::TraceStatistics()
 {
-	UNREFERENCED_PARAMETER(sender);
-
-	if (FId == wclWiFi::GUID_NULL)
-		EnumInterfaces();
-}
-
-void CDroneRemoteIdDlg::WiFiClientBeforeClose(void* sender)
-{
-	UNREFERENCED_PARAMETER(sender);
-
-	Trace(_T("WiFi Client closed"));
-}
-
-void CDroneRemoteIdDlg::WiFiClientAfterOpen(void* sender)
-{
-	UNREFERENCED_PARAMETER(sender);
-
-	Trace(_T("WiFi Client opened"));
+	driRenderStatistics Render;
+	FRender.GetStatistics(Render);
+	CString Str;
+	Str.Format(_T("UI: frames %I64u, updates %I64u, skipped %I64u, frame time %.2f ms (max %.2f ms)"),
+		Render.Frames, Render.Updates, Render.Skipped, Render.AverageFrameTime,
+		Render.MaxFrameTime);
+	Trace(Str);
 }
 
 void CDroneRemoteIdDlg::OnBnClickedButtonClear()
 {
-	lbLog.ResetContent();
+	FSensor.Log->Clear();
+	RenderLog();
 }
 
 void CDroneRemoteIdDlg::OnBnClickedButtonStart()
@@ -1168,53 +524,43 @@ void CDroneRemoteIdDlg::OnDestroy()
 {
 	CDialogEx::OnDestroy();
 
+	KillTimer(CAPTURE_TIMER);
+	KillTimer(FLUSH_TIMER);
+	KillTimer(RENDER_TIMER);
 	StopScan();
+	FSensor.Close();
 
-	__unhook(&WiFiEvents);
-	__unhook(&WiFiClient);
-	__unhook(&BluetoothManager);
-	__unhook(&BeaconWatcher);
+	__unhook(&FSensor);
 }
 
-void CDroneRemoteIdDlg::BeaconWatcherDriAsdMessage(void* Sender, const __int64 Address,
-	const __int64 Timestamp, const char Rssi, const wclDriRawData& Raw)
+void CDroneRemoteIdDlg::OnTimer(UINT_PTR nIDEvent)
 {
-	UNREFERENCED_PARAMETER(Sender);
-	UNREFERENCED_PARAMETER(Timestamp);
-	UNREFERENCED_PARAMETER(Rssi);
-
-	wclDriMessages Messages;
-	if (FBtParser.Parse(Raw, Messages) == WCL_E_SUCCESS)
+	switch (nIDEvent)
 	{
-		if (Messages.size() > 0)
-			UpdateMessages(IntToHex(Address), Messages);
+		case CAPTURE_TIMER:
+			FSensor.Tick();
+			break;
+		case FLUSH_TIMER:
+			FSensor.Flush();
+			break;
+		case RENDER_TIMER:
+			Render();
+			RenderLog();
+			break;
 	}
-}
 
-void CDroneRemoteIdDlg::BeaconWatcherStarted(void* Sender)
-{
-	UNREFERENCED_PARAMETER(Sender);
-
-	Trace(_T("Bluetooth scan started"));
-}
-
-void CDroneRemoteIdDlg::BeaconWatcherStopped(void* Sender)
-{
-	UNREFERENCED_PARAMETER(Sender);
-
-	Trace(_T("Bluetooth scan stopped"));
+	CDialogEx::OnTimer(nIDEvent);
 }
 
-void CDroneRemoteIdDlg::BluetoothManagerAfterOpen(void* Sender)
+void CDroneRemoteIdDlg::SensorDroneChanged(void* Sender, const size_t Drone,
+	const size_t Slot, const bool Added)
 {
 	UNREFERENCED_PARAMETER(Sender);
 
-	Trace(_T("Bluetooth manager opened"));
+	// Only the model is updated here. The controls are updated by the
+	// render timer.
+	if (Added)
+		FRender.MarkDirty(Drone);
+	if (Slot != DRI_NO_SLOT && Drone == FSelectedDrone && Slot == FSelectedSlot)
+		FRender.MarkDetailsDirty();
 }
-
-void CDroneRemoteIdDlg::BluetoothManagerClosed(void* Sender)
-{
-	UNREFERENCED_PARAMETER(Sender);
-
-	Trace(_T("Bluetooth manager closed"));
-}
\ No newline at end of file
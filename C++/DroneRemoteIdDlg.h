@@ -10,6 +10,10 @@
 #include "wclWiFi.h"
 #include "wclBluetooth.h"
 
+#include "DriSensor.h"
+#include "DriDroneList.h"
+#include "DriRender.h"
+
 using namespace wclBluetooth;
 using namespace wclWiFi;
 using namespace wclDri;
@@ -40,6 +44,10 @@ protected:
 	afx_msg void OnPaint();
 	afx_msg HCURSOR OnQueryDragIcon();
 	afx_msg void OnTvnSelchangedTreeDrones(NMHDR *pNMHDR, LRESULT *pResult);
+	afx_msg void OnTvnGetdispinfoTreeDrones(NMHDR *pNMHDR, LRESULT *pResult);
+	afx_msg void OnTvnItemexpandingTreeDrones(NMHDR *pNMHDR, LRESULT *pResult);
+	afx_msg void OnLvnGetdispinfoListDetails(NMHDR *pNMHDR, LRESULT *pResult);
+	afx_msg void OnLvnGetdispinfoListLog(NMHDR *pNMHDR, LRESULT *pResult);
 	DECLARE_MESSAGE_MAP()
 
 private:
@@ -47,97 +55,61 @@ private:
 	CListCtrl lvDetails;
 	CButton btStart;
 	CButton btStop;
-	CListBox lbLog;
+	CListCtrl lvLog;
 
 private:
-	CwclWiFiClient WiFiClient;
-	CwclWiFiEvents WiFiEvents;
-	CwclBluetoothManager BluetoothManager;
-	CwclBluetoothLeBeaconWatcher BeaconWatcher;
+	CDriSensor FSensor;
 	
-	GUID FId;
-	CwclDriAsdParser FBtParser;
-	CwclWiFiDriParser FParser;
 	HTREEITEM FRootNode;
 	bool FScanActive;
+	// The shown log range.
+	__int64 FLogFirst;
+	__int64 FLogNext;
+	// The last event copied for the log list.
+	__int64 FLogSequence;
+	driEvent FLogEvent;
+
+	// The drone tree node.
+	typedef struct
+	{
+		HTREEITEM		Node;
+		// The bit mask of the slots that have the message node.
+		unsigned char	Slots;
+	} driDroneNode;
+
+	// The drone nodes indexed by the drone.
+	std::vector<driDroneNode> FDroneNodes;
+	CDriRenderScheduler FRender;
+	std::vector<size_t> FRenderDrones;
+	// The message shown in the details list.
+	size_t FSelectedDrone;
+	size_t FSelectedSlot;
 
 	CString IntToHex(const int Val) const;
-	CString IntToHex(const unsigned char Val) const;
-	CString IntToHex(const __int64 i) const;
-	CString FloatToStr(const float Val) const;
-	CString FloatToStr(const double Val) const;
-	CString IntToStr(const unsigned short Val) const;
 	CString GuidToString(const GUID& Guid) const;
-	CString DateTimeToStr(const time_t Time) const;
 
 	void Trace(const CString& Msg);
 	void Trace(const CString& Msg, int Res);
-	void AdapterDisabled();
+	void RenderLog();
 	void ClearMessageDetails();
-	void EnumInterfaces();
-	HTREEITEM FindDrone(const CString& Ssid);
-
-	CString MessageTypeToText(const CwclDriAsdMessage* const Message) const;
-	CString AsdVerticalAccuracyToText(const wclDriAsdUavVerticalAccuracy Accuracy) const;
-	CString AsdHeightReferenceToText(const wclDriAsdUavHeightReference Reference) const;
-	CString AsdHorizontalAccuracyToText(const wclDriAsdUavHorizontalAccuracy Accuracy) const;
-	CString AsdSpeedAccuracyToText(const wclDriAsdUavSpeedAccuracy Accuracy) const;
-	CString AsdStatusToText(const wclDriAsdUavStatus Status) const;
-	CString AsdTimestampAccuracyToText(const wclDriAsdUavTimestampAccuracy Accuracy) const;
-	CString AsdAltitudeToText(const float Altitude) const;
-	CString AsdDescriptionTypeToText(const wclDriAsdDescriptionType DescriptionType) const;
-	CString AsdDirectionToText(const unsigned short Direction) const;
-	CString AsdHorizontalSpeedToText(const float Speed) const;
-	CString AsdLatLonToText(const double LatLon) const;
-	CString AsdOperatorClassificationToText(const wclDriAsdOperatorClassification Classification) const;
-	CString AsdLocationTypeToText(const wclDriAsdOperatorLocationType Location) const;
-	CString AsdEuUavCategoryToText(const wclDriAsdUavEuCategory Category) const;
-	CString AsdEuUavClassToText(const wclDriAsdUavEuClass UavClass) const;
-	CString AsdIdTypeToText(const wclDriAsdIdType IdType) const;
-	CString AsdUavTypeToText(const wclDriAsdUavType UavType) const;
-	CString VendorToText(const CwclDriMessage* const Message) const;
-
-	void ShowAsdLocationMessage(const CwclDriAsdLocationMessage* const Message);
-	void ShowAsdSelfIdMessage(const CwclDriAsdSelfIdMessage* const Message);
-	void ShowAsdOperatorIdMessage(const CwclDriAsdOperatorIdMessage* const Message);
-	void ShowAsdSystemMessage(const CwclDriAsdSystemMessage* const Message);
-	void ShowAsdBassicIdMessage(const CwclDriAsdBasicIdMessage* const Message);
-	void ShowUnknownAsdMessage(const CwclDriAsdMessage* const Message);
-
-	void UpdateAsdMessageDetails(const CString& Ssid, const CwclDriAsdMessage* const Message);
-	void UpdateDroneMessages(const HTREEITEM Node, wclDriMessages& Messages);
-	void UpdateMessageDetails(const CString& Ssid, const CwclDriMessage* const Message);
-	void UpdateMessages(const CString& Ssid, wclDriMessages& Messages);
-
-	void GetDriInfo();
-
-	void RestartScan();
-	void StartScan();
-	void StopScan();
+	void ClearDrones();
 
-	void WiFiEventsMsmRadioStateChange(void* sender, const GUID& IfaceId,
-		const wclWiFiPhyRadioState& State);
-	void WiFiEventsBeforeClose(void* sender);
-	void WiFiEventsAfterOpen(void* sender);
-	void WiFiEventsAcmScanFail(void* sender, const GUID& IfaceId, const int Reason);
-	void WiFiEventsAcmScanComplete(void* sender, const GUID& IfaceId);
-	void WiFiEventsAcmInterfaceRemoval(void* sender, const GUID& IfaceId);
-	void WiFiEventsAcmInterfaceArrival(void* sender, const GUID& IfaceId);
+	void InsertMessageNode(const size_t Drone, const size_t Slot);
+	void ShowMessageDetails();
+	void RenderDrone(const size_t Drone);
+	void Render();
 
-	void WiFiClientBeforeClose(void* sender);
-	void WiFiClientAfterOpen(void* sender);
-
-	void BeaconWatcherDriAsdMessage(void* Sender, const __int64 Address,
-		const __int64 Timestamp, const char Rssi, const wclDriRawData& Raw);
-	void BeaconWatcherStarted(void* Sender);
-	void BeaconWatcherStopped(void* Sender);
+	void StartScan();
+	void StopScan();
+	void TraceStatistics();
 
-	void BluetoothManagerAfterOpen(void* Sender);
-	void BluetoothManagerClosed(void* Sender);
+	void SensorDroneChanged(void* Sender, const size_t Drone,
+		const size_t Slot, const bool Added);
 
 public:
 	afx_msg void OnBnClickedButtonClear();
 	afx_msg void OnBnClickedButtonStart();
 	afx_msg void OnBnClickedButtonStop();
 	afx_msg void OnDestroy();
+	afx_msg void OnTimer(UINT_PTR nIDEvent);
 };
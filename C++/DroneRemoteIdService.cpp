@@ -0,0 +1,393 @@
+
+// DroneRemoteIdService.cpp : Defines the entry point of the headless sensor.
+//
+// Usage:
+//   DroneRemoteIdService [/config <file>]
+//     Captures until Ctrl+C (or the console is closed). The configuration is
+//     read from DroneRemoteIdService.ini in the application folder if no file
+//     is given.
+//   DroneRemoteIdService [/config <file>] /replay <capture log>
+//     Processes a recording and prints the drones and their last messages.
+//   DroneRemoteIdService /table <name>
+//     Prints the drone table published by a running sensor.
+//   DroneRemoteIdService /selftest
+//     Runs the checks and the benchmarks of the sensor core that need no
+//     radio.
+//   DroneRemoteIdService [/config <file>] /fuse <port>
+//     Fuses the JSON streams the sensors export to the UDP port and sends
+//     one track per drone to ExportHost:ExportPort until Ctrl+C. The
+//     [Sensors] section of the configuration gives the sensor positions
+//     for the transmitter location: <ExportSource>=<lat>,<lon>,<alt>.
+
+#include "stdafx.h"
+
+#include <stdio.h>
+
+#include "DriSensor.h"
+#include "DriFusion.h"
+#include "DriSelfTest.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+
+// The default configuration file name (in the application folder).
+#define SERVICE_CONFIG_FILE		_T("DroneRemoteIdService.ini")
+// The default event log file name (in the application folder).
+#define SERVICE_LOG_FILE		_T("DroneRemoteIdService.log")
+// The fusion statistics print interval in milliseconds.
+#define SERVICE_FUSION_INTERVAL	10000
+// The configuration section with the sensor positions.
+#define SERVICE_SENSORS_SECTION	_T("Sensors")
+// The maximum size of a configuration section in characters.
+#define SERVICE_SECTION_SIZE	32767
+
+// Set by the console control handler to stop the main loop.
+static HANDLE StopEvent = NULL;
+// Set by the main thread when the sensor is closed.
+static HANDLE StoppedEvent = NULL;
+
+static BOOL WINAPI ConsoleCtrlHandler(DWORD CtrlType)
+{
+	SetEvent(StopEvent);
+
+	// The process ends when the handler returns from these events: let the
+	// main thread close the sensor first.
+	if (CtrlType == CTRL_CLOSE_EVENT || CtrlType == CTRL_LOGOFF_EVENT ||
+		CtrlType == CTRL_SHUTDOWN_EVENT)
+	{
+		WaitForSingleObject(StoppedEvent, INFINITE);
+	}
+	return TRUE;
+}
+
+// Prints the events logged since the previous call.
+static void PrintEvents(CDriEventLog* const Log, __int64& Printed)
+{
+	if (Printed < Log->First)
+		Printed = Log->First;
+
+	__int64 Next = Log->Next;
+	driEvent Event;
+	while (Printed < Next)
+	{
+		if (Log->Get(Printed, Event))
+		{
+			_tprintf(_T("%-7s %s\n"), CDriEventLog::SeverityText(Event.Severity),
+				Event.Text);
+		}
+		else
+		{
+			// The event is still being written: print it next time.
+			if (Printed >= Log->First)
+				break;
+		}
+		Printed++;
+	}
+}
+
+// Prints the drones and the details of their last messages.
+static void PrintDrones(CDriSensor& Sensor)
+{
+	Sensor.Lock();
+	CDriDroneList* Drones = Sensor.Drones;
+	for (size_t Drone = 0; Drone < Drones->Count; Drone++)
+	{
+		_tprintf(_T("%s\n"), Drones->GetDrone(Drone)->Ssid.c_str());
+		for (size_t Slot = 0; Slot < DRI_MESSAGE_SLOTS; Slot++)
+		{
+			const driDetailRows* Rows = Drones->GetDetails(Drone, Slot);
+			if (Rows != NULL)
+			{
+				_tprintf(_T("  %s\n"), CDriDroneList::SlotText(Slot));
+				for (driDetailRows::const_iterator Row = Rows->begin(); Row != Rows->end(); Row++)
+					_tprintf(_T("    %s: %s\n"), Row->Name, Row->Value.c_str());
+			}
+		}
+	}
+	Sensor.Unlock();
+}
+
+// Prints the drone table published by other sensor process.
+static int PrintTable(const tstring& Name)
+{
+	CDriSharedTableReader* Reader = new CDriSharedTableReader();
+	int Res = Reader->Open(Name);
+	if (Res != WCL_E_SUCCESS)
+		_tprintf(_T("Open drone table failed: 0x%.8X\n"), Res);
+	else
+	{
+		driTableDrone Drone;
+		for (size_t i = 0; i < Reader->Count; i++)
+		{
+			if (!Reader->Read(i, Drone) || Drone.Present == 0)
+				continue;
+
+			printf("%.*s", DRI_TABLE_NAME_SIZE, Drone.Name);
+			if ((Drone.Present & DRI_TABLE_BASIC_ID) != 0)
+				printf(" ID %.*s", DRI_TABLE_ID_SIZE, Drone.Id);
+			if ((Drone.Present & DRI_TABLE_LOCATION) != 0)
+			{
+				printf(" at %.7f %.7f, %.1f m", Drone.Latitude, Drone.Longitude,
+					Drone.GeoAltitude);
+			}
+			if ((Drone.Present & DRI_TABLE_OPERATOR_ID) != 0)
+				printf(" operator %.*s", DRI_TABLE_ID_SIZE, Drone.OperatorId);
+			printf("\n");
+		}
+		if (Reader->Unpublished > 0)
+			printf("%u drones did not fit the table\n", (unsigned int)Reader->Unpublished);
+		Reader->Close();
+	}
+	delete Reader;
+	return Res;
+}
+
+// Prints the fusion counters and the sensor clocks.
+static void PrintFusion(const CDriFusion& Fusion)
+{
+	std::vector<driFusionSensor> Sensors;
+	Fusion.GetSensors(Sensors);
+
+	_tprintf(_T("Fusion: sensors %u, lines %I64u, fused %I64u, duplicates %I64u, late %I64u, errors %I64u\n"),
+		(unsigned int)Sensors.size(), Fusion.Lines, Fusion.Fused, Fusion.Duplicates,
+		Fusion.Late, Fusion.Errors);
+	_tprintf(_T("  located %I64u, spoofed %I64u\n"), Fusion.Located, Fusion.Spoofed);
+	for (std::vector<driFusionSensor>::const_iterator Sensor = Sensors.begin(); Sensor != Sensors.end(); Sensor++)
+	{
+		const unsigned char* Address = (const unsigned char*)&Sensor->Address;
+		_tprintf(_T("  %u.%u.%u.%u:%u sensor %u: lines %I64u"), Address[0], Address[1],
+			Address[2], Address[3], (unsigned int)Sensor->Port, (unsigned int)Sensor->Source,
+			Sensor->Lines);
+		if (Sensor->Synchronized)
+			_tprintf(_T(", offset %I64d ms\n"), Sensor->Offset);
+		else
+			_tprintf(_T(", not synchronized\n"));
+	}
+}
+
+// Adds the sensor positions of the configuration file to the fusion node.
+static void LoadSensors(const tstring& FileName, CDriFusion& Fusion)
+{
+	std::vector<TCHAR> Section(SERVICE_SECTION_SIZE);
+	DWORD Len = GetPrivateProfileSection(SERVICE_SENSORS_SECTION, &Section[0],
+		SERVICE_SECTION_SIZE, FileName.c_str());
+
+	// The section is the "key=value" strings, each one is terminated by
+	// zero.
+	unsigned int Count = 0;
+	const TCHAR* Line = &Section[0];
+	while (Line < &Section[0] + Len && *Line != 0)
+	{
+		unsigned int Source;
+		double Latitude;
+		double Longitude;
+		double Altitude;
+		if (_stscanf_s(Line, _T("%u=%lf,%lf,%lf"), &Source, &Latitude, &Longitude,
+			&Altitude) != 4 || Source > 0xFFFF || Fusion.AddSensor((unsigned short)Source,
+			Latitude, Longitude, Altitude) != WCL_E_SUCCESS)
+		{
+			_tprintf(_T("Invalid sensor position: %s\n"), Line);
+		}
+		else
+			Count++;
+		Line += _tcslen(Line) + 1;
+	}
+	if (Count > 0)
+		_tprintf(_T("Sensor positions: %u\n"), Count);
+}
+
+// Runs the fusion node until Ctrl+C. The fused lines go to the export
+// destination of the configuration.
+static int Fuse(const tstring& FileName, const driSensorConfig& Config,
+	const unsigned short Port)
+{
+	CDriExporter* Output = new CDriExporter();
+	CDriFusion* Fusion = new CDriFusion(Output);
+	LoadSensors(FileName, *Fusion);
+
+	int Res = WCL_E_SUCCESS;
+	if (Config.ExportHost == _T(""))
+		_tprintf(_T("No ExportHost: the fused lines are not sent\n"));
+	else
+	{
+		Output->Latency = Config.ExportLatency;
+		Output->Source = Config.ExportSource;
+		Res = Output->Open(Config.ExportHost, Config.ExportPort);
+		if (Res != WCL_E_SUCCESS)
+			_tprintf(_T("Open export failed: 0x%.8X\n"), Res);
+	}
+
+	if (Res == WCL_E_SUCCESS)
+	{
+		Res = Fusion->Open(Port);
+		if (Res != WCL_E_SUCCESS)
+			_tprintf(_T("Open fusion failed: 0x%.8X\n"), Res);
+		else
+		{
+			_tprintf(_T("Fusion: UDP port %u\n"), (unsigned int)Port);
+			while (WaitForSingleObject(StopEvent, SERVICE_FUSION_INTERVAL) == WAIT_TIMEOUT)
+				PrintFusion(*Fusion);
+			PrintFusion(*Fusion);
+			// The node forwards the pending messages before the exporter is
+			// closed.
+			Fusion->Close();
+		}
+		Output->Close();
+	}
+
+	delete Fusion;
+	delete Output;
+	return Res;
+}
+
+static int Run(CDriSensor& Sensor)
+{
+	__int64 Printed = 0;
+
+	int Res = Sensor.Start();
+	PrintEvents(Sensor.Log, Printed);
+	if (Res != WCL_E_SUCCESS)
+		return Res;
+
+	DWORD LastTick = GetTickCount();
+	while (WaitForSingleObject(StopEvent, DRI_SENSOR_FLUSH_INTERVAL) == WAIT_TIMEOUT)
+	{
+		Sensor.Flush();
+		if (GetTickCount() - LastTick >= DRI_SENSOR_TICK_INTERVAL)
+		{
+			Sensor.Tick();
+			LastTick = GetTickCount();
+		}
+		PrintEvents(Sensor.Log, Printed);
+	}
+
+	Sensor.Stop();
+	PrintEvents(Sensor.Log, Printed);
+	return WCL_E_SUCCESS;
+}
+
+int _tmain(int argc, TCHAR* argv[])
+{
+	tstring ConfigFile;
+	tstring ReplayFile;
+	tstring TableName;
+	// -1 if the node is not asked for.
+	int FusePort = -1;
+	bool SelfTest = false;
+	for (int i = 1; i < argc; i++)
+	{
+		if (_tcsicmp(argv[i], _T("/config")) == 0 && i + 1 < argc)
+			ConfigFile = argv[++i];
+		else
+		{
+			if (_tcsicmp(argv[i], _T("/replay")) == 0 && i + 1 < argc)
+				ReplayFile = argv[++i];
+			else
+			{
+				if (_tcsicmp(argv[i], _T("/table")) == 0 && i + 1 < argc)
+					TableName = argv[++i];
+				else
+				{
+					if (_tcsicmp(argv[i], _T("/fuse")) == 0 && i + 1 < argc)
+						FusePort = _ttoi(argv[++i]);
+					else
+					{
+						if (_tcsicmp(argv[i], _T("/selftest")) == 0)
+							SelfTest = true;
+						else
+						{
+							_tprintf(_T("Usage: DroneRemoteIdService [/config <file>] [/replay <file>] | /table <name> | /fuse <port> | /selftest\n"));
+							return 1;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	if (FusePort != -1 && (FusePort <= 0 || FusePort > 0xFFFF))
+	{
+		_tprintf(_T("Invalid fusion port\n"));
+		return 1;
+	}
+
+	// The table reader and the self test do not need the sensor.
+	if (TableName != _T(""))
+		return (PrintTable(TableName) == WCL_E_SUCCESS) ? 0 : 1;
+	if (SelfTest)
+	{
+		CDriSelfTest* Test = new CDriSelfTest();
+		bool Passed = Test->Run();
+		delete Test;
+		return Passed ? 0 : 1;
+	}
+
+	// The service does not run a message loop.
+	driSensorConfig Config;
+	CDriSensor::DefaultConfig(Config);
+	Config.MessageProcessing = mpAsync;
+	Config.LogFile = CDriSensor::AppPath() + SERVICE_LOG_FILE;
+
+	int Res;
+	if (ConfigFile == _T(""))
+	{
+		ConfigFile = CDriSensor::AppPath() + SERVICE_CONFIG_FILE;
+		Res = CDriSensor::LoadConfig(ConfigFile, Config);
+		// The default file is optional.
+		if (Res == DRI_E_SENSOR_NO_CONFIG)
+			Res = WCL_E_SUCCESS;
+	}
+	else
+		Res = CDriSensor::LoadConfig(ConfigFile, Config);
+	if (Res != WCL_E_SUCCESS)
+	{
+		_tprintf(_T("Read configuration failed: 0x%.8X\n"), Res);
+		return 1;
+	}
+
+	StopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	StoppedEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (StopEvent == NULL || StoppedEvent == NULL)
+	{
+		_tprintf(_T("Create events failed: %u\n"), GetLastError());
+		return 1;
+	}
+	SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
+
+	if (FusePort > 0)
+		Res = Fuse(ConfigFile, Config, (unsigned short)FusePort);
+	else
+	{
+		CDriSensor* Sensor = new CDriSensor();
+		Res = Sensor->Open(Config);
+		if (Res != WCL_E_SUCCESS)
+			_tprintf(_T("Open sensor failed: 0x%.8X\n"), Res);
+		else
+		{
+			if (ReplayFile == _T(""))
+				Res = Run(*Sensor);
+			else
+			{
+				__int64 Printed = 0;
+				Res = Sensor->Replay(ReplayFile);
+				PrintEvents(Sensor->Log, Printed);
+				if (Res == WCL_E_SUCCESS)
+					PrintDrones(*Sensor);
+			}
+
+			Sensor->Close();
+		}
+		delete Sensor;
+	}
+
+	SetEvent(StoppedEvent);
+	SetConsoleCtrlHandler(ConsoleCtrlHandler, FALSE);
+	CloseHandle(StoppedEvent);
+	CloseHandle(StopEvent);
+
+	if (Res != WCL_E_SUCCESS)
+		return 1;
+	return 0;
+}
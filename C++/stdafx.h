@@ -11,6 +11,17 @@
 
 #include "targetver.h"
 
+#ifdef DRI_HEADLESS
+
+// The headless service (DroneRemoteIdService) builds the DRI classes without
+// MFC.
+#include <windows.h>
+#include <tchar.h>
+
+#define DEBUG_NEW new
+
+#else
+
 #define _ATL_CSTRING_EXPLICIT_CONSTRUCTORS      // some CString constructors will be explicit
 
 // turns off MFC's hiding of some common and often safely ignored warning messages
@@ -50,4 +61,4 @@
 #endif
 #endif
 
-
+#endif // DRI_HEADLESS